@@ -326,6 +326,7 @@ const struct ist promex_st_metric_desc[ST_F_TOTAL_FIELDS] = {
 enum sticktable_field {
 	STICKTABLE_SIZE = 0,
 	STICKTABLE_USED,
+	STICKTABLE_TOP_VALUE,
 	/* must always be the last one */
 	STICKTABLE_TOTAL_FIELDS
 };
@@ -333,12 +334,14 @@ enum sticktable_field {
 const struct promex_metric promex_sticktable_metrics[STICKTABLE_TOTAL_FIELDS] = {
 	[STICKTABLE_SIZE] = { .n = IST("size"), .type = PROMEX_MT_GAUGE, .flags = PROMEX_FL_STICKTABLE_METRIC },
 	[STICKTABLE_USED] = { .n = IST("used"), .type = PROMEX_MT_GAUGE, .flags = PROMEX_FL_STICKTABLE_METRIC },
+	[STICKTABLE_TOP_VALUE] = { .n = IST("top_value"), .type = PROMEX_MT_GAUGE, .flags = PROMEX_FL_STICKTABLE_METRIC },
 };
 
 /* stick table base description */
 const struct ist promex_sticktable_metric_desc[STICKTABLE_TOTAL_FIELDS] = {
 	[STICKTABLE_SIZE] = IST("Stick table size."),
 	[STICKTABLE_USED] = IST("Number of entries used in this stick table."),
+	[STICKTABLE_TOP_VALUE] = IST("Value of the entries of this stick table's top-K list."),
 };
 
 /* Specific labels for all ST_F_HRSP_* fields */
@@ -1162,6 +1165,9 @@ static int promex_dump_sticktable_metrics(struct appctx *appctx, struct htx *htx
 	size_t max = htx_get_max_blksz(htx, channel_htx_recv_max(chn, htx));
 	int ret = 1;
 	struct stktable *t;
+	struct buffer *key = NULL, *esc = NULL;
+	unsigned long long value;
+	size_t i;
 
 	for (; ctx->field_num < STICKTABLE_TOTAL_FIELDS; ctx->field_num++) {
 		if (!(promex_sticktable_metrics[ctx->field_num].flags & ctx->flags))
@@ -1185,6 +1191,40 @@ static int promex_dump_sticktable_metrics(struct appctx *appctx, struct htx *htx
 				case STICKTABLE_USED:
 					val = mkf_u32(FN_GAUGE, t->current);
 					break;
+				case STICKTABLE_TOP_VALUE:
+					if (!t->topk.size)
+						goto next_px;
+					if (!key && (!(key = alloc_trash_chunk()) || !(esc = alloc_trash_chunk()))) {
+						ret = -1;
+						goto end;
+					}
+					labels[2].name  = ist("data");
+					labels[2].value = ist(stktable_data_types[t->topk.data_type].name);
+					while (1) {
+						chunk_reset(key);
+						if (!stktable_topk_get(t, ctx->obj_state, key, &value))
+							break;
+
+						/* label values only support \\ and \" escapes */
+						chunk_reset(esc);
+						for (i = 0; i < key->data && esc->data < esc->size - 2; i++) {
+							if (key->area[i] == '\\' || key->area[i] == '"')
+								esc->area[esc->data++] = '\\';
+							esc->area[esc->data++] = key->area[i];
+						}
+						labels[3].name  = ist("rank");
+						labels[3].value = ist(ultoa(ctx->obj_state + 1));
+						labels[4].name  = ist("key");
+						labels[4].value = ist2(esc->area, esc->data);
+						val = mkf_u64(FN_GAUGE, value);
+						if (!promex_dump_metric(appctx, htx, prefix,
+									&promex_sticktable_metrics[ctx->field_num],
+									&val, labels, &out, max))
+							goto full;
+						ctx->obj_state++;
+					}
+					ctx->obj_state = 0;
+					goto next_px;
 				default:
 					goto next_px;
 			}
@@ -1202,6 +1242,8 @@ static int promex_dump_sticktable_metrics(struct appctx *appctx, struct htx *htx
 	}
 
   end:
+	free_trash_chunk(key);
+	free_trash_chunk(esc);
 	if (out.len) {
 		if (!htx_add_data_atonce(htx, out))
 			return -1; /* Unexpected and unrecoverable error */
@@ -0,0 +1,241 @@
+/*
+ * Compression benchmark comparing SLZ's modes with zlib
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* Usage: slzbench [-b blksize] [-l loops] file...
+ *
+ * Each file is compressed in gzip format by blocks of <blksize> bytes
+ * (default: 16384, roughly what haproxy passes at once) with SLZ levels 1 and
+ * 2 and zlib levels 1 and 6. The output size, ratio and input speed are
+ * reported for each of them. SLZ's output is verified by decompressing it
+ * with zlib.
+ */
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <zlib.h>
+
+#include <import/slz.h>
+
+static long blksize = 16384;
+static int loops = 0;
+
+static void usage(const char *name, int ret)
+{
+	fprintf(stderr, "Usage: %s [-b blksize] [-l loops] file...\n", name);
+	exit(ret);
+}
+
+static double now_us(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1000000.0 + tv.tv_usec;
+}
+
+/* compresses <ilen> bytes from <in> into <out> with SLZ at level <level>,
+ * returns the output length.
+ */
+static long slz_run(const unsigned char *in, long ilen, unsigned char *out, int level)
+{
+	struct slz_stream strm;
+	unsigned char *o = out;
+	long pos, len;
+
+	slz_rfc1952_init(&strm, level);
+	for (pos = 0; pos < ilen; pos += len) {
+		len = ilen - pos;
+		if (len > blksize)
+			len = blksize;
+		o += slz_rfc1952_encode(&strm, o, in + pos, len, pos + len < ilen);
+	}
+	o += slz_rfc1952_finish(&strm, o);
+	return o - out;
+}
+
+/* compresses <ilen> bytes from <in> into <out> (of size <osize>) with zlib at
+ * level <level>, returns the output length or -1 on error.
+ */
+static long zlib_run(const unsigned char *in, long ilen, unsigned char *out, long osize, int level)
+{
+	z_stream strm;
+	long pos, len;
+
+	memset(&strm, 0, sizeof(strm));
+	if (deflateInit2(&strm, level, Z_DEFLATED, 31, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+		return -1;
+
+	strm.next_out = out;
+	strm.avail_out = osize;
+	for (pos = 0; pos < ilen; pos += len) {
+		len = ilen - pos;
+		if (len > blksize)
+			len = blksize;
+		strm.next_in = (unsigned char *)in + pos;
+		strm.avail_in = len;
+		if (deflate(&strm, Z_NO_FLUSH) != Z_OK)
+			goto fail;
+	}
+	if (deflate(&strm, Z_FINISH) != Z_STREAM_END)
+		goto fail;
+	len = strm.total_out;
+	deflateEnd(&strm);
+	return len;
+ fail:
+	deflateEnd(&strm);
+	return -1;
+}
+
+/* returns non-zero if the <clen> bytes of gzip data in <comp> decompress to
+ * the <ilen> bytes of <in>.
+ */
+static int verify(const unsigned char *comp, long clen, const unsigned char *in, long ilen)
+{
+	unsigned char *out = malloc(ilen + 1);
+	z_stream strm;
+	int ret = 0;
+
+	if (!out)
+		return 0;
+
+	memset(&strm, 0, sizeof(strm));
+	if (inflateInit2(&strm, 31) != Z_OK)
+		goto end;
+	strm.next_in = (unsigned char *)comp;
+	strm.avail_in = clen;
+	strm.next_out = out;
+	strm.avail_out = ilen + 1;
+	if (inflate(&strm, Z_FINISH) == Z_STREAM_END &&
+	    strm.total_out == ilen && memcmp(in, out, ilen) == 0)
+		ret = 1;
+	inflateEnd(&strm);
+ end:
+	free(out);
+	return ret;
+}
+
+static void report(const char *name, long ilen, long olen, double us, int loop, int ok)
+{
+	printf("  %-7s %10ld %7.2f%% %9.1f MB/s%s\n", name, olen,
+	       ilen ? olen * 100.0 / ilen : 0.0,
+	       us > 0 ? (double)ilen * loop / us : 0.0,
+	       ok ? "" : "  (VERIFY FAILED)");
+}
+
+static int bench_file(const char *file)
+{
+	unsigned char *in, *out;
+	struct stat st;
+	double start;
+	long ilen, olen = 0, osize;
+	int fd, loop, level, lps, err = 0;
+
+	fd = open(file, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st) < 0) {
+		perror(file);
+		return 1;
+	}
+
+	ilen = st.st_size;
+	osize = ilen + ilen / 8 + 1024;
+	in = malloc(ilen + 1);
+	out = malloc(osize);
+	if (!in || !out || read(fd, in, ilen) != ilen) {
+		perror(file);
+		close(fd);
+		return 1;
+	}
+	close(fd);
+
+	/* by default, process roughly 256 MB per test */
+	lps = loops ? loops : 1 + (256 << 20) / (ilen + 1);
+
+	printf("%s: %ld bytes, %d loops\n", file, ilen, lps);
+	for (level = 1; level <= 2; level++) {
+		char name[16];
+		int ok;
+
+		start = now_us();
+		for (loop = 0; loop < lps; loop++)
+			olen = slz_run(in, ilen, out, level);
+		start = now_us() - start;
+		ok = verify(out, olen, in, ilen);
+		err |= !ok;
+		snprintf(name, sizeof(name), "slz-%d", level);
+		report(name, ilen, olen, start, lps, ok);
+	}
+
+	for (level = 1; level <= 6; level += 5) {
+		char name[16];
+
+		start = now_us();
+		for (loop = 0; loop < lps; loop++)
+			olen = zlib_run(in, ilen, out, osize, level);
+		start = now_us() - start;
+		snprintf(name, sizeof(name), "zlib-%d", level);
+		report(name, ilen, olen, start, lps, olen >= 0);
+		err |= olen < 0;
+	}
+
+	free(in);
+	free(out);
+	return err;
+}
+
+int main(int argc, char **argv)
+{
+	const char *name = argv[0];
+	int err = 0;
+
+	argc--; argv++;
+	while (argc > 0 && **argv == '-') {
+		if (strcmp(*argv, "-b") == 0 && argc > 1) {
+			blksize = atol(argv[1]);
+			argc--; argv++;
+		}
+		else if (strcmp(*argv, "-l") == 0 && argc > 1) {
+			loops = atoi(argv[1]);
+			argc--; argv++;
+		}
+		else if (strcmp(*argv, "-h") == 0)
+			usage(name, 0);
+		else
+			usage(name, 1);
+		argc--; argv++;
+	}
+
+	if (!argc || blksize <= 0)
+		usage(name, 1);
+
+	while (argc > 0) {
+		err |= bench_file(*argv);
+		argc--; argv++;
+	}
+	return err;
+}
@@ -24,6 +24,7 @@
 
 #include <haproxy/api-t.h>
 #include <haproxy/freq_ctr-t.h>
+#include <haproxy/tinfo-t.h>
 
 /* bit fields for the "profiling" global variable */
 #define HA_PROF_TASKS_OFF   0x00000000     /* per-task CPU profiling forced disabled */
@@ -74,6 +75,12 @@ struct memprof_stats {
 };
 #endif
 
+/* Number of buckets of the per-class run queue delay histograms. Bucket 0
+ * counts delays below 16us, then each bucket covers delays 4 times as large as
+ * the previous one, and the last one counts all delays of 65ms and above.
+ */
+#define SCHED_LAT_BUCKETS 8
+
 /* per-thread activity reports. It's important that it's aligned on cache lines
  * because some elements will be updated very often. Most counters are OK on
  * 32-bit since this will be used during debugging sessions for troubleshooting
@@ -95,6 +102,7 @@ struct activity {
 	unsigned int long_rq;      // process_runnable_tasks() left with tasks in the run queue
 	unsigned int cpust_total;  // sum of half-ms stolen per thread
 	unsigned int fd_takeover;  // number of times this thread stole another one's FD
+	unsigned int conn_migrated; // idle connections moved to this thread in addition to a takeover
 	ALWAYS_ALIGN(64);
 
 	struct freq_ctr cpust_1s;  // avg amount of half-ms stolen over last second
@@ -103,8 +111,14 @@ struct activity {
 	unsigned int accepted;     // accepted incoming connections
 	unsigned int accq_pushed;  // accept queue connections pushed
 	unsigned int accq_full;    // accept queue connection not pushed because full
+	unsigned int accq_bulk;    // accept queue bulk pushes (one wakeup each)
 	unsigned int pool_fail;    // failed a pool allocation
 	unsigned int buf_wait;     // waited on a buffer allocation
+	unsigned int tasks_stolen; // tasks taken from another thread's run queue
+	unsigned int rq_delay[TL_CLASSES][SCHED_LAT_BUCKETS]; // wake-to-run delays per class (when measured)
+	unsigned long long cls_cpu_ns[TL_CLASSES]; // CPU time spent per class (when measured)
+	unsigned long long poll_spin_ns;  // time spent spinning in the poller (busy-polling only)
+	unsigned long long poll_sleep_ns; // time spent sleeping in the poller (busy-polling only)
 #if defined(DEBUG_DEV)
 	/* keep these ones at the end */
 	unsigned int ctr0;         // general purposee debug counter
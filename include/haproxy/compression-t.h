@@ -32,6 +32,14 @@
 #include <zlib.h>
 #endif
 
+#if defined(USE_ZSTD)
+#include <zstd.h>
+#endif
+
+#if defined(USE_BROTLI)
+#include <brotli/encode.h>
+#endif
+
 #include <haproxy/buf-t.h>
 
 /* Direction index */
@@ -66,6 +74,12 @@ struct comp_ctx {
 	void *zlib_prev;
 	void *zlib_pending_buf;
 	void *zlib_head;
+#endif
+#if defined(USE_ZSTD)
+	ZSTD_CCtx *zstd;                /* zstd stream, NULL if unused */
+#endif
+#if defined(USE_BROTLI)
+	BrotliEncoderState *brotli;     /* brotli stream, NULL if unused */
 #endif
 	int cur_lvl;
 };
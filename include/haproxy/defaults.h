@@ -56,6 +56,20 @@
 
 #endif // USE_THREAD
 
+/* FREQ_CTR_SHARDS is the number of shards of the sharded frequency counters
+ * (struct freq_ctr_shd), which are used for rates updated by all threads such
+ * as the per-proxy and per-server session rates. Threads are spread over the
+ * shards so that this divides the contention on these counters, at the cost
+ * of one cache line per shard and slightly slower reads.
+ */
+#ifndef FREQ_CTR_SHARDS
+#ifdef USE_THREAD
+#define FREQ_CTR_SHARDS 8
+#else
+#define FREQ_CTR_SHARDS 1
+#endif
+#endif
+
 /*
  * BUFSIZE defines the size of a read and write buffer. It is the maximum
  * amount of bytes which can be stored by the proxy for each stream. However,
@@ -483,6 +497,14 @@
 #define DEFAULT_PAT_LRU_SIZE 10000
 #endif
 
+/* minimum number of entries of an IP pattern tree for it to be compiled into a
+ * trie, 0 to never compile them. Tries use memory in addition to the trees, so
+ * they are disabled by default.
+ */
+#ifndef DEFAULT_PAT_IP_TRIE_THRESHOLD
+#define DEFAULT_PAT_IP_TRIE_THRESHOLD 0
+#endif
+
 /* maximum number of pollers that may be registered */
 #ifndef MAX_POLLERS
 #define MAX_POLLERS	10
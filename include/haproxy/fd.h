@@ -85,6 +85,7 @@ struct rlimit;
 int raise_rlim_nofile(struct rlimit *old_limit, struct rlimit *new_limit);
 
 int compute_poll_timeout(int next);
+int fd_poll_timeout(int wait_time, int exp);
 void fd_leaving_poll(int wait_time, int status);
 
 /* disable the specified poller */
@@ -35,6 +35,20 @@ struct freq_ctr {
 	unsigned int prev_ctr; /* value for last period */
 };
 
+/* The sharded freq_ctr counter spreads the events over FREQ_CTR_SHARDS
+ * independent counters depending on the calling thread, and sums them on
+ * read. It is meant for rates updated by all threads at once, which would
+ * otherwise make their cache line bounce between all CPUs. Each shard is
+ * padded so that two shards never share a cache line, even if the structure
+ * is not aligned.
+ */
+struct freq_ctr_shd {
+	struct {
+		struct freq_ctr ctr;
+		THREAD_PAD(63);
+	} shard[FREQ_CTR_SHARDS];
+};
+
 #endif /* _HAPROXY_FREQ_CTR_T_H */
 
 /*
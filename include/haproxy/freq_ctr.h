@@ -25,10 +25,13 @@
 #include <haproxy/api.h>
 #include <haproxy/freq_ctr-t.h>
 #include <haproxy/intops.h>
+#include <haproxy/thread.h>
 #include <haproxy/ticks.h>
 
 /* exported functions from freq_ctr.c */
 ullong freq_ctr_total(const struct freq_ctr *ctr, uint period, int pend);
+ullong freq_ctr_shd_total(const struct freq_ctr_shd *ctr, uint period, int pend);
+uint freq_ctr_shd_curr_others(const struct freq_ctr_shd *ctr, const struct freq_ctr *skip, uint period);
 int freq_ctr_overshoot_period(const struct freq_ctr *ctr, uint period, uint freq);
 uint update_freq_ctr_period_slow(struct freq_ctr *ctr, uint period, uint inc);
 
@@ -133,15 +136,13 @@ static inline unsigned int freq_ctr_remain(struct freq_ctr *ctr, unsigned int fr
 	return freq_ctr_remain_period(ctr, MS_TO_TICKS(1000), freq, pend);
 }
 
-/* return the expected wait time in ms before the next event may occur,
- * respecting frequency <freq>, and assuming there may already be some pending
- * events. It returns zero if we can proceed immediately, otherwise the wait
- * time, which will be rounded down 1ms for better accuracy, with a minimum
- * of one ms.
+/* returns the expected wait time in ms before the next event may occur on a
+ * counter having <total> events over the last <period> (as returned by
+ * freq_ctr_total()), respecting frequency <freq>. This is the common part of
+ * next_event_delay_period() and next_event_delay_shd().
  */
-static inline uint next_event_delay_period(struct freq_ctr *ctr, uint period, uint freq, uint pend)
+static inline uint __next_event_delay_total(ullong total, uint period, uint freq)
 {
-	ullong total = freq_ctr_total(ctr, period, pend);
 	ullong limit = (ullong)freq * period;
 	uint wait;
 
@@ -158,6 +159,17 @@ static inline uint next_event_delay_period(struct freq_ctr *ctr, uint period, ui
 	return MAX(wait, 1);
 }
 
+/* return the expected wait time in ms before the next event may occur,
+ * respecting frequency <freq>, and assuming there may already be some pending
+ * events. It returns zero if we can proceed immediately, otherwise the wait
+ * time, which will be rounded down 1ms for better accuracy, with a minimum
+ * of one ms.
+ */
+static inline uint next_event_delay_period(struct freq_ctr *ctr, uint period, uint freq, uint pend)
+{
+	return __next_event_delay_total(freq_ctr_total(ctr, period, pend), period, freq);
+}
+
 /* Returns the expected wait time in ms before the next event may occur,
  * respecting frequency <freq> over 1 second, and assuming there may already be
  * some pending events. It returns zero if we can proceed immediately, otherwise
@@ -169,6 +181,75 @@ static inline unsigned int next_event_delay(struct freq_ctr *ctr, unsigned int f
 	return next_event_delay_period(ctr, MS_TO_TICKS(1000), freq, pend);
 }
 
+/* Returns the shard of sharded frequency counter <ctr> for the calling thread */
+static inline struct freq_ctr *freq_ctr_shd_local(struct freq_ctr_shd *ctr)
+{
+	return &ctr->shard[tid % FREQ_CTR_SHARDS].ctr;
+}
+
+/* Reads a sharded frequency counter over <period>, see read_freq_ctr_period() */
+static inline uint read_freq_ctr_shd_period(struct freq_ctr_shd *ctr, uint period)
+{
+	return div64_32(freq_ctr_shd_total(ctr, period, -1), period);
+}
+
+/* Reads a 1-sec sharded frequency counter */
+static inline unsigned int read_freq_ctr_shd(struct freq_ctr_shd *ctr)
+{
+	return read_freq_ctr_shd_period(ctr, MS_TO_TICKS(1000));
+}
+
+/* same as read_freq_ctr_shd() above except that floats are used for the
+ * output so that low rates can be more precise.
+ */
+static inline double read_freq_ctr_shd_flt(struct freq_ctr_shd *ctr)
+{
+	return (double)freq_ctr_shd_total(ctr, MS_TO_TICKS(1000), -1) / (double)MS_TO_TICKS(1000);
+}
+
+/* Updates a 1-sec sharded frequency counter by <inc> incremental units. Only
+ * the calling thread's shard is updated. Like update_freq_ctr(), it returns
+ * the number of events of the current period, summed over all shards, so that
+ * the caller may feed a maximum with it.
+ */
+static inline uint update_freq_ctr_shd(struct freq_ctr_shd *ctr, uint inc)
+{
+	struct freq_ctr *shd = freq_ctr_shd_local(ctr);
+	uint period = MS_TO_TICKS(1000);
+	uint curr;
+
+	if (likely(now_ms - HA_ATOMIC_LOAD(&shd->curr_tick) < period))
+		curr = HA_ATOMIC_ADD_FETCH(&shd->curr_ctr, inc);
+	else
+		curr = update_freq_ctr_period_slow(shd, period, inc);
+
+	return curr + freq_ctr_shd_curr_others(ctr, shd, period);
+}
+
+/* returns the number of remaining events that can occur on this sharded freq
+ * counter while respecting <freq> per second and taking into account that
+ * <pend> events are already known to be pending. Returns 0 if limit was
+ * reached.
+ */
+static inline unsigned int freq_ctr_shd_remain(struct freq_ctr_shd *ctr, unsigned int freq, unsigned int pend)
+{
+	uint avg = div64_32(freq_ctr_shd_total(ctr, MS_TO_TICKS(1000), pend), MS_TO_TICKS(1000));
+
+	if (avg > freq)
+		avg = freq;
+	return freq - avg;
+}
+
+/* Returns the expected wait time in ms before the next event may occur on this
+ * sharded freq counter, respecting frequency <freq> over 1 second, see
+ * next_event_delay().
+ */
+static inline unsigned int next_event_delay_shd(struct freq_ctr_shd *ctr, unsigned int freq, unsigned int pend)
+{
+	return __next_event_delay_total(freq_ctr_shd_total(ctr, MS_TO_TICKS(1000), pend),
+	                                MS_TO_TICKS(1000), freq);
+}
+
 /* While the functions above report average event counts per period, we are
  * also interested in average values per event. For this we use a different
  * method. The principle is to rely on a long tail which sums the new value
@@ -66,7 +66,7 @@
 #define GTUNE_USE_SYSTEMD        (1<<10)
 
 #define GTUNE_BUSY_POLLING       (1<<11)
-/* unused: (1<<12) */
+#define GTUNE_SCHED_WORK_STEALING (1<<12)
 #define GTUNE_SET_DUMPABLE       (1<<13)
 #define GTUNE_USE_EVPORTS        (1<<14)
 #define GTUNE_STRICT_LIMITS      (1<<15)
@@ -147,6 +147,9 @@ struct global {
 		int maxaccept;     /* max number of consecutive accept() */
 		int options;       /* various tuning options */
 		int runqueue_depth;/* max number of tasks to run at once */
+		uint sched_lat_target; /* target wake-to-run delay in microseconds for adaptive weights, 0=fixed */
+		uint busy_poll_window; /* busy-polling: spinning time in microseconds after activity, 0=always */
+		ulong busy_poll_tgroups; /* busy-polling: mask of thread groups concerned */
 		int recv_enough;   /* how many input bytes at once are "enough" */
 		int bufsize;       /* buffer size in bytes, defaults to BUFSIZE */
 		int maxrewrite;    /* buffer max rewrite size in bytes, defaults to MAXREWRITE */
@@ -161,12 +164,14 @@ struct global {
 		int requri_len;    /* max len of request URI, use REQURI_LEN if zero */
 		int cookie_len;    /* max length of cookie captures */
 		int pattern_cache; /* max number of entries in the pattern cache. */
+		unsigned int pattern_ip_trie; /* min entries of an IP tree to compile it, 0=never */
 		int sslcachesize;  /* SSL cache size in session, defaults to 20000 */
 		int comp_maxlevel;    /* max HTTP compression level */
 		int pool_low_ratio;   /* max ratio of FDs used before we stop using new idle connections */
 		int pool_high_ratio;  /* max ratio of FDs used before we start killing idle connections when creating new connections */
 		int pool_low_count;   /* max number of opened fd before we stop using new idle connections */
 		int pool_high_count;  /* max number of opened fd before we start killing idle connections when creating new connections */
+		int idle_steal_batch; /* max number of idle connections taken from another thread at once (0/1 = only the needed one) */
 		size_t pool_cache_size;    /* per-thread cache size per pool (defaults to CONFIG_HAP_POOL_CACHE_SIZE) */
 		unsigned short idle_timer; /* how long before an empty buffer is considered idle (ms) */
 		int nb_stk_ctr;       /* number of stick counters, defaults to MAX_SESS_STKCTR */
@@ -201,9 +206,9 @@ struct global {
 	 * possible grouped by changes.
 	 */
 	ALWAYS_ALIGN(64);
-	struct freq_ctr conn_per_sec;
-	struct freq_ctr sess_per_sec;
-	struct freq_ctr ssl_per_sec;
+	struct freq_ctr_shd conn_per_sec;
+	struct freq_ctr_shd sess_per_sec;
+	struct freq_ctr_shd ssl_per_sec;
 	struct freq_ctr ssl_fe_keys_per_sec;
 	struct freq_ctr ssl_be_keys_per_sec;
 	struct freq_ctr comp_bps_in;	/* bytes per second, before http compression */
@@ -33,6 +33,7 @@ struct httpclient {
 	void *caller;                         /* ptr of the caller */
 	unsigned int flags;                   /* other flags */
 	struct proxy *px;                     /* proxy for special cases */
+	struct proxy *be;                     /* backend to route the request through, or NULL */
 	struct server *srv_raw;               /* server for clear connections */
 #ifdef USE_OPENSSL
 	struct server *srv_ssl;               /* server for SSL connections */
@@ -107,6 +107,15 @@ static inline unsigned int my_popcountl(unsigned long a)
 	return (unsigned long)(a * (~0UL/255)) >> (sizeof(unsigned long) - 1) * 8;
 }
 
+/* Same as my_popcountl() but for 64-bit words, including on 32-bit platforms */
+static inline unsigned int my_popcountll(unsigned long long a)
+{
+	a = a - ((a >> 1) & ~0ULL/3);
+	a = (a & ~0ULL/15*3) + ((a >> 2) & ~0ULL/15*3);
+	a = (a + (a >> 4)) & ~0ULL/255*15;
+	return (a * (~0ULL/255)) >> 56;
+}
+
 /* returns non-zero if <a> has at least 2 bits set */
 static inline unsigned long atleast2(unsigned long a)
 {
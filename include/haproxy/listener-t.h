@@ -110,6 +110,7 @@ enum li_status {
 #define BC_O_ACC_CIP            0x00001000 /* find the proxied address in the NetScaler Client IP header */
 #define BC_O_UNLIMITED          0x00002000 /* listeners not subject to global limits (peers & stats socket) */
 #define BC_O_NOSTOP             0x00004000 /* keep the listeners active even after a soft stop */
+#define BC_O_INCOMING_CPU       0x00008000 /* steer connections to the shard whose thread runs on the receiving CPU */
 #define BC_O_XPRT_MAXCONN       0x00010000 /* transport layer allocates its own resource prior to accept and is responsible to check maxconn limit */
 
 
@@ -192,6 +193,7 @@ struct bind_conf {
 	unsigned int analysers;    /* bitmap of required protocol analysers */
 	int maxseg;                /* for TCP, advertised MSS */
 	int tcp_ut;                /* for TCP, user timeout */
+	int busy_poll;             /* for TCP, SO_BUSY_POLL delay in microseconds */
 	int maxaccept;             /* if set, max number of connections accepted at once (-1 when disabled) */
 	unsigned int backlog;      /* if set, listen backlog */
 	int maxconn;               /* maximum connections allowed on this listener */
@@ -299,6 +301,20 @@ struct accept_queue_ring {
 	struct connection *entry[ACCEPT_QUEUE_SIZE] __attribute((aligned(64)));
 };
 
+/* Max number of connections accepted in a row before being dispatched */
+#define ACCEPT_QUEUE_BATCH 16
+
+/* Connections accepted by listener_accept() and waiting to be pushed into
+ * their target thread's accept queue.
+ */
+struct accept_queue_batch {
+	uint count;               /* number of entries in use */
+	struct {
+		struct connection *conn; /* accepted connection, NULL once pushed */
+		uint thr;                /* target thread */
+	} e[ACCEPT_QUEUE_BATCH];
+};
+
 
 #endif /* _HAPROXY_LISTENER_T_H */
 
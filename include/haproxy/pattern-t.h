@@ -111,6 +111,7 @@ struct pat_ref {
 	int unique_id; /* Each pattern reference have unique id. */
 	unsigned long long revision; /* updated for each update */
 	unsigned long long entry_cnt; /* the total number of entries */
+	struct pat_trie_job *trie_job; /* compilation of the IP trees into tries, or NULL */
 	__decl_thread(HA_SPINLOCK_T lock); /* Lock used to protect pat ref elements */
 };
 
@@ -136,6 +137,7 @@ struct pattern_tree {
 	void *from_ref;    // pattern_tree linked from pat_ref_elt, ends with NULL
 	struct sample_data *data;
 	struct pat_ref_elt *ref;
+	struct pattern_expr *expr; /* the expression this node is indexed in */
 	struct ebmb_node node;
 };
 
@@ -179,10 +181,84 @@ struct pattern {
 /* This struct is just used for chaining patterns */
 struct pattern_list {
 	void *from_ref;    // pattern_tree linked from pat_ref_elt, ends with NULL
+	struct pattern_expr *expr; /* the expression this pattern is indexed in */
 	struct list list;
 	struct pattern pat;
 };
 
+/* IP prefix trees may be compiled into a compressed multibit trie for faster
+ * lookups. Each node covers PAT_TRIE_STRIDE bits of the address, hence 64
+ * slots. A slot either leads to a child node or holds a leaf, which is the
+ * longest prefix covering it. The children of a node are contiguous and are
+ * located using the population count of <child_map> below the slot. Leaves
+ * are only stored once per run of identical values, <leaf_map> marking the
+ * slots starting a new run.
+ */
+#define PAT_TRIE_STRIDE 6
+
+struct pat_trie_node {
+	uint64_t child_map;    /* slots leading to a child node */
+	uint64_t leaf_map;     /* slots starting a new run of leaves */
+	uint32_t child_base;   /* index of the first child in the nodes array */
+	uint32_t leaf_base;    /* index of the first leaf in the leaves array */
+};
+
+/* A trie compiled from one of the IP trees of an expression. It is only valid
+ * as long as the reference's revision matches the one it was built for.
+ */
+struct pat_trie {
+	unsigned long long revision;  /* revision of the reference when built */
+	struct pat_trie_node *nodes;  /* nodes[0] is the root */
+	struct pattern_tree **leaves; /* matching entry per leaf, or NULL */
+	unsigned int nb_nodes;
+	unsigned int nb_leaves;
+	unsigned int key_len;         /* 4 for IPv4, 16 for IPv6 */
+};
+
+/* Steps of the compilation of an IP tree into a trie */
+enum pat_trie_step {
+	PAT_TRIE_ST_COLLECT = 0,      /* collecting the entries under the PATREF lock */
+	PAT_TRIE_ST_SORT,             /* sorting the collected prefixes */
+	PAT_TRIE_ST_BUILD,            /* building the nodes of the trie */
+};
+
+/* Compilation of the IP trees of a reference into tries, performed by a heavy
+ * tasklet in small steps. The entries of the current generation of each tree
+ * are collected, sorted, then compiled into a trie which replaces the previous
+ * one if the reference's revision did not change meanwhile.
+ */
+struct pat_trie_job {
+	struct tasklet *tasklet;      /* tasklet performing the compilation */
+	struct pat_ref *ref;          /* reference being compiled */
+	struct pattern_expr *expr;    /* expression being compiled, NULL once done */
+	int idx;                      /* IP tree of <expr> being compiled (0 or 1) */
+	enum pat_trie_step step;      /* current step for this tree */
+	unsigned long long revision;  /* revision of the reference being compiled */
+	struct ebmb_node *next;       /* next tree node to collect, NULL at the end */
+	struct pat_trie_pfx *pfx;     /* prefixes collected from the tree */
+	struct pat_trie_pfx *tmp;     /* room to sort the prefixes */
+	size_t nb;                    /* number of prefixes collected */
+	size_t size;                  /* allocated number of prefixes */
+	size_t pos;                   /* position in the current sort pass */
+	unsigned int pass;            /* sort pass, on the length then the key's bytes */
+	size_t cnt[256];              /* byte counts then positions of the sort pass */
+	struct pat_trie *trie;        /* trie being built */
+	unsigned int nodes_size;      /* allocated number of nodes of <trie> */
+	unsigned int leaves_size;     /* allocated number of leaves of <trie> */
+	struct pat_trie_todo *todo;   /* stack of the nodes left to build */
+	unsigned int nb_todo;         /* number of nodes left to build */
+};
+
+/* Per-thread statistics of the pattern cache for one expression. Each thread
+ * only updates its own entry, which is padded so that two threads never share
+ * a cache line, even if the array is not aligned.
+ */
+struct pat_cache_ctr {
+	unsigned long long hits;   /* lookups answered by the pattern cache */
+	unsigned long long misses; /* cacheable lookups not found in the cache */
+	THREAD_PAD(64 - 2 * sizeof(unsigned long long));
+};
+
 /* Description of a pattern expression.
  * It contains pointers to the parse and match functions, and a list or tree of
  * patterns to test against. The structure is organized so that the hot parts
@@ -201,6 +277,8 @@ struct pattern_expr {
 	struct eb_root pattern_tree_2;  /* may be used for different types */
 	int mflags;                     /* flags relative to the parsing or matching method. */
 	__decl_thread(HA_RWLOCK_T lock);               /* lock used to protect patterns */
+	struct pat_trie *trie[2];       /* compiled pattern_tree and pattern_tree_2, or NULL */
+	struct pat_cache_ctr *cache_ctr; /* per-thread cache statistics, allocated on first lookup */
 };
 
 /* This is a list of expression. A struct pattern_expr can be used by
@@ -27,6 +27,7 @@
 #include <haproxy/api.h>
 #include <haproxy/pattern-t.h>
 #include <haproxy/sample-t.h>
+#include <haproxy/tools.h>
 
 /* pattern management function arrays */
 extern const char *const pat_match_names[PAT_MATCH_NUM];
@@ -195,6 +196,8 @@ void pat_ref_delete_by_ptr(struct pat_ref *ref, struct pat_ref_elt *elt);
 int pat_ref_delete_by_id(struct pat_ref *ref, struct pat_ref_elt *refelt);
 int pat_ref_prune(struct pat_ref *ref);
 int pat_ref_commit_elt(struct pat_ref *ref, struct pat_ref_elt *elt, char **err);
+void pat_ref_build_tries(struct pat_ref *ref);
+int pat_ref_parse_line(char *line, char **key, char **value);
 int pat_ref_purge_range(struct pat_ref *ref, uint from, uint to, int budget);
 
 /* Create a new generation number for next pattern updates and returns it. This
@@ -231,14 +234,30 @@ static inline void pat_ref_giveup(struct pat_ref *ref, unsigned int gen)
  * functions that rely on it. It returns zero on success, non-zero on failure
  * (technically speaking it returns the difference between the attempted
  * generation and the effective one, so that it can be used for reporting).
+ * On success, pat_ref_build_tries() must be called to compile the new version.
  */
 static inline int pat_ref_commit(struct pat_ref *ref, unsigned int gen)
 {
-	if ((int)(gen - ref->curr_gen) > 0)
+	if ((int)(gen - ref->curr_gen) > 0) {
 		ref->curr_gen = gen;
+		/* the new generation must be visible before the revision */
+		__ha_barrier_store();
+		HA_ATOMIC_STORE(&ref->revision, rdtsc());
+	}
 	return gen - ref->curr_gen;
 }
 
+/* Notifies the pattern caches that an entry of generation <gen> was added to
+ * or removed from <ref>. Only changes to the current generation may affect the
+ * lookups, so other ones do not invalidate the cached results. These results
+ * will be invalidated when committing the new generation.
+ */
+static inline void pat_ref_changed(struct pat_ref *ref, unsigned int gen)
+{
+	if (gen == ref->curr_gen)
+		HA_ATOMIC_STORE(&ref->revision, rdtsc());
+}
+
 /* This function purges all elements from <ref> that are older than generation
  * <oldest>. It will not purge more than <budget> entries at once, in order to
  * remain responsive. If budget is negative, no limit is applied.
@@ -35,6 +35,9 @@
 #include <haproxy/thread-t.h>
 
 
+/* maximum number of sessions per remote peer */
+#define PEER_MAX_SESSIONS 64
+
 struct shared_table {
 	struct stktable *table;       /* stick table to sync */
 	int local_id;
@@ -83,6 +86,9 @@ struct peer {
 	struct server *srv;
 	struct dcache *dcache;        /* dictionary cache */
 	struct peers *peers;          /* associated peer section */
+	struct peer *primary;         /* first session to the same peer (itself for the first one) */
+	unsigned int sess_idx;        /* session index for this peer, 0 for the first one */
+	unsigned long long teach_sessions; /* first session only: other sessions which must teach their share of a resync requested on it */
 	struct peer *next;            /* next peer in the list */
 };
 
@@ -104,6 +110,8 @@ struct peers {
 	unsigned int resync_timeout;    /* resync timeout timer */
 	int count;                      /* total of peers */
 	int nb_shards;                  /* Number of peer shards */
+	int nb_sessions;                /* Number of sessions per remote peer */
+	unsigned long long lessons;     /* other sessions to the peer assigned for the lesson still teaching us */
 	int disabled;                   /* peers proxy disabled if >0 */
 	int applet_count[MAX_THREADS];  /* applet count per thread */
 };
@@ -37,6 +37,9 @@ int peers_init_sync(struct peers *peers);
 int peers_alloc_dcache(struct peers *peers);
 int peers_register_table(struct peers *, struct stktable *table);
 void peers_setup_frontend(struct proxy *fe);
+int peers_snapshot_init(struct stktable *t);
+void peers_snapshot_save_all(void);
+void peers_snapshot_deinit(struct stktable *t);
 
 #if defined(USE_OPENSSL)
 static inline enum obj_type *peer_session_target(struct peer *p, struct stream *s)
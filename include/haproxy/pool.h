@@ -102,6 +102,7 @@ extern int mem_poison_byte;
 extern uint pool_debugging;
 
 int malloc_trim(size_t pad);
+ssize_t malloc_heap_used(void);
 void trim_all_pools(void);
 
 void *pool_get_from_os(struct pool_head *pool);
@@ -236,11 +236,34 @@ struct srv_per_thread {
 	struct eb_root idle_conns;              /* Shareable idle connections */
 	struct eb_root safe_conns;              /* Safe idle connections */
 	struct eb_root avail_conns;             /* Connections in use, but with still new streams available */
+	struct list warm_conns;                 /* Pre-established connections (pool-warm), only used by this thread */
+	struct task *warm_task;                 /* task refilling warm_conns */
+	unsigned int warm_nb;                   /* number of entries in warm_conns (ready or being established) */
 };
 
+/* Context of a connection pre-established by "pool-warm". It only exists
+ * until the connection is picked by a stream, at which point it is released
+ * and the connection continues as a regular one.
+ */
+struct srv_warm_conn {
+	struct list list;                       /* attach point in the per-thread warm_conns list */
+	struct connection *conn;                /* the connection being established or kept ready */
+	struct wait_event wait_event;           /* to subscribe to the transport layer */
+	int expire;                             /* date after which the unused connection is closed */
+};
+
+/* Number of buckets (as a power of two) of the per-tgroup index of idle
+ * connections. Each bucket covers a range of connection hashes.
+ */
+#define SRV_IDLE_HINT_BITS    6
+#define SRV_IDLE_HINT_BUCKETS (1U << SRV_IDLE_HINT_BITS)
+
+/* max number of idle connections migrated at once from another thread */
+#define MAX_IDLE_STEAL_BATCH  64
+
 /* Each server will have one occurrence of this structure per thread group */
 struct srv_per_tgroup {
-	unsigned int next_takeover;             /* thread ID to try to steal connections from next time */
+	ulong idle_hint[SRV_IDLE_HINT_BUCKETS]; /* per hash range, mask of threads which may have idle/safe conns (ltid_bit) */
 };
 
 /* Configure the protocol selection for websocket */
@@ -277,6 +300,7 @@ struct server {
 	unsigned int pool_purge_delay;          /* Delay before starting to purge the idle conns pool */
 	unsigned int low_idle_conns;            /* min idle connection count to start picking from other threads */
 	unsigned int max_idle_conns;            /* Max number of connection allowed in the orphan connections list */
+	unsigned int pool_warm;                 /* Number of pre-established connections to keep per thread (0=none) */
 	int max_reuse;                          /* Max number of requests on a same connection */
 	struct task *warmup;                    /* the task dedicated to the warmup when slowstart is set */
 
@@ -316,6 +340,7 @@ struct server {
 	unsigned int curr_used_conns;           /* Current number of used connections */
 	unsigned int max_used_conns;            /* Max number of used connections (the counter is reset at each connection purges */
 	unsigned int est_need_conns;            /* Estimate on the number of needed connections (max of curr and previous max_used) */
+	unsigned int curr_warm_conns;           /* Current number of pre-established connections on all threads */
 
 	struct queue queue;			/* pending connections */
 
@@ -333,7 +358,7 @@ struct server {
 	int cur_sess;				/* number of currently active sessions (including syn_sent) */
 	int served;				/* # of active sessions currently being served (ie not pending) */
 	int consecutive_errors;			/* current number of consecutive errors */
-	struct freq_ctr sess_per_sec;		/* sessions per second on this server */
+	struct freq_ctr_shd sess_per_sec;	/* sessions per second on this server */
 	struct be_counters counters;		/* statistics counters */
 
 	/* Below are some relatively stable settings, only changed under the lock */
@@ -24,6 +24,8 @@
 
 #include <unistd.h>
 
+#include <import/eb64tree.h>
+
 #include <haproxy/api.h>
 #include <haproxy/applet-t.h>
 #include <haproxy/freq_ctr.h>
@@ -85,6 +87,7 @@ struct connection *srv_lookup_conn(struct eb_root *tree, uint64_t hash);
 struct connection *srv_lookup_conn_next(struct connection *conn);
 
 int srv_add_to_idle_list(struct server *srv, struct connection *conn, int is_safe);
+struct connection *srv_take_warm_conn(struct server *srv);
 struct task *srv_cleanup_toremove_conns(struct task *task, void *context, unsigned int state);
 
 int srv_apply_track(struct server *srv, struct proxy *curproxy);
@@ -179,7 +182,7 @@ static inline void srv_inc_sess_ctr(struct server *s)
 {
 	_HA_ATOMIC_INC(&s->counters.cum_sess);
 	HA_ATOMIC_UPDATE_MAX(&s->counters.sps_max,
-			     update_freq_ctr(&s->sess_per_sec, 1));
+			     update_freq_ctr_shd(&s->sess_per_sec, 1));
 }
 
 /* set the time of last session on the designated server */
@@ -266,6 +269,30 @@ static inline enum srv_initaddr srv_get_next_initaddr(unsigned int *list)
 	return ret;
 }
 
+/* Returns the bucket of the per-tgroup idle connections index for connection
+ * hash <hash>. Buckets cover contiguous ranges of hashes so that the presence
+ * of a connection in a bucket can be checked with a single tree lookup.
+ */
+static inline uint srv_idle_hint_bucket(uint64_t hash)
+{
+	return hash >> (64 - SRV_IDLE_HINT_BITS);
+}
+
+/* Inserts connection <conn> into the current thread's safe tree of server
+ * <srv> if <is_safe> is set, otherwise into its idle tree, and records in the
+ * server's index that this thread may hold idle connections for this hash.
+ * The current thread's idle_conns_lock must be held.
+ */
+static inline void _srv_idle_tree_insert(struct server *srv, struct connection *conn, int is_safe)
+{
+	ulong *hint = &srv->per_tgrp[tgid - 1].idle_hint[srv_idle_hint_bucket(conn->hash_node->node.key)];
+
+	eb64_insert(is_safe ? &srv->per_thr[tid].safe_conns : &srv->per_thr[tid].idle_conns,
+	            &conn->hash_node->node);
+	if (!(HA_ATOMIC_LOAD(hint) & ti->ltid_bit))
+		HA_ATOMIC_OR(hint, ti->ltid_bit);
+}
+
 static inline void srv_use_conn(struct server *srv, struct connection *conn)
 {
 	unsigned int curr, prev;
@@ -0,0 +1,60 @@
+/*
+ * include/haproxy/sketch-t.h
+ * Types for the approximate counting sketches.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, version 2.1
+ * exclusively.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _HAPROXY_SKETCH_T_H
+#define _HAPROXY_SKETCH_T_H
+
+#include <haproxy/api-t.h>
+
+/* A HyperLogLog estimates the number of distinct values it was fed with. It
+ * is made of HLL_REGS one-byte registers, each of which keeps the highest rank
+ * (position of the first bit set plus one) seen among the hashes whose top
+ * HLL_BITS bits designate it. The standard error is about 1.04/sqrt(HLL_REGS),
+ * hence 13% with 64 registers, and small cardinalities are counted almost
+ * exactly. Two sketches are merged by keeping the highest of each register.
+ */
+#define HLL_BITS        6
+#define HLL_REGS        (1U << HLL_BITS)
+
+struct hll {
+	uint8_t reg[HLL_REGS];
+};
+
+/* A count-min sketch estimates the frequency of any value using <depth> rows
+ * of <width> counters. A value increments one counter per row, designated by
+ * its hash, and its frequency is estimated as the lowest of these counters.
+ * The estimate is never below the real count, and exceeds it by at most
+ * e/<width> times the total count with a probability 1-exp(-<depth>). When
+ * <period> is set, all counters are halved once per period so that the
+ * sketch reflects the recent activity. This is done outside of the traffic
+ * path by cms_decay(), by batches of CMS_DECAY_BATCH counters.
+ */
+#define CMS_DECAY_BATCH 65536
+
+struct cms {
+	uint width;             /* number of counters per row */
+	uint depth;             /* number of rows */
+	uint period;            /* halving period in milliseconds, 0 for none */
+	uint last_decay;        /* date of the last halving, in ticks */
+	uint decay_pos;         /* next counter to halve during a halving */
+	uint decay_shift;       /* shift applied by the halving in progress, or 0 */
+	uint *ctr;              /* <depth> rows of <width> counters, or NULL */
+};
+
+#endif /* _HAPROXY_SKETCH_T_H */
@@ -0,0 +1,67 @@
+/*
+ * include/haproxy/sketch.h
+ * Approximate counting sketches: HyperLogLog and count-min.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, version 2.1
+ * exclusively.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _HAPROXY_SKETCH_H
+#define _HAPROXY_SKETCH_H
+
+#include <string.h>
+
+#include <haproxy/api.h>
+#include <haproxy/sketch-t.h>
+
+uint hll_estimate(const struct hll *hll);
+int cms_init(struct cms *cms, uint width, uint depth, uint period);
+void cms_free(struct cms *cms);
+int cms_decay(struct cms *cms);
+uint cms_add(struct cms *cms, uint64_t hash, uint inc);
+uint cms_get(struct cms *cms, uint64_t hash);
+
+/* Accounts for the value whose 64-bit hash is <hash> in sketch <hll>. The
+ * caller is responsible for the locking.
+ */
+static inline void hll_add(struct hll *hll, uint64_t hash)
+{
+	uint idx = hash >> (64 - HLL_BITS);
+	uint64_t rest = hash << HLL_BITS;
+	uint rank = rest ? __builtin_clzll(rest) + 1 : 64 - HLL_BITS + 1;
+
+	if (hll->reg[idx] < rank)
+		hll->reg[idx] = rank;
+}
+
+/* Merges the HLL_REGS registers pointed to by <regs> into sketch <hll>, which
+ * then counts the union of the values of both sketches.
+ */
+static inline void hll_merge(struct hll *hll, const uint8_t *regs)
+{
+	uint i;
+
+	for (i = 0; i < HLL_REGS; i++) {
+		if (hll->reg[i] < regs[i])
+			hll->reg[i] = regs[i];
+	}
+}
+
+/* Resets sketch <hll> to an empty one */
+static inline void hll_reset(struct hll *hll)
+{
+	memset(hll->reg, 0, sizeof(hll->reg));
+}
+
+#endif /* _HAPROXY_SKETCH_H */
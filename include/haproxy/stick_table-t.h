@@ -27,9 +27,13 @@
 
 #include <haproxy/api-t.h>
 #include <haproxy/freq_ctr-t.h>
+#include <haproxy/sketch-t.h>
 #include <haproxy/thread-t.h>
 
 #define STKTABLE_MAX_DT_ARRAY_SIZE 100
+#define STKTABLE_MAX_TOPK_SIZE     100
+#define STKTABLE_TOPK_REFRESH      1000  /* top-K list refresh period (ms) */
+#define STKTABLE_SNAPSHOT_PERIOD   60000 /* default snapshot period (ms) */
 
 /* The types of extra data we can store in a stick table */
 enum {
@@ -58,6 +62,7 @@ enum {
 	STKTABLE_DT_GPT,           /* array of gpt */
 	STKTABLE_DT_GPC,           /* array of gpc */
 	STKTABLE_DT_GPC_RATE,      /* array of gpc_rate */
+	STKTABLE_DT_DISTINCT,      /* estimated number of distinct values (HyperLogLog) */
 
 
 	STKTABLE_STATIC_DATA_TYPES,/* number of types above */
@@ -74,6 +79,7 @@ enum {
 	STD_T_ULL,                /* data is of type unsigned long long */
 	STD_T_FRQP,               /* data is of type freq_ctr */
 	STD_T_DICT,               /* data is of type key of dictionary entry */
+	STD_T_HLL,                /* data is of type HyperLogLog sketch */
 };
 
 /* The types of optional arguments to stored data */
@@ -118,6 +124,7 @@ union stktable_data {
 	unsigned long long std_t_ull;
 	struct freq_ctr std_t_frqp;
 	struct dict_entry *std_t_dict;
+	struct hll std_t_hll;
 };
 
 /* known data types */
@@ -146,12 +153,37 @@ struct stksess {
 	unsigned int ref_cnt;     /* reference count, can only purge when zero */
 	__decl_thread(HA_RWLOCK_T lock); /* lock related to the table entry */
 	int shard;                /* shard */
+	unsigned int topk;        /* non-zero when listed in the table's top-K */
 	struct eb32_node exp;     /* ebtree node used to hold the session in expiration tree */
 	struct eb32_node upd;     /* ebtree node used to hold the update sequence tree */
 	struct ebmb_node key;     /* ebtree node used to hold the session in table */
 	/* WARNING! do not put anything after <keys>, it's used by the key */
 };
 
+/* an entry of a table's top-K list, with the last value read for it */
+struct stktable_topk_elem {
+	struct stksess *ts;
+	unsigned long long value;
+};
+
+/* Top-K list of a table: the (at most) <size> entries with the highest values
+ * of data type <data_type>. Entries are offered by stktable_touch_local() and
+ * only take the lock if their value is above <min>, the lowest value of the
+ * list once full, in which case they replace the entry at <min_idx>. Listed
+ * entries are marked and removed when freed, so that their values may be read
+ * live. The list is not kept sorted, its values are refreshed and sorted by
+ * <task> every STKTABLE_TOPK_REFRESH ms and when it is dumped.
+ */
+struct stktable_topk {
+	unsigned int size;        /* max number of entries, 0 if disabled */
+	unsigned int count;       /* number of entries in the list */
+	unsigned int min_idx;     /* position of the lowest entry of a full list */
+	int data_type;            /* data type the entries are ranked on */
+	unsigned long long min;   /* lowest value of a full list, admission threshold */
+	struct stktable_topk_elem *elems;
+	struct task *task;        /* periodic refresh task */
+	__decl_thread(HA_SPINLOCK_T lock);
+};
 
 /* stick table */
 struct stktable {
@@ -195,6 +227,14 @@ struct stktable {
 		unsigned int u;
 		void *p;
 	} data_arg[STKTABLE_DATA_TYPES]; /* optional argument of each data type */
+	struct cms cms;           /* optional table-wide count-min sketch */
+	struct task *cms_task;    /* count-min sketch halving task, or NULL */
+	struct stktable_topk topk; /* optional top-K list of entries */
+	struct {
+		char *file;           /* file the table is saved to and restored from */
+		unsigned int period;  /* delay between two snapshots (ms) */
+		struct task *task;    /* snapshot task, its context is private to peers */
+	} snapshot;
 	struct proxy *proxy;      /* The proxy this stick-table is attached to, if any.*/
 	struct proxy *proxies_list; /* The list of proxies which reference this stick-table. */
 	struct {
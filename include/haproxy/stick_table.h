@@ -28,6 +28,7 @@
 #include <haproxy/errors.h>
 #include <haproxy/freq_ctr.h>
 #include <haproxy/sample-t.h>
+#include <haproxy/sketch.h>
 #include <haproxy/stick_table-t.h>
 #include <haproxy/ticks.h>
 
@@ -70,6 +71,7 @@ int stktable_compatible_sample(struct sample_expr *expr, unsigned long table_typ
 int stktable_register_data_store(int idx, const char *name, int std_type, int arg_type);
 int stktable_get_data_type(char *name);
 int stktable_trash_oldest(struct stktable *t, int to_batch);
+int stktable_topk_get(struct stktable *t, uint rank, struct buffer *key, unsigned long long *value);
 int __stksess_kill(struct stktable *t, struct stksess *ts);
 
 /************************* Composite address manipulation *********************
@@ -135,6 +137,8 @@ static inline int stktable_type_size(int type)
 		return sizeof(struct freq_ctr);
 	case STD_T_DICT:
 		return sizeof(struct dict_entry *);
+	case STD_T_HLL:
+		return sizeof(struct hll);
 	}
 	return 0;
 }
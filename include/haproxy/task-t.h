@@ -29,6 +29,7 @@
 #include <haproxy/api-t.h>
 #include <haproxy/show_flags-t.h>
 #include <haproxy/thread-t.h>
+#include <haproxy/twheel-t.h>
 
 /* values for task->state (32 bits).
  * Please also update the task_show_state() function below in case of changes.
@@ -146,7 +147,11 @@ struct task {
 	 * where rq starts and this works because both are exclusive. Never
 	 * ever reorder these fields without taking this into account!
 	 */
+#ifdef USE_TIMER_WHEEL
+	struct twheel_node wq;		/* timer wheel node used to hold the task in the wait queue */
+#else
 	struct eb32_node wq;		/* ebtree node used to hold the task in the wait queue */
+#endif
 	int expire;			/* next expiration date for this task, in ticks */
 	short nice;                     /* task prio from -1024 to +1024 */
 	/* 16-bit hole here */
@@ -38,6 +38,7 @@
 #include <haproxy/task-t.h>
 #include <haproxy/thread.h>
 #include <haproxy/ticks.h>
+#include <haproxy/twheel.h>
 
 
 /* Principle of the wait queue.
@@ -76,6 +77,12 @@
  *   - timer is the real expiration date (possibly infinite)
  *   - node->key is always before or equal to timer
  *
+ * When built with USE_TIMER_WHEEL, the wait queues are hierarchical timer
+ * wheels (see twheel.c) instead of trees, offering O(1) insertion and removal
+ * with the same principles regarding node->key. The first expiration date
+ * they report may then be the beginning of a wheel slot, a bit earlier than
+ * the first timer, in which case the next wakeup only reorganizes the wheel.
+ *
  * The run queue works similarly to the wait queue except that the current date
  * is replaced by an insertion counter which can also wrap without any problem.
  */
@@ -83,6 +90,15 @@
 /* The farthest we can look back in a timer tree */
 #define TIMER_LOOK_BACK       (1U << 31)
 
+/* wait queue of a thread or group context, and its emptiness */
+#ifdef USE_TIMER_WHEEL
+#define TASK_WQ(ctx)          ((ctx)->timers)
+#define TASK_WQ_IS_EMPTY(ctx) twheel_is_empty((ctx)->timers)
+#else
+#define TASK_WQ(ctx)          (&(ctx)->timers)
+#define TASK_WQ_IS_EMPTY(ctx) eb_is_empty(&(ctx)->timers)
+#endif
+
 /* tasklets are recognized with nice==-32768 */
 #define TASK_IS_TASKLET(t) ((t)->state & TASK_F_TASKLET)
 
@@ -98,7 +114,11 @@ struct list *__tasklet_wakeup_after(struct list *head, struct tasklet *tl);
 void task_kill(struct task *t);
 void tasklet_kill(struct tasklet *t);
 void __task_wakeup(struct task *t);
+#ifdef USE_TIMER_WHEEL
+void __task_queue(struct task *task, struct twheel *wq);
+#else
 void __task_queue(struct task *task, struct eb_root *wq);
+#endif
 
 unsigned int run_tasks_from_lists(unsigned int budgets[]);
 
@@ -167,7 +187,11 @@ static inline int task_in_rq(struct task *t)
 /* return 0 if task is in wait queue, otherwise non-zero */
 static inline int task_in_wq(struct task *t)
 {
+#ifdef USE_TIMER_WHEEL
+	return twheel_node_queued(&t->wq);
+#else
 	return t->wq.node.leaf_p != NULL;
+#endif
 }
 
 /* returns true if the current thread has some work to do */
@@ -250,7 +274,11 @@ static inline void _task_drop_running(struct task *t, unsigned int f, const stru
  */
 static inline struct task *__task_unlink_wq(struct task *t)
 {
+#ifdef USE_TIMER_WHEEL
+	twheel_delete(&t->wq);
+#else
 	eb32_delete(&t->wq);
+#endif
 	return t;
 }
 
@@ -298,14 +326,14 @@ static inline void task_queue(struct task *task)
 	if (task->tid < 0) {
 		HA_RWLOCK_WRLOCK(TASK_WQ_LOCK, &wq_lock);
 		if (!task_in_wq(task) || tick_is_lt(task->expire, task->wq.key))
-			__task_queue(task, &tg_ctx->timers);
+			__task_queue(task, TASK_WQ(tg_ctx));
 		HA_RWLOCK_WRUNLOCK(TASK_WQ_LOCK, &wq_lock);
 	} else
 #endif
 	{
 		BUG_ON(task->tid != tid);
 		if (!task_in_wq(task) || tick_is_lt(task->expire, task->wq.key))
-			__task_queue(task, &th_ctx->timers);
+			__task_queue(task, TASK_WQ(th_ctx));
 	}
 }
 
@@ -361,7 +389,7 @@ static inline void _tasklet_wakeup_on(struct tasklet *tl, int thr, const struct
 #ifdef DEBUG_TASK
 	HA_ATOMIC_STORE(&tl->debug.prev_caller, caller);
 #endif
-	if (_HA_ATOMIC_LOAD(&th_ctx->flags) & TH_FL_TASK_PROFILING)
+	if (_HA_ATOMIC_LOAD(&th_ctx->flags) & (TH_FL_TASK_PROFILING | TH_FL_SCHED_TIMING))
 		tl->wake_date = now_mono_time();
 	__tasklet_wakeup_on(tl, thr);
 }
@@ -415,7 +443,7 @@ static inline void _task_instant_wakeup(struct task *t, unsigned int f, const st
 #ifdef DEBUG_TASK
 	HA_ATOMIC_STORE(&t->debug.prev_caller, caller);
 #endif
-	if (_HA_ATOMIC_LOAD(&th_ctx->flags) & TH_FL_TASK_PROFILING)
+	if (_HA_ATOMIC_LOAD(&th_ctx->flags) & (TH_FL_TASK_PROFILING | TH_FL_SCHED_TIMING))
 		t->wake_date = now_mono_time();
 	__tasklet_wakeup_on((struct tasklet *)t, thr);
 }
@@ -449,7 +477,7 @@ static inline struct list *_tasklet_wakeup_after(struct list *head, struct taskl
 #ifdef DEBUG_TASK
 	HA_ATOMIC_STORE(&tl->debug.prev_caller, caller);
 #endif
-	if (th_ctx->flags & TH_FL_TASK_PROFILING)
+	if (th_ctx->flags & (TH_FL_TASK_PROFILING | TH_FL_SCHED_TIMING))
 		tl->wake_date = now_mono_time();
 	return __tasklet_wakeup_after(head, tl);
 }
@@ -491,7 +519,11 @@ static inline void tasklet_remove_from_tasklet_list(struct tasklet *t)
  */
 static inline struct task *task_init(struct task *t, int tid)
 {
+#ifdef USE_TIMER_WHEEL
+	twheel_node_init(&t->wq);
+#else
 	t->wq.node.leaf_p = NULL;
+#endif
 	t->rq.node.leaf_p = NULL;
 	t->state = TASK_SLEEPING;
 #ifndef USE_THREAD
@@ -665,7 +697,7 @@ static inline void task_schedule(struct task *task, int when)
 
 		task->expire = when;
 		if (!task_in_wq(task) || tick_is_lt(task->expire, task->wq.key))
-			__task_queue(task, &tg_ctx->timers);
+			__task_queue(task, TASK_WQ(tg_ctx));
 		HA_RWLOCK_WRUNLOCK(TASK_WQ_LOCK, &wq_lock);
 	} else
 #endif
@@ -676,7 +708,7 @@ static inline void task_schedule(struct task *task, int when)
 
 		task->expire = when;
 		if (!task_in_wq(task) || tick_is_lt(task->expire, task->wq.key))
-			__task_queue(task, &th_ctx->timers);
+			__task_queue(task, TASK_WQ(th_ctx));
 	}
 }
 
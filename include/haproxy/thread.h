@@ -400,6 +400,7 @@ enum lock_label {
 	APPLETS_LOCK,
 	PEER_LOCK,
 	SHCTX_LOCK,
+	CACHE_LOCK,
 	SSL_LOCK,
 	SSL_GEN_CERTS_LOCK,
 	PATREF_LOCK,
@@ -30,6 +30,7 @@
 
 /* forward declarations for types used below */
 struct buffer;
+struct twheel;
 
 /* Threads sets are known either by a set of absolute thread numbers, or by a
  * set of relative thread numbers within a group, for each group. The default
@@ -64,6 +65,7 @@ enum {
 #define TH_FL_SLEEPING          0x00000008  /* thread won't check its task list before next wakeup */
 #define TH_FL_STARTED           0x00000010  /* set once the thread starts */
 #define TH_FL_IN_LOOP           0x00000020  /* set only inside the polling loop */
+#define TH_FL_SCHED_TIMING      0x00000040  /* record wake dates for the adaptive scheduler */
 
 
 /* Thread group information. This defines a base and a count of global thread
@@ -90,7 +92,11 @@ struct tgroup_ctx {
 	ulong threads_idle;               /* mask of threads idling in the poller */
 	ulong stopping_threads;           /* mask of threads currently stopping */
 
+#ifdef USE_TIMER_WHEEL
+	struct twheel *timers;            /* wait queue (timer wheel, global, accessed under wq_lock) */
+#else
 	struct eb_root timers;            /* wait queue (sorted timers tree, global, accessed under wq_lock) */
+#endif
 
 	uint niced_tasks;                 /* number of niced tasks in this group's run queues */
 
@@ -123,7 +129,11 @@ struct thread_info {
  */
 struct thread_ctx {
 	// first and second cache lines on 64 bits: thread-local operations only.
+#ifdef USE_TIMER_WHEEL
+	struct twheel *timers;              /* timer wheel constituting the per-thread wait queue */
+#else
 	struct eb_root timers;              /* tree constituting the per-thread wait queue */
+#endif
 	struct eb_root rqueue;              /* tree constituting the per-thread run queue */
 	struct task *current;               /* current task (not tasklet) */
 	int current_queue;                  /* points to current tasklet list being run, -1 if none */
@@ -153,9 +163,16 @@ struct thread_ctx {
 	uint32_t sched_wake_date;           /* current task/tasklet's wake date or 0 */
 	uint32_t sched_call_date;           /* current task/tasklet's call date (valid if sched_wake_date > 0) */
 	struct sched_activity *sched_profile_entry; /* profile entry in use by the current task/tasklet, only if sched_wake_date>0 */
+	uint sched_weights[TL_CLASSES];     /* per-class weights, adjusted when tune.sched.latency-target is set */
+	uint sched_lat_avg[TL_CLASSES];     /* sliding average of wake-to-run delays per class, in ns */
+	uint sched_adapt_date;              /* next date (ms) at which weights are adjusted */
+	int sched_low_lat;                  /* low-latency mode forced by the adaptive scheduler */
 
 	uint64_t prev_cpu_time;             /* previous per thread CPU time */
 	uint64_t prev_mono_time;            /* previous system wide monotonic time  */
+	uint64_t poll_spin_date;            /* busy-polling: date the poller started to spin, or 0 */
+	uint64_t poll_sleep_date;           /* busy-polling: date the poller started to sleep, or 0 */
+	uint64_t poll_last_active;          /* busy-polling: last date the poller reported activity */
 
 	struct eb_root rqueue_shared;       /* run queue fed by other threads */
 	__decl_thread(HA_SPINLOCK_T rqsh_lock); /* lock protecting the shared runqueue */
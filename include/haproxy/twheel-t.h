@@ -0,0 +1,57 @@
+/*
+ * include/haproxy/twheel-t.h
+ * Types for the hierarchical timer wheel.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, version 2.1
+ * exclusively.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _HAPROXY_TWHEEL_T_H
+#define _HAPROXY_TWHEEL_T_H
+
+#include <haproxy/api-t.h>
+#include <haproxy/list-t.h>
+
+/* The wheel is made of TWHEEL_LEVELS levels of TWHEEL_SLOTS slots each. Level
+ * N slots span 2^(N*TWHEEL_BITS) ticks, so that level 0 has one slot per
+ * millisecond and the upper level covers the whole 32-bit tick space. Each
+ * level has a 64-bit map of its possibly non-empty slots.
+ */
+#define TWHEEL_BITS     6
+#define TWHEEL_SLOTS    (1U << TWHEEL_BITS)
+#define TWHEEL_LEVELS   6
+
+/* A node queued in a timer wheel. <key> is its expiration date in ticks. It
+ * is detached (LIST_INLIST() is false) when not queued.
+ */
+struct twheel_node {
+	struct list list;       /* element in a slot or in the expired list */
+	unsigned int key;       /* expiration date, in ticks */
+};
+
+/* A hierarchical timer wheel. A node is stored at the lowest level where its
+ * key shares all upper bits with <cur>, in the slot designated by the key's
+ * bits for this level. Slots are cascaded to the lower levels once <cur>
+ * reaches them, and level 0 slots hold nodes sharing the exact same key.
+ * Nodes whose key was already reached are moved to the <expired> list.
+ */
+struct twheel {
+	unsigned int cur;       /* next tick to be processed */
+	unsigned int started;   /* <cur> was initialized */
+	uint64_t map[TWHEEL_LEVELS]; /* possibly non-empty slots per level */
+	struct list expired;    /* nodes whose key is before <cur> */
+	struct list slots[TWHEEL_LEVELS][TWHEEL_SLOTS];
+};
+
+#endif /* _HAPROXY_TWHEEL_T_H */
@@ -0,0 +1,115 @@
+/*
+ * include/haproxy/twheel.h
+ * Hierarchical timer wheel: O(1) insertion and removal of timers.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, version 2.1
+ * exclusively.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _HAPROXY_TWHEEL_H
+#define _HAPROXY_TWHEEL_H
+
+#include <haproxy/api.h>
+#include <haproxy/intops.h>
+#include <haproxy/list.h>
+#include <haproxy/ticks.h>
+#include <haproxy/twheel-t.h>
+
+void twheel_init(struct twheel *w);
+void twheel_advance(struct twheel *w, unsigned int now);
+int twheel_next_expiry(struct twheel *w, int clean);
+struct twheel_node *twheel_first(struct twheel *w);
+
+/* Initializes node <n> as not queued */
+static inline void twheel_node_init(struct twheel_node *n)
+{
+	LIST_INIT(&n->list);
+}
+
+/* Returns non-zero if node <n> is queued in a wheel */
+static inline int twheel_node_queued(const struct twheel_node *n)
+{
+	return LIST_INLIST(&n->list);
+}
+
+/* Removes node <n> from its wheel. It must be queued. */
+static inline void twheel_delete(struct twheel_node *n)
+{
+	LIST_DEL_INIT(&n->list);
+}
+
+/* Returns non-zero if wheel <w> holds no node. It may be called without the
+ * wheel's lock, in which case the result is only a hint. The maps may report
+ * slots which have become empty since, so this may return zero for an empty
+ * wheel, but never the opposite.
+ */
+static inline int twheel_is_empty(const struct twheel *w)
+{
+	int lvl;
+
+	if (!LIST_ISEMPTY(&w->expired))
+		return 0;
+	for (lvl = 0; lvl < TWHEEL_LEVELS; lvl++)
+		if (w->map[lvl])
+			return 0;
+	return 1;
+}
+
+/* Returns the first node of wheel <w> which has already expired, or NULL if
+ * there is none. Only twheel_advance() fills this list.
+ */
+static inline struct twheel_node *twheel_first_expired(const struct twheel *w)
+{
+	if (LIST_ISEMPTY(&w->expired))
+		return NULL;
+	return LIST_ELEM(w->expired.n, struct twheel_node *, list);
+}
+
+/* Queues node <n>, which must not be queued, into wheel <w> at the position
+ * given by its key, relative to the wheel's current date. Nodes whose key is
+ * already past are directly placed into the expired list.
+ */
+static inline void __twheel_insert(struct twheel *w, struct twheel_node *n)
+{
+	unsigned int diff, lvl, slot;
+
+	if (unlikely(tick_is_lt(n->key, w->cur))) {
+		LIST_APPEND(&w->expired, &n->list);
+		return;
+	}
+
+	/* the level is the one of the highest bit differing from cur */
+	diff = n->key ^ w->cur;
+	lvl = diff ? (my_flsl(diff) - 1) / TWHEEL_BITS : 0;
+	slot = (n->key >> (lvl * TWHEEL_BITS)) & (TWHEEL_SLOTS - 1);
+	LIST_APPEND(&w->slots[lvl][slot], &n->list);
+	w->map[lvl] |= 1ULL << slot;
+}
+
+/* Queues node <n>, which must not be queued, into wheel <w>. <now> is the
+ * current date. Keys must not be further than 2^31 ticks from it. The wheel's
+ * date is reset to <now> when the wheel is empty and late, so that it may be
+ * left untouched while it holds no timer.
+ */
+static inline void twheel_insert(struct twheel *w, struct twheel_node *n, unsigned int now)
+{
+	if (unlikely(!w->started) ||
+	    (tick_is_lt(w->cur, now) && twheel_is_empty(w))) {
+		w->cur = now;
+		w->started = 1;
+	}
+	__twheel_insert(w, n);
+}
+
+#endif /* _HAPROXY_TWHEEL_H */
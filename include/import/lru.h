@@ -43,6 +43,12 @@
  * consists in simply checking that the return is not null and that the domain
  * is not null, then to use the result. The get() function returns null if it
  * cannot allocate a node (memory or key being currently updated).
+ *
+ * The LRU may optionally be segmented. In this case, new entries are placed
+ * into a probation segment, and only entries which are hit again are promoted
+ * into a protected segment, whose oldest entries are demoted back to the
+ * probation segment. Only entries from the probation segment are evicted, so
+ * that a burst of keys seen only once cannot flush the frequently used ones.
  */
 struct lru64_list {
 	struct lru64_list *n;
@@ -50,11 +56,14 @@ struct lru64_list {
 };
 
 struct lru64_head {
-	struct lru64_list list;
+	struct lru64_list list;       /* probation segment, or whole LRU */
+	struct lru64_list prot;       /* protected segment when segmented */
 	struct eb_root keys;
 	struct lru64  *spare;
 	int cache_size;
 	int cache_usage;
+	int prot_size;                /* max protected entries, 0 if not segmented */
+	int prot_usage;
 };
 
 struct lru64 {
@@ -64,6 +73,7 @@ struct lru64 {
 	unsigned long long revision;  /* data revision (to avoid use-after-free) */
 	void *data;                   /* returned value, user decides how to use this */
 	void (*free)(void *data);     /* function to release data, if needed */
+	int prot;                     /* entry is in the protected segment */
 };
 
 
@@ -71,5 +81,6 @@ struct lru64 *lru64_lookup(unsigned long long key, struct lru64_head *lru, void
 struct lru64 *lru64_get(unsigned long long key, struct lru64_head *lru, void *domain, unsigned long long revision);
 void lru64_commit(struct lru64 *elem, void *data, void *domain, unsigned long long revision, void (*free)(void *));
 struct lru64_head *lru64_new(int size);
+struct lru64_head *lru64_new_segmented(int size, int prot_size);
 int lru64_destroy(struct lru64_head *lru);
 void lru64_kill_oldest(struct lru64_head *lru, unsigned long int nb);
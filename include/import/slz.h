@@ -76,7 +76,7 @@ struct slz_stream {
 	uint32_t qbits; /* number of bits in queue, < 8 on 32-bit, < 32 on 64-bit */
 	unsigned char *outbuf; /* set by encode() */
 	uint16_t state; /* one of slz_state */
-	uint8_t level:1; /* 0 = no compression, 1 = compression */
+	uint8_t level:2; /* 0 = no compression, 1 = compression, 2 = higher ratio */
 	uint8_t format:2; /* SLZ_FMT_* */
 	uint8_t unused1; /* unused for now */
 	uint32_t crc32;
@@ -111,9 +111,9 @@ int slz_rfc1950_finish(struct slz_stream *strm, unsigned char *buf);
 
 /* Initializes stream <strm>. It will configure the stream to use format
  * <format> for the data, which must be one of SLZ_FMT_*. The compression level
- * passed in <level> is set. This value can only be 0 (no compression) or 1
- * (compression) and other values will lead to unpredictable behaviour. The
- * function should always return 0.
+ * passed in <level> is set. This value can only be 0 (no compression), 1
+ * (compression) or 2 (slower compression with a better ratio) and other values
+ * will lead to unpredictable behaviour. The function should always return 0.
  */
 static inline int slz_init(struct slz_stream *strm, int level, int format)
 {
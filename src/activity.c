@@ -1017,6 +1017,31 @@ static int cli_io_handler_show_tasks(struct appctx *appctx)
 	return 1;
 }
 
+/* Appends to <out> a line starting with <header> and made of the wake-to-run
+ * delay histogram of tasklet class <cls>, summed over all threads when <tgt>
+ * is negative or null, otherwise only for thread <tgt>. These are only fed
+ * while task profiling or the adaptive scheduler are enabled.
+ */
+static void activity_show_rq_delay(struct buffer *out, const char *header, int cls, int tgt)
+{
+	static const char *const labels[SCHED_LAT_BUCKETS] = {
+		"<16us", "<64us", "<256us", "<1ms", "<4ms", "<16ms", "<65ms", ">=65ms"
+	};
+	unsigned int cnt;
+	int thr, b;
+
+	chunk_appendf(out, "%s", header);
+	for (b = 0; b < SCHED_LAT_BUCKETS; b++) {
+		cnt = 0;
+		for (thr = 0; thr < global.nbthread; thr++) {
+			if (tgt <= 0 || tgt == thr + 1)
+				cnt += activity[thr].rq_delay[cls][b];
+		}
+		chunk_appendf(out, " %s:%u", labels[b], cnt);
+	}
+	chunk_appendf(out, "\n");
+}
+
 /* This function dumps some activity counters used by developers and support to
  * rule out some hypothesis during bug reports. It returns 0 if the output
  * buffer is full and it needs to be called again, otherwise non-zero. It dumps
@@ -1138,10 +1163,26 @@ static int cli_io_handler_show_activity(struct appctx *appctx)
 		case __LINE__: SHOW_VAL("accepted:",     activity[thr].accepted, _tot); break;
 		case __LINE__: SHOW_VAL("accq_pushed:",  activity[thr].accq_pushed, _tot); break;
 		case __LINE__: SHOW_VAL("accq_full:",    activity[thr].accq_full, _tot); break;
+		case __LINE__: SHOW_VAL("accq_bulk:",    activity[thr].accq_bulk, _tot); break;
 #ifdef USE_THREAD
 		case __LINE__: SHOW_VAL("accq_ring:",    accept_queue_ring_len(&accept_queue_rings[thr]), _tot); break;
 		case __LINE__: SHOW_VAL("fd_takeover:",  activity[thr].fd_takeover, _tot); break;
+		case __LINE__: SHOW_VAL("conn_migrated:", activity[thr].conn_migrated, _tot); break;
+		case __LINE__: SHOW_VAL("tasks_stolen:", activity[thr].tasks_stolen, _tot); break;
 #endif
+		case __LINE__: SHOW_VAL("poll_spin_ms:", activity[thr].poll_spin_ns / 1000000, _tot); break;
+		case __LINE__: SHOW_VAL("poll_sleep_ms:", activity[thr].poll_sleep_ns / 1000000, _tot); break;
+		case __LINE__: SHOW_VAL("cpu_ms_urgent:", activity[thr].cls_cpu_ns[TL_URGENT] / 1000000, _tot); break;
+		case __LINE__: SHOW_VAL("cpu_ms_normal:", activity[thr].cls_cpu_ns[TL_NORMAL] / 1000000, _tot); break;
+		case __LINE__: SHOW_VAL("cpu_ms_bulk:",  activity[thr].cls_cpu_ns[TL_BULK] / 1000000, _tot); break;
+		case __LINE__: SHOW_VAL("cpu_ms_heavy:", activity[thr].cls_cpu_ns[TL_HEAVY] / 1000000, _tot); break;
+		case __LINE__: SHOW_VAL("weight_urgent:", ha_thread_ctx[thr].sched_weights[TL_URGENT], (_tot + _nbt/2) / _nbt); break;
+		case __LINE__: SHOW_VAL("weight_normal:", ha_thread_ctx[thr].sched_weights[TL_NORMAL], (_tot + _nbt/2) / _nbt); break;
+		case __LINE__: SHOW_VAL("weight_bulk:",  ha_thread_ctx[thr].sched_weights[TL_BULK], (_tot + _nbt/2) / _nbt); break;
+		case __LINE__: activity_show_rq_delay(&trash, "rq_delay_urgent:", TL_URGENT, tgt); break;
+		case __LINE__: activity_show_rq_delay(&trash, "rq_delay_normal:", TL_NORMAL, tgt); break;
+		case __LINE__: activity_show_rq_delay(&trash, "rq_delay_bulk:",   TL_BULK, tgt); break;
+		case __LINE__: activity_show_rq_delay(&trash, "rq_delay_heavy:",  TL_HEAVY, tgt); break;
 
 #if defined(DEBUG_DEV)
 			/* keep these ones at the end */
@@ -1144,16 +1144,90 @@ static int alloc_bind_address(struct sockaddr_storage **ss,
 	return SRV_STATUS_OK;
 }
 
+/* Takes over the first idle connection matching <hash> in tree <root> of
+ * thread <thr> that the mux accepts to migrate, and removes it from the tree.
+ * The caller must hold <thr>'s idle_conns_lock. Returns the connection or
+ * NULL if none could be taken.
+ */
+static struct connection *conn_backend_takeover(struct eb_root *root, int64_t hash, int thr)
+{
+	struct connection *conn;
+
+	conn = srv_lookup_conn(root, hash);
+	while (conn) {
+		if (conn->mux->takeover && conn->mux->takeover(conn, thr) == 0) {
+			conn_delete_from_tree(&conn->hash_node->node);
+			_HA_ATOMIC_INC(&activity[tid].fd_takeover);
+			return conn;
+		}
+
+		conn = srv_lookup_conn_next(conn);
+	}
+	return NULL;
+}
+
+/* Returns non-zero if thread <thr> still has idle or safe connections to
+ * server <srv> in the hash range of the idle index bucket covering <hash>.
+ * The caller must hold <thr>'s idle_conns_lock.
+ */
+static int conn_backend_idle_range_used(struct server *srv, int thr, int64_t hash)
+{
+	const uint64_t span = ~0ULL >> SRV_IDLE_HINT_BITS;
+	const uint64_t low = (uint64_t)hash & ~span;
+	struct eb64_node *node;
+
+	node = eb64_lookup_ge(&srv->per_thr[thr].idle_conns, low);
+	if (node && node->key <= low + span)
+		return 1;
+
+	node = eb64_lookup_ge(&srv->per_thr[thr].safe_conns, low);
+	if (node && node->key <= low + span)
+		return 1;
+
+	return 0;
+}
+
+/* Among the threads of the current group designated by <mask> (ltid bits),
+ * returns the one to first try to take an idle connection to <srv> from: the
+ * one holding the most idle connections to this server so that the takeover
+ * hurts it the least, then the closest one to the current thread since
+ * neighbour threads are usually bound to CPUs sharing some cache levels.
+ */
+static int conn_backend_takeover_thr(const struct server *srv, ulong mask)
+{
+	int best = -1;
+	int best_score = INT_MIN;
+
+	while (mask) {
+		int l = my_ffsl(mask) - 1;
+		int dist = (l > ti->ltid) ? l - ti->ltid : ti->ltid - l;
+		int score = (int)(MIN(srv->curr_idle_thr[tg->base + l], 0xFFFFFF) << 6) - dist;
+
+		if (score > best_score) {
+			best_score = score;
+			best = tg->base + l;
+		}
+		mask &= mask - 1;
+	}
+	return best;
+}
+
 /* Attempt to get a backend connection from the specified mt_list array
  * (safe or idle connections). The <is_safe> argument means what type of
- * connection the caller wants.
+ * connection the caller wants. When the connection is taken from another
+ * thread, a few more matching ones may be migrated along with it to the
+ * current thread's idle trees (see "tune.idle-pool.steal-batch").
  */
 static struct connection *conn_backend_get(struct stream *s, struct server *srv, int is_safe, int64_t hash)
 {
+	struct connection *migr[MAX_IDLE_STEAL_BATCH];
 	struct connection *conn = NULL;
+	struct eb_root *root;
+	ulong *hint;
+	ulong mask;
+	int nb_migr = 0;
 	int i; // thread number
 	int found = 0;
-	int stop;
 
 	/* We need to lock even if this is our own list, because another
 	 * thread may be trying to migrate that connection, and we don't want
@@ -1196,56 +1270,72 @@ static struct connection *conn_backend_get(struct stream *s, struct server *srv,
 	    ha_used_fds < global.tune.pool_low_count)
 		goto done;
 
-	/* Lookup all other threads for an idle connection, starting from last
-	 * unvisited thread, but always staying in the same group.
+	/* Lookup other threads for an idle connection, but always staying in
+	 * the same group. Only the threads that the server's index reports as
+	 * possibly holding idle connections in this hash range are visited,
+	 * best scored first. Those found not to have any are removed from the
+	 * index.
 	 */
-	stop = srv->per_tgrp[tgid - 1].next_takeover;
-	if (stop >= tg->count)
-		stop %= tg->count;
+	hint = &srv->per_tgrp[tgid - 1].idle_hint[srv_idle_hint_bucket(hash)];
+	mask = HA_ATOMIC_LOAD(hint) & ~ti->ltid_bit;
+	while (mask) {
+		i = conn_backend_takeover_thr(srv, mask);
+		mask &= ~ha_thread_info[i].ltid_bit;
 
-	stop += tg->base;
-	i = stop;
-	do {
-		if (!srv->curr_idle_thr[i] || i == tid)
+		if (!srv->curr_idle_thr[i])
 			continue;
 
 		if (HA_SPIN_TRYLOCK(IDLE_CONNS_LOCK, &idle_conns[i].idle_conns_lock) != 0)
 			continue;
-		conn = srv_lookup_conn(is_safe ? &srv->per_thr[i].safe_conns : &srv->per_thr[i].idle_conns, hash);
-		while (conn) {
-			if (conn->mux->takeover && conn->mux->takeover(conn, i) == 0) {
-				conn_delete_from_tree(&conn->hash_node->node);
-				_HA_ATOMIC_INC(&activity[tid].fd_takeover);
-				found = 1;
-				break;
-			}
 
-			conn = srv_lookup_conn_next(conn);
+		root = is_safe ? &srv->per_thr[i].safe_conns : &srv->per_thr[i].idle_conns;
+		conn = conn_backend_takeover(root, hash, i);
+		if (!conn && !is_safe && srv->curr_safe_nb > 0) {
+			root = &srv->per_thr[i].safe_conns;
+			conn = conn_backend_takeover(root, hash, i);
+			if (conn)
+				is_safe = 1;
 		}
 
-		if (!found && !is_safe && srv->curr_safe_nb > 0) {
-			conn = srv_lookup_conn(&srv->per_thr[i].safe_conns, hash);
-			while (conn) {
-				if (conn->mux->takeover && conn->mux->takeover(conn, i) == 0) {
-					conn_delete_from_tree(&conn->hash_node->node);
-					_HA_ATOMIC_INC(&activity[tid].fd_takeover);
-					found = 1;
-					is_safe = 1;
-					break;
-				}
+		if (conn) {
+			/* also bring a few more of the same kind, within the
+			 * limit of half of what this thread has left.
+			 */
+			int batch = MIN(global.tune.idle_steal_batch - 1,
+			                ((int)srv->curr_idle_thr[i] - 1) / 2);
 
-				conn = srv_lookup_conn_next(conn);
-			}
+			while (nb_migr < batch &&
+			       (migr[nb_migr] = conn_backend_takeover(root, hash, i)) != NULL)
+				nb_migr++;
+			found = 1;
 		}
+		else if (!conn_backend_idle_range_used(srv, i, hash))
+			HA_ATOMIC_AND(hint, ~ha_thread_info[i].ltid_bit);
 		HA_SPIN_UNLOCK(IDLE_CONNS_LOCK, &idle_conns[i].idle_conns_lock);
-	} while (!found && (i = (i + 1 == tg->base + tg->count) ? tg->base : i + 1) != stop);
+
+		if (found)
+			break;
+	}
 
 	if (!found)
 		conn = NULL;
+	else if (nb_migr) {
+		int m;
+
+		/* the migrated connections stay idle, now on our thread */
+		HA_SPIN_LOCK(IDLE_CONNS_LOCK, &idle_conns[tid].idle_conns_lock);
+		for (m = 0; m < nb_migr; m++) {
+			migr[m]->mux->ctl(migr[m], MUX_SET_IDLE, NULL);
+			_srv_idle_tree_insert(srv, migr[m], migr[m]->flags & CO_FL_SAFE_LIST);
+		}
+		HA_SPIN_UNLOCK(IDLE_CONNS_LOCK, &idle_conns[tid].idle_conns_lock);
+
+		_HA_ATOMIC_SUB(&srv->curr_idle_thr[i], nb_migr);
+		_HA_ATOMIC_ADD(&srv->curr_idle_thr[tid], nb_migr);
+		_HA_ATOMIC_ADD(&activity[tid].conn_migrated, nb_migr);
+	}
  done:
 	if (conn) {
-		_HA_ATOMIC_STORE(&srv->per_tgrp[tgid - 1].next_takeover, (i + 1 == tg->base + tg->count) ? tg->base : i + 1);
-
 		srv_use_conn(srv, conn);
 
 		_HA_ATOMIC_DEC(&srv->curr_idle_conns);
@@ -1289,6 +1379,12 @@ static int do_connect_server(struct stream *s, struct connection *conn)
 		/* we're in the process of establishing a connection */
 		s->scb->state = SC_ST_CON;
 	}
+	else if (!conn->mux) {
+		/* pre-established connection (pool-warm), the mux will be
+		 * installed by the caller.
+		 */
+		s->scb->state = SC_ST_CON;
+	}
 	else {
 		/* try to reuse the existing connection, it will be
 		 * confirmed once we can send on it.
@@ -1328,6 +1424,7 @@ static int connect_server(struct stream *s)
 	struct server *srv;
 	const int reuse_mode = s->be->options & PR_O_REUSE_MASK;
 	int reuse = 0;
+	int warm = 0;
 	int init_mux = 0;
 	int err;
 #ifdef USE_OPENSSL
@@ -1585,7 +1682,21 @@ static int connect_server(struct stream *s)
 		srv_conn = NULL;
 
 skip_reuse:
-	/* no reuse or failed to reuse the connection above, pick a new one */
+	/* no reuse or failed to reuse the connection above, try to pick a
+	 * pre-established one, or a new one.
+	 */
+	if (!srv_conn && srv && srv->pool_warm && !(s->flags & SF_WEBSOCKET)) {
+		srv_conn = srv_take_warm_conn(srv);
+		if (srv_conn) {
+			DBG_TRACE_STATE("use pre-established be connection", STRM_EV_STRM_PROC|STRM_EV_CS_ST, s);
+			warm = 1;
+			srv_conn->owner = s->sess;
+			if (reuse_mode == PR_O_REUSE_NEVR)
+				conn_set_private(srv_conn);
+			srv_conn->hash_node->node.key = hash;
+		}
+	}
+
 	if (!srv_conn) {
 		srv_conn = conn_new(s->target);
 		if (srv_conn) {
@@ -1624,9 +1735,12 @@ static int connect_server(struct stream *s)
 	/* Copy network namespace from client connection */
 	srv_conn->proxy_netns = cli_conn ? cli_conn->proxy_netns : NULL;
 
-	if (!srv_conn->xprt) {
+	if (!srv_conn->xprt || warm) {
 		/* set the correct protocol on the output stream connector */
-		if (srv) {
+		if (warm) {
+			/* ctrl and xprt were already set up by the warming task */
+		}
+		else if (srv) {
 			if (conn_prepare(srv_conn, protocol_lookup(srv_conn->dst->ss_family, PROTO_TYPE_STREAM, 0), srv->xprt)) {
 				conn_free(srv_conn);
 				return SF_ERR_INTERNAL;
@@ -3004,7 +3118,7 @@ smp_fetch_be_sess_rate(const struct arg *args, struct sample *smp, const char *k
 
 	smp->flags = SMP_F_VOL_TEST;
 	smp->data.type = SMP_T_SINT;
-	smp->data.u.sint = read_freq_ctr(&px->be_sess_per_sec);
+	smp->data.u.sint = read_freq_ctr_shd(&px->be_sess_per_sec);
 	return 1;
 }
 
@@ -3187,7 +3301,7 @@ smp_fetch_srv_sess_rate(const struct arg *args, struct sample *smp, const char *
 {
 	smp->flags = SMP_F_VOL_TEST;
 	smp->data.type = SMP_T_SINT;
-	smp->data.u.sint = read_freq_ctr(&args->data.srv->sess_per_sec);
+	smp->data.u.sint = read_freq_ctr_shd(&args->data.srv->sess_per_sec);
 	return 1;
 }
 
@@ -10,12 +10,18 @@
  * 2 of the License, or (at your option) any later version.
  */
 
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
 #include <import/eb32tree.h>
 #include <import/sha1.h>
 
 #include <haproxy/action-t.h>
 #include <haproxy/api.h>
 #include <haproxy/applet.h>
+#include <haproxy/backend.h>
 #include <haproxy/cfgparse.h>
 #include <haproxy/channel.h>
 #include <haproxy/cli.h>
@@ -24,6 +30,7 @@
 #include <haproxy/hash.h>
 #include <haproxy/http.h>
 #include <haproxy/http_ana.h>
+#include <haproxy/http_client.h>
 #include <haproxy/http_htx.h>
 #include <haproxy/http_rules.h>
 #include <haproxy/htx.h>
@@ -34,6 +41,7 @@
 #include <haproxy/shctx.h>
 #include <haproxy/stconn.h>
 #include <haproxy/stream.h>
+#include <haproxy/task.h>
 #include <haproxy/tools.h>
 
 #define CACHE_FLT_F_IMPLICIT_DECL  0x00000001 /* The cache filtre was implicitly declared (ie without
@@ -53,10 +61,91 @@ struct cache {
 	unsigned int maxblocks;
 	unsigned int maxobjsz;   /* max-object-size (in bytes) */
 	unsigned int max_secondary_entries;  /* maximum number of secondary entries with the same primary hash */
+	unsigned int collapse_timeout;       /* max time (ms) a miss waits for another stream filling the same entry, 0=disabled */
+	unsigned int maxstale;   /* max-stale, cap of the stale-while-revalidate/stale-if-error windows (seconds) */
 	uint8_t vary_processing_enabled;     /* boolean : manage Vary header (disabled by default) */
+	struct eb_root pending;  /* entries being fetched from the server (cache_pending), used for request collapsing */
+	char *disk_path;         /* directory of the disk tier file, NULL=disabled */
+	unsigned int disk_max_size;  /* size of the disk tier file (in megabytes) */
+	struct cache_disk *disk; /* disk tier, NULL if disabled */
 	char id[33];             /* cache name */
 };
 
+/* Second tier of a cache, stored in a file mapped in memory. The oldest entries
+ * of the shared memory are copied there by a task shortly before they are
+ * evicted (demoted), and are promoted back to the shared memory when they are
+ * requested again. The file
+ * is used as a ring: entries are written one after the other, and the oldest
+ * ones are overwritten once the end is reached. The index only lives in the
+ * process' memory, the file content is not reused across restarts.
+ */
+struct cache_disk {
+	__decl_thread(HA_RWLOCK_T lock);
+	unsigned char *area;     /* mapped file */
+	size_t size;             /* size of the mapped file */
+	size_t head;             /* offset of the next entry to be written */
+	size_t used;             /* number of bytes used by valid entries */
+	struct eb_root entries;  /* cache_disk_entry indexed by primary hash */
+	struct list fifo;        /* cache_disk_entry ordered by write date (oldest first) */
+	unsigned long long next_id;  /* unique ID of the next written entry */
+	unsigned int nb_entries; /* number of valid entries */
+	unsigned long long demoted;  /* number of entries demoted from the shared memory */
+	unsigned long long promoted; /* number of entries promoted to the shared memory */
+	struct task *task;       /* demotes the oldest entries ahead of their eviction */
+};
+
+/* The task of the disk tier keeps the entries demoted in the oldest part of the
+ * shared memory, made of this fraction of the available blocks, with at most
+ * CACHE_DISK_AHEAD_MAX blocks. It demotes at most CACHE_DISK_BATCH rows per run.
+ */
+#define CACHE_DISK_AHEAD      8
+#define CACHE_DISK_AHEAD_MAX  4096
+#define CACHE_DISK_BATCH      16
+
+/* An entry of the disk tier, pointing to a copy of a whole cache row */
+struct cache_disk_entry {
+	struct eb32_node eb;     /* node in the disk tier's entries, keyed on the primary hash */
+	struct list list;        /* element in the disk tier's fifo */
+	unsigned long long id;   /* unique ID, to find it again after the lock was released */
+	size_t offset;           /* offset of the row in the file */
+	unsigned int len;        /* length of the row */
+	unsigned int expire;     /* date until which the entry may be used, stale windows included */
+	char hash[20];           /* primary hash */
+	char secondary_key[HTTP_CACHE_SEC_KEY_LEN];  /* secondary key, if any */
+	unsigned int secondary_key_signature;        /* vary signature of the entry */
+};
+
+/* An entry currently being fetched from the server by a stream (the filler)
+ * while other streams requesting the same primary key wait for it instead of
+ * also contacting the server. It lives in the process' memory and is indexed
+ * in the cache's <pending> tree under the shctx lock.
+ */
+struct cache_pending {
+	struct eb32_node node;   /* node in the cache's pending tree, keyed on the primary hash */
+	char hash[20];           /* primary hash of the entry being fetched */
+	struct list waiters;     /* list of cache_st waiting for this entry (cache_st->pending_el) */
+};
+
+#define CACHE_MAX_RANGES     16   /* max number of byte ranges served from a cached object */
+#define CACHE_RANGE_CTYPE_LEN 128  /* max Content-Type length repeated in multipart parts */
+
+/* Byte ranges requested for an object delivered by the cache applet. They are
+ * first stored as parsed from the "Range" header, with <first> set to -1 for
+ * a suffix range of <last> bytes and <last> set to -1 for an open range, then
+ * resolved to absolute inclusive offsets once the payload length is known.
+ */
+struct cache_ranges {
+	unsigned int nb;                 /* number of ranges */
+	unsigned int cur;                /* range being sent, nb + 1 once the closing boundary is sent */
+	unsigned long long boundary;     /* multipart boundary, for several ranges */
+	long long len;                   /* payload length of the object */
+	struct {
+		long long first, last;
+	} r[CACHE_MAX_RANGES];
+	size_t ctype_len;                /* length of <ctype>, 0 if none */
+	char ctype[CACHE_RANGE_CTYPE_LEN]; /* object's Content-Type, for multipart parts */
+};
+
 /* the appctx context of a cache applet, stored in appctx->svcctx */
 struct cache_appctx {
 	struct cache_entry *entry;       /* Entry to be sent from cache. */
@@ -66,6 +155,11 @@ struct cache_appctx {
 	unsigned int send_notmodified:1; /* In case of conditional request, we might want to send a "304 Not Modified" response instead of the stored data. */
 	unsigned int unused:31;
 	struct shared_block *next;       /* The next block of data to be sent for this cache entry. */
+	struct cache_ranges *ranges;     /* byte ranges to send instead of the whole object, or NULL */
+	struct shared_block *body_blk;   /* block where the payload starts (ranges only) */
+	unsigned int body_offset;        /* offset of the payload in <body_blk> (ranges only) */
+	unsigned int body_pos;           /* payload offset <next>/<offset> point to (ranges only) */
+	long long range_rem;             /* bytes left to send for the current range */
 };
 
 /* cache config for filters */
@@ -146,8 +240,16 @@ const struct vary_hashing_information vary_information[] = {
 /*
  * cache ctx for filters
  */
+#define CACHE_ST_F_FILLER  0x00000001 /* the stream is fetching the entry others may wait for */
+#define CACHE_ST_F_WAITED  0x00000002 /* the stream waited (or is waiting) for another one's fetch */
+#define CACHE_ST_F_COMPRESSED 0x00000004 /* the response is compressed by a preceding filter */
+
 struct cache_st {
 	struct shared_block *first_block;
+	struct cache_pending *pending;   /* fetch this stream performs or waits for, if any */
+	struct list pending_el;          /* element in pending->waiters while waiting */
+	struct stream *strm;             /* the stream, to be woken up by the filler */
+	unsigned int flags;              /* CACHE_ST_F_* */
 };
 
 #define DEFAULT_MAX_SECONDARY_ENTRY 10
@@ -157,6 +259,10 @@ struct cache_entry {
 	unsigned int latest_validation;     /* latest validation date */
 	unsigned int expire;      /* expiration date (wall clock time) */
 	unsigned int age;         /* Origin server "Age" header value */
+	unsigned int stale_while_revalidate; /* seconds the entry may be served stale while being revalidated */
+	unsigned int stale_if_error;         /* seconds the entry may be served stale when the server is unavailable */
+	unsigned int revalidating;           /* a background revalidation is running for this entry */
+	unsigned int demoted;                /* a copy of the entry was written to the disk tier */
 
 	struct eb32_node eb;     /* ebtree node used to hold the cache object */
 	char hash[20];
@@ -180,6 +286,14 @@ struct cache_entry {
 	unsigned char data[0];
 };
 
+/* Returns the date until which entry <entry> may be kept, which is its
+ * expiration date extended by the longest of its stale windows.
+ */
+static inline unsigned int cache_entry_deadline(const struct cache_entry *entry)
+{
+	return entry->expire + MAX(entry->stale_while_revalidate, entry->stale_if_error);
+}
+
 #define CACHE_BLOCKSIZE 1024
 #define CACHE_ENTRY_MAX_AGE 2147483648U
 
@@ -188,9 +302,13 @@ static struct list caches_config = LIST_HEAD_INIT(caches_config); /* cache confi
 static struct cache *tmp_cache_config = NULL;
 
 DECLARE_STATIC_POOL(pool_head_cache_st, "cache_st", sizeof(struct cache_st));
+DECLARE_STATIC_POOL(pool_head_cache_pending, "cache_pending", sizeof(struct cache_pending));
+DECLARE_STATIC_POOL(pool_head_cache_disk_entry, "cache_disk_entry", sizeof(struct cache_disk_entry));
+DECLARE_STATIC_POOL(pool_head_cache_ranges, "cache_ranges", sizeof(struct cache_ranges));
 
 static struct eb32_node *insert_entry(struct cache *cache, struct cache_entry *new_entry);
 static void delete_entry(struct cache_entry *del_entry);
+static int cache_store_compressed_hdrs(struct cache_st *st, struct filter *filter, struct http_msg *msg);
 
 struct cache_entry *entry_exist(struct cache *cache, char *hash)
 {
@@ -207,7 +325,7 @@ struct cache_entry *entry_exist(struct cache *cache, char *hash)
 	if (memcmp(entry->hash, hash, sizeof(entry->hash)))
 		return NULL;
 
-	if (entry->expire > date.tv_sec) {
+	if (cache_entry_deadline(entry) > date.tv_sec) {
 		return entry;
 	} else {
 		delete_entry(entry);
@@ -268,7 +386,7 @@ struct cache_entry *secondary_entry_exist(struct cache *cache, struct cache_entr
 		 * when we find them. Calling delete_entry would be too costly
 		 * so we simply call eb32_delete. The secondary_entry count will
 		 * be updated when we try to insert a new entry to this list. */
-		if (entry->expire <= date.tv_sec) {
+		if (cache_entry_deadline(entry) <= date.tv_sec) {
 			eb32_delete(&entry->eb);
 			entry->eb.key = 0;
 		}
@@ -277,7 +395,7 @@ struct cache_entry *secondary_entry_exist(struct cache *cache, struct cache_entr
 	}
 
 	/* Expired entry */
-	if (entry && entry->expire <= date.tv_sec) {
+	if (entry && cache_entry_deadline(entry) <= date.tv_sec) {
 		eb32_delete(&entry->eb);
 		entry->eb.key = 0;
 		entry = NULL;
@@ -302,7 +420,7 @@ static unsigned int clear_expired_duplicates(struct eb32_node **dup_tail)
 	while (prev) {
 		entry = container_of(prev, struct cache_entry, eb);
 		prev = eb32_prev_dup(prev);
-		if (entry->expire <= date.tv_sec) {
+		if (cache_entry_deadline(entry) <= date.tv_sec) {
 			eb32_delete(&entry->eb);
 			entry->eb.key = 0;
 		}
@@ -433,6 +551,492 @@ static inline struct shared_block *block_ptr(struct cache_entry *entry)
 	return (struct shared_block *)((unsigned char *)entry - offsetof(struct shared_block, data));
 }
 
+/* Looks up the fetch in progress for primary hash <hash> in <cache>. Must be
+ * called under the shctx lock. Returns NULL if there is none.
+ */
+static struct cache_pending *cache_pending_lookup(struct cache *cache, const char *hash)
+{
+	struct eb32_node *node;
+	struct cache_pending *pending;
+
+	node = eb32_lookup(&cache->pending, read_u32(hash));
+	while (node) {
+		pending = eb32_entry(node, struct cache_pending, node);
+		if (memcmp(pending->hash, hash, sizeof(pending->hash)) == 0)
+			return pending;
+		node = eb32_next_dup(node);
+	}
+	return NULL;
+}
+
+/* Detaches the stream of cache filter context <st> from the fetch it performs
+ * or waits for, if any. When it is the filler, all the streams waiting for it
+ * are woken up so that they look the cache up again, and the pending fetch is
+ * released. Must be called without the shctx lock.
+ */
+static void cache_release_pending(struct cache *cache, struct cache_st *st)
+{
+	struct shared_context *shctx = shctx_ptr(cache);
+	struct cache_pending *pending;
+	struct cache_st *waiter, *back;
+
+	if (!HA_ATOMIC_LOAD(&st->pending))
+		return;
+
+	shctx_lock(shctx);
+	pending = st->pending;
+	if (!pending)
+		goto end;
+
+	if (st->flags & CACHE_ST_F_FILLER) {
+		eb32_delete(&pending->node);
+		list_for_each_entry_safe(waiter, back, &pending->waiters, pending_el) {
+			LIST_DEL_INIT(&waiter->pending_el);
+			waiter->pending = NULL;
+			task_wakeup(waiter->strm->task, TASK_WOKEN_MSG);
+		}
+		pool_free(pool_head_cache_pending, pending);
+		st->flags &= ~CACHE_ST_F_FILLER;
+	}
+	else
+		LIST_DEL_INIT(&st->pending_el);
+	st->pending = NULL;
+  end:
+	shctx_unlock(shctx);
+}
+
+/* Called on a cache miss for stream <s> when request collapsing is enabled on
+ * <cache>. If another stream is already fetching the same primary key, the
+ * stream is registered as waiting for it and 1 is returned: the caller must
+ * then yield until it is woken up or the request analysis timer expires.
+ * Otherwise the stream becomes the filler of this key, and 0 is returned. A
+ * stream which already waited once never waits again nor becomes a filler.
+ */
+static int cache_collapse_miss(struct cache *cache, struct cache_st *st, struct stream *s)
+{
+	struct shared_context *shctx = shctx_ptr(cache);
+	struct cache_pending *pending;
+	int ret = 0;
+
+	if (!st || st->pending || (st->flags & CACHE_ST_F_WAITED) ||
+	    s->txn->meth != HTTP_METH_GET)
+		return 0;
+
+	shctx_lock(shctx);
+	pending = cache_pending_lookup(cache, s->txn->cache_hash);
+	if (pending) {
+		LIST_APPEND(&pending->waiters, &st->pending_el);
+		st->flags |= CACHE_ST_F_WAITED;
+		ret = 1;
+	}
+	else if ((pending = pool_alloc(pool_head_cache_pending)) != NULL) {
+		memcpy(pending->hash, s->txn->cache_hash, sizeof(pending->hash));
+		pending->node.key = read_u32(pending->hash);
+		LIST_INIT(&pending->waiters);
+		eb32_insert(&cache->pending, &pending->node);
+		st->flags |= CACHE_ST_F_FILLER;
+	}
+	st->pending = pending;
+	shctx_unlock(shctx);
+
+	if (ret)
+		s->req.analyse_exp = tick_add(now_ms, cache->collapse_timeout);
+	return ret;
+}
+
+/* Makes cache filter context <st> of stream <s> the filler of the fetch that
+ * another cache filter context of the same stream performs for <cache>, if
+ * any. This happens when "cache-use" and "cache-store" are not in the same
+ * proxy: the stream becomes the filler in the filter of the first one, but the
+ * object is stored by the filter of the second one, which must then be the one
+ * waking the waiting streams up. Must be called without the shctx lock.
+ */
+static void cache_take_pending(struct cache *cache, struct stream *s, struct cache_st *st)
+{
+	struct shared_context *shctx = shctx_ptr(cache);
+	struct filter *filter;
+	struct cache_st *other;
+
+	list_for_each_entry(filter, &s->strm_flt.filters, list) {
+		other = filter->ctx;
+		if (FLT_ID(filter) != cache_store_flt_id || !other || other == st ||
+		    ((struct cache_flt_conf *)FLT_CONF(filter))->c.cache != cache ||
+		    !(other->flags & CACHE_ST_F_FILLER))
+			continue;
+
+		shctx_lock(shctx);
+		st->pending = other->pending;
+		st->flags |= CACHE_ST_F_FILLER;
+		other->pending = NULL;
+		other->flags &= ~CACHE_ST_F_FILLER;
+		shctx_unlock(shctx);
+		break;
+	}
+}
+
+static struct task *cache_disk_task(struct task *t, void *context, unsigned int state);
+
+/* Creates the disk tier of cache <cache> in a new file of its "disk-path"
+ * directory. The file is immediately unlinked so that it is never shared with
+ * another process, such as an old one during a reload. Returns the disk tier,
+ * or NULL with <err> filled on error.
+ */
+static struct cache_disk *cache_disk_init(struct cache *cache, char **err)
+{
+	struct cache_disk *disk;
+	char *path = NULL;
+	void *area;
+	size_t size;
+	int fd = -1;
+
+	size = (size_t)cache->disk_max_size << 20;
+
+	disk = calloc(1, sizeof(*disk));
+	if (!disk) {
+		memprintf(err, "out of memory");
+		goto fail;
+	}
+
+	disk->task = task_new_anywhere();
+	if (!disk->task) {
+		memprintf(err, "out of memory");
+		goto fail;
+	}
+	disk->task->process = cache_disk_task;
+	disk->task->context = cache;
+
+	memprintf(&path, "%s/haproxy-cache-%s-XXXXXX", cache->disk_path, cache->id);
+	if (!path) {
+		memprintf(err, "out of memory");
+		goto fail;
+	}
+
+	fd = mkstemp(path);
+	if (fd < 0) {
+		memprintf(err, "cannot create file in '%s' (%s)", cache->disk_path, strerror(errno));
+		goto fail;
+	}
+	unlink(path);
+
+	if (ftruncate(fd, size) < 0) {
+		memprintf(err, "cannot extend file to %u MB (%s)", cache->disk_max_size, strerror(errno));
+		goto fail;
+	}
+
+	area = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (area == MAP_FAILED) {
+		memprintf(err, "cannot map file (%s)", strerror(errno));
+		goto fail;
+	}
+	close(fd);
+	free(path);
+
+	HA_RWLOCK_INIT(&disk->lock);
+	disk->area = area;
+	disk->size = size;
+	disk->entries = EB_ROOT;
+	LIST_INIT(&disk->fifo);
+	return disk;
+
+  fail:
+	if (fd >= 0)
+		close(fd);
+	free(path);
+	if (disk)
+		task_destroy(disk->task);
+	free(disk);
+	return NULL;
+}
+
+/* Removes entry <dentry> from disk tier <disk>. Must be called under the disk
+ * tier's write lock.
+ */
+static void cache_disk_delete(struct cache_disk *disk, struct cache_disk_entry *dentry)
+{
+	eb32_delete(&dentry->eb);
+	LIST_DELETE(&dentry->list);
+	disk->used -= dentry->len;
+	disk->nb_entries--;
+	pool_free(pool_head_cache_disk_entry, dentry);
+}
+
+/* Removes all the entries of primary hash <hash> from the disk tier of <cache>,
+ * if any. It is used when a newer object is about to be stored for this key.
+ * Must be called without the disk tier's lock.
+ */
+static void cache_disk_invalidate(struct cache *cache, const char *hash)
+{
+	struct cache_disk *disk = cache->disk;
+	struct cache_disk_entry *dentry;
+	struct eb32_node *node, *next;
+
+	if (!disk)
+		return;
+
+	HA_RWLOCK_WRLOCK(CACHE_LOCK, &disk->lock);
+	node = eb32_lookup(&disk->entries, read_u32(hash));
+	while (node) {
+		next = eb32_next_dup(node);
+		dentry = eb32_entry(node, struct cache_disk_entry, eb);
+		if (memcmp(dentry->hash, hash, sizeof(dentry->hash)) == 0)
+			cache_disk_delete(disk, dentry);
+		node = next;
+	}
+	HA_RWLOCK_WRUNLOCK(CACHE_LOCK, &disk->lock);
+}
+
+/* Copies the cache row starting at <first>, which is about to be evicted from
+ * the shared memory of <cache>, to the cache's disk tier. The oldest entries of
+ * the disk tier are overwritten to make room for it. The row must be hot so
+ * that it may be read without the shctx lock, which must not be held.
+ */
+static void cache_disk_demote(struct cache *cache, struct shared_block *first)
+{
+	struct shared_context *shctx = shctx_ptr(cache);
+	struct cache_disk *disk = cache->disk;
+	struct cache_entry *object = (struct cache_entry *)first->data;
+	struct cache_disk_entry *dentry;
+	struct shared_block *block;
+	unsigned int count, ofs, len;
+
+	if (first->len < sizeof(*object) || first->len > disk->size)
+		return;
+
+	dentry = pool_alloc(pool_head_cache_disk_entry);
+	if (!dentry)
+		return;
+
+	HA_RWLOCK_WRLOCK(CACHE_LOCK, &disk->lock);
+
+	/* the entry may have been replaced while the lock was not held, in
+	 * which case the older copies on disk were already invalidated.
+	 */
+	if (!object->eb.key) {
+		HA_RWLOCK_WRUNLOCK(CACHE_LOCK, &disk->lock);
+		pool_free(pool_head_cache_disk_entry, dentry);
+		return;
+	}
+
+	/* wrap to the beginning of the file if the row doesn't fit at the
+	 * end, all the remaining entries of the previous lap are lost.
+	 */
+	if (disk->head + first->len > disk->size) {
+		while (!LIST_ISEMPTY(&disk->fifo)) {
+			struct cache_disk_entry *old = LIST_ELEM(disk->fifo.n, struct cache_disk_entry *, list);
+
+			if (old->offset < disk->head)
+				break;
+			cache_disk_delete(disk, old);
+		}
+		disk->head = 0;
+	}
+
+	/* drop the oldest entries overlapping with the new one */
+	while (!LIST_ISEMPTY(&disk->fifo)) {
+		struct cache_disk_entry *old = LIST_ELEM(disk->fifo.n, struct cache_disk_entry *, list);
+
+		if (old->offset < disk->head || old->offset >= disk->head + first->len)
+			break;
+		cache_disk_delete(disk, old);
+	}
+
+	/* the row's blocks follow each other in the available list */
+	block = first;
+	for (count = ofs = 0; count < first->block_count && ofs < first->len; count++) {
+		len = MIN(shctx->block_size, first->len - ofs);
+		memcpy(disk->area + disk->head + ofs, block->data, len);
+		ofs += len;
+		block = LIST_NEXT(&block->list, struct shared_block *, list);
+	}
+
+	dentry->id = disk->next_id++;
+	dentry->offset = disk->head;
+	dentry->len = first->len;
+	dentry->expire = cache_entry_deadline(object);
+	memcpy(dentry->hash, object->hash, sizeof(dentry->hash));
+	memcpy(dentry->secondary_key, object->secondary_key, sizeof(dentry->secondary_key));
+	dentry->secondary_key_signature = object->secondary_key_signature;
+	dentry->eb.key = read_u32(dentry->hash);
+	eb32_insert(&disk->entries, &dentry->eb);
+	LIST_APPEND(&disk->fifo, &dentry->list);
+
+	disk->head += first->len;
+	disk->used += first->len;
+	disk->nb_entries++;
+	disk->demoted++;
+
+	HA_RWLOCK_WRUNLOCK(CACHE_LOCK, &disk->lock);
+}
+
+/* Task of the disk tier of cache <context>, woken up when valid entries are
+ * evicted from the shared memory. It demotes the entries found in the oldest
+ * part of the shared memory, which are the next ones to be evicted. The rows
+ * are made hot while they are copied so that the shctx lock is not held during
+ * the copy, then they are put back at their place.
+ */
+static struct task *cache_disk_task(struct task *t, void *context, unsigned int state)
+{
+	struct cache *cache = context;
+	struct shared_context *shctx = shctx_ptr(cache);
+	struct shared_block *rows[CACHE_DISK_BATCH];
+	struct shared_block *block, *next;
+	struct cache_entry *object;
+	unsigned int scanned = 0, limit, count;
+	int nb = 0, i;
+
+	shctx_lock(shctx);
+	limit = MIN(shctx->nbav / CACHE_DISK_AHEAD, CACHE_DISK_AHEAD_MAX);
+	block = LIST_NEXT(&shctx->avail, struct shared_block *, list);
+	while (nb < CACHE_DISK_BATCH && scanned < limit && &block->list != &shctx->avail) {
+		/* the row's blocks follow each other in the available list */
+		next = block;
+		for (count = block->block_count; count && &next->list != &shctx->avail; count--) {
+			next = LIST_NEXT(&next->list, struct shared_block *, list);
+			scanned++;
+		}
+
+		object = (struct cache_entry *)block->data;
+		if (block->len && object->eb.key && object->complete && !object->demoted &&
+		    cache_entry_deadline(object) > date.tv_sec) {
+			shctx_row_inc_hot(shctx, block);
+			rows[nb++] = block;
+		}
+		block = next;
+	}
+	shctx_unlock(shctx);
+
+	if (!nb)
+		return t;
+
+	for (i = 0; i < nb; i++)
+		cache_disk_demote(cache, rows[i]);
+
+	/* the oldest row must end up first */
+	shctx_lock(shctx);
+	for (i = nb - 1; i >= 0; i--) {
+		object = (struct cache_entry *)rows[i]->data;
+		object->demoted = 1;
+		shctx_row_dec_hot_oldest(shctx, rows[i]);
+	}
+	shctx_unlock(shctx);
+
+	/* more may be needed, let other tasks run first */
+	if (nb == CACHE_DISK_BATCH)
+		task_wakeup(t, TASK_WOKEN_OTHER);
+	return t;
+}
+
+/* Looks up in disk tier <disk> a valid entry matching the request of stream
+ * <s>, whose primary hash was already computed. For entries having a vary
+ * signature, the request's secondary key is built again for this signature.
+ * Must be called under the disk tier's lock. Returns NULL if none is found.
+ */
+static struct cache_disk_entry *cache_disk_lookup(struct cache_disk *disk, struct stream *s)
+{
+	struct cache_disk_entry *dentry;
+	struct eb32_node *node;
+
+	node = eb32_lookup(&disk->entries, read_u32(s->txn->cache_hash));
+	for (; node; node = eb32_next_dup(node)) {
+		dentry = eb32_entry(node, struct cache_disk_entry, eb);
+
+		if (memcmp(dentry->hash, s->txn->cache_hash, sizeof(dentry->hash)) != 0 ||
+		    dentry->expire <= date.tv_sec)
+			continue;
+
+		if (!dentry->secondary_key_signature)
+			return dentry;
+
+		if (!http_request_build_secondary_key(s, dentry->secondary_key_signature) &&
+		    secondary_key_cmp(dentry->secondary_key, s->txn->cache_secondary_hash) == 0)
+			return dentry;
+	}
+	return NULL;
+}
+
+/* Called on a miss in the shared memory of <cache> for stream <s>. If the disk
+ * tier holds a matching entry, it is copied back to a new row of the shared
+ * memory, indexed there and removed from the disk tier. Returns 1 if an entry
+ * was promoted, in which case the caller should look the cache up again,
+ * otherwise 0.
+ */
+static int cache_disk_promote(struct cache *cache, struct stream *s)
+{
+	struct shared_context *shctx = shctx_ptr(cache);
+	struct cache_disk *disk = cache->disk;
+	struct cache_disk_entry *dentry;
+	struct cache_entry *object, *old;
+	struct shared_block *first;
+	struct eb32_node *node;
+	unsigned long long id;
+	unsigned int len;
+	int ret = 0;
+
+	HA_RWLOCK_RDLOCK(CACHE_LOCK, &disk->lock);
+	dentry = cache_disk_lookup(disk, s);
+	if (dentry) {
+		id = dentry->id;
+		len = dentry->len;
+	}
+	HA_RWLOCK_RDUNLOCK(CACHE_LOCK, &disk->lock);
+
+	if (!dentry)
+		return 0;
+
+	/* Reserving the row may evict other entries to the disk tier, which
+	 * itself may overwrite the one we want. This is why it is looked up
+	 * again by its ID once the row is allocated.
+	 */
+	shctx_lock(shctx);
+	first = shctx_row_reserve_hot(shctx, NULL, len);
+	if (first) {
+		object = (struct cache_entry *)first->data;
+		object->eb.key = 0;
+		first->len = 0;
+		first->last_append = NULL;
+	}
+	shctx_unlock(shctx);
+
+	if (!first)
+		return 0;
+
+	HA_RWLOCK_WRLOCK(CACHE_LOCK, &disk->lock);
+	node = eb32_lookup(&disk->entries, read_u32(s->txn->cache_hash));
+	for (; node; node = eb32_next_dup(node)) {
+		dentry = eb32_entry(node, struct cache_disk_entry, eb);
+		if (dentry->id == id)
+			break;
+	}
+	if (node) {
+		if (shctx_row_data_append(shctx, first, NULL, disk->area + dentry->offset, len) == 0)
+			ret = 1;
+		cache_disk_delete(disk, dentry);
+	}
+	HA_RWLOCK_WRUNLOCK(CACHE_LOCK, &disk->lock);
+
+	shctx_lock(shctx);
+	if (ret) {
+		/* don't replace an entry stored in the meantime */
+		old = entry_exist(cache, object->hash);
+		if (old && object->secondary_key_signature)
+			old = secondary_entry_exist(cache, old, object->secondary_key);
+
+		object->eb.key = read_u32(object->hash);
+		if (old || insert_entry(cache, object) != &object->eb) {
+			object->eb.key = 0;
+			ret = 0;
+		}
+		else
+			_HA_ATOMIC_INC(&disk->promoted);
+	}
+	if (!ret)
+		first->len = 0;
+	shctx_row_dec_hot(shctx, first);
+	shctx_unlock(shctx);
+
+	return ret;
+}
+
 
 
 static int
@@ -480,14 +1084,14 @@ cache_store_check(struct proxy *px, struct flt_conf *fconf)
 
 	/* Check all filters for proxy <px> to know if the compression is
 	 * enabled and if it is after the cache. When the compression is before
-	 * the cache, an error is returned. Also check if the cache filter must
-	 * be explicitly declaired or not. */
+	 * the cache, compressed responses are stored and must be keyed by their
+	 * encoding, so an error is returned if the Vary support is disabled.
+	 * Also check if the cache filter must be explicitly declaired or not. */
 	list_for_each_entry(f, &px->filter_configs, list) {
 		if (f == fconf) {
-			/* The compression filter must be evaluated after the cache. */
-			if (comp) {
+			if (comp && !cache->vary_processing_enabled) {
 				ha_alert("config: %s '%s': unable to enable the compression filter before "
-					 "the cache '%s'.\n", proxy_type_str(px), px->id, cache->id);
+					 "the cache '%s' without 'process-vary'.\n", proxy_type_str(px), px->id, cache->id);
 				return 1;
 			}
 		}
@@ -518,6 +1122,10 @@ cache_store_strm_init(struct stream *s, struct filter *filter)
 		return -1;
 
 	st->first_block = NULL;
+	st->pending     = NULL;
+	LIST_INIT(&st->pending_el);
+	st->strm        = s;
+	st->flags       = 0;
 	filter->ctx     = st;
 
 	/* Register post-analyzer on AN_RES_WAIT_HTTP */
@@ -533,6 +1141,9 @@ cache_store_strm_deinit(struct stream *s, struct filter *filter)
 	struct cache *cache = cconf->c.cache;
 	struct shared_context *shctx = shctx_ptr(cache);
 
+	if (st)
+		cache_release_pending(cache, st);
+
 	/* Everything should be released in the http_end filter, but we need to do it
 	 * there too, in case of errors */
 	if (st && st->first_block) {
@@ -563,43 +1174,40 @@ cache_store_post_analyze(struct stream *s, struct filter *filter, struct channel
 	struct http_txn *txn = s->txn;
 	struct http_msg *msg = &txn->rsp;
 	struct cache_st *st = filter->ctx;
+	struct cache_flt_conf *cconf = FLT_CONF(filter);
 
 	if (an_bit != AN_RES_WAIT_HTTP)
 		goto end;
 
 	/* Here we need to check if any compression filter precedes the cache
-	 * filter. This is only possible when the compression is configured in
-	 * the frontend while the cache filter is configured on the
-	 * backend. This case cannot be detected during HAProxy startup. So in
-	 * such cases, the cache is disabled.
+	 * filter. In this case the compressed response is stored, keyed by its
+	 * encoding, which requires the Vary support. It is checked during
+	 * startup, except when the compression is configured in the frontend
+	 * while the cache filter is configured on the backend. So in such
+	 * cases, the cache is disabled.
 	 */
 	if (st && (msg->flags & HTTP_MSGF_COMPRESSING)) {
-		pool_free(pool_head_cache_st, st);
-		filter->ctx = NULL;
+		if (cconf->c.cache->vary_processing_enabled)
+			st->flags |= CACHE_ST_F_COMPRESSED;
+		else {
+			cache_release_pending(cconf->c.cache, st);
+			pool_free(pool_head_cache_st, st);
+			filter->ctx = NULL;
+		}
 	}
 
   end:
 	return 1;
 }
 
-static int
-cache_store_http_headers(struct stream *s, struct filter *filter, struct http_msg *msg)
-{
-	struct cache_st *st = filter->ctx;
-
-	if (!(msg->chn->flags & CF_ISRESP) || !st)
-		return 1;
-
-	if (st->first_block)
-		register_data_filter(s, msg->chn, filter);
-	return 1;
-}
-
 static inline void disable_cache_entry(struct cache_st *st,
                                        struct filter *filter, struct shared_context *shctx)
 {
+	struct cache_flt_conf *cconf = FLT_CONF(filter);
 	struct cache_entry *object;
 
+	cache_release_pending(cconf->c.cache, st);
+
 	object = (struct cache_entry *)st->first_block->data;
 	filter->ctx = NULL; /* disable cache  */
 	shctx_lock(shctx);
@@ -610,6 +1218,36 @@ static inline void disable_cache_entry(struct cache_st *st,
 	pool_free(pool_head_cache_st, st);
 }
 
+static int
+cache_store_http_headers(struct stream *s, struct filter *filter, struct http_msg *msg)
+{
+	struct cache_st *st = filter->ctx;
+	struct cache_flt_conf *cconf = FLT_CONF(filter);
+
+	if (!(msg->chn->flags & CF_ISRESP) || !st)
+		return 1;
+
+	if (st->first_block && (st->flags & CACHE_ST_F_COMPRESSED)) {
+		/* the headers were rewritten by the compression filter since
+		 * the "cache-store" rule, they are only stored now.
+		 */
+		if (cache_store_compressed_hdrs(st, filter, msg) < 0) {
+			disable_cache_entry(st, filter, shctx_ptr(cconf->c.cache));
+			return 1;
+		}
+	}
+
+	if (st->first_block)
+		register_data_filter(s, msg->chn, filter);
+	else {
+		/* the response will not be stored, let the waiting streams
+		 * go to the server.
+		 */
+		cache_release_pending(cconf->c.cache, st);
+	}
+	return 1;
+}
+
 static int
 cache_store_http_payload(struct stream *s, struct filter *filter, struct http_msg *msg,
 			 unsigned int offset, unsigned int len)
@@ -726,6 +1364,8 @@ cache_store_http_end(struct stream *s, struct filter *filter,
 
 	}
 	if (st) {
+		/* wake up the streams waiting for this entry */
+		cache_release_pending(cache, st);
 		pool_free(pool_head_cache_st, st);
 		filter->ctx = NULL;
 	}
@@ -785,9 +1425,8 @@ char *directive_value(const char *sample, int slen, const char *word, int wlen)
  *  - the default-max-age of the cache
  *
  */
-int http_calc_maxage(struct stream *s, struct cache *cache, int *true_maxage)
+int http_calc_maxage(struct htx *htx, struct cache *cache, int *true_maxage)
 {
-	struct htx *htx = htxbuf(&s->res.buf);
 	struct http_hdr_ctx ctx = { .blk = NULL };
 	long smaxage = -1;
 	long maxage = -1;
@@ -875,13 +1514,67 @@ int http_calc_maxage(struct stream *s, struct cache *cache, int *true_maxage)
 
 }
 
+/*
+ * Set the stale-while-revalidate and stale-if-error windows of <object> from
+ * the Cache-Control directives of the response in <htx> (see RFC 5861), capped
+ * by the cache's "max-stale". The must-revalidate, proxy-revalidate and
+ * no-cache directives forbid serving the object once stale.
+ */
+static void http_calc_stale(struct htx *htx, struct cache *cache, struct cache_entry *object)
+{
+	struct http_hdr_ctx ctx = { .blk = NULL };
+	long swr = 0, sie = 0;
+	char *value;
+
+	object->stale_while_revalidate = object->stale_if_error = 0;
+	if (!cache->maxstale)
+		return;
+
+	while (http_find_header(htx, ist("cache-control"), &ctx, 0)) {
+		if (isteqi(ctx.value, ist("must-revalidate")) ||
+		    isteqi(ctx.value, ist("proxy-revalidate")) ||
+		    isteqi(ctx.value, ist("no-cache")))
+			return;
+
+		value = directive_value(ctx.value.ptr, ctx.value.len, "stale-while-revalidate", 22);
+		if (value) {
+			struct buffer *chk = get_trash_chunk();
+
+			chunk_memcat(chk, value, istend(ctx.value) - value);
+			chunk_memcat(chk, "", 1);
+			swr = strtol(chk->area + (*chk->area == '"'), NULL, 10);
+		}
+
+		value = directive_value(ctx.value.ptr, ctx.value.len, "stale-if-error", 14);
+		if (value) {
+			struct buffer *chk = get_trash_chunk();
+
+			chunk_memcat(chk, value, istend(ctx.value) - value);
+			chunk_memcat(chk, "", 1);
+			sie = strtol(chk->area + (*chk->area == '"'), NULL, 10);
+		}
+	}
+
+	if (swr > 0)
+		object->stale_while_revalidate = MIN(swr, cache->maxstale);
+	if (sie > 0)
+		object->stale_if_error = MIN(sie, cache->maxstale);
+}
+
 
-static void cache_free_blocks(struct shared_block *first, struct shared_block *block)
+static void cache_free_blocks(struct shared_context *shctx, struct shared_block *first, struct shared_block *block)
 {
+	struct cache *cache = (struct cache *)shctx->data;
 	struct cache_entry *object = (struct cache_entry *)block->data;
 
-	if (first == block && object->eb.key)
+	if (first == block && object->eb.key) {
+		/* a valid entry is evicted, it was normally already demoted,
+		 * let's keep the next ones ahead.
+		 */
+		if (cache->disk)
+			task_wakeup(cache->disk->task, TASK_WOKEN_OTHER);
 		delete_entry(object);
+	}
 	object->eb.key = 0;
 }
 
@@ -1001,8 +1694,46 @@ static int set_secondary_key_encoding(struct htx *htx, char *secondary_key)
  * This function will store the headers of the response in a buffer and then
  * register a filter to store the data
  */
-enum act_return http_action_store_cache(struct act_rule *rule, struct proxy *px,
-					struct session *sess, struct stream *s, int flags)
+/*
+ * Serialize the HTX blocks of <htx> up to the end of headers into <chk>, the
+ * way they are stored in a cache row right after <object>, and record the
+ * location of the optional ETag value in <object>.
+ * Returns the size of the headers in the HTX message.
+ */
+static unsigned int cache_dump_hdrs(struct htx *htx, struct cache_entry *object, struct buffer *chk)
+{
+	unsigned int hdrs_len = 0;
+	int32_t pos;
+
+	chunk_reset(chk);
+	for (pos = htx_get_first(htx); pos != -1; pos = htx_get_next(htx, pos)) {
+		struct htx_blk *blk = htx_get_blk(htx, pos);
+		enum htx_blk_type type = htx_get_blk_type(blk);
+		uint32_t sz = htx_get_blksz(blk);
+
+		hdrs_len += sizeof(*blk) + sz;
+		chunk_memcat(chk, (char *)&blk->info, sizeof(blk->info));
+		chunk_memcat(chk, htx_get_blk_ptr(htx, blk), sz);
+
+		/* Look for optional ETag header.
+		 * We need to store the offset of the ETag value in order for
+		 * future conditional requests to be able to perform ETag
+		 * comparisons. */
+		if (type == HTX_BLK_HDR) {
+			struct ist header_name = htx_get_blk_name(htx, blk);
+			if (isteq(header_name, ist("etag"))) {
+				object->etag_length = sz - istlen(header_name);
+				object->etag_offset = sizeof(struct cache_entry) + b_data(chk) - sz + istlen(header_name);
+			}
+		}
+		if (type == HTX_BLK_EOH)
+			break;
+	}
+	return hdrs_len;
+}
+
+enum act_return http_action_store_cache(struct act_rule *rule, struct proxy *px,
+					struct session *sess, struct stream *s, int flags)
 {
 	int effective_maxage = 0;
 	int true_maxage = 0;
@@ -1019,7 +1750,6 @@ enum act_return http_action_store_cache(struct act_rule *rule, struct proxy *px,
 	struct htx *htx;
 	struct http_hdr_ctx ctx;
 	size_t hdrs_len = 0;
-	int32_t pos;
 	unsigned int vary_signature = 0;
 
 	/* Don't cache if the response came from a cache */
@@ -1028,6 +1758,10 @@ enum act_return http_action_store_cache(struct act_rule *rule, struct proxy *px,
 		goto out;
 	}
 
+	/* background revalidations store the object themselves */
+	if (strm_fe(s)->cap & PR_CAP_HTTPCLIENT)
+		goto out;
+
 	/* cache only HTTP/1.1 */
 	if (!(txn->req.flags & HTTP_MSGF_VER_11))
 		goto out;
@@ -1057,6 +1791,7 @@ enum act_return http_action_store_cache(struct act_rule *rule, struct proxy *px,
 					old->eb.key = 0;
 				}
 				shctx_unlock(shctx);
+				cache_disk_invalidate(cconf->c.cache, txn->cache_hash);
 			}
 		}
 		goto out;
@@ -1081,11 +1816,18 @@ enum act_return http_action_store_cache(struct act_rule *rule, struct proxy *px,
 		}
 	}
 
+	/* the stream may have missed the cache in another proxy */
+	if (cache->collapse_timeout && !cache_ctx->pending)
+		cache_take_pending(cache, s, cache_ctx);
+
 	/* from there, cache_ctx is always defined */
 	htx = htxbuf(&s->res.buf);
 
-	/* Do not cache too big objects. */
-	if ((msg->flags & HTTP_MSGF_CNT_LEN) && shctx->max_obj_size > 0 &&
+	/* Do not cache too big objects. A compressed response's length is not
+	 * known yet, it will be checked while storing the payload.
+	 */
+	if (!(cache_ctx->flags & CACHE_ST_F_COMPRESSED) &&
+	    (msg->flags & HTTP_MSGF_CNT_LEN) && shctx->max_obj_size > 0 &&
 	    htx->data + htx->extra > shctx->max_obj_size)
 		goto out;
 
@@ -1097,6 +1839,9 @@ enum act_return http_action_store_cache(struct act_rule *rule, struct proxy *px,
 	if (cache->vary_processing_enabled) {
 		if (!http_check_vary_header(htx, &vary_signature))
 			goto out;
+		/* the compression filter adds "Vary: accept-encoding" */
+		if (cache_ctx->flags & CACHE_ST_F_COMPRESSED)
+			vary_signature |= VARY_ACCEPT_ENCODING;
 		if (vary_signature) {
 			/* If something went wrong during the secondary key
 			 * building, do not store the response. */
@@ -1162,6 +1907,9 @@ enum act_return http_action_store_cache(struct act_rule *rule, struct proxy *px,
 	}
 	shctx_unlock(shctx);
 
+	/* older copies on disk must not be promoted anymore */
+	cache_disk_invalidate(cache, txn->cache_hash);
+
 	/* reserve space for the cache_entry structure */
 	first->len = sizeof(struct cache_entry);
 	first->last_append = NULL;
@@ -1169,7 +1917,8 @@ enum act_return http_action_store_cache(struct act_rule *rule, struct proxy *px,
 	/* Determine the entry's maximum age (taking into account the cache's
 	 * configuration) as well as the response's explicit max age (extracted
 	 * from cache-control directives or the expires header). */
-	effective_maxage = http_calc_maxage(s, cconf->c.cache, &true_maxage);
+	effective_maxage = http_calc_maxage(htx, cconf->c.cache, &true_maxage);
+	http_calc_stale(htx, cconf->c.cache, object);
 
 	ctx.blk = NULL;
 	if (http_find_header(htx, ist("Age"), &ctx, 0)) {
@@ -1192,30 +1941,13 @@ enum act_return http_action_store_cache(struct act_rule *rule, struct proxy *px,
 	 * compared to a future If-Modified-Since client header. */
 	object->last_modified = get_last_modified_time(htx);
 
-	chunk_reset(&trash);
-	for (pos = htx_get_first(htx); pos != -1; pos = htx_get_next(htx, pos)) {
-		struct htx_blk *blk = htx_get_blk(htx, pos);
-		enum htx_blk_type type = htx_get_blk_type(blk);
-		uint32_t sz = htx_get_blksz(blk);
-
-		hdrs_len += sizeof(*blk) + sz;
-		chunk_memcat(&trash, (char *)&blk->info, sizeof(blk->info));
-		chunk_memcat(&trash, htx_get_blk_ptr(htx, blk), sz);
+	/* the compression filter has yet to rewrite the headers of a
+	 * compressed response, they will be stored by the filter.
+	 */
+	if (cache_ctx->flags & CACHE_ST_F_COMPRESSED)
+		goto end;
 
-		/* Look for optional ETag header.
-		 * We need to store the offset of the ETag value in order for
-		 * future conditional requests to be able to perform ETag
-		 * comparisons. */
-		if (type == HTX_BLK_HDR) {
-			struct ist header_name = htx_get_blk_name(htx, blk);
-			if (isteq(header_name, ist("etag"))) {
-				object->etag_length = sz - istlen(header_name);
-				object->etag_offset = sizeof(struct cache_entry) + b_data(&trash) - sz + istlen(header_name);
-			}
-		}
-		if (type == HTX_BLK_EOH)
-			break;
-	}
+	hdrs_len = cache_dump_hdrs(htx, object, &trash);
 
 	/* Do not cache objects if the headers are too big. */
 	if (hdrs_len > htx->size - global.tune.maxrewrite)
@@ -1248,6 +1980,7 @@ enum act_return http_action_store_cache(struct act_rule *rule, struct proxy *px,
 	if (shctx_row_data_append(shctx, first, NULL, (unsigned char *)trash.area, trash.data) < 0)
 		goto out;
 
+  end:
 	/* register the buffer in the filter ctx for filling it with data*/
 	if (cache_ctx) {
 		cache_ctx->first_block = first;
@@ -1272,6 +2005,40 @@ enum act_return http_action_store_cache(struct act_rule *rule, struct proxy *px,
 	return ACT_RET_CONT;
 }
 
+/*
+ * Stores the headers of a response compressed by a filter preceding the cache
+ * one, once rewritten by this filter, in the row reserved by the "cache-store"
+ * action for <st>. The encoding part of the entry's secondary key is set to
+ * the negotiated encoding.
+ * Returns 0 on success, -1 if the response must not be stored.
+ */
+static int cache_store_compressed_hdrs(struct cache_st *st, struct filter *filter, struct http_msg *msg)
+{
+	struct cache_flt_conf *cconf = FLT_CONF(filter);
+	struct shared_context *shctx = shctx_ptr(cconf->c.cache);
+	struct cache_entry *object = (struct cache_entry *)st->first_block->data;
+	struct htx *htx = htxbuf(&msg->chn->buf);
+	unsigned int hdrs_len;
+
+	hdrs_len = cache_dump_hdrs(htx, object, &trash);
+	if (hdrs_len > htx->size - global.tune.maxrewrite)
+		return -1;
+
+	if (set_secondary_key_encoding(htx, object->secondary_key))
+		return -1;
+
+	shctx_lock(shctx);
+	if (!shctx_row_reserve_hot(shctx, st->first_block, trash.data)) {
+		shctx_unlock(shctx);
+		return -1;
+	}
+	shctx_unlock(shctx);
+
+	if (shctx_row_data_append(shctx, st->first_block, NULL, (unsigned char *)trash.area, trash.data) < 0)
+		return -1;
+	return 0;
+}
+
 #define 	HTX_CACHE_INIT   0  /* Initial state. */
 #define 	HTX_CACHE_HEADER 1  /* Cache entry headers forwarding */
 #define 	HTX_CACHE_DATA   2  /* Cache entry data forwarding */
@@ -1286,6 +2053,9 @@ static void http_cache_applet_release(struct appctx *appctx)
 	struct cache *cache = cconf->c.cache;
 	struct shared_block *first = block_ptr(cache_ptr);
 
+	pool_free(pool_head_cache_ranges, ctx->ranges);
+	ctx->ranges = NULL;
+
 	shctx_lock(shctx_ptr(cache));
 	shctx_row_dec_hot(shctx_ptr(cache), first);
 	shctx_unlock(shctx_ptr(cache));
@@ -1460,6 +2230,343 @@ static int htx_cache_add_age_hdr(struct appctx *appctx, struct htx *htx)
 	return 1;
 }
 
+/* Moves the position <blk>/<offset> in a row of cache <shctx> forward by <len>
+ * bytes. The position never points to the end of a block.
+ */
+static void cache_row_skip(struct shared_context *shctx, struct shared_block **blk,
+                           unsigned int *offset, unsigned int len)
+{
+	unsigned int max;
+
+	while (len) {
+		max = MIN(len, shctx->block_size - *offset);
+		*offset += max;
+		len -= max;
+		if (*offset == shctx->block_size) {
+			*blk = LIST_NEXT(&(*blk)->list, typeof(*blk), list);
+			*offset = 0;
+		}
+	}
+}
+
+/* Reads the info of the HTX block stored at position <blk>/<offset> in a row
+ * of cache <shctx>, and moves the position to the block's payload.
+ */
+static uint32_t cache_row_read_info(struct shared_context *shctx, struct shared_block **blk,
+                                    unsigned int *offset)
+{
+	uint32_t info;
+	unsigned int sz;
+
+	/* May be split on 2 shblk */
+	sz = MIN(4, shctx->block_size - *offset);
+	memcpy((char *)&info, (const char *)(*blk)->data + *offset, sz);
+	if (sz < 4)
+		memcpy(((char *)&info) + sz,
+		       (const char *)LIST_NEXT(&(*blk)->list, typeof(*blk), list)->data, 4 - sz);
+	cache_row_skip(shctx, blk, offset, 4);
+	return info;
+}
+
+/* Returns the payload length of the object sent by <appctx>, whose headers
+ * were already dumped, or -1 if the stored object is inconsistent. Trailers
+ * are not part of the payload.
+ */
+static long long htx_cache_payload_len(struct appctx *appctx)
+{
+	struct cache_appctx *ctx = appctx->svcctx;
+	struct cache_flt_conf *cconf = appctx->rule->arg.act.p[0];
+	struct shared_context *shctx = shctx_ptr(cconf->c.cache);
+	struct shared_block *blk = ctx->next;
+	unsigned int offset = ctx->offset;
+	unsigned int left, sz;
+	long long len = 0;
+	uint32_t info;
+
+	left = block_ptr(ctx->entry)->len - sizeof(*ctx->entry) - ctx->sent;
+	while (left >= 4) {
+		info = cache_row_read_info(shctx, &blk, &offset);
+		left -= 4;
+		if ((info >> 28) != HTX_BLK_DATA)
+			break;
+		sz = info & 0xfffffff;
+		if (sz > left)
+			return -1;
+		cache_row_skip(shctx, &blk, &offset, sz);
+		left -= sz;
+		len += sz;
+	}
+	return len;
+}
+
+/* Moves the position of <appctx> to offset <pos> of the payload. It restarts
+ * from the beginning of the payload when <pos> is behind the current position.
+ * <pos> must be lower than the payload length. Returns 0 if the stored object
+ * is inconsistent, otherwise 1.
+ */
+static int htx_cache_range_seek(struct appctx *appctx, long long pos)
+{
+	struct cache_appctx *ctx = appctx->svcctx;
+	struct cache_flt_conf *cconf = appctx->rule->arg.act.p[0];
+	struct shared_context *shctx = shctx_ptr(cconf->c.cache);
+	unsigned int sz;
+	uint32_t info;
+
+	if (pos < ctx->body_pos) {
+		ctx->next = ctx->body_blk;
+		ctx->offset = ctx->body_offset;
+		ctx->rem_data = 0;
+		ctx->body_pos = 0;
+	}
+
+	while (ctx->body_pos < pos || !ctx->rem_data) {
+		if (!ctx->rem_data) {
+			info = cache_row_read_info(shctx, &ctx->next, &ctx->offset);
+			if ((info >> 28) != HTX_BLK_DATA)
+				return 0;
+			ctx->rem_data = info & 0xfffffff;
+			continue;
+		}
+		sz = MIN(ctx->rem_data, pos - ctx->body_pos);
+		cache_row_skip(shctx, &ctx->next, &ctx->offset, sz);
+		ctx->rem_data -= sz;
+		ctx->body_pos += sz;
+	}
+	return 1;
+}
+
+/* Dumps into <htx> as much as possible of the current range of <appctx>,
+ * from its current position. Returns 0 on success, -1 if the stored object is
+ * inconsistent. The range is complete once ctx->range_rem is zero.
+ */
+static int htx_cache_dump_range_data(struct appctx *appctx, struct htx *htx)
+{
+	struct cache_appctx *ctx = appctx->svcctx;
+	struct cache_flt_conf *cconf = appctx->rule->arg.act.p[0];
+	struct shared_context *shctx = shctx_ptr(cconf->c.cache);
+	unsigned int max, len;
+	size_t sz;
+	uint32_t info;
+
+	max = htx_get_max_blksz(htx, channel_htx_recv_max(sc_ic(appctx_sc(appctx)), htx));
+	while (ctx->range_rem && max) {
+		if (!ctx->rem_data) {
+			info = cache_row_read_info(shctx, &ctx->next, &ctx->offset);
+			if ((info >> 28) != HTX_BLK_DATA)
+				return -1;
+			ctx->rem_data = info & 0xfffffff;
+			continue;
+		}
+
+		len = MIN(ctx->rem_data, shctx->block_size - ctx->offset);
+		len = MIN(len, max);
+		if (len > ctx->range_rem)
+			len = ctx->range_rem;
+
+		sz = htx_add_data(htx, ist2(ctx->next->data + ctx->offset, len));
+		cache_row_skip(shctx, &ctx->next, &ctx->offset, sz);
+		ctx->rem_data  -= sz;
+		ctx->body_pos  += sz;
+		ctx->range_rem -= sz;
+		max -= sz;
+		if (sz < len)
+			break;
+	}
+	return 0;
+}
+
+/* Builds in <chk> the part header preceding range <idx> of <ranges> in a
+ * multipart response, or the closing boundary if <idx> is the number of
+ * ranges.
+ */
+static void cache_range_part_hdr(const struct cache_ranges *ranges, unsigned int idx,
+                                 struct buffer *chk)
+{
+	if (idx == ranges->nb) {
+		chunk_printf(chk, "\r\n--%016llx--\r\n", ranges->boundary);
+		return;
+	}
+
+	chunk_printf(chk, "\r\n--%016llx\r\n", ranges->boundary);
+	if (ranges->ctype_len)
+		chunk_appendf(chk, "Content-Type: %.*s\r\n", (int)ranges->ctype_len, ranges->ctype);
+	chunk_appendf(chk, "Content-Range: bytes %lld-%lld/%lld\r\n\r\n",
+		      ranges->r[idx].first, ranges->r[idx].last, ranges->len);
+}
+
+/* Replaces the payload framing headers of response <htx> to announce <len>
+ * bytes. Returns 0 on failure.
+ */
+static int http_cache_set_payload_len(struct htx *htx, long long len)
+{
+	struct http_hdr_ctx hctx;
+	struct htx_sl *sl;
+	struct buffer *chk;
+
+	hctx.blk = NULL;
+	while (http_find_header(htx, ist("Content-Length"), &hctx, 1))
+		http_remove_header(htx, &hctx);
+	hctx.blk = NULL;
+	while (http_find_header(htx, ist("Transfer-Encoding"), &hctx, 1))
+		http_remove_header(htx, &hctx);
+
+	chk = get_trash_chunk();
+	chunk_printf(chk, "%lld", len);
+	if (!http_add_header(htx, ist("Content-Length"), ist2(b_orig(chk), b_data(chk))))
+		return 0;
+
+	sl = http_get_stline(htx);
+	sl->flags &= ~HTX_SL_F_CHNK;
+	sl->flags |= HTX_SL_F_XFER_LEN | HTX_SL_F_CLEN;
+	return 1;
+}
+
+/* Resolves the ranges requested to <appctx> against the payload of the object
+ * and turns the response headers already dumped into <htx> accordingly. Returns
+ * 1 if the ranges must be sent, 2 if none is satisfiable and a 416 without
+ * payload was prepared, 0 if the whole object must be sent instead, and -1 on
+ * error.
+ */
+static int htx_cache_set_ranges(struct appctx *appctx, struct htx *htx)
+{
+	struct cache_appctx *ctx = appctx->svcctx;
+	struct cache_ranges *ranges = ctx->ranges;
+	struct http_hdr_ctx hctx;
+	struct htx_sl *sl;
+	struct buffer *chk;
+	long long first, last, total;
+	unsigned int i, nb;
+
+	/* only complete objects may be partially sent */
+	sl = http_get_stline(htx);
+	if (!sl || sl->info.res.status != 200)
+		return 0;
+
+	ranges->len = htx_cache_payload_len(appctx);
+	if (ranges->len < 0)
+		return -1;
+
+	/* Resolve the ranges, dropping the unsatisfiable ones (RFC7233#4.1) */
+	for (i = nb = 0, total = 0; i < ranges->nb; i++) {
+		first = ranges->r[i].first;
+		last  = ranges->r[i].last;
+		if (first < 0) {
+			/* suffix range */
+			if (!last || !ranges->len)
+				continue;
+			first = (last < ranges->len) ? ranges->len - last : 0;
+			last = ranges->len - 1;
+		}
+		else {
+			if (first >= ranges->len)
+				continue;
+			if (last < 0 || last >= ranges->len)
+				last = ranges->len - 1;
+		}
+		ranges->r[nb].first = first;
+		ranges->r[nb].last = last;
+		total += last - first + 1;
+		nb++;
+	}
+	ranges->nb = nb;
+	ranges->cur = 0;
+
+	chk = get_trash_chunk();
+	if (!nb) {
+		chunk_printf(chk, "bytes */%lld", ranges->len);
+		if (!http_replace_res_status(htx, ist("416"), ist("Range Not Satisfiable")) ||
+		    !http_add_header(htx, ist("Content-Range"), ist2(b_orig(chk), b_data(chk))) ||
+		    !http_cache_set_payload_len(htx, 0))
+			return -1;
+		return 2;
+	}
+
+	/* Overlapping ranges asking for more than the object are not worth
+	 * honoring (RFC7233#6.1).
+	 */
+	if (total > ranges->len)
+		return 0;
+
+	ctx->body_blk = ctx->next;
+	ctx->body_offset = ctx->offset;
+	ctx->body_pos = 0;
+	ctx->rem_data = 0;
+	ctx->range_rem = 0;
+
+	if (nb == 1) {
+		chunk_printf(chk, "bytes %lld-%lld/%lld",
+			     ranges->r[0].first, ranges->r[0].last, ranges->len);
+		if (!http_replace_res_status(htx, ist("206"), ist("Partial Content")) ||
+		    !http_add_header(htx, ist("Content-Range"), ist2(b_orig(chk), b_data(chk))) ||
+		    !http_cache_set_payload_len(htx, total))
+			return -1;
+		return 1;
+	}
+
+	/* Several ranges are sent as a multipart/byteranges payload, each part
+	 * repeating the object's Content-Type.
+	 */
+	ranges->ctype_len = 0;
+	hctx.blk = NULL;
+	if (http_find_header(htx, ist("Content-Type"), &hctx, 1)) {
+		if (istlen(hctx.value) > sizeof(ranges->ctype))
+			return 0;
+		ranges->ctype_len = istlen(hctx.value);
+		memcpy(ranges->ctype, istptr(hctx.value), ranges->ctype_len);
+		http_remove_header(htx, &hctx);
+	}
+	ranges->boundary = ha_random64();
+
+	for (i = 0; i <= nb; i++) {
+		cache_range_part_hdr(ranges, i, chk);
+		total += b_data(chk);
+	}
+
+	chunk_printf(chk, "multipart/byteranges; boundary=%016llx", ranges->boundary);
+	if (!http_replace_res_status(htx, ist("206"), ist("Partial Content")) ||
+	    !http_add_header(htx, ist("Content-Type"), ist2(b_orig(chk), b_data(chk))) ||
+	    !http_cache_set_payload_len(htx, total))
+		return -1;
+	return 1;
+}
+
+/* Dumps into <htx> the ranges requested to <appctx>. Returns 1 once all of
+ * them were sent, 0 if more room is needed and -1 on error.
+ */
+static int htx_cache_dump_ranges(struct appctx *appctx, struct htx *htx)
+{
+	struct cache_appctx *ctx = appctx->svcctx;
+	struct cache_ranges *ranges = ctx->ranges;
+	struct channel *res = sc_ic(appctx_sc(appctx));
+	struct buffer *chk;
+
+	while (ranges->cur <= ranges->nb) {
+		if (!ctx->range_rem) {
+			if (ranges->nb > 1) {
+				chk = get_trash_chunk();
+				cache_range_part_hdr(ranges, ranges->cur, chk);
+				if (htx_get_max_blksz(htx, channel_htx_recv_max(res, htx)) < b_data(chk) ||
+				    !htx_add_data_atonce(htx, ist2(b_orig(chk), b_data(chk))))
+					return 0;
+			}
+			if (ranges->cur == ranges->nb) {
+				ranges->cur++;
+				break;
+			}
+			if (!htx_cache_range_seek(appctx, ranges->r[ranges->cur].first))
+				return -1;
+			ctx->range_rem = ranges->r[ranges->cur].last - ranges->r[ranges->cur].first + 1;
+		}
+
+		if (htx_cache_dump_range_data(appctx, htx) < 0)
+			return -1;
+		if (ctx->range_rem)
+			return 0;
+		ranges->cur++;
+	}
+	return 1;
+}
+
 static void http_cache_io_handler(struct appctx *appctx)
 {
 	struct cache_appctx *ctx = appctx->svcctx;
@@ -1472,6 +2579,7 @@ static void http_cache_io_handler(struct appctx *appctx)
 	struct buffer *errmsg;
 	unsigned int len;
 	size_t ret, total = 0;
+	int rng = 0;
 
 	res_htx = htx_from_buf(&res->buf);
 	total = res_htx->data;
@@ -1510,14 +2618,37 @@ static void http_cache_io_handler(struct appctx *appctx)
 			}
 		}
 
+		/* In case of a range request, only the requested parts of the
+		 * payload are sent, if any. */
+		if (ctx->ranges) {
+			rng = ctx->send_notmodified ? 0 : htx_cache_set_ranges(appctx, res_htx);
+			if (rng < 0)
+				goto error;
+			if (!rng) {
+				pool_free(pool_head_cache_ranges, ctx->ranges);
+				ctx->ranges = NULL;
+			}
+		}
+
 		/* Skip response body for HEAD requests or in case of "304 Not
-		 * Modified" response. */
-		if (__sc_strm(sc)->txn->meth == HTTP_METH_HEAD || ctx->send_notmodified)
+		 * Modified" or "416 Range Not Satisfiable" response. */
+		if (__sc_strm(sc)->txn->meth == HTTP_METH_HEAD || ctx->send_notmodified || rng == 2)
 			appctx->st0 = HTX_CACHE_EOM;
 		else
 			appctx->st0 = HTX_CACHE_DATA;
 	}
 
+	if (appctx->st0 == HTX_CACHE_DATA && ctx->ranges) {
+		rng = htx_cache_dump_ranges(appctx, res_htx);
+		if (rng < 0)
+			goto error;
+		if (!rng) {
+			sc_need_room(sc, channel_htx_recv_max(res, res_htx) + 1);
+			goto out;
+		}
+		appctx->st0 = HTX_CACHE_EOM;
+	}
+
 	if (appctx->st0 == HTX_CACHE_DATA) {
 		len = first->len - sizeof(*cache_ptr) - ctx->sent;
 		if (len) {
@@ -1611,164 +2742,809 @@ static int parse_cache_rule(struct proxy *proxy, const char *name, struct act_ru
 		memprintf(err, "out of memory\n");
 		goto err;
 	}
-	fconf->id = cache_store_flt_id;
-	fconf->conf = cconf;
-	fconf->ops  = &cache_ops;
-	LIST_APPEND(&proxy->filter_configs, &fconf->list);
+	fconf->id = cache_store_flt_id;
+	fconf->conf = cconf;
+	fconf->ops  = &cache_ops;
+	LIST_APPEND(&proxy->filter_configs, &fconf->list);
+
+	rule->arg.act.p[0] = cconf;
+	return 1;
+
+  err:
+	free(cconf);
+	return 0;
+}
+
+enum act_parse_ret parse_cache_store(const char **args, int *orig_arg, struct proxy *proxy,
+                                          struct act_rule *rule, char **err)
+{
+	rule->action       = ACT_CUSTOM;
+	rule->action_ptr   = http_action_store_cache;
+
+	if (!parse_cache_rule(proxy, args[*orig_arg], rule, err))
+		return ACT_RET_PRS_ERR;
+
+	(*orig_arg)++;
+	return ACT_RET_PRS_OK;
+}
+
+/* This produces a sha1 hash of the concatenation of the HTTP method,
+ * the first occurrence of the Host header followed by the path component
+ * if it begins with a slash ('/'). */
+int sha1_hosturi(struct stream *s)
+{
+	struct http_txn *txn = s->txn;
+	struct htx *htx = htxbuf(&s->req.buf);
+	struct htx_sl *sl;
+	struct http_hdr_ctx ctx;
+	struct ist uri;
+	blk_SHA_CTX sha1_ctx;
+	struct buffer *trash;
+
+	trash = get_trash_chunk();
+	ctx.blk = NULL;
+
+	sl = http_get_stline(htx);
+	uri = htx_sl_req_uri(sl); // whole uri
+	if (!uri.len)
+		return 0;
+
+	/* In HTTP/1, most URIs are seen in origin form ('/path/to/resource'),
+	 * unless haproxy is deployed in front of an outbound cache. In HTTP/2,
+	 * URIs are almost always sent in absolute form with their scheme. In
+	 * this case, the scheme is almost always "https". In order to support
+	 * sharing of cache objects between H1 and H2, we'll hash the absolute
+	 * URI whenever known, or prepend "https://" + the Host header for
+	 * relative URIs. The difference will only appear on absolute HTTP/1
+	 * requests sent to an origin server, which practically is never met in
+	 * the real world so we don't care about the ability to share the same
+	 * key here.URIs are normalized from the absolute URI to an origin form as
+	 * well.
+	 */
+	if (!(sl->flags & HTX_SL_F_HAS_AUTHORITY)) {
+		chunk_istcat(trash, ist("https://"));
+		if (!http_find_header(htx, ist("Host"), &ctx, 0))
+			return 0;
+		chunk_istcat(trash, ctx.value);
+	}
+
+	chunk_istcat(trash, uri);
+
+	/* hash everything */
+	blk_SHA1_Init(&sha1_ctx);
+	blk_SHA1_Update(&sha1_ctx, trash->area, trash->data);
+	blk_SHA1_Final((unsigned char *)txn->cache_hash, &sha1_ctx);
+
+	return 1;
+}
+
+/* Looks for "If-None-Match" headers in the request and compares their value
+ * with the one that might have been stored in the cache_entry. If any of them
+ * matches, a "304 Not Modified" response should be sent instead of the cached
+ * data.
+ * Although unlikely in a GET/HEAD request, the "If-None-Match: *" syntax is
+ * valid and should receive a "304 Not Modified" response (RFC 7234#4.3.2).
+ *
+ * If no "If-None-Match" header was found, look for an "If-Modified-Since"
+ * header and compare its value (date) to the one stored in the cache_entry.
+ * If the request's date is later than the cached one, we also send a
+ * "304 Not Modified" response (see RFCs 7232#3.3 and 7234#4.3.2).
+ *
+ * Returns 1 if "304 Not Modified" should be sent, 0 otherwise.
+ */
+static int should_send_notmodified_response(struct cache *cache, struct htx *htx,
+                                            struct cache_entry *entry)
+{
+	int retval = 0;
+
+	struct http_hdr_ctx ctx = { .blk = NULL };
+	struct ist cache_entry_etag = IST_NULL;
+	struct buffer *etag_buffer = NULL;
+	int if_none_match_found = 0;
+
+	struct tm tm = {};
+	time_t if_modified_since = 0;
+
+	/* If we find a "If-None-Match" header in the request, rebuild the
+	 * cache_entry's ETag in order to perform comparisons.
+	 * There could be multiple "if-none-match" header lines. */
+	while (http_find_header(htx, ist("if-none-match"), &ctx, 0)) {
+		if_none_match_found = 1;
+
+		/* A '*' matches everything. */
+		if (isteq(ctx.value, ist("*")) != 0) {
+			retval = 1;
+			break;
+		}
+
+		/* No need to rebuild an etag if none was stored in the cache. */
+		if (entry->etag_length == 0)
+			break;
+
+		/* Rebuild the stored ETag. */
+		if (etag_buffer == NULL) {
+			etag_buffer = get_trash_chunk();
+
+			if (shctx_row_data_get(shctx_ptr(cache), block_ptr(entry),
+					       (unsigned char*)b_orig(etag_buffer),
+					       entry->etag_offset, entry->etag_length) == 0) {
+				cache_entry_etag = ist2(b_orig(etag_buffer), entry->etag_length);
+			} else {
+				/* We could not rebuild the ETag in one go, we
+				 * won't send a "304 Not Modified" response. */
+				break;
+			}
+		}
+
+		if (http_compare_etags(cache_entry_etag, ctx.value) == 1) {
+			retval = 1;
+			break;
+		}
+	}
+
+	/* If the request did not contain an "If-None-Match" header, we look for
+	 * an "If-Modified-Since" header (see RFC 7232#3.3). */
+	if (retval == 0 && if_none_match_found == 0) {
+		ctx.blk = NULL;
+		if (http_find_header(htx, ist("if-modified-since"), &ctx, 1)) {
+			if (parse_http_date(istptr(ctx.value), istlen(ctx.value), &tm)) {
+				if_modified_since = my_timegm(&tm);
+
+				/* We send a "304 Not Modified" response if the
+				 * entry's last modified date is earlier than
+				 * the one found in the "If-Modified-Since"
+				 * header. */
+				retval = (entry->last_modified <= if_modified_since);
+			}
+		}
+	}
+
+	return retval;
+}
+
+/* Looks for an "If-Range" header in the request and compares its value with
+ * the validators of the cache_entry. A range request may only be served when
+ * there is none or when it matches: an ETag must strongly match the stored
+ * one, and a date must be exactly the entry's last modification date (see
+ * RFC7233#3.2).
+ *
+ * Returns 1 if the ranges may be sent, 0 if the whole object must be sent.
+ */
+static int cache_if_range_match(struct cache *cache, struct htx *htx,
+                                struct cache_entry *entry)
+{
+	struct http_hdr_ctx ctx = { .blk = NULL };
+	struct buffer *etag_buffer;
+	struct ist etag;
+	struct tm tm = {};
+
+	if (!http_find_header(htx, ist("if-range"), &ctx, 1))
+		return 1;
+
+	switch (http_get_etag_type(ctx.value)) {
+	case ETAG_STRONG:
+		if (entry->etag_length == 0)
+			return 0;
+
+		etag_buffer = get_trash_chunk();
+		if (shctx_row_data_get(shctx_ptr(cache), block_ptr(entry),
+				       (unsigned char*)b_orig(etag_buffer),
+				       entry->etag_offset, entry->etag_length) != 0)
+			return 0;
+
+		etag = ist2(b_orig(etag_buffer), entry->etag_length);
+		return http_get_etag_type(etag) == ETAG_STRONG && isteq(etag, ctx.value);
+
+	case ETAG_WEAK:
+		return 0;
+
+	default:
+		if (!parse_http_date(istptr(ctx.value), istlen(ctx.value), &tm))
+			return 0;
+		return my_timegm(&tm) == entry->last_modified;
+	}
+}
+
+/* Parses the decimal number at the beginning of <v> into <ret> and skips it.
+ * Returns 0 on overflow.
+ */
+static int cache_parse_range_pos(struct ist *v, long long *ret)
+{
+	long long val = 0;
+
+	while (istlen(*v) && isdigit((unsigned char)*istptr(*v))) {
+		if (val > (LLONG_MAX - 9) / 10)
+			return 0;
+		val = val * 10 + (*istptr(*v) - '0');
+		*v = istnext(*v);
+	}
+	*ret = val;
+	return 1;
+}
+
+/* Parses the "Range" header of request <htx> looking for entry <entry> of
+ * cache <cache>. Only a single valid "bytes" range set of at most
+ * CACHE_MAX_RANGES ranges is supported, otherwise the header is ignored as
+ * permitted by RFC7233#3.1.
+ *
+ * Returns the ranges allocated from pool_head_cache_ranges, or NULL if the
+ * whole object must be sent.
+ */
+static struct cache_ranges *cache_parse_ranges(struct cache *cache, struct htx *htx,
+                                               struct cache_entry *entry)
+{
+	struct http_hdr_ctx ctx = { .blk = NULL };
+	struct cache_ranges *ranges;
+	long long first, last;
+	struct ist v;
+
+	if (!http_find_header(htx, ist("range"), &ctx, 1))
+		return NULL;
+	v = ctx.value;
+	if (http_find_header(htx, ist("range"), &ctx, 1))
+		return NULL;
+
+	if (!istmatchi(v, ist("bytes=")) || !cache_if_range_match(cache, htx, entry))
+		return NULL;
+
+	ranges = pool_alloc(pool_head_cache_ranges);
+	if (!ranges)
+		return NULL;
+
+	ranges->nb = 0;
+	v = istadv(v, 6);
+	while (1) {
+		v = http_trim_leading_spht(v);
+		if (!istlen(v))
+			break;
+
+		/* empty list elements are permitted */
+		if (*istptr(v) == ',') {
+			v = istnext(v);
+			continue;
+		}
+
+		if (ranges->nb == CACHE_MAX_RANGES)
+			goto ignore;
+
+		first = last = -1;
+		if (isdigit((unsigned char)*istptr(v)) && !cache_parse_range_pos(&v, &first))
+			goto ignore;
+		if (!istlen(v) || *istptr(v) != '-')
+			goto ignore;
+		v = istnext(v);
+		if (istlen(v) && isdigit((unsigned char)*istptr(v)) && !cache_parse_range_pos(&v, &last))
+			goto ignore;
+
+		if ((first < 0 && last < 0) || (last >= 0 && last < first))
+			goto ignore;
+
+		ranges->r[ranges->nb].first = first;
+		ranges->r[ranges->nb].last = last;
+		ranges->nb++;
+
+		v = http_trim_leading_spht(v);
+		if (istlen(v) && *istptr(v) != ',')
+			goto ignore;
+	}
+
+	if (ranges->nb)
+		return ranges;
+
+  ignore:
+	pool_free(pool_head_cache_ranges, ranges);
+	return NULL;
+}
+
+/* On a miss, a "Range: bytes=0-" request asks for the whole object. The Range
+ * header is removed so that the server delivers a complete response which may
+ * then be stored. The client receives a 200 instead of a 206 for the same
+ * payload, which is permitted by RFC7233#3.1.
+ */
+static void cache_drop_full_range(struct stream *s)
+{
+	struct htx *htx = htxbuf(&s->req.buf);
+	struct http_hdr_ctx ctx = { .blk = NULL };
+	struct http_hdr_ctx range;
+
+	if (s->txn->meth != HTTP_METH_GET || !http_find_header(htx, ist("range"), &ctx, 1))
+		return;
+
+	range = ctx;
+	if (http_find_header(htx, ist("range"), &ctx, 1) ||
+	    !isteqi(http_trim_trailing_spht(range.value), ist("bytes=0-")))
+		return;
+
+	http_remove_header(htx, &range);
+	ctx.blk = NULL;
+	while (http_find_header(htx, ist("if-range"), &ctx, 1))
+		http_remove_header(htx, &ctx);
+}
+
+/* Context of the background revalidation of a stale entry, performed with the
+ * httpclient. The stale entry's row is kept hot until it completes. On a 200
+ * response, the new object is stored in a separate row which replaces the
+ * stale entry once complete.
+ */
+struct cache_reval {
+	struct cache *cache;
+	long long clen;                 /* announced length of the new object */
+	long long received;             /* payload bytes received so far */
+	struct shared_block *stale;     /* row of the stale entry */
+	struct shared_block *first;     /* row of the new object, if being stored */
+	int maxage;                     /* freshness of a 304 response (seconds), -1 if unknown */
+	unsigned int swr, sie;          /* stale windows of a 304 response */
+};
+
+/* Builds in <buf> an HTX response out of the status and headers received by
+ * <hc>, without the payload. Returns the HTX message or NULL on error.
+ */
+static struct htx *cache_reval_build_htx(struct httpclient *hc, struct buffer *buf)
+{
+	struct htx *htx;
+	struct htx_sl *sl;
+	struct http_hdr *hdr;
+	unsigned int flags = HTX_SL_F_IS_RESP | HTX_SL_F_VER_11 | HTX_SL_F_XFER_LEN;
+	char status[4];
+
+	for (hdr = hc->res.hdrs; hdr && isttest(hdr->n); hdr++) {
+		if (isteqi(hdr->n, ist("content-length")))
+			flags |= HTX_SL_F_CLEN;
+	}
+
+	snprintf(status, sizeof(status), "%03u", hc->res.status % 1000);
+	htx = htx_from_buf(buf);
+	sl = htx_add_stline(htx, HTX_BLK_RES_SL, flags, ist("HTTP/1.1"), ist(status), hc->res.reason);
+	if (!sl)
+		return NULL;
+	sl->info.res.status = hc->res.status;
+
+	for (hdr = hc->res.hdrs; hdr && isttest(hdr->n); hdr++) {
+		if (!htx_add_header(htx, hdr->n, hdr->v))
+			return NULL;
+	}
+
+	if (!htx_add_endof(htx, HTX_BLK_EOH))
+		return NULL;
+	return htx;
+}
+
+/* Returns non-zero if the response in <htx> may replace the stale entry
+ * <stale> of <cache>. It is a reduced version of the checks performed by
+ * "cache-store", which is not involved here. The response must announce its
+ * length, which is returned in <clen>, so that a truncated object is never
+ * indexed.
+ */
+static int cache_reval_storable(struct cache *cache, struct htx *htx, struct cache_entry *stale,
+                                long long *clen)
+{
+	struct http_hdr_ctx ctx = { .blk = NULL };
+	unsigned int vary_signature = 0;
+
+	while (http_find_header(htx, ist("cache-control"), &ctx, 0)) {
+		if (isteqi(ctx.value, ist("no-store")) ||
+		    isteqi(ctx.value, ist("no-cache")) ||
+		    isteqi(ctx.value, ist("private")))
+			return 0;
+	}
+
+	ctx.blk = NULL;
+	if (http_find_header(htx, ist("set-cookie"), &ctx, 1))
+		return 0;
+
+	ctx.blk = NULL;
+	if (!http_find_header(htx, ist("content-length"), &ctx, 1) ||
+	    strl2llrc(ctx.value.ptr, ctx.value.len, clen) != 0 ||
+	    (cache->maxobjsz && *clen > cache->maxobjsz))
+		return 0;
+
+	if (cache->vary_processing_enabled) {
+		if (!http_check_vary_header(htx, &vary_signature))
+			return 0;
+	}
+	else {
+		ctx.blk = NULL;
+		if (http_find_header(htx, ist("vary"), &ctx, 0))
+			return 0;
+	}
+
+	/* the new object must use the stale entry's secondary key, including
+	 * the encoding of the stored variant.
+	 */
+	if (vary_signature != stale->secondary_key_signature)
+		return 0;
+
+	if (vary_signature) {
+		char key[HTTP_CACHE_SEC_KEY_LEN];
+
+		memcpy(key, stale->secondary_key, sizeof(key));
+		if (set_secondary_key_encoding(htx, key) ||
+		    memcmp(key, stale->secondary_key, sizeof(key)) != 0)
+			return 0;
+	}
+	return 1;
+}
+
+/* Returns non-zero if the 200 response in <htx> carries the same validators as
+ * the stale entry <stale> of <cache>, meaning that the object did not change.
+ * This is used when the response cannot replace the entry, typically because
+ * the entry is a variant compressed by haproxy while the server delivers the
+ * raw object. ETags are compared weakly since the compression weakens them.
+ */
+static int cache_reval_unchanged(struct cache *cache, struct htx *htx, struct cache_entry *stale)
+{
+	struct http_hdr_ctx ctx = { .blk = NULL };
+	struct buffer *etag;
+	struct tm tm = {};
+
+	if (stale->etag_length) {
+		if (!http_find_header(htx, ist("etag"), &ctx, 1))
+			return 0;
+
+		/* the row is hot, it may be read without the lock */
+		etag = get_trash_chunk();
+		if (stale->etag_length > b_size(etag) ||
+		    shctx_row_data_get(shctx_ptr(cache), block_ptr(stale), (unsigned char *)etag->area,
+				       stale->etag_offset, stale->etag_length) != 0)
+			return 0;
+		return http_compare_etags(ist2(etag->area, stale->etag_length), ctx.value);
+	}
+
+	/* get_last_modified_time() falls back to the date, only an explicit
+	 * Last-Modified header may be trusted here.
+	 */
+	return stale->last_modified &&
+		http_find_header(htx, ist("last-modified"), &ctx, 1) &&
+		parse_http_date(istptr(ctx.value), istlen(ctx.value), &tm) &&
+		my_timegm(&tm) == stale->last_modified;
+}
+
+/* httpclient callback called once the response headers are received */
+static void cache_reval_res_headers(struct httpclient *hc)
+{
+	struct cache_reval *reval = hc->caller;
+	struct cache *cache = reval->cache;
+	struct shared_context *shctx = shctx_ptr(cache);
+	struct cache_entry *stale = (struct cache_entry *)reval->stale->data;
+	struct cache_entry *object;
+	struct shared_block *first;
+	struct buffer *buf;
+	struct htx *htx;
+	int maxage, true_maxage = 0;
+	int refresh = 0;
+
+	if (hc->res.status != 200 && hc->res.status != 304)
+		return;
+
+	/* the trash chunks are used by the header parsing functions */
+	buf = alloc_trash_chunk();
+	if (!buf)
+		return;
+
+	htx = cache_reval_build_htx(hc, buf);
+	if (!htx)
+		goto end;
+
+	if (hc->res.status == 200 && !cache_reval_storable(cache, htx, stale, &reval->clen)) {
+		/* the stored variant may not be the one delivered by the
+		 * server, typically when it was compressed by haproxy. It is
+		 * then only refreshed if the object did not change.
+		 */
+		if (!cache_reval_unchanged(cache, htx, stale))
+			goto end;
+		refresh = 1;
+	}
+
+	if (hc->res.status == 304 || refresh) {
+		struct cache_entry fresh = { };
+
+		/* update the stale entry's freshness */
+		reval->maxage = http_calc_maxage(htx, cache, NULL);
+		http_calc_stale(htx, cache, &fresh);
+		reval->swr = fresh.stale_while_revalidate;
+		reval->sie = fresh.stale_if_error;
+		goto end;
+	}
+
+
+	maxage = http_calc_maxage(htx, cache, &true_maxage);
+	if (maxage < 0)
+		goto end;
+
+	shctx_lock(shctx);
+	first = shctx_row_reserve_hot(shctx, NULL, sizeof(struct cache_entry));
+	if (first) {
+		object = (struct cache_entry *)first->data;
+		memset(object, 0, sizeof(*object));
+	}
+	shctx_unlock(shctx);
+	if (!first)
+		goto end;
+
+	first->len = sizeof(struct cache_entry);
+	first->last_append = NULL;
+	reval->first = first;
+
+	/* the object is only indexed once complete */
+	memcpy(object->hash, stale->hash, sizeof(object->hash));
+	object->secondary_key_signature = stale->secondary_key_signature;
+	memcpy(object->secondary_key, stale->secondary_key, HTTP_CACHE_SEC_KEY_LEN);
+
+	http_calc_stale(htx, cache, object);
+	object->last_modified = get_last_modified_time(htx);
+	object->latest_validation = date.tv_sec;
+	object->expire = date.tv_sec + maxage;
+
+	cache_dump_hdrs(htx, object, &trash);
+
+	shctx_lock(shctx);
+	if (!shctx_row_reserve_hot(shctx, first, trash.data)) {
+		shctx_unlock(shctx);
+		goto abort;
+	}
+	shctx_unlock(shctx);
 
-	rule->arg.act.p[0] = cconf;
-	return 1;
+	if (shctx_row_data_append(shctx, first, NULL, (unsigned char *)trash.area, trash.data) < 0)
+		goto abort;
+	goto end;
 
-  err:
-	free(cconf);
-	return 0;
+  abort:
+	shctx_lock(shctx);
+	first->len = 0;
+	shctx_row_dec_hot(shctx, first);
+	shctx_unlock(shctx);
+	reval->first = NULL;
+  end:
+	free_trash_chunk(buf);
 }
 
-enum act_parse_ret parse_cache_store(const char **args, int *orig_arg, struct proxy *proxy,
-                                          struct act_rule *rule, char **err)
+/* httpclient callback called when some payload is received. It is appended
+ * as DATA blocks to the new object, if any, or dropped.
+ */
+static void cache_reval_res_payload(struct httpclient *hc)
 {
-	rule->action       = ACT_CUSTOM;
-	rule->action_ptr   = http_action_store_cache;
+	struct cache_reval *reval = hc->caller;
+	struct shared_context *shctx = shctx_ptr(reval->cache);
+	struct shared_block *first = reval->first;
+	uint32_t info;
+	size_t len;
+
+	while (b_data(&hc->res.buf)) {
+		len = MIN(b_contig_data(&hc->res.buf, 0), b_size(&trash) - sizeof(info));
+
+		if (first) {
+			chunk_reset(&trash);
+			info = (HTX_BLK_DATA << 28) + len;
+			chunk_memcat(&trash, (char *)&info, sizeof(info));
+			chunk_memcat(&trash, b_head(&hc->res.buf), len);
+
+			shctx_lock(shctx);
+			if (!shctx_row_reserve_hot(shctx, first, trash.data)) {
+				shctx_unlock(shctx);
+				goto abort;
+			}
+			shctx_unlock(shctx);
 
-	if (!parse_cache_rule(proxy, args[*orig_arg], rule, err))
-		return ACT_RET_PRS_ERR;
+			if (shctx_row_data_append(shctx, first, first->last_append,
+						  (unsigned char *)trash.area, trash.data) < 0)
+				goto abort;
+		}
+		reval->received += len;
+		b_del(&hc->res.buf, len);
+		continue;
 
-	(*orig_arg)++;
-	return ACT_RET_PRS_OK;
+	  abort:
+		shctx_lock(shctx);
+		first->len = 0;
+		shctx_row_dec_hot(shctx, first);
+		shctx_unlock(shctx);
+		reval->first = first = NULL;
+	}
 }
 
-/* This produces a sha1 hash of the concatenation of the HTTP method,
- * the first occurrence of the Host header followed by the path component
- * if it begins with a slash ('/'). */
-int sha1_hosturi(struct stream *s)
+/* httpclient callback called when the revalidation ends, successfully or not.
+ * It updates or replaces the stale entry depending on the response, then
+ * releases the revalidation context.
+ */
+static void cache_reval_res_end(struct httpclient *hc)
 {
-	struct http_txn *txn = s->txn;
-	struct htx *htx = htxbuf(&s->req.buf);
-	struct htx_sl *sl;
-	struct http_hdr_ctx ctx;
-	struct ist uri;
-	blk_SHA_CTX sha1_ctx;
-	struct buffer *trash;
-
-	trash = get_trash_chunk();
-	ctx.blk = NULL;
+	struct cache_reval *reval = hc->caller;
+	struct cache *cache = reval->cache;
+	struct shared_context *shctx = shctx_ptr(cache);
+	struct cache_entry *stale = (struct cache_entry *)reval->stale->data;
+	struct cache_entry *object;
+	int stored = 0, invalidate = 0;
+	char hash[20];
 
-	sl = http_get_stline(htx);
-	uri = htx_sl_req_uri(sl); // whole uri
-	if (!uri.len)
-		return 0;
+	shctx_lock(shctx);
+	if (reval->maxage >= 0) {
+		/* still valid (304 or 200 with the same validators) */
+		stale->latest_validation = date.tv_sec;
+		stale->expire = date.tv_sec + reval->maxage;
+		stale->age = 0;
+		stale->stale_while_revalidate = reval->swr;
+		stale->stale_if_error = reval->sie;
+	}
+	else if (hc->res.status == 200 && reval->first && reval->received == reval->clen) {
+		/* replace the stale entry with the new object */
+		object = (struct cache_entry *)reval->first->data;
+		if (stale->eb.key)
+			delete_entry(stale);
+		stale->eb.key = 0;
 
-	/* In HTTP/1, most URIs are seen in origin form ('/path/to/resource'),
-	 * unless haproxy is deployed in front of an outbound cache. In HTTP/2,
-	 * URIs are almost always sent in absolute form with their scheme. In
-	 * this case, the scheme is almost always "https". In order to support
-	 * sharing of cache objects between H1 and H2, we'll hash the absolute
-	 * URI whenever known, or prepend "https://" + the Host header for
-	 * relative URIs. The difference will only appear on absolute HTTP/1
-	 * requests sent to an origin server, which practically is never met in
-	 * the real world so we don't care about the ability to share the same
-	 * key here.URIs are normalized from the absolute URI to an origin form as
-	 * well.
-	 */
-	if (!(sl->flags & HTX_SL_F_HAS_AUTHORITY)) {
-		chunk_istcat(trash, ist("https://"));
-		if (!http_find_header(htx, ist("Host"), &ctx, 0))
-			return 0;
-		chunk_istcat(trash, ctx.value);
+		object->complete = 1;
+		object->eb.key = read_u32(object->hash);
+		if (insert_entry(cache, object) != &object->eb)
+			object->eb.key = 0;
+		else {
+			memcpy(hash, object->hash, sizeof(hash));
+			stored = invalidate = 1;
+		}
+	}
+	else if (hc->res.status && hc->res.status < 500) {
+		/* the object changed but could not be stored, don't serve the
+		 * stale one anymore, nor its copy on disk.
+		 */
+		if (stale->eb.key)
+			delete_entry(stale);
+		stale->eb.key = 0;
+		memcpy(hash, stale->hash, sizeof(hash));
+		invalidate = 1;
 	}
+	/* otherwise the server failed, the stale entry is kept */
 
-	chunk_istcat(trash, uri);
+	if (reval->first) {
+		if (!stored)
+			reval->first->len = 0;
+		shctx_row_dec_hot(shctx, reval->first);
+	}
+	stale->revalidating = 0;
+	shctx_row_dec_hot(shctx, reval->stale);
+	shctx_unlock(shctx);
 
-	/* hash everything */
-	blk_SHA1_Init(&sha1_ctx);
-	blk_SHA1_Update(&sha1_ctx, trash->area, trash->data);
-	blk_SHA1_Final((unsigned char *)txn->cache_hash, &sha1_ctx);
+	if (invalidate)
+		cache_disk_invalidate(cache, hash);
 
-	return 1;
+	hc->caller = NULL;
+	free(reval);
 }
 
-/* Looks for "If-None-Match" headers in the request and compares their value
- * with the one that might have been stored in the cache_entry. If any of them
- * matches, a "304 Not Modified" response should be sent instead of the cached
- * data.
- * Although unlikely in a GET/HEAD request, the "If-None-Match: *" syntax is
- * valid and should receive a "304 Not Modified" response (RFC 7234#4.3.2).
- *
- * If no "If-None-Match" header was found, look for an "If-Modified-Since"
- * header and compare its value (date) to the one stored in the cache_entry.
- * If the request's date is later than the cached one, we also send a
- * "304 Not Modified" response (see RFCs 7232#3.3 and 7234#4.3.2).
- *
- * Returns 1 if "304 Not Modified" should be sent, 0 otherwise.
+/* Starts the background revalidation of stale entry <entry> of <cache>, which
+ * is being served to stream <s>, unless one is already running. The request is
+ * sent with the httpclient through backend <be>, which applies its rules and
+ * load-balancing, with the validators of the entry and the headers it varies
+ * on. The cache is bypassed for this request.
  */
-static int should_send_notmodified_response(struct cache *cache, struct htx *htx,
-                                            struct cache_entry *entry)
+static void cache_revalidate(struct cache *cache, struct stream *s, struct proxy *be, struct cache_entry *entry)
 {
-	int retval = 0;
+	struct shared_context *shctx = shctx_ptr(cache);
+	struct htx *htx = htxbuf(&s->req.buf);
+	struct http_hdr hdrs[5];
+	struct http_hdr_ctx ctx;
+	struct http_uri_parser parser;
+	struct cache_reval *reval = NULL;
+	struct httpclient *hc = NULL;
+	struct htx_sl *sl;
+	struct buffer *url, *cond;
+	struct ist host, path;
+	int nbhdrs = 0;
 
-	struct http_hdr_ctx ctx = { .blk = NULL };
-	struct ist cache_entry_etag = IST_NULL;
-	struct buffer *etag_buffer = NULL;
-	int if_none_match_found = 0;
+	if (!be_usable_srv(be))
+		return;
 
-	struct tm tm = {};
-	time_t if_modified_since = 0;
+	sl = http_get_stline(htx);
+	ctx.blk = NULL;
+	if (!sl || !http_find_header(htx, ist("host"), &ctx, 1))
+		return;
+	host = ctx.value;
+	parser = http_uri_parser_init(htx_sl_req_uri(sl));
+	path = http_parse_path(&parser);
+	if (!isttest(path))
+		path = ist("/");
+
+	/* mark the entry and keep it in memory until the end */
+	shctx_lock(shctx);
+	if (entry->revalidating) {
+		shctx_unlock(shctx);
+		return;
+	}
+	entry->revalidating = 1;
+	shctx_row_inc_hot(shctx, block_ptr(entry));
+	shctx_unlock(shctx);
 
-	/* If we find a "If-None-Match" header in the request, rebuild the
-	 * cache_entry's ETag in order to perform comparisons.
-	 * There could be multiple "if-none-match" header lines. */
-	while (http_find_header(htx, ist("if-none-match"), &ctx, 0)) {
-		if_none_match_found = 1;
+	url = get_trash_chunk();
+	chunk_printf(url, "http://%.*s%.*s",
+		     (int)istlen(host), istptr(host), (int)istlen(path), istptr(path));
+
+	cond = get_trash_chunk();
+	if (entry->etag_length) {
+		/* the row is hot, it may be read without the lock */
+		if (entry->etag_length > b_size(cond) ||
+		    shctx_row_data_get(shctx, block_ptr(entry), (unsigned char *)cond->area,
+				       entry->etag_offset, entry->etag_length) != 0)
+			goto fail;
+		cond->data = entry->etag_length;
+		hdrs[nbhdrs++] = (struct http_hdr){ ist("if-none-match"), ist2(cond->area, cond->data) };
+	}
+	else if (entry->last_modified) {
+		struct tm tm;
 
-		/* A '*' matches everything. */
-		if (isteq(ctx.value, ist("*")) != 0) {
-			retval = 1;
-			break;
-		}
+		get_gmtime(entry->last_modified, &tm);
+		cond->data = strftime(cond->area, b_size(cond), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+		hdrs[nbhdrs++] = (struct http_hdr){ ist("if-modified-since"), ist2(cond->area, cond->data) };
+	}
 
-		/* No need to rebuild an etag if none was stored in the cache. */
-		if (entry->etag_length == 0)
-			break;
+	/* the response must match the same variant */
+	ctx.blk = NULL;
+	if ((entry->secondary_key_signature & VARY_ACCEPT_ENCODING) &&
+	    http_find_header(htx, ist("accept-encoding"), &ctx, 1))
+		hdrs[nbhdrs++] = (struct http_hdr){ ist("accept-encoding"), ctx.value };
+	ctx.blk = NULL;
+	if ((entry->secondary_key_signature & VARY_REFERER) &&
+	    http_find_header(htx, ist("referer"), &ctx, 1))
+		hdrs[nbhdrs++] = (struct http_hdr){ ist("referer"), ctx.value };
+	hdrs[nbhdrs++] = (struct http_hdr){ ist("host"), host };
+	hdrs[nbhdrs] = (struct http_hdr){ IST_NULL, IST_NULL };
+
+	reval = calloc(1, sizeof(*reval));
+	if (!reval)
+		goto fail;
+	reval->cache = cache;
+	reval->stale = block_ptr(entry);
+	reval->maxage = -1;
+
+	hc = httpclient_new(reval, HTTP_METH_GET, ist2(url->area, url->data));
+	if (!hc)
+		goto fail;
+	hc->ops.res_headers = cache_reval_res_headers;
+	hc->ops.res_payload = cache_reval_res_payload;
+	hc->ops.res_end = cache_reval_res_end;
+	hc->be = be;
+	if (tick_isset(be->timeout.server))
+		httpclient_set_timeout(hc, be->timeout.server);
+
+	if (httpclient_req_gen(hc, hc->req.url, hc->req.meth, hdrs, IST_NULL) != ERR_NONE)
+		goto fail;
+
+	if (!httpclient_start(hc))
+		goto fail;
+
+	/* the httpclient releases itself once done */
+	hc->flags |= HTTPCLIENT_FA_AUTOKILL;
+	return;
 
-		/* Rebuild the stored ETag. */
-		if (etag_buffer == NULL) {
-			etag_buffer = get_trash_chunk();
+  fail:
+	httpclient_destroy(hc);
+	free(reval);
+	shctx_lock(shctx);
+	entry->revalidating = 0;
+	shctx_row_dec_hot(shctx, block_ptr(entry));
+	shctx_unlock(shctx);
+}
 
-			if (shctx_row_data_get(shctx_ptr(cache), block_ptr(entry),
-					       (unsigned char*)b_orig(etag_buffer),
-					       entry->etag_offset, entry->etag_length) == 0) {
-				cache_entry_etag = ist2(b_orig(etag_buffer), entry->etag_length);
-			} else {
-				/* We could not rebuild the ETag in one go, we
-				 * won't send a "304 Not Modified" response. */
-				break;
-			}
-		}
+/* Returns non-zero if the complete entry <entry> found for stream <s> may be
+ * delivered. Once expired, an entry may still be delivered within its
+ * stale-while-revalidate window, in which case a background revalidation is
+ * started, or within its stale-if-error window when the backend has no usable
+ * server.
+ */
+static int cache_entry_usable(struct cache *cache, struct stream *s, struct cache_entry *entry)
+{
+	struct proxy *be = s->be;
 
-		if (http_compare_etags(cache_entry_etag, ctx.value) == 1) {
-			retval = 1;
-			break;
-		}
-	}
+	if (entry->expire > date.tv_sec)
+		return 1;
 
-	/* If the request did not contain an "If-None-Match" header, we look for
-	 * an "If-Modified-Since" header (see RFC 7232#3.3). */
-	if (retval == 0 && if_none_match_found == 0) {
-		ctx.blk = NULL;
-		if (http_find_header(htx, ist("if-modified-since"), &ctx, 1)) {
-			if (parse_http_date(istptr(ctx.value), istlen(ctx.value), &tm)) {
-				if_modified_since = my_timegm(&tm);
+	/* "cache-use" may be evaluated before the backend is selected */
+	if (be == strm_fe(s) && be->defbe.be)
+		be = be->defbe.be;
 
-				/* We send a "304 Not Modified" response if the
-				 * entry's last modified date is earlier than
-				 * the one found in the "If-Modified-Since"
-				 * header. */
-				retval = (entry->last_modified <= if_modified_since);
-			}
-		}
+	if (date.tv_sec < entry->expire + entry->stale_while_revalidate) {
+		cache_revalidate(cache, s, be, entry);
+		return 1;
 	}
 
-	return retval;
+	return (date.tv_sec < entry->expire + entry->stale_if_error && !be_usable_srv(be));
 }
 
 enum act_return http_action_req_cache_use(struct act_rule *rule, struct proxy *px,
@@ -1780,12 +3556,46 @@ enum act_return http_action_req_cache_use(struct act_rule *rule, struct proxy *p
 	struct cache_flt_conf *cconf = rule->arg.act.p[0];
 	struct cache *cache = cconf->c.cache;
 	struct shared_block *entry_block;
+	struct cache_st *st = NULL;
+	struct filter *filter;
+	int promoted = 0;
+
+	/* With request collapsing, the cache filter context of the stream
+	 * tracks the fetch it performs or waits for.
+	 */
+	if (cache->collapse_timeout) {
+		list_for_each_entry(filter, &s->strm_flt.filters, list) {
+			if (FLT_ID(filter) == cache_store_flt_id && FLT_CONF(filter) == cconf) {
+				st = filter->ctx;
+				break;
+			}
+		}
+	}
+
+	if (!(flags & ACT_OPT_FIRST)) {
+		/* We're resuming after having waited for another stream to
+		 * fetch the same object. Wait until it is done, the timer
+		 * expires or the client aborts, then look the cache up again.
+		 */
+		if (!st)
+			return ACT_RET_CONT;
 
+		if (HA_ATOMIC_LOAD(&st->pending)) {
+			if (!(flags & ACT_OPT_FINAL) && !tick_is_expired(s->req.analyse_exp, now_ms))
+				return ACT_RET_YIELD;
+			cache_release_pending(cache, st);
+		}
+		s->req.analyse_exp = TICK_ETERNITY;
+		goto lookup;
+	}
 
-	/* Ignore cache for HTTP/1.0 requests and for requests other than GET
-	 * and HEAD */
+	/* Ignore cache for HTTP/1.0 requests, for requests other than GET
+	 * and HEAD, and for the background revalidations which must reach a
+	 * server.
+	 */
 	if (!(txn->req.flags & HTTP_MSGF_VER_11) ||
-	    (txn->meth != HTTP_METH_GET && txn->meth != HTTP_METH_HEAD))
+	    (txn->meth != HTTP_METH_GET && txn->meth != HTTP_METH_HEAD) ||
+	    (strm_fe(s)->cap & PR_CAP_HTTPCLIENT))
 		txn->flags |= TX_CACHE_IGNORE;
 
 	http_check_request_for_cacheability(s, &s->req);
@@ -1805,6 +3615,7 @@ enum act_return http_action_req_cache_use(struct act_rule *rule, struct proxy *p
 	else
 		_HA_ATOMIC_INC(&px->be_counters.p.http.cache_lookups);
 
+  lookup:
 	shctx_lock(shctx_ptr(cache));
 	res = entry_exist(cache, s->txn->cache_hash);
 	/* We must not use an entry that is not complete but the check will be
@@ -1838,13 +3649,22 @@ enum act_return http_action_req_cache_use(struct act_rule *rule, struct proxy *p
 		}
 
 		/* We either looked for a valid secondary entry and could not
-		 * find one, or the entry we want to use is not complete. We
-		 * can't use the cache's entry and must forward the request to
-		 * the server. */
-		if (!res || !res->complete) {
+		 * find one, or the entry we want to use is not complete or too
+		 * stale. We can't use the cache's entry and must forward the
+		 * request to the server. */
+		if (!res || !res->complete || !cache_entry_usable(cache, s, res)) {
 			shctx_lock(shctx_ptr(cache));
 			shctx_row_dec_hot(shctx_ptr(cache), entry_block);
 			shctx_unlock(shctx_ptr(cache));
+			/* the variant we want may still be on disk */
+			if (!res && cache->disk && !promoted) {
+				promoted = 1;
+				if (cache_disk_promote(cache, s))
+					goto lookup;
+			}
+			if (cache_collapse_miss(cache, st, s))
+				return ACT_RET_YIELD;
+			cache_drop_full_range(s);
 			return ACT_RET_CONT;
 		}
 
@@ -1859,6 +3679,9 @@ enum act_return http_action_req_cache_use(struct act_rule *rule, struct proxy *p
 			ctx->sent = 0;
 			ctx->send_notmodified =
                                 should_send_notmodified_response(cache, htxbuf(&s->req.buf), res);
+			ctx->ranges = NULL;
+			if (txn->meth == HTTP_METH_GET && !ctx->send_notmodified)
+				ctx->ranges = cache_parse_ranges(cache, htxbuf(&s->req.buf), res);
 
 			if (px == strm_fe(s))
 				_HA_ATOMIC_INC(&px->fe_counters.p.http.cache_hits);
@@ -1875,6 +3698,19 @@ enum act_return http_action_req_cache_use(struct act_rule *rule, struct proxy *p
 	}
 	shctx_unlock(shctx_ptr(cache));
 
+	/* The object may have been demoted to the disk tier */
+	if (cache->disk && !promoted) {
+		promoted = 1;
+		if (cache_disk_promote(cache, s))
+			goto lookup;
+	}
+
+	/* Another stream may already be fetching this object */
+	if (cache_collapse_miss(cache, st, s))
+		return ACT_RET_YIELD;
+
+	cache_drop_full_range(s);
+
 	/* Shared context does not need to be locked while we calculate the
 	 * secondary hash. */
 	if (!res && cache->vary_processing_enabled) {
@@ -1988,6 +3824,19 @@ int cfg_parse_cache(const char *file, int linenum, char **args, int kwm)
 		}
 
 		tmp_cache_config->maxage = atoi(args[1]);
+	} else if (strcmp(args[0], "max-stale") == 0) {
+		if (alertif_too_many_args(1, file, linenum, args, &err_code)) {
+			err_code |= ERR_ABORT;
+			goto out;
+		}
+
+		if (!*args[1]) {
+			ha_warning("parsing [%s:%d]: '%s' expects a duration parameter in seconds.\n",
+			        file, linenum, args[0]);
+			err_code |= ERR_WARN;
+		}
+
+		tmp_cache_config->maxstale = atoi(args[1]);
 	} else if (strcmp(args[0], "max-object-size") == 0) {
 		unsigned int maxobjsz;
 		char *err;
@@ -2054,6 +3903,67 @@ int cfg_parse_cache(const char *file, int linenum, char **args, int kwm)
 			goto out;
 		}
 		tmp_cache_config->max_secondary_entries = max_sec_entries;
+	} else if (strcmp(args[0], "collapse-timeout") == 0) {
+		const char *res;
+		unsigned int timeout;
+
+		if (alertif_too_many_args(1, file, linenum, args, &err_code)) {
+			err_code |= ERR_ABORT;
+			goto out;
+		}
+
+		if (!*args[1]) {
+			ha_alert("parsing [%s:%d]: '%s' expects a timeout value.\n",
+				 file, linenum, args[0]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+
+		res = parse_time_err(args[1], &timeout, TIME_UNIT_MS);
+		if (res == PARSE_TIME_OVER || res == PARSE_TIME_UNDER || res) {
+			ha_alert("parsing [%s:%d]: invalid value '%s' for '%s'.\n",
+				 file, linenum, args[1], args[0]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+		tmp_cache_config->collapse_timeout = timeout;
+	} else if (strcmp(args[0], "disk-path") == 0) {
+		if (alertif_too_many_args(1, file, linenum, args, &err_code)) {
+			err_code |= ERR_ABORT;
+			goto out;
+		}
+
+		if (!*args[1]) {
+			ha_alert("parsing [%s:%d]: '%s' expects a directory.\n",
+				 file, linenum, args[0]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+
+		free(tmp_cache_config->disk_path);
+		tmp_cache_config->disk_path = strdup(args[1]);
+		if (!tmp_cache_config->disk_path) {
+			ha_alert("parsing [%s:%d]: out of memory.\n", file, linenum);
+			err_code |= ERR_ALERT | ERR_ABORT;
+			goto out;
+		}
+	} else if (strcmp(args[0], "disk-max-size") == 0) {
+		unsigned long int maxsize;
+		char *err;
+
+		if (alertif_too_many_args(1, file, linenum, args, &err_code)) {
+			err_code |= ERR_ABORT;
+			goto out;
+		}
+
+		maxsize = strtoul(args[1], &err, 10);
+		if (err == args[1] || *err != '\0' || !maxsize || maxsize > UINT_MAX) {
+			ha_alert("parsing [%s:%d]: '%s' expects a strictly positive size in megabytes, got '%s'.\n",
+				 file, linenum, args[0], args[1]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+		tmp_cache_config->disk_max_size = maxsize;
 	}
 	else if (*args[0] != 0) {
 		ha_alert("parsing [%s:%d] : unknown keyword '%s' in 'cache' section\n", file, linenum, args[0]);
@@ -2089,6 +3999,17 @@ int cfg_post_parse_section_cache()
 			goto out;
 		}
 
+		if (tmp_cache_config->disk_path && !tmp_cache_config->disk_max_size) {
+			ha_alert("\"disk-path\" requires \"disk-max-size\" for cache '%s'\n", tmp_cache_config->id);
+			err_code |= ERR_FATAL | ERR_ALERT;
+			goto out;
+		}
+		else if (!tmp_cache_config->disk_path && tmp_cache_config->disk_max_size) {
+			ha_alert("\"disk-max-size\" requires \"disk-path\" for cache '%s'\n", tmp_cache_config->id);
+			err_code |= ERR_FATAL | ERR_ALERT;
+			goto out;
+		}
+
 		/* add to the list of cache to init and reinit tmp_cache_config
 		 * for next cache section, if any.
 		 */
@@ -2097,6 +4018,8 @@ int cfg_post_parse_section_cache()
 		return err_code;
 	}
 out:
+	if (tmp_cache_config)
+		ha_free(&tmp_cache_config->disk_path);
 	ha_free(&tmp_cache_config);
 	return err_code;
 
@@ -2131,10 +4054,23 @@ int post_check_cache()
 		memcpy(shctx->data, cache_config, sizeof(struct cache));
 		cache = (struct cache *)shctx->data;
 		cache->entries = EB_ROOT;
+		cache->pending = EB_ROOT;
 		LIST_APPEND(&caches, &cache->list);
 		LIST_DELETE(&cache_config->list);
 		free(cache_config);
 
+		if (cache->disk_path) {
+			char *err = NULL;
+
+			cache->disk = cache_disk_init(cache, &err);
+			if (!cache->disk) {
+				ha_alert("Unable to create the disk tier of cache '%s': %s.\n", cache->id, err);
+				free(err);
+				err_code |= ERR_FATAL | ERR_ALERT;
+				goto out;
+			}
+		}
+
 		/* Find all references for this cache in the existing filters
 		 * (over all proxies) and reference it in matching filters.
 		 */
@@ -2619,6 +4555,15 @@ static int cli_io_handler_show_cache(struct appctx *appctx)
 		next_key = ctx->next_key;
 		if (!next_key) {
 			chunk_printf(&trash, "%p: %s (shctx:%p, available blocks:%d)\n", cache, cache->id, shctx_ptr(cache), shctx_ptr(cache)->nbav);
+			if (cache->disk) {
+				struct cache_disk *disk = cache->disk;
+
+				HA_RWLOCK_RDLOCK(CACHE_LOCK, &disk->lock);
+				chunk_appendf(&trash, "  disk tier: %s (used:%llu/%llu bytes, entries:%u, demoted:%llu, promoted:%llu)\n",
+					      cache->disk_path, (ullong)disk->used, (ullong)disk->size,
+					      disk->nb_entries, disk->demoted, HA_ATOMIC_LOAD(&disk->promoted));
+				HA_RWLOCK_RDUNLOCK(CACHE_LOCK, &disk->lock);
+			}
 			if (applet_putchk(appctx, &trash) == -1)
 				return 0;
 		}
@@ -2638,7 +4583,7 @@ static int cli_io_handler_show_cache(struct appctx *appctx)
 			entry = container_of(node, struct cache_entry, eb);
 			next_key = node->key + 1;
 
-			if (entry->expire > date.tv_sec) {
+			if (cache_entry_deadline(entry) > date.tv_sec) {
 				chunk_printf(&trash, "%p hash:%u vary:0x", entry, read_u32(entry->hash));
 				for (i = 0; i < HTTP_CACHE_SEC_KEY_LEN; ++i)
 					chunk_appendf(&trash, "%02x", (unsigned char)entry->secondary_key[i]);
@@ -42,7 +42,7 @@ static const char *common_kw_list[] = {
 	"tune.sndbuf.client", "tune.sndbuf.server", "tune.pipesize",
 	"tune.http.cookielen", "tune.http.logurilen", "tune.http.maxhdr",
 	"tune.comp.maxlevel", "tune.pattern.cache-size",
-	"tune.fast-forward", "uid", "gid",
+	"tune.pattern.ip-trie-threshold", "tune.fast-forward", "uid", "gid",
 	"external-check", "user", "group", "nbproc", "maxconn",
 	"ssl-server-verify", "maxconnrate", "maxsessrate", "maxsslrate",
 	"maxcomprate", "maxpipes", "maxzlibmem", "maxcompcpuusage", "ulimit-n",
@@ -130,12 +130,60 @@ int cfg_parse_global(const char *file, int linenum, char **args, int kwm)
 		global.tune.options |= GTUNE_NO_QUIC;
 	}
 	else if (strcmp(args[0], "busy-polling") == 0) { /* "no busy-polling" or "busy-polling" */
-		if (alertif_too_many_args(0, file, linenum, args, &err_code))
-			goto out;
-		if (kwm == KWM_NO)
+		int cur_arg;
+
+		if (kwm == KWM_NO) {
+			if (alertif_too_many_args(0, file, linenum, args, &err_code))
+				goto out;
 			global.tune.options &= ~GTUNE_BUSY_POLLING;
-		else
-			global.tune.options |=  GTUNE_BUSY_POLLING;
+			goto out;
+		}
+
+		global.tune.options |=  GTUNE_BUSY_POLLING;
+		for (cur_arg = 1; *args[cur_arg]; cur_arg += 2) {
+			if (strcmp(args[cur_arg], "window") == 0 && *args[cur_arg + 1]) {
+				const char *res;
+				uint window;
+
+				res = parse_time_err(args[cur_arg + 1], &window, TIME_UNIT_US);
+				if (res) {
+					ha_alert("parsing [%s:%d] : '%s %s' expects a time in microseconds (or with a unit), got '%s'.\n",
+						 file, linenum, args[0], args[cur_arg], args[cur_arg + 1]);
+					err_code |= ERR_ALERT | ERR_FATAL;
+					goto out;
+				}
+				global.tune.busy_poll_window = window;
+			}
+			else if (strcmp(args[cur_arg], "thread-groups") == 0 && *args[cur_arg + 1]) {
+				char *p = args[cur_arg + 1];
+				long low, high;
+
+				/* comma-delimited list of group numbers or ranges */
+				global.tune.busy_poll_tgroups = 0;
+				while (*p) {
+					low = high = strtol(p, &p, 10);
+					if (*p == '-')
+						high = strtol(p + 1, &p, 10);
+					if (low < 1 || high < low || high > MIN(MAX_TGROUPS, LONGBITS) ||
+					    (*p && *p != ',')) {
+						ha_alert("parsing [%s:%d] : '%s %s' expects a list of thread group numbers or ranges between 1 and %d, got '%s'.\n",
+							 file, linenum, args[0], args[cur_arg], MIN(MAX_TGROUPS, LONGBITS), args[cur_arg + 1]);
+						err_code |= ERR_ALERT | ERR_FATAL;
+						goto out;
+					}
+					for (; low <= high; low++)
+						global.tune.busy_poll_tgroups |= 1UL << (low - 1);
+					if (*p)
+						p++;
+				}
+			}
+			else {
+				ha_alert("parsing [%s:%d] : '%s' only supports 'window <time>' and 'thread-groups <list>', got '%s'.\n",
+					 file, linenum, args[0], args[cur_arg]);
+				err_code |= ERR_ALERT | ERR_FATAL;
+				goto out;
+			}
+		}
 	}
 	else if (strcmp(args[0], "set-dumpable") == 0) { /* "no set-dumpable" or "set-dumpable" */
 		if (alertif_too_many_args(0, file, linenum, args, &err_code))
@@ -504,6 +552,17 @@ int cfg_parse_global(const char *file, int linenum, char **args, int kwm)
 			goto out;
 		}
 	}
+	else if (strcmp(args[0], "tune.pattern.ip-trie-threshold") == 0) {
+		if (alertif_too_many_args(1, file, linenum, args, &err_code))
+			goto out;
+		if (*(args[1]) == 0 || atoi(args[1]) < 0) {
+			ha_alert("parsing [%s:%d] : '%s' expects a positive numeric value\n",
+				 file, linenum, args[0]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+		global.tune.pattern_ip_trie = atoi(args[1]);
+	}
 	else if (strcmp(args[0], "tune.disable-fast-forward") == 0) {
 		if (!experimental_directives_allowed) {
 			ha_alert("parsing [%s:%d] : '%s' directive is experimental, must be allowed via a global 'expose-experimental-directives'",
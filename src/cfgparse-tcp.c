@@ -69,6 +69,15 @@ static int bind_parse_defer_accept(char **args, int cur_arg, struct proxy *px, s
 }
 #endif
 
+#if defined(SO_INCOMING_CPU) && defined(USE_CPU_AFFINITY)
+/* parse the "incoming-cpu" bind keyword */
+static int bind_parse_incoming_cpu(char **args, int cur_arg, struct proxy *px, struct bind_conf *conf, char **err)
+{
+	conf->options |= BC_O_INCOMING_CPU;
+	return 0;
+}
+#endif
+
 #ifdef TCP_FASTOPEN
 /* parse the "tfo" bind keyword */
 static int bind_parse_tfo(char **args, int cur_arg, struct proxy *px, struct bind_conf *conf, char **err)
@@ -78,6 +87,39 @@ static int bind_parse_tfo(char **args, int cur_arg, struct proxy *px, struct bin
 }
 #endif
 
+#ifdef SO_BUSY_POLL
+/* parse the "busy-poll" bind keyword */
+static int bind_parse_busy_poll(char **args, int cur_arg, struct proxy *px, struct bind_conf *conf, char **err)
+{
+	const char *ptr = NULL;
+	unsigned int delay;
+
+	if (!*args[cur_arg + 1]) {
+		memprintf(err, "'%s' : missing busy polling delay", args[cur_arg]);
+		return ERR_ALERT | ERR_FATAL;
+	}
+
+	ptr = parse_time_err(args[cur_arg + 1], &delay, TIME_UNIT_US);
+	if (ptr == PARSE_TIME_OVER) {
+		memprintf(err, "timer overflow in argument '%s' to '%s' (maximum value is 2147483647 us)",
+			  args[cur_arg+1], args[cur_arg]);
+		return ERR_ALERT | ERR_FATAL;
+	}
+	else if (ptr == PARSE_TIME_UNDER) {
+		memprintf(err, "timer underflow in argument '%s' to '%s' (minimum non-null value is 1 us)",
+			  args[cur_arg+1], args[cur_arg]);
+		return ERR_ALERT | ERR_FATAL;
+	}
+	else if (ptr) {
+		memprintf(err, "'%s' : expects a positive delay in microseconds", args[cur_arg]);
+		return ERR_ALERT | ERR_FATAL;
+	}
+
+	conf->busy_poll = delay;
+	return 0;
+}
+#endif
+
 #ifdef TCP_MAXSEG
 /* parse the "mss" bind keyword */
 static int bind_parse_mss(char **args, int cur_arg, struct proxy *px, struct bind_conf *conf, char **err)
@@ -221,9 +263,15 @@ static int srv_parse_tcp_ut(char **args, int *cur_arg, struct proxy *px, struct
  * not enabled.
  */
 static struct bind_kw_list bind_kws = { "TCP", { }, {
+#ifdef SO_BUSY_POLL
+	{ "busy-poll",     bind_parse_busy_poll,    1 }, /* enable kernel busy polling on the socket */
+#endif
 #if defined(TCP_DEFER_ACCEPT) || defined(SO_ACCEPTFILTER)
 	{ "defer-accept",  bind_parse_defer_accept, 0 }, /* wait for some data for 1 second max before doing accept */
 #endif
+#if defined(SO_INCOMING_CPU) && defined(USE_CPU_AFFINITY)
+	{ "incoming-cpu",  bind_parse_incoming_cpu, 0 }, /* steer connections to the shard running on the receiving CPU */
+#endif
 #ifdef SO_BINDTODEVICE
 	{ "interface",     bind_parse_interface,    1 }, /* specifically bind to this interface */
 #endif
@@ -247,7 +295,9 @@ static struct bind_kw_list bind_kws = { "TCP", { }, {
 	{ "namespace",     bind_parse_namespace,    1 },
 #endif
 	/* the versions with the NULL parse function*/
+	{ "busy-poll",     NULL,  1 },
 	{ "defer-accept",  NULL,  0 },
+	{ "incoming-cpu",  NULL,  0 },
 	{ "interface",     NULL,  1 },
 	{ "mss",           NULL,  1 },
 	{ "transparent",   NULL,  0 },
@@ -848,6 +848,7 @@ int cfg_parse_peers(const char *file, int linenum, char **args, int kwm)
 		curpeers->last_change = ns_to_sec(now_ns);
 		curpeers->id = strdup(args[1]);
 		curpeers->disabled = 0;
+		curpeers->nb_sessions = 1;
 	}
 	else if (strcmp(args[0], "peer") == 0 ||
 	         strcmp(args[0], "server") == 0) { /* peer or server definition */
@@ -1005,6 +1006,23 @@ int cfg_parse_peers(const char *file, int linenum, char **args, int kwm)
 
 		nb_shards = curpeers->nb_shards;
 	}
+	else if (strcmp(args[0], "sessions-per-peer") == 0) {
+		char *endptr;
+
+		if (!*args[1]) {
+			ha_alert("parsing [%s:%d] : '%s' : missing value\n", file, linenum, args[0]);
+			err_code |= ERR_FATAL;
+			goto out;
+		}
+
+		curpeers->nb_sessions = strtol(args[1], &endptr, 10);
+		if (*endptr != '\0' || curpeers->nb_sessions < 1 || curpeers->nb_sessions > PEER_MAX_SESSIONS) {
+			ha_alert("parsing [%s:%d] : '%s' : expects an integer argument between 1 and %d, found '%s'\n",
+			         file, linenum, args[0], PEER_MAX_SESSIONS, args[1]);
+			err_code |= ERR_FATAL;
+			goto out;
+		}
+	}
 	else if (strcmp(args[0], "table") == 0) {
 		struct stktable *t, *other;
 		char *id;
@@ -40,6 +40,7 @@ THREAD_LOCAL struct timeval      date;            /* the real current date (wall
 
 static THREAD_LOCAL struct timeval before_poll;   /* system date before calling poll() */
 static THREAD_LOCAL struct timeval after_poll;    /* system date after leaving poll() */
+static THREAD_LOCAL struct timeval last_date;     /* last system date accepted as the local date */
 static THREAD_LOCAL unsigned int samp_time;       /* total elapsed time over current sample */
 static THREAD_LOCAL unsigned int idle_time;       /* total idle time over current sample */
 static THREAD_LOCAL unsigned int iso_time_sec;     /* last iso time value for this thread */
@@ -212,12 +213,16 @@ void clock_update_local_date(int max_wait, int interrupted)
 	 *    - in any case the new date cannot be newer than
 	 *      before_poll+max_wait+some margin (100ms used here).
 	 * In case of violation, we'll ignore the current date and instead
-	 * restart from the last date we knew.
+	 * restart from the last date we knew. A poller may be called several
+	 * times in a row without sleeping (busy-polling), so the reference
+	 * is in fact the last date that was accepted, which is before_poll
+	 * for the first call, otherwise spinning for more than the margin
+	 * would be mistaken for a jump forwards and would freeze the time.
 	 */
-	_tv_ms_add(&min_deadline, &before_poll, max_wait);
-	_tv_ms_add(&max_deadline, &before_poll, max_wait + 100);
+	_tv_ms_add(&min_deadline, &last_date, max_wait);
+	_tv_ms_add(&max_deadline, &last_date, max_wait + 100);
 
-	if (unlikely(__tv_islt(&date, &before_poll)                    || // big jump backwards
+	if (unlikely(__tv_islt(&date, &last_date)                      || // big jump backwards
 		     (!interrupted && __tv_islt(&date, &min_deadline)) || // small jump backwards
 		     __tv_islt(&max_deadline, &date))) {                  // big jump forwards
 		if (!interrupted)
@@ -228,6 +233,7 @@ void clock_update_local_date(int max_wait, int interrupted)
 		 * independent signed ints.
 		 */
 		now_ns = tv_to_ns(&date) + HA_ATOMIC_LOAD(&now_offset);
+		last_date = date;
 	}
 	now_ms = ns_to_ms(now_ns);
 }
@@ -285,7 +291,7 @@ void clock_init_process_date(void)
 {
 	now_offset = 0;
 	gettimeofday(&date, NULL);
-	after_poll = before_poll = date;
+	last_date = after_poll = before_poll = date;
 	now_ns = global_now_ns = tv_to_ns(&date);
 	global_now_ms = ns_to_ms(now_ns);
 
@@ -315,7 +321,7 @@ void clock_adjust_now_offset(void)
 void clock_init_thread_date(void)
 {
 	gettimeofday(&date, NULL);
-	after_poll = before_poll = date;
+	last_date = after_poll = before_poll = date;
 
 	now_ns = _HA_ATOMIC_LOAD(&global_now_ns);
 	th_ctx->idle_pct = 100;
@@ -396,6 +402,7 @@ void clock_entering_poll(void)
 	int64_t stolen;
 
 	gettimeofday(&before_poll, NULL);
+	last_date = before_poll;
 
 	run_time = (before_poll.tv_sec - after_poll.tv_sec) * 1000000U + (before_poll.tv_usec - after_poll.tv_usec);
 
@@ -60,6 +60,20 @@ static int global_tune_zlibwindowsize = MAX_WBITS;  /* zlib window size */
 
 #endif
 
+#ifdef USE_SLZ
+static int global_tune_slzmaxlevel = 1;             /* highest SLZ level, 2 with tune.slz.high-ratio */
+#endif
+
+#ifdef USE_ZSTD
+static int global_tune_zstdlevel = 3;               /* zstd compression level */
+static int global_tune_zstdwindowsize = 18;         /* zstd window log */
+#endif
+
+#ifdef USE_BROTLI
+static int global_tune_brotlilevel = 4;             /* brotli quality */
+static int global_tune_brotliwindowsize = 18;       /* brotli window log */
+#endif
+
 unsigned int compress_min_idle = 0;
 
 static int identity_init(struct comp_ctx **comp_ctx, int level);
@@ -90,6 +104,26 @@ static int deflate_end(struct comp_ctx **comp_ctx);
 
 #endif /* USE_ZLIB */
 
+#if defined(USE_ZSTD)
+
+static int zstd_init(struct comp_ctx **comp_ctx, int level);
+static int zstd_add_data(struct comp_ctx *comp_ctx, const char *in_data, int in_len, struct buffer *out);
+static int zstd_flush(struct comp_ctx *comp_ctx, struct buffer *out);
+static int zstd_finish(struct comp_ctx *comp_ctx, struct buffer *out);
+static int zstd_end(struct comp_ctx **comp_ctx);
+
+#endif /* USE_ZSTD */
+
+#if defined(USE_BROTLI)
+
+static int brotli_init(struct comp_ctx **comp_ctx, int level);
+static int brotli_add_data(struct comp_ctx *comp_ctx, const char *in_data, int in_len, struct buffer *out);
+static int brotli_flush(struct comp_ctx *comp_ctx, struct buffer *out);
+static int brotli_finish(struct comp_ctx *comp_ctx, struct buffer *out);
+static int brotli_end(struct comp_ctx **comp_ctx);
+
+#endif /* USE_BROTLI */
+
 
 const struct comp_algo comp_algos[] =
 {
@@ -103,6 +137,12 @@ const struct comp_algo comp_algos[] =
 	{ "raw-deflate", 11, "deflate",  7, raw_def_init,  deflate_add_data,  deflate_flush,  deflate_finish,  deflate_end },
 	{ "gzip",         4, "gzip",     4, gzip_init,     deflate_add_data,  deflate_flush,  deflate_finish,  deflate_end },
 #endif /* USE_ZLIB */
+#if defined(USE_ZSTD)
+	{ "zstd",         4, "zstd",     4, zstd_init,     zstd_add_data,     zstd_flush,     zstd_finish,     zstd_end },
+#endif /* USE_ZSTD */
+#if defined(USE_BROTLI)
+	{ "brotli",       6, "br",       2, brotli_init,   brotli_add_data,   brotli_flush,   brotli_finish,   brotli_end },
+#endif /* USE_BROTLI */
 	{ NULL,       0, NULL,          0, NULL ,         NULL,              NULL,           NULL,           NULL }
 };
 
@@ -148,7 +188,7 @@ int comp_append_algo(struct comp_algo **algos, const char *algo)
 	return -1;
 }
 
-#if defined(USE_ZLIB) || defined(USE_SLZ)
+#if defined(USE_ZLIB) || defined(USE_SLZ) || defined(USE_ZSTD) || defined(USE_BROTLI)
 DECLARE_STATIC_POOL(pool_comp_ctx, "comp_ctx", sizeof(struct comp_ctx));
 
 /*
@@ -178,6 +218,12 @@ static inline int init_comp_ctx(struct comp_ctx **comp_ctx)
 	strm->zalloc = alloc_zlib;
 	strm->zfree = free_zlib;
 	strm->opaque = *comp_ctx;
+#endif
+#if defined(USE_ZSTD)
+	(*comp_ctx)->zstd = NULL;
+#endif
+#if defined(USE_BROTLI)
+	(*comp_ctx)->brotli = NULL;
 #endif
 	return 0;
 }
@@ -260,8 +306,8 @@ static int rfc1952_init(struct comp_ctx **comp_ctx, int level)
 	if (init_comp_ctx(comp_ctx) < 0)
 		return -1;
 
-	(*comp_ctx)->cur_lvl = !!level;
-	return slz_rfc1952_init(&(*comp_ctx)->strm, !!level);
+	(*comp_ctx)->cur_lvl = MIN(level, global_tune_slzmaxlevel);
+	return slz_rfc1952_init(&(*comp_ctx)->strm, (*comp_ctx)->cur_lvl);
 }
 
 /* SLZ's raw deflate format (RFC1951). Returns < 0 on error. */
@@ -270,8 +316,8 @@ static int rfc1951_init(struct comp_ctx **comp_ctx, int level)
 	if (init_comp_ctx(comp_ctx) < 0)
 		return -1;
 
-	(*comp_ctx)->cur_lvl = !!level;
-	return slz_rfc1951_init(&(*comp_ctx)->strm, !!level);
+	(*comp_ctx)->cur_lvl = MIN(level, global_tune_slzmaxlevel);
+	return slz_rfc1951_init(&(*comp_ctx)->strm, (*comp_ctx)->cur_lvl);
 }
 
 /* SLZ's zlib format (RFC1950). Returns < 0 on error. */
@@ -280,8 +326,8 @@ static int rfc1950_init(struct comp_ctx **comp_ctx, int level)
 	if (init_comp_ctx(comp_ctx) < 0)
 		return -1;
 
-	(*comp_ctx)->cur_lvl = !!level;
-	return slz_rfc1950_init(&(*comp_ctx)->strm, !!level);
+	(*comp_ctx)->cur_lvl = MIN(level, global_tune_slzmaxlevel);
+	return slz_rfc1950_init(&(*comp_ctx)->strm, (*comp_ctx)->cur_lvl);
 }
 
 /* Return the size of consumed data or -1. The output buffer is unused at this
@@ -366,7 +412,7 @@ static int rfc195x_flush_or_finish(struct comp_ctx *comp_ctx, struct buffer *out
 		if (comp_ctx->cur_lvl > 0)
 			strm->level = --comp_ctx->cur_lvl;
 	}
-	else if (comp_ctx->cur_lvl < global.tune.comp_maxlevel && comp_ctx->cur_lvl < 1) {
+	else if (comp_ctx->cur_lvl < global.tune.comp_maxlevel && comp_ctx->cur_lvl < global_tune_slzmaxlevel) {
 		strm->level = ++comp_ctx->cur_lvl;
 	}
 
@@ -391,6 +437,25 @@ static int rfc195x_end(struct comp_ctx **comp_ctx)
 	return 0;
 }
 
+/* config parser for global "tune.slz.high-ratio", accepts "on" or "off" */
+static int slz_parse_global_high_ratio(char **args, int section_type, struct proxy *curpx,
+                                       const struct proxy *defpx, const char *file, int line,
+                                       char **err)
+{
+	if (too_many_args(1, args, err, NULL))
+		return -1;
+
+	if (strcmp(args[1], "on") == 0)
+		global_tune_slzmaxlevel = 2;
+	else if (strcmp(args[1], "off") == 0)
+		global_tune_slzmaxlevel = 1;
+	else {
+		memprintf(err, "'%s' expects 'on' or 'off' but got '%s'.", args[0], args[1]);
+		return -1;
+	}
+	return 0;
+}
+
 #elif defined(USE_ZLIB)  /* ! USE_SLZ */
 
 /*
@@ -704,11 +769,305 @@ static int zlib_parse_global_windowsize(char **args, int section_type, struct pr
 #endif /* USE_ZLIB */
 
 
+#ifdef USE_ZSTD
+
+/**************************
+****  zstd algorithm   ****
+***************************/
+
+/* Allocates a zstd stream using the configured level and window size. The
+ * <level> passed by the caller is ignored, zstd levels having a different
+ * range. Returns < 0 on error.
+ */
+static int zstd_init(struct comp_ctx **comp_ctx, int level)
+{
+	ZSTD_CCtx *cctx;
+
+	if (init_comp_ctx(comp_ctx) < 0)
+		return -1;
+
+	cctx = ZSTD_createCCtx();
+	if (!cctx)
+		goto fail;
+
+	if (ZSTD_isError(ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, global_tune_zstdlevel)) ||
+	    ZSTD_isError(ZSTD_CCtx_setParameter(cctx, ZSTD_c_windowLog, global_tune_zstdwindowsize)) ||
+	    ZSTD_isError(ZSTD_CCtx_setParameter(cctx, ZSTD_c_checksumFlag, 0))) {
+		ZSTD_freeCCtx(cctx);
+		goto fail;
+	}
+
+	(*comp_ctx)->zstd = cctx;
+	(*comp_ctx)->cur_lvl = global_tune_zstdlevel;
+	return 0;
+
+  fail:
+	deinit_comp_ctx(comp_ctx);
+	return -1;
+}
+
+/* Runs the zstd stream over <in_data> with directive <op> and appends the
+ * output to <out>. Returns the amount of consumed input, or -1 on error or if
+ * the directive could not be completed for lack of room.
+ */
+static int zstd_process(struct comp_ctx *comp_ctx, const char *in_data, int in_len,
+                        struct buffer *out, ZSTD_EndDirective op)
+{
+	ZSTD_inBuffer in = { .src = in_data, .size = in_len, .pos = 0 };
+	ZSTD_outBuffer zout;
+	size_t ret;
+
+	do {
+		if (!b_room(out))
+			return -1;
+
+		zout.dst  = b_tail(out);
+		zout.size = b_room(out);
+		zout.pos  = 0;
+
+		ret = ZSTD_compressStream2(comp_ctx->zstd, &zout, &in, op);
+		if (ZSTD_isError(ret))
+			return -1;
+		b_add(out, zout.pos);
+
+		/* with ZSTD_e_continue, we only need the input to be consumed */
+	} while (op == ZSTD_e_continue ? in.pos < in.size : ret != 0);
+
+	return in.pos;
+}
+
+/* Return the size of consumed data or -1 */
+static int zstd_add_data(struct comp_ctx *comp_ctx, const char *in_data, int in_len, struct buffer *out)
+{
+	if (in_len <= 0)
+		return 0;
+
+	return zstd_process(comp_ctx, in_data, in_len, out, ZSTD_e_continue);
+}
+
+static int zstd_flush_or_finish(struct comp_ctx *comp_ctx, struct buffer *out, ZSTD_EndDirective op)
+{
+	int out_len = b_data(out);
+
+	if (zstd_process(comp_ctx, NULL, 0, out, op) < 0)
+		return -1;
+
+	/* the level cannot be changed within a frame, the rate limit is only
+	 * enforced on new streams.
+	 */
+	return b_data(out) - out_len;
+}
+
+static int zstd_flush(struct comp_ctx *comp_ctx, struct buffer *out)
+{
+	return zstd_flush_or_finish(comp_ctx, out, ZSTD_e_flush);
+}
+
+static int zstd_finish(struct comp_ctx *comp_ctx, struct buffer *out)
+{
+	return zstd_flush_or_finish(comp_ctx, out, ZSTD_e_end);
+}
+
+static int zstd_end(struct comp_ctx **comp_ctx)
+{
+	ZSTD_freeCCtx((*comp_ctx)->zstd);
+	deinit_comp_ctx(comp_ctx);
+	return 0;
+}
+
+/* config parser for global "tune.zstd.level" */
+static int zstd_parse_global_level(char **args, int section_type, struct proxy *curpx,
+                                   const struct proxy *defpx, const char *file, int line,
+                                   char **err)
+{
+	if (too_many_args(1, args, err, NULL))
+		return -1;
+
+	global_tune_zstdlevel = *(args[1]) ? atoi(args[1]) : 0;
+	if (global_tune_zstdlevel < 1 || global_tune_zstdlevel > ZSTD_maxCLevel()) {
+		memprintf(err, "'%s' expects a numeric value between 1 and %d.", args[0], ZSTD_maxCLevel());
+		return -1;
+	}
+	return 0;
+}
+
+/* config parser for global "tune.zstd.windowsize" */
+static int zstd_parse_global_windowsize(char **args, int section_type, struct proxy *curpx,
+                                        const struct proxy *defpx, const char *file, int line,
+                                        char **err)
+{
+	if (too_many_args(1, args, err, NULL))
+		return -1;
+
+	global_tune_zstdwindowsize = *(args[1]) ? atoi(args[1]) : 0;
+	if (global_tune_zstdwindowsize < 10 || global_tune_zstdwindowsize > 23) {
+		memprintf(err, "'%s' expects a numeric value between 10 and 23.", args[0]);
+		return -1;
+	}
+	return 0;
+}
+
+#endif /* USE_ZSTD */
+
+
+#ifdef USE_BROTLI
+
+/**************************
+**** brotli algorithm  ****
+***************************/
+
+/* Allocates a brotli stream using the configured quality and window size. The
+ * <level> passed by the caller is ignored, brotli qualities having a different
+ * range. Returns < 0 on error.
+ */
+static int brotli_init(struct comp_ctx **comp_ctx, int level)
+{
+	BrotliEncoderState *state;
+
+	if (init_comp_ctx(comp_ctx) < 0)
+		return -1;
+
+	state = BrotliEncoderCreateInstance(NULL, NULL, NULL);
+	if (!state)
+		goto fail;
+
+	if (!BrotliEncoderSetParameter(state, BROTLI_PARAM_QUALITY, global_tune_brotlilevel) ||
+	    !BrotliEncoderSetParameter(state, BROTLI_PARAM_LGWIN, global_tune_brotliwindowsize)) {
+		BrotliEncoderDestroyInstance(state);
+		goto fail;
+	}
+
+	(*comp_ctx)->brotli = state;
+	(*comp_ctx)->cur_lvl = global_tune_brotlilevel;
+	return 0;
+
+  fail:
+	deinit_comp_ctx(comp_ctx);
+	return -1;
+}
+
+/* Runs the brotli stream over <in_data> with operation <op> and appends the
+ * output to <out>. Returns the amount of consumed input, or -1 on error or if
+ * the operation could not be completed for lack of room.
+ */
+static int brotli_process(struct comp_ctx *comp_ctx, const char *in_data, int in_len,
+                          struct buffer *out, BrotliEncoderOperation op)
+{
+	const uint8_t *next_in = (const uint8_t *)in_data;
+	size_t avail_in = in_len;
+	uint8_t *next_out;
+	size_t avail_out;
+
+	do {
+		if (!b_room(out))
+			return -1;
+
+		next_out = (uint8_t *)b_tail(out);
+		avail_out = b_room(out);
+
+		if (!BrotliEncoderCompressStream(comp_ctx->brotli, op, &avail_in, &next_in,
+						 &avail_out, &next_out, NULL))
+			return -1;
+		b_add(out, b_room(out) - avail_out);
+	} while (avail_in ||
+		 (op != BROTLI_OPERATION_PROCESS && BrotliEncoderHasMoreOutput(comp_ctx->brotli)) ||
+		 (op == BROTLI_OPERATION_FINISH && !BrotliEncoderIsFinished(comp_ctx->brotli)));
+
+	return in_len;
+}
+
+/* Return the size of consumed data or -1 */
+static int brotli_add_data(struct comp_ctx *comp_ctx, const char *in_data, int in_len, struct buffer *out)
+{
+	if (in_len <= 0)
+		return 0;
+
+	return brotli_process(comp_ctx, in_data, in_len, out, BROTLI_OPERATION_PROCESS);
+}
+
+static int brotli_flush_or_finish(struct comp_ctx *comp_ctx, struct buffer *out, BrotliEncoderOperation op)
+{
+	int out_len = b_data(out);
+
+	if (brotli_process(comp_ctx, NULL, 0, out, op) < 0)
+		return -1;
+
+	/* the quality cannot be changed once started, the rate limit is only
+	 * enforced on new streams.
+	 */
+	return b_data(out) - out_len;
+}
+
+static int brotli_flush(struct comp_ctx *comp_ctx, struct buffer *out)
+{
+	return brotli_flush_or_finish(comp_ctx, out, BROTLI_OPERATION_FLUSH);
+}
+
+static int brotli_finish(struct comp_ctx *comp_ctx, struct buffer *out)
+{
+	return brotli_flush_or_finish(comp_ctx, out, BROTLI_OPERATION_FINISH);
+}
+
+static int brotli_end(struct comp_ctx **comp_ctx)
+{
+	BrotliEncoderDestroyInstance((*comp_ctx)->brotli);
+	deinit_comp_ctx(comp_ctx);
+	return 0;
+}
+
+/* config parser for global "tune.brotli.level" */
+static int brotli_parse_global_level(char **args, int section_type, struct proxy *curpx,
+                                     const struct proxy *defpx, const char *file, int line,
+                                     char **err)
+{
+	if (too_many_args(1, args, err, NULL))
+		return -1;
+
+	global_tune_brotlilevel = *(args[1]) ? atoi(args[1]) : 0;
+	if (global_tune_brotlilevel < 1 || global_tune_brotlilevel > BROTLI_MAX_QUALITY) {
+		memprintf(err, "'%s' expects a numeric value between 1 and %d.", args[0], BROTLI_MAX_QUALITY);
+		return -1;
+	}
+	return 0;
+}
+
+/* config parser for global "tune.brotli.windowsize" */
+static int brotli_parse_global_windowsize(char **args, int section_type, struct proxy *curpx,
+                                          const struct proxy *defpx, const char *file, int line,
+                                          char **err)
+{
+	if (too_many_args(1, args, err, NULL))
+		return -1;
+
+	global_tune_brotliwindowsize = *(args[1]) ? atoi(args[1]) : 0;
+	if (global_tune_brotliwindowsize < BROTLI_MIN_WINDOW_BITS ||
+	    global_tune_brotliwindowsize > BROTLI_MAX_WINDOW_BITS) {
+		memprintf(err, "'%s' expects a numeric value between %d and %d.",
+			  args[0], BROTLI_MIN_WINDOW_BITS, BROTLI_MAX_WINDOW_BITS);
+		return -1;
+	}
+	return 0;
+}
+
+#endif /* USE_BROTLI */
+
+
 /* config keyword parsers */
 static struct cfg_kw_list cfg_kws = {ILH, {
+#ifdef USE_SLZ
+	{ CFG_GLOBAL, "tune.slz.high-ratio",  slz_parse_global_high_ratio },
+#endif
 #ifdef USE_ZLIB
 	{ CFG_GLOBAL, "tune.zlib.memlevel",   zlib_parse_global_memlevel },
 	{ CFG_GLOBAL, "tune.zlib.windowsize", zlib_parse_global_windowsize },
+#endif
+#ifdef USE_ZSTD
+	{ CFG_GLOBAL, "tune.zstd.level",      zstd_parse_global_level },
+	{ CFG_GLOBAL, "tune.zstd.windowsize", zstd_parse_global_windowsize },
+#endif
+#ifdef USE_BROTLI
+	{ CFG_GLOBAL, "tune.brotli.level",      brotli_parse_global_level },
+	{ CFG_GLOBAL, "tune.brotli.windowsize", brotli_parse_global_windowsize },
 #endif
 	{ 0, NULL, NULL }
 }};
@@ -727,6 +1086,15 @@ static void comp_register_build_opts(void)
 	memprintf(&ptr, "Built with libslz for stateless compression.");
 #else
 	memprintf(&ptr, "Built without compression support (neither USE_ZLIB nor USE_SLZ are set).");
+#endif
+#ifdef USE_ZSTD
+	memprintf(&ptr, "%s\nBuilt with zstd version : " ZSTD_VERSION_STRING, ptr);
+	memprintf(&ptr, "%s\nRunning on zstd version : %s", ptr, ZSTD_versionString());
+#endif
+#ifdef USE_BROTLI
+	memprintf(&ptr, "%s\nRunning on brotli version : %u.%u.%u", ptr,
+		  BrotliEncoderVersion() >> 24, (BrotliEncoderVersion() >> 12) & 0xfff,
+		  BrotliEncoderVersion() & 0xfff);
 #endif
 	memprintf(&ptr, "%s\nCompression algorithms supported :", ptr);
 
@@ -64,6 +64,12 @@ int conn_create_mux(struct connection *conn)
 		struct stconn *sc = conn->ctx;
 		struct session *sess = conn->owner;
 
+		/* pre-established connections (pool-warm) only get a mux
+		 * once picked by a stream.
+		 */
+		if (conn->flags & CO_FL_WARM)
+			return 0;
+
 		if (conn->flags & CO_FL_ERROR)
 			goto fail;
 
@@ -160,12 +166,8 @@ int conn_notify_mux(struct connection *conn, int old_flags, int forced_wake)
 			goto done;
 
 		if (conn_in_list) {
-			struct eb_root *root = (conn_in_list == CO_FL_SAFE_LIST) ?
-				&srv->per_thr[tid].safe_conns :
-				&srv->per_thr[tid].idle_conns;
-
 			HA_SPIN_LOCK(IDLE_CONNS_LOCK, &idle_conns[tid].idle_conns_lock);
-			eb64_insert(root, &conn->hash_node->node);
+			_srv_idle_tree_insert(srv, conn, conn_in_list == CO_FL_SAFE_LIST);
 			HA_SPIN_UNLOCK(IDLE_CONNS_LOCK, &idle_conns[tid].idle_conns_lock);
 		}
 	}
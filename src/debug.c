@@ -196,7 +196,7 @@ void ha_thread_dump_one(int thr, int from_signal)
 		      ha_get_pthread_id(thr),
 		      thread_has_tasks(),
 	              !eb_is_empty(&ha_thread_ctx[thr].rqueue_shared),
-	              !eb_is_empty(&ha_thread_ctx[thr].timers),
+	              !TASK_WQ_IS_EMPTY(&ha_thread_ctx[thr]),
 	              !eb_is_empty(&ha_thread_ctx[thr].rqueue),
 	              !(LIST_ISEMPTY(&ha_thread_ctx[thr].tasklets[TL_URGENT]) &&
 			LIST_ISEMPTY(&ha_thread_ctx[thr].tasklets[TL_NORMAL]) &&
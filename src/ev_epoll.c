@@ -227,7 +227,7 @@ static void _do_poll(struct poller *p, int exp, int wake)
 	clock_entering_poll();
 
 	do {
-		int timeout = (global.tune.options & GTUNE_BUSY_POLLING) ? 0 : wait_time;
+		int timeout = fd_poll_timeout(wait_time, exp);
 
 		status = epoll_wait(epoll_fd[tid], epoll_events, global.tune.maxpollevents, timeout);
 		clock_update_local_date(timeout, status);
@@ -183,7 +183,7 @@ static void _do_poll(struct poller *p, int exp, int wake)
 	clock_entering_poll();
 
 	do {
-		int timeout = (global.tune.options & GTUNE_BUSY_POLLING) ? 0 : wait_time;
+		int timeout = fd_poll_timeout(wait_time, exp);
 		int interrupted = 0;
 		nevlist = 1; /* desired number of events to be retrieved */
 		timeout_ts.tv_sec  = (timeout / 1000);
@@ -172,7 +172,7 @@ static void _do_poll(struct poller *p, int exp, int wake)
 	clock_entering_poll();
 
 	do {
-		int timeout = (global.tune.options & GTUNE_BUSY_POLLING) ? 0 : wait_time;
+		int timeout = fd_poll_timeout(wait_time, exp);
 
 		timeout_ts.tv_sec  = (timeout / 1000);
 		timeout_ts.tv_nsec = (timeout % 1000) * 1000000;
@@ -90,6 +90,7 @@
 #include <haproxy/api.h>
 #include <haproxy/activity.h>
 #include <haproxy/cfgparse.h>
+#include <haproxy/clock.h>
 #include <haproxy/fd.h>
 #include <haproxy/global.h>
 #include <haproxy/log.h>
@@ -1070,6 +1071,36 @@ int compute_poll_timeout(int next)
 	return wait_time;
 }
 
+/* Returns the timeout in milliseconds the poller must use for its next attempt,
+ * given the <wait_time> it computed on entry and the date of the next timer
+ * <exp>. When busy-polling is enabled for the current thread's group, zero is
+ * returned as long as the spinning window following the last activity is not
+ * over (or forever if there is no window), then the time left before <exp>.
+ * The dates at which the poller starts to spin then to sleep are recorded for
+ * fd_leaving_poll().
+ */
+int fd_poll_timeout(int wait_time, int exp)
+{
+	uint64_t now;
+
+	if (!wait_time || !(global.tune.options & GTUNE_BUSY_POLLING) ||
+	    !(global.tune.busy_poll_tgroups & tg->tgid_bit))
+		return wait_time;
+
+	now = now_mono_time();
+	if (!th_ctx->poll_spin_date)
+		th_ctx->poll_spin_date = now;
+
+	if (!global.tune.busy_poll_window ||
+	    now - th_ctx->poll_last_active < (uint64_t)global.tune.busy_poll_window * 1000U)
+		return 0;
+
+	/* the window is over, let's sleep till the next timer */
+	if (!th_ctx->poll_sleep_date)
+		th_ctx->poll_sleep_date = now;
+	return compute_poll_timeout(exp);
+}
+
 /* Handle the return of the poller, which consists in calculating the idle
  * time, saving a few clocks, marking the thread harmful again etc. All that
  * is some boring stuff that all pollers have to do anyway.
@@ -1078,6 +1109,25 @@ void fd_leaving_poll(int wait_time, int status)
 {
 	clock_leaving_poll(wait_time, status);
 
+	if ((global.tune.options & GTUNE_BUSY_POLLING) &&
+	    (global.tune.busy_poll_tgroups & tg->tgid_bit)) {
+		uint64_t now = now_mono_time();
+
+		/* account for the time spent spinning and sleeping */
+		if (th_ctx->poll_spin_date) {
+			uint64_t sleep = th_ctx->poll_sleep_date;
+
+			activity[tid].poll_spin_ns += (sleep ? sleep : now) - th_ctx->poll_spin_date;
+			if (sleep)
+				activity[tid].poll_sleep_ns += now - sleep;
+			th_ctx->poll_spin_date = th_ctx->poll_sleep_date = 0;
+		}
+
+		/* events or pending work restart the spinning window */
+		if (status || !wait_time)
+			th_ctx->poll_last_active = now;
+	}
+
 	thread_harmless_end();
 	thread_idle_end();
 
@@ -532,12 +532,12 @@ select_compression_request_header(struct comp_state *st, struct stream *s, struc
 	/* search for the algo in the backend in priority or the frontend */
 	if ((s->be->comp && (comp_algo_back = s->be->comp->algos_res)) ||
 	    (strm_fe(s)->comp && (comp_algo_back = strm_fe(s)->comp->algos_res))) {
-		int best_q = 0;
+		int best_q = 0, best_rank = 0;
 
 		ctx.blk = NULL;
 		while (http_find_header(htx, ist("Accept-Encoding"), &ctx, 0)) {
 			const char *qval;
-			int q;
+			int q, rank;
 			int toklen;
 
 			/* try to isolate the token from the optional q-value */
@@ -573,14 +573,22 @@ select_compression_request_header(struct comp_state *st, struct stream *s, struc
 			/* here we have qval pointing to the first "q=" attribute or NULL if not found */
 			q = qval ? http_parse_qvalue(qval + 2, NULL) : 1000;
 
-			if (q <= best_q)
+			if (q < best_q || !q)
 				continue;
 
-			for (comp_algo = comp_algo_back; comp_algo; comp_algo = comp_algo->next) {
+			/* among algos of equal weight, the one declared first on
+			 * the "compression algo" line is preferred. The list being
+			 * built in reverse order, it is the one with the highest
+			 * rank.
+			 */
+			for (comp_algo = comp_algo_back, rank = 1; comp_algo; comp_algo = comp_algo->next, rank++) {
 				if (*(ctx.value.ptr) == '*' ||
 				    word_match(ctx.value.ptr, toklen, comp_algo->ua_name, comp_algo->ua_name_len)) {
-					st->comp_algo[COMP_DIR_RES] = comp_algo;
-					best_q = q;
+					if (q > best_q || rank > best_rank) {
+						st->comp_algo[COMP_DIR_RES] = comp_algo;
+						best_q = q;
+						best_rank = rank;
+					}
 					break;
 				}
 			}
@@ -959,18 +967,12 @@ check_implicit_http_comp_flt(struct proxy *proxy)
 		goto end;
 	if (!LIST_ISEMPTY(&proxy->filter_configs)) {
 		list_for_each_entry(fconf, &proxy->filter_configs, list) {
+			/* the relative order of the cache and compression
+			 * filters is checked by the cache.
+			 */
 			if (fconf->id == http_comp_flt_id)
 				comp = 1;
-			else if (fconf->id == cache_store_flt_id) {
-				if (comp) {
-					ha_alert("config: %s '%s': unable to enable the compression filter "
-						 "before any cache filter.\n",
-						 proxy_type_str(proxy), proxy->id);
-					err++;
-					goto end;
-				}
-			}
-			else if (fconf->id == fcgi_flt_id)
+			else if (fconf->id == cache_store_flt_id || fconf->id == fcgi_flt_id)
 				continue;
 			else
 				explicit = 1;
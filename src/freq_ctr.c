@@ -146,6 +146,45 @@ ullong freq_ctr_total(const struct freq_ctr *ctr, uint period, int pend)
 	return past * remain + (curr + pend) * period;
 }
 
+/* Returns the total number of events over the current + last period of all
+ * shards of sharded counter <ctr>, including a number of already pending
+ * events <pend>, which are only accounted once. See freq_ctr_total() for the
+ * special meaning of a negative <pend>, which applies to each shard.
+ */
+ullong freq_ctr_shd_total(const struct freq_ctr_shd *ctr, uint period, int pend)
+{
+	ullong total = 0;
+	int shd;
+
+	for (shd = 0; shd < FREQ_CTR_SHARDS; shd++) {
+		total += freq_ctr_total(&ctr->shard[shd].ctr, period, pend);
+		if (pend > 0)
+			pend = 0;
+	}
+	return total;
+}
+
+/* Returns the sum of the events counted over their current period by all the
+ * shards of sharded counter <ctr> except <skip>, ignoring those whose period is
+ * over. Only the current counters are read, so that this remains cheap enough
+ * to be called on each update.
+ */
+uint freq_ctr_shd_curr_others(const struct freq_ctr_shd *ctr, const struct freq_ctr *skip, uint period)
+{
+	uint total = 0;
+	int shd;
+
+	for (shd = 0; shd < FREQ_CTR_SHARDS; shd++) {
+		const struct freq_ctr *c = &ctr->shard[shd].ctr;
+
+		if (c == skip)
+			continue;
+		if (now_ms - HA_ATOMIC_LOAD(&c->curr_tick) < period)
+			total += HA_ATOMIC_LOAD(&c->curr_ctr);
+	}
+	return total;
+}
+
 /* Returns the excess of events (may be negative) over the current period for
  * target frequency <freq>. It returns 0 if the counter is in the future or if
  * the counter is empty. The result considers the position of the current time
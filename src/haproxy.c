@@ -195,6 +195,7 @@ struct global global = {
 		.maxrewrite = MAXREWRITE,
 		.reserved_bufs = RESERVED_BUFS,
 		.pattern_cache = DEFAULT_PAT_LRU_SIZE,
+		.pattern_ip_trie = DEFAULT_PAT_IP_TRIE_THRESHOLD,
 		.pool_low_ratio  = 20,
 		.pool_high_ratio = 25,
 		.max_http_hdr = MAX_HTTP_HDR,
@@ -202,6 +203,7 @@ struct global global = {
 		.sslcachesize = SSLCACHESIZE,
 #endif
 		.comp_maxlevel = 1,
+		.busy_poll_tgroups = ~0UL,
 #ifdef DEFAULT_IDLE_TIMER
 		.idle_timer = DEFAULT_IDLE_TIMER,
 #else
@@ -3860,6 +3862,9 @@ int main(int argc, char **argv)
 	/* wait for all threads to terminate */
 	wait_for_threads_completion();
 
+	/* save the stick-tables while they are still intact */
+	peers_snapshot_save_all();
+
 	deinit_and_exit(0);
 }
 
@@ -885,6 +885,9 @@ static void hlua_stktable_entry(lua_State *L, struct stktable *t, struct stksess
 			lua_pushstring(L, de ? (char *)de->value.key : "-");
 			break;
 		}
+		case STD_T_HLL:
+			lua_pushinteger(L, hll_estimate(&stktable_data_cast(ptr, std_t_hll)));
+			break;
 		}
 
 		lua_settable(L, -3);
@@ -1076,6 +1079,9 @@ int hlua_stktable_dump(lua_State *L)
 				val = read_freq_ctr_period(&stktable_data_cast(ptr, std_t_frqp),
 						           t->data_arg[filter[i].type].u);
 				break;
+			case STD_T_HLL:
+				val = hll_estimate(&stktable_data_cast(ptr, std_t_hll));
+				break;
 			default:
 				continue;
 				break;
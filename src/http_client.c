@@ -1023,6 +1023,25 @@ static int httpclient_applet_init(struct appctx *appctx)
 	if (!httpclient_spliturl(hc->req.url, &scheme, &host, &port))
 		goto out_error;
 
+	if (hc->be) {
+		/* the request is routed through a regular backend, which
+		 * applies its rules and chooses the server itself.
+		 */
+		if (appctx_finalize_startup(appctx, hc->px, &hc->req.buf) == -1) {
+			ha_alert("httpclient: Failed to initialize appctx %s:%d.\n", __FUNCTION__, __LINE__);
+			goto out_error;
+		}
+
+		s = appctx_strm(appctx);
+		/* on failure, the stream stays on the httpclient proxy, which
+		 * has no usable server and will return a 503.
+		 */
+		stream_set_backend(s, hc->be);
+		s->scb->ioto = hc->timeout_server;
+		s->scb->flags |= (SC_FL_RCV_ONCE|SC_FL_NOLINGER);
+		goto started;
+	}
+
 	if (hc->dst) {
 		/* if httpclient_set_dst() was used, sets the alternative address */
 		ss_dst = hc->dst;
@@ -1083,6 +1102,7 @@ static int httpclient_applet_init(struct appctx *appctx)
 	s->scb->flags |= (SC_FL_RCV_ONCE|SC_FL_NOLINGER);
 	s->flags |= SF_ASSIGNED;
 
+  started:
 	/* applet is waiting for data */
 	applet_need_more_data(appctx);
 	appctx_wakeup(appctx);
@@ -104,28 +104,49 @@ struct connection *accept_queue_pop_sc(struct accept_queue_ring *ring)
 }
 
 
-/* tries to push a new accepted connection <conn> into ring <ring>. Returns
- * non-zero if it succeeds, or zero if the ring is full. Supports multiple
+/* tries to push the <count> accepted connections from <conns> into ring
+ * <ring> using a single update of the ring's index. Returns the number of
+ * connections pushed, which are the first ones of <conns>, and which may be
+ * less than <count> (possibly zero) if the ring lacks room. Supports multiple
  * producers.
  */
-int accept_queue_push_mp(struct accept_queue_ring *ring, struct connection *conn)
+uint accept_queue_push_mp_bulk(struct accept_queue_ring *ring, struct connection **conns, uint count)
 {
-	unsigned int pos, next;
+	unsigned int pos, next, room, i;
 	uint32_t idx = _HA_ATOMIC_LOAD(&ring->idx);  /* (head << 16) + tail */
 
 	do {
 		pos = (uint16_t)idx;
-		next = pos + 1;
-		if (next >= ACCEPT_QUEUE_SIZE)
-			next = 0;
-		if (next == (idx >> 16))
+		/* one entry always remains free so that a full ring differs
+		 * from an empty one.
+		 */
+		room = ((idx >> 16) + ACCEPT_QUEUE_SIZE - pos - 1) % ACCEPT_QUEUE_SIZE;
+		if (count > room)
+			count = room;
+		if (!count)
 			return 0; // ring full
+		next = pos + count;
+		if (next >= ACCEPT_QUEUE_SIZE)
+			next -= ACCEPT_QUEUE_SIZE;
 		next |= (idx & 0xffff0000U);
 	} while (unlikely(!_HA_ATOMIC_CAS(&ring->idx, &idx, next) && __ha_cpu_relax()));
 
-	ring->entry[pos] = conn;
+	for (i = 0; i < count; i++) {
+		ring->entry[pos] = conns[i];
+		if (++pos >= ACCEPT_QUEUE_SIZE)
+			pos = 0;
+	}
 	__ha_barrier_store();
-	return 1;
+	return count;
+}
+
+/* tries to push a new accepted connection <conn> into ring <ring>. Returns
+ * non-zero if it succeeds, or zero if the ring is full. Supports multiple
+ * producers.
+ */
+int accept_queue_push_mp(struct accept_queue_ring *ring, struct connection *conn)
+{
+	return accept_queue_push_mp_bulk(ring, &conn, 1);
 }
 
 /* proceed with accepting new connections. Don't mark it static so that it appears
@@ -162,10 +183,10 @@ struct task *accept_queue_process(struct task *t, void *context, unsigned int st
 		 */
 		if (!(li->bind_conf->options & BC_O_UNLIMITED)) {
 			HA_ATOMIC_UPDATE_MAX(&global.sps_max,
-			                     update_freq_ctr(&global.sess_per_sec, 1));
+			                     update_freq_ctr_shd(&global.sess_per_sec, 1));
 			if (li->bind_conf->options & BC_O_USE_SSL) {
 				HA_ATOMIC_UPDATE_MAX(&global.ssl_max,
-				                     update_freq_ctr(&global.ssl_per_sec, 1));
+				                     update_freq_ctr_shd(&global.ssl_per_sec, 1));
 			}
 		}
 	}
@@ -999,14 +1020,105 @@ static inline int listener_uses_maxconn(const struct listener *l)
 	return !(l->bind_conf->options & (BC_O_UNLIMITED|BC_O_XPRT_MAXCONN));
 }
 
+/* Passes connection <cli_conn> accepted by listener <l> to the listener's
+ * accept handler on the current thread, and accounts for the new session.
+ * Returns the accept handler's result: >0 if the connection was accepted, 0 if
+ * it was closed, or <0 on a resource shortage which requires to pause the
+ * listener.
+ */
+static int listener_accept_local(struct listener *l, struct connection *cli_conn)
+{
+	unsigned int count;
+	int ret;
+
+	/* restore the connection's listener in case we failed to migrate it */
+	cli_conn->target = &l->obj_type;
+	_HA_ATOMIC_INC(&l->thr_conn[ti->ltid]);
+	ret = l->bind_conf->accept(cli_conn);
+	if (unlikely(ret <= 0))
+		return ret;
+
+	/* increase the per-process number of cumulated sessions, this
+	 * may only be done once l->bind_conf->accept() has accepted the
+	 * connection.
+	 */
+	if (!(l->bind_conf->options & BC_O_UNLIMITED)) {
+		count = update_freq_ctr_shd(&global.sess_per_sec, 1);
+		HA_ATOMIC_UPDATE_MAX(&global.sps_max, count);
+	}
+#ifdef USE_OPENSSL
+	if (!(l->bind_conf->options & BC_O_UNLIMITED) &&
+	    l->bind_conf && l->bind_conf->options & BC_O_USE_SSL) {
+		count = update_freq_ctr_shd(&global.ssl_per_sec, 1);
+		HA_ATOMIC_UPDATE_MAX(&global.ssl_max, count);
+	}
+#endif
+	return ret;
+}
+
+#if defined(USE_THREAD)
+/* Pushes the connections of batch <b>, accepted by listener <l>, into their
+ * target threads' accept queues, with a single ring update and a single wakeup
+ * per target thread. Connections which do not fit into their target's ring are
+ * accepted on the current thread instead. Returns 0 on success, or <0 if one of
+ * these local accepts requires to pause the listener. The batch is always
+ * empty on return.
+ */
+static int accept_queue_flush_batch(struct listener *l, struct accept_queue_batch *b)
+{
+	struct connection *conns[ACCEPT_QUEUE_BATCH];
+	struct accept_queue_ring *ring;
+	uint i, j, n, pushed, thr;
+	int ret = 0;
+
+	for (i = 0; i < b->count; i++) {
+		if (!b->e[i].conn)
+			continue;
+
+		/* collect all connections going to the same thread */
+		thr = b->e[i].thr;
+		for (n = 0, j = i; j < b->count; j++) {
+			if (b->e[j].conn && b->e[j].thr == thr) {
+				conns[n++] = b->e[j].conn;
+				b->e[j].conn = NULL;
+			}
+		}
+
+		ring = &accept_queue_rings[thr];
+		pushed = accept_queue_push_mp_bulk(ring, conns, n);
+		if (pushed) {
+			_HA_ATOMIC_ADD(&activity[thr].accq_pushed, pushed);
+			_HA_ATOMIC_INC(&activity[thr].accq_bulk);
+			tasklet_wakeup(ring->tasklet);
+		}
+
+		/* If the ring is full we do a synchronous accept on the
+		 * local thread here.
+		 */
+		for (; pushed < n; pushed++) {
+			_HA_ATOMIC_INC(&activity[thr].accq_full);
+			if (listener_accept_local(l, conns[pushed]) < 0)
+				ret = -1;
+		}
+	}
+	b->count = 0;
+	return ret;
+}
+#endif // USE_THREAD
+
 /* This function is called on a read event from a listening socket, corresponding
  * to an accept. It tries to accept as many connections as possible, and for each
  * calls the listener's accept handler (generally the frontend's accept handler).
+ * Connections dispatched to other threads are pushed into their accept queues
+ * by batches, so that each target thread is only woken up once per batch.
  */
 void listener_accept(struct listener *l)
 {
 	struct connection *cli_conn;
 	struct proxy *p;
+#if defined(USE_THREAD)
+	struct accept_queue_batch batch;
+#endif
 	unsigned int max_accept;
 	int next_conn = 0;
 	int next_feconn = 0;
@@ -1015,6 +1127,9 @@ void listener_accept(struct listener *l)
 	int ret;
 
 	p = l->bind_conf->frontend;
+#if defined(USE_THREAD)
+	batch.count = 0;
+#endif
 
 	/* if l->bind_conf->maxaccept is -1, then max_accept is UINT_MAX. It is
 	 * not really illimited, but it is probably enough.
@@ -1022,11 +1137,11 @@ void listener_accept(struct listener *l)
 	max_accept = l->bind_conf->maxaccept ? l->bind_conf->maxaccept : 1;
 
 	if (!(l->bind_conf->options & BC_O_UNLIMITED) && global.sps_lim) {
-		int max = freq_ctr_remain(&global.sess_per_sec, global.sps_lim, 0);
+		int max = freq_ctr_shd_remain(&global.sess_per_sec, global.sps_lim, 0);
 
 		if (unlikely(!max)) {
 			/* frontend accept rate limit was reached */
-			expire = tick_add(now_ms, next_event_delay(&global.sess_per_sec, global.sps_lim, 0));
+			expire = tick_add(now_ms, next_event_delay_shd(&global.sess_per_sec, global.sps_lim, 0));
 			goto limit_global;
 		}
 
@@ -1035,11 +1150,11 @@ void listener_accept(struct listener *l)
 	}
 
 	if (!(l->bind_conf->options & BC_O_UNLIMITED) && global.cps_lim) {
-		int max = freq_ctr_remain(&global.conn_per_sec, global.cps_lim, 0);
+		int max = freq_ctr_shd_remain(&global.conn_per_sec, global.cps_lim, 0);
 
 		if (unlikely(!max)) {
 			/* frontend accept rate limit was reached */
-			expire = tick_add(now_ms, next_event_delay(&global.conn_per_sec, global.cps_lim, 0));
+			expire = tick_add(now_ms, next_event_delay_shd(&global.conn_per_sec, global.cps_lim, 0));
 			goto limit_global;
 		}
 
@@ -1049,11 +1164,11 @@ void listener_accept(struct listener *l)
 #ifdef USE_OPENSSL
 	if (!(l->bind_conf->options & BC_O_UNLIMITED) && global.ssl_lim &&
 	    l->bind_conf && l->bind_conf->options & BC_O_USE_SSL) {
-		int max = freq_ctr_remain(&global.ssl_per_sec, global.ssl_lim, 0);
+		int max = freq_ctr_shd_remain(&global.ssl_per_sec, global.ssl_lim, 0);
 
 		if (unlikely(!max)) {
 			/* frontend accept rate limit was reached */
-			expire = tick_add(now_ms, next_event_delay(&global.ssl_per_sec, global.ssl_lim, 0));
+			expire = tick_add(now_ms, next_event_delay_shd(&global.ssl_per_sec, global.ssl_lim, 0));
 			goto limit_global;
 		}
 
@@ -1062,11 +1177,11 @@ void listener_accept(struct listener *l)
 	}
 #endif
 	if (p && p->fe_sps_lim) {
-		int max = freq_ctr_remain(&p->fe_sess_per_sec, p->fe_sps_lim, 0);
+		int max = freq_ctr_shd_remain(&p->fe_sess_per_sec, p->fe_sps_lim, 0);
 
 		if (unlikely(!max)) {
 			/* frontend accept rate limit was reached */
-			expire = tick_add(now_ms, next_event_delay(&p->fe_sess_per_sec, p->fe_sps_lim, 0));
+			expire = tick_add(now_ms, next_event_delay_shd(&p->fe_sess_per_sec, p->fe_sps_lim, 0));
 			goto limit_proxy;
 		}
 
@@ -1171,7 +1286,7 @@ void listener_accept(struct listener *l)
 		}
 
 		if (!(l->bind_conf->options & BC_O_UNLIMITED)) {
-			count = update_freq_ctr(&global.conn_per_sec, 1);
+			count = update_freq_ctr_shd(&global.conn_per_sec, 1);
 			HA_ATOMIC_UPDATE_MAX(&global.cps_max, count);
 		}
 
@@ -1203,7 +1318,6 @@ void listener_accept(struct listener *l)
 		 */
 		mask = l->rx.bind_thread & _HA_ATOMIC_LOAD(&tg->threads_enabled);
 		if (l->rx.shard_info || atleast2(mask)) {
-			struct accept_queue_ring *ring;
 			struct listener *new_li;
 			uint r1, r2, t, t1, t2;
 			ulong n0, n1;
@@ -1464,26 +1578,21 @@ void listener_accept(struct listener *l)
 			 * connection. We use deferred accepts even if it's the
 			 * local thread because tests show that it's the best
 			 * performing model, likely due to better cache locality
-			 * when processing this loop.
+			 * when processing this loop. Connections are batched so
+			 * that each target ring is updated and its thread woken
+			 * up only once per batch.
 			 */
-			ring = &accept_queue_rings[t];
-			if (accept_queue_push_mp(ring, cli_conn)) {
-				_HA_ATOMIC_INC(&activity[t].accq_pushed);
-				tasklet_wakeup(ring->tasklet);
-				continue;
-			}
-			/* If the ring is full we do a synchronous accept on
-			 * the local thread here.
-			 */
-			_HA_ATOMIC_INC(&activity[t].accq_full);
+			batch.e[batch.count].conn = cli_conn;
+			batch.e[batch.count].thr = t;
+			if (++batch.count == ACCEPT_QUEUE_BATCH &&
+			    accept_queue_flush_batch(l, &batch) < 0)
+				goto transient_error;
+			continue;
 		}
 #endif // USE_THREAD
 
  local_accept:
-		/* restore the connection's listener in case we failed to migrate above */
-		cli_conn->target = &l->obj_type;
-		_HA_ATOMIC_INC(&l->thr_conn[ti->ltid]);
-		ret = l->bind_conf->accept(cli_conn);
+		ret = listener_accept_local(l, cli_conn);
 		if (unlikely(ret <= 0)) {
 			/* The connection was closed by stream_accept(). Either
 			 * we just have to ignore it (ret == 0) or it's a critical
@@ -1496,26 +1605,16 @@ void listener_accept(struct listener *l)
 			goto transient_error;
 		}
 
-		/* increase the per-process number of cumulated sessions, this
-		 * may only be done once l->bind_conf->accept() has accepted the
-		 * connection.
-		 */
-		if (!(l->bind_conf->options & BC_O_UNLIMITED)) {
-			count = update_freq_ctr(&global.sess_per_sec, 1);
-			HA_ATOMIC_UPDATE_MAX(&global.sps_max, count);
-		}
-#ifdef USE_OPENSSL
-		if (!(l->bind_conf->options & BC_O_UNLIMITED) &&
-		    l->bind_conf && l->bind_conf->options & BC_O_USE_SSL) {
-			count = update_freq_ctr(&global.ssl_per_sec, 1);
-			HA_ATOMIC_UPDATE_MAX(&global.ssl_max, count);
-		}
-#endif
-
 		_HA_ATOMIC_AND(&th_ctx->flags, ~TH_FL_STUCK); // this thread is still running
 	} /* end of for (max_accept--) */
 
  end:
+#if defined(USE_THREAD)
+	/* dispatch the connections still pending in the batch */
+	if (batch.count && accept_queue_flush_batch(l, &batch) < 0)
+		goto transient_error;
+#endif
+
 	if (next_conn)
 		_HA_ATOMIC_DEC(&l->nbconn);
 
@@ -1537,7 +1636,7 @@ void listener_accept(struct listener *l)
 		dequeue_all_listeners();
 
 		if (p && !MT_LIST_ISEMPTY(&p->listener_queue) &&
-		    (!p->fe_sps_lim || freq_ctr_remain(&p->fe_sess_per_sec, p->fe_sps_lim, 0) > 0))
+		    (!p->fe_sps_lim || freq_ctr_shd_remain(&p->fe_sess_per_sec, p->fe_sps_lim, 0) > 0))
 			dequeue_proxy_listeners(p);
 	}
 	return;
@@ -1596,7 +1695,7 @@ void listener_release(struct listener *l)
 	dequeue_all_listeners();
 
 	if (fe && !MT_LIST_ISEMPTY(&fe->listener_queue) &&
-	    (!fe->fe_sps_lim || freq_ctr_remain(&fe->fe_sess_per_sec, fe->fe_sps_lim, 0) > 0))
+	    (!fe->fe_sps_lim || freq_ctr_shd_remain(&fe->fe_sess_per_sec, fe->fe_sps_lim, 0) > 0))
 		dequeue_proxy_listeners(fe);
 }
 
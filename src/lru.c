@@ -28,6 +28,44 @@
 #define LIST_INSERT(lh, el) ({ (el)->n = (lh)->n; (el)->n->p = (lh)->n = (el); (el)->p = (lh); })
 #define LIST_DELETE(el)     ({ (el)->n->p = (el)->p; (el)->p->n = (el)->n; })
 
+/* Moves entry <elem> of LRU <lru> which was just hit to the head of the LRU. If
+ * the LRU is segmented, the entry is promoted to the protected segment, whose
+ * oldest entry may then be demoted to the head of the probation segment.
+ */
+static void lru64_touch(struct lru64_head *lru, struct lru64 *elem)
+{
+	struct lru64 *old;
+
+	LIST_DELETE(&elem->lru);
+	if (!lru->prot_size) {
+		LIST_INSERT(&lru->list, &elem->lru);
+		return;
+	}
+
+	if (!elem->prot) {
+		elem->prot = 1;
+		lru->prot_usage++;
+	}
+	LIST_INSERT(&lru->prot, &elem->lru);
+
+	if (lru->prot_usage > lru->prot_size) {
+		old = container_of(lru->prot.p, typeof(*old), lru);
+		LIST_DELETE(&old->lru);
+		old->prot = 0;
+		lru->prot_usage--;
+		LIST_INSERT(&lru->list, &old->lru);
+	}
+}
+
+/* Detaches entry <elem> from the segment of LRU <lru> it belongs to. */
+static void lru64_unlink(struct lru64_head *lru, struct lru64 *elem)
+{
+	LIST_DELETE(&elem->lru);
+	if (elem->prot) {
+		elem->prot = 0;
+		lru->prot_usage--;
+	}
+}
 
 /* Lookup key <key> in LRU cache <lru> for use with domain <domain> whose data's
  * current version is <revision>. It differs from lru64_get as it does not
@@ -46,8 +84,7 @@ struct lru64 *lru64_lookup(unsigned long long key, struct lru64_head *lru,
 		 * head of the LRU list.
 		 */
 		if (elem->domain == domain && elem->revision == revision) {
-			LIST_DELETE(&elem->lru);
-			LIST_INSERT(&lru->list, &elem->lru);
+			lru64_touch(lru, elem);
 			return elem;
 		}
 	}
@@ -75,6 +112,7 @@ struct lru64 *lru64_get(unsigned long long key, struct lru64_head *lru,
 		if (!lru->spare)
 			return NULL;
 		lru->spare->domain = NULL;
+		lru->spare->prot = 0;
 	}
 
 	/* Lookup or insert */
@@ -87,8 +125,7 @@ struct lru64 *lru64_get(unsigned long long key, struct lru64_head *lru,
 		 * head of the LRU list.
 		 */
 		if (elem->domain == domain && elem->revision == revision) {
-			LIST_DELETE(&elem->lru);
-			LIST_INSERT(&lru->list, &elem->lru);
+			lru64_touch(lru, elem);
 			return elem;
 		}
 
@@ -96,7 +133,7 @@ struct lru64 *lru64_get(unsigned long long key, struct lru64_head *lru,
 			return NULL; // currently locked
 
 		/* recycle this entry */
-		LIST_DELETE(&elem->lru);
+		lru64_unlink(lru, elem);
 	}
 	else {
 		/* New entry inserted, initialize and move to the head of the
@@ -110,7 +147,7 @@ struct lru64 *lru64_get(unsigned long long key, struct lru64_head *lru,
 	LIST_INSERT(&lru->list, &elem->lru);
 
 	if (lru->cache_usage > lru->cache_size) {
-		/* try to kill oldest entry */
+		/* try to kill oldest entry, which is never protected */
 		struct lru64 *old;
 
 		old = container_of(lru->list.p, typeof(*old), lru);
@@ -158,10 +195,31 @@ struct lru64_head *lru64_new(int size)
 	lru = malloc(sizeof(*lru));
 	if (lru) {
 		lru->list.p = lru->list.n = &lru->list;
+		lru->prot.p = lru->prot.n = &lru->prot;
 		lru->keys = EB_ROOT_UNIQUE;
 		lru->spare = NULL;
 		lru->cache_size = size;
 		lru->cache_usage = 0;
+		lru->prot_size = 0;
+		lru->prot_usage = 0;
+	}
+	return lru;
+}
+
+/* Create a new segmented LRU cache of <size> entries, of which up to
+ * <prot_size> may be protected. The protected segment is limited so that at
+ * least one entry remains in the probation segment. Returns the new cache or
+ * NULL in case of allocation failure.
+ */
+struct lru64_head *lru64_new_segmented(int size, int prot_size)
+{
+	struct lru64_head *lru;
+
+	lru = lru64_new(size);
+	if (lru) {
+		if (prot_size >= size)
+			prot_size = size - 1;
+		lru->prot_size = prot_size > 0 ? prot_size : 0;
 	}
 	return lru;
 }
@@ -171,25 +229,28 @@ struct lru64_head *lru64_new(int size)
  */
 int lru64_destroy(struct lru64_head *lru)
 {
+	struct lru64_list *head;
 	struct lru64 *elem, *next;
 
 	if (!lru)
 		return 0;
 
-	elem = container_of(lru->list.p, typeof(*elem), lru);
-	while (&elem->lru != &lru->list) {
-		next = container_of(elem->lru.p, typeof(*next), lru);
-		if (elem->domain) {
-			/* not locked */
-			LIST_DELETE(&elem->lru);
-			eb64_delete(&elem->node);
-			if (elem->data && elem->free)
-				elem->free(elem->data);
-			free(elem);
-			lru->cache_usage--;
-			lru->cache_size--;
+	for (head = &lru->list; head; head = (head == &lru->list) ? &lru->prot : NULL) {
+		elem = container_of(head->p, typeof(*elem), lru);
+		while (&elem->lru != head) {
+			next = container_of(elem->lru.p, typeof(*next), lru);
+			if (elem->domain) {
+				/* not locked */
+				lru64_unlink(lru, elem);
+				eb64_delete(&elem->node);
+				if (elem->data && elem->free)
+					elem->free(elem->data);
+				free(elem);
+				lru->cache_usage--;
+				lru->cache_size--;
+			}
+			elem = next;
 		}
-		elem = next;
 	}
 
 	if (lru->cache_usage)
@@ -199,28 +260,33 @@ int lru64_destroy(struct lru64_head *lru)
 	return 0;
 }
 
-/* kill the <nb> least used entries from the <lru> cache */
+/* kill the <nb> least used entries from the <lru> cache, starting with the
+ * probation segment if it is segmented.
+ */
 void lru64_kill_oldest(struct lru64_head *lru, unsigned long int nb)
 {
+	struct lru64_list *head;
 	struct lru64 *elem, *next;
 
-	for (elem = container_of(lru->list.p, typeof(*elem), lru);
-	     nb && (&elem->lru != &lru->list);
-	     elem = next) {
-		next = container_of(elem->lru.p, typeof(*next), lru);
-		if (!elem->domain)
-			continue; /* locked entry */
+	for (head = &lru->list; head; head = (head == &lru->list) ? &lru->prot : NULL) {
+		for (elem = container_of(head->p, typeof(*elem), lru);
+		     nb && (&elem->lru != head);
+		     elem = next) {
+			next = container_of(elem->lru.p, typeof(*next), lru);
+			if (!elem->domain)
+				continue; /* locked entry */
 
-		LIST_DELETE(&elem->lru);
-		eb64_delete(&elem->node);
-		if (elem->data && elem->free)
-			elem->free(elem->data);
-		if (!lru->spare)
-			lru->spare = elem;
-		else
-			free(elem);
-		lru->cache_usage--;
-		nb--;
+			lru64_unlink(lru, elem);
+			eb64_delete(&elem->node);
+			if (elem->data && elem->free)
+				elem->free(elem->data);
+			if (!lru->spare)
+				lru->spare = elem;
+			else
+				free(elem);
+			lru->cache_usage--;
+			nb--;
+		}
 	}
 }
 
@@ -258,7 +324,7 @@ static long get_value(struct lru64_head *lru, long a)
 	/* do the painful work here */
 	a = sum(a);
 	if (item)
-		lru64_commit(item, (void *)a, lru, 1, 0);
+		lru64_commit(item, (void *)a, lru, 0, 0);
 	return a;
 }
 
@@ -281,13 +347,15 @@ int main(int argc, char **argv)
 	int total, loops;
 
 	if (argc < 2) {
-		printf("Need a number of rounds and optionally an LRU cache size (0..65536)\n");
+		printf("Need a number of rounds and optionally an LRU cache size (0..65536) and a protected size\n");
 		exit(1);
 	}
 
 	total = atoi(argv[1]);
 
-	if (argc > 2) /* cache size */
+	if (argc > 3) /* cache size and protected size */
+		lru = lru64_new_segmented(atoi(argv[2]), atoi(argv[3]));
+	else if (argc > 2) /* cache size */
 		lru = lru64_new(atoi(argv[2]));
 
 	ret = 0;
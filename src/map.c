@@ -10,6 +10,7 @@
  *
  */
 
+#include <errno.h>
 #include <stdio.h>
 #include <syslog.h>
 
@@ -17,8 +18,10 @@
 #include <haproxy/applet.h>
 #include <haproxy/arg.h>
 #include <haproxy/cli.h>
+#include <haproxy/clock.h>
 #include <haproxy/map.h>
 #include <haproxy/pattern.h>
+#include <haproxy/pool.h>
 #include <haproxy/regex.h>
 #include <haproxy/sample.h>
 #include <haproxy/sc_strm.h>
@@ -341,6 +344,44 @@ struct show_map_ctx {
 	} state;                /* state of the dump */
 };
 
+/* maximum number of lines read then loaded at once by "load map" */
+#define LOAD_MAP_BATCH 1000
+
+/* a batch of lines read by "load map", waiting to be loaded. The lines are
+ * read into <area> of LOAD_MAP_BATCH_BUFS buffers, and parsed into <lines>.
+ */
+#define LOAD_MAP_BATCH_BUFS 4
+struct load_map_batch {
+	struct {
+		char *key;
+		char *value;        /* NULL for ACLs */
+		int line;           /* line number in the file */
+	} lines[LOAD_MAP_BATCH];
+	char area[VAR_ARRAY];
+};
+
+/* context used by "load map" and "load acl" */
+struct load_map_ctx {
+	struct pat_ref *ref;
+	FILE *file;                 /* file being loaded */
+	struct load_map_batch *batch; /* current batch of lines */
+	char *err;                  /* error message, if any */
+	unsigned int display_flags;
+	unsigned int gen;           /* generation being loaded */
+	int commit;                 /* commit <gen> once loaded */
+	int line;                   /* current line number */
+	unsigned int entries;       /* number of loaded entries */
+	enum {
+		LOAD_ST_LOAD = 0,   /* loading entries from the file */
+		LOAD_ST_PURGE,      /* purging the replaced or the failed generations */
+		LOAD_ST_REPORT,     /* reporting the result */
+	} state;
+	ullong start_ns;            /* date the load started */
+	ullong load_ns;             /* time spent loading */
+	ssize_t heap_start;         /* heap usage before the load, -1 if unknown */
+	ssize_t heap_loaded;        /* heap usage after the load, -1 if unknown */
+};
+
 /* expects the current generation ID in ctx->curr_gen */
 static int cli_io_handler_pat_list(struct appctx *appctx)
 {
@@ -442,15 +483,36 @@ static int cli_io_handler_pats_list(struct appctx *appctx)
 
 	case STATE_LIST:
 		while (ctx->ref) {
+			struct pattern_expr *expr;
+			struct pat_cache_ctr *ctr;
+			unsigned long long hits = 0, misses = 0;
+			int thr;
+
 			chunk_reset(&trash);
 
+			/* sum the cache statistics of all the threads for all the
+			 * expressions using it.
+			 */
+			HA_SPIN_LOCK(PATREF_LOCK, &ctx->ref->lock);
+			list_for_each_entry(expr, &ctx->ref->pat, list) {
+				ctr = HA_ATOMIC_LOAD(&expr->cache_ctr);
+				if (!ctr)
+					continue;
+				for (thr = 0; thr < global.nbthread; thr++) {
+					hits   += HA_ATOMIC_LOAD(&ctr[thr].hits);
+					misses += HA_ATOMIC_LOAD(&ctr[thr].misses);
+				}
+			}
+			HA_SPIN_UNLOCK(PATREF_LOCK, &ctx->ref->lock);
+
 			/* Build messages. If the reference is used by another category than
 			 * the listed categories, display the information in the message.
 			 */
-			chunk_appendf(&trash, "%d (%s) %s. curr_ver=%u next_ver=%u entry_cnt=%llu\n", ctx->ref->unique_id,
+			chunk_appendf(&trash, "%d (%s) %s. curr_ver=%u next_ver=%u entry_cnt=%llu cache_hits=%llu cache_misses=%llu\n",
+			              ctx->ref->unique_id,
 			              ctx->ref->reference ? ctx->ref->reference : "",
 			              ctx->ref->display, ctx->ref->curr_gen, ctx->ref->next_gen,
-			              ctx->ref->entry_cnt);
+			              ctx->ref->entry_cnt, hits, misses);
 
 			if (applet_putchk(appctx, &trash) == -1) {
 				/* let's try again later from this stream. We add ourselves into
@@ -1148,12 +1210,255 @@ static int cli_parse_commit_map(char **args, char *payload, struct appctx *appct
 		if (ret != 0)
 			return cli_err(appctx, "Version number out of range.\n");
 
+		pat_ref_build_tries(ctx->ref);
+
 		/* delegate the clearing to the I/O handler which can yield */
 		return 0;
 	}
 	return 1;
 }
 
+/* Parses "load map" and "load acl". The file is opened here and loaded by
+ * cli_io_handler_load_map(). Without a version number, a new version is
+ * created and committed once complete.
+ */
+static int cli_parse_load_map(char **args, char *payload, struct appctx *appctx, void *private)
+{
+	struct load_map_ctx *ctx = applet_reserve_svcctx(appctx, sizeof(*ctx));
+	const char *gen = NULL;
+	char *err = NULL;
+
+	if (!cli_has_level(appctx, ACCESS_LVL_ADMIN))
+		return 1;
+
+	/* Set ACL or MAP flags. */
+	if (args[1][0] == 'm')
+		ctx->display_flags = PAT_REF_MAP;
+	else
+		ctx->display_flags = PAT_REF_ACL;
+
+	if (*args[2] == '@') {
+		gen = args[2] + 1;
+		args++;
+	}
+
+	if (!*args[2] || !*args[3]) {
+		if (ctx->display_flags == PAT_REF_MAP)
+			return cli_err(appctx, "'load map' expects a map identifier and a file name.\n");
+		else
+			return cli_err(appctx, "'load acl' expects an ACL identifier and a file name.\n");
+	}
+
+	/* lookup into the refs and check the map flag */
+	ctx->ref = pat_ref_lookup_ref(args[2]);
+	if (!ctx->ref ||
+	    !(ctx->ref->flags & ctx->display_flags)) {
+		if (ctx->display_flags == PAT_REF_MAP)
+			return cli_err(appctx, "Unknown map identifier. Please use #<id> or <file>.\n");
+		else
+			return cli_err(appctx, "Unknown ACL identifier. Please use #<id> or <file>.\n");
+	}
+
+	if ((ctx->display_flags & PAT_REF_ACL) &&
+	    (ctx->ref->flags & PAT_REF_SMP)) {
+		return cli_err(appctx,
+			       "This ACL is shared with a map containing samples. "
+			       "You must use the command 'load map' to load values.\n");
+	}
+
+	if (gen) {
+		ctx->gen = str2uic(gen);
+		if ((int)(ctx->gen - ctx->ref->next_gen) > 0) {
+			if (ctx->display_flags == PAT_REF_MAP)
+				return cli_err(appctx, "Version number in the future, please use 'prepare map' before.\n");
+			else
+				return cli_err(appctx, "Version number in the future, please use 'prepare acl' before.\n");
+		}
+	}
+	else {
+		ctx->gen = pat_ref_newgen(ctx->ref);
+		ctx->commit = 1;
+	}
+
+	ctx->file = fopen(args[3], "r");
+	if (!ctx->file) {
+		if (ctx->commit)
+			pat_ref_giveup(ctx->ref, ctx->gen);
+		return cli_dynerr(appctx, memprintf(&err, "Failed to open '%s': %s.\n", args[3], strerror(errno)));
+	}
+
+	ctx->batch = malloc(sizeof(*ctx->batch) + LOAD_MAP_BATCH_BUFS * (size_t)global.tune.bufsize);
+	if (!ctx->batch) {
+		if (ctx->commit)
+			pat_ref_giveup(ctx->ref, ctx->gen);
+		return cli_err(appctx, "Out of memory error.\n");
+	}
+
+	ctx->heap_start = malloc_heap_used();
+	ctx->start_ns = now_mono_time();
+	return 0;
+}
+
+/* Loads the entries of the file into the generation of the reference, by
+ * batches in order to remain responsive, then commits it if needed, purges
+ * the replaced generations and reports the loading rate and the memory usage.
+ * Each batch is read and parsed before taking the reference's lock, which is
+ * only held to load the entries. In case of error during a load into a new
+ * version, this version is purged. Errors only report the line number, so that
+ * the file's contents are never disclosed.
+ */
+static int cli_io_handler_load_map(struct appctx *appctx)
+{
+	struct load_map_ctx *ctx = appctx->svcctx;
+	size_t line_size = global.tune.bufsize;
+	size_t area_size = LOAD_MAP_BATCH_BUFS * line_size;
+	size_t used = 0;
+	char *key, *value;
+	int eof = 0;
+	int nb = 0;
+	int ret, i;
+
+	switch (ctx->state) {
+	case LOAD_ST_LOAD:
+		while (nb < LOAD_MAP_BATCH && area_size - used >= line_size) {
+			char *line = ctx->batch->area + used;
+
+			if (!fgets(line, line_size, ctx->file)) {
+				if (ferror(ctx->file))
+					memprintf(&ctx->err, "read error after line %d: %s", ctx->line, strerror(errno));
+				eof = 1;
+				break;
+			}
+
+			ctx->line++;
+			used += strlen(line) + 1;
+			if (!pat_ref_parse_line(line, &key,
+			                        (ctx->display_flags == PAT_REF_MAP) ? &value : NULL))
+				continue;
+
+			ctx->batch->lines[nb].key = key;
+			ctx->batch->lines[nb].value = (ctx->display_flags == PAT_REF_MAP) ? value : NULL;
+			ctx->batch->lines[nb].line = ctx->line;
+			nb++;
+		}
+
+		if (nb && !ctx->err) {
+			HA_SPIN_LOCK(PATREF_LOCK, &ctx->ref->lock);
+			for (i = 0; i < nb; i++) {
+				if (!pat_ref_load(ctx->ref, ctx->gen, ctx->batch->lines[i].key,
+				                  ctx->batch->lines[i].value, ctx->batch->lines[i].line, &ctx->err)) {
+					ha_free(&ctx->err);
+					memprintf(&ctx->err, "line %d: failed to load the entry", ctx->batch->lines[i].line);
+					break;
+				}
+				ctx->entries++;
+			}
+			HA_SPIN_UNLOCK(PATREF_LOCK, &ctx->ref->lock);
+		}
+
+		if (eof && !ctx->err) {
+			/* end of file */
+			ctx->load_ns = now_mono_time() - ctx->start_ns;
+			ctx->heap_loaded = malloc_heap_used();
+		}
+		else if (!ctx->err) {
+			/* let's come back later */
+			applet_have_more_data(appctx);
+			return 0;
+		}
+
+		fclose(ctx->file);
+		ctx->file = NULL;
+
+		if (!ctx->commit) {
+			/* entries loaded into an existing version are left
+			 * to the user even in case of error.
+			 */
+			ctx->state = LOAD_ST_REPORT;
+			goto report;
+		}
+
+		if (!ctx->err) {
+			HA_SPIN_LOCK(PATREF_LOCK, &ctx->ref->lock);
+			ret = pat_ref_commit(ctx->ref, ctx->gen);
+			HA_SPIN_UNLOCK(PATREF_LOCK, &ctx->ref->lock);
+			if (ret != 0)
+				memprintf(&ctx->err, "a more recent version was committed meanwhile");
+			else
+				pat_ref_build_tries(ctx->ref);
+		}
+
+		ctx->state = LOAD_ST_PURGE;
+		__fallthrough;
+
+	case LOAD_ST_PURGE:
+		/* on error, only the failed version is purged, otherwise all
+		 * the versions before the committed one are.
+		 */
+		HA_SPIN_LOCK(PATREF_LOCK, &ctx->ref->lock);
+		if (ctx->err)
+			ret = pat_ref_purge_range(ctx->ref, ctx->gen, ctx->gen, 100);
+		else
+			ret = pat_ref_purge_range(ctx->ref, ctx->gen - 1 - ((~0U) >> 1), ctx->gen - 1, 100);
+		HA_SPIN_UNLOCK(PATREF_LOCK, &ctx->ref->lock);
+
+		if (!ret) {
+			/* let's come back later */
+			applet_have_more_data(appctx);
+			return 0;
+		}
+
+		trim_all_pools();
+		ctx->state = LOAD_ST_REPORT;
+		__fallthrough;
+
+	case LOAD_ST_REPORT:
+	report:
+		chunk_reset(&trash);
+		if (ctx->err) {
+			chunk_appendf(&trash, "Load aborted, %s.\n", ctx->err);
+			if (!ctx->commit)
+				chunk_appendf(&trash, "Version %u is incomplete.\n", ctx->gen);
+		}
+		else {
+			chunk_appendf(&trash, "Loaded %u entries into version %u%s in %llu ms",
+			              ctx->entries, ctx->gen, ctx->commit ? " and committed it" : "",
+			              ctx->load_ns / 1000000ULL);
+			if (ctx->load_ns)
+				chunk_appendf(&trash, " (%llu entries/s)", ctx->entries * 1000000000ULL / ctx->load_ns);
+			chunk_appendf(&trash, ".\n");
+
+			if (ctx->heap_start >= 0 && ctx->heap_loaded >= 0) {
+				chunk_appendf(&trash, "Memory: %+lld kB for the loaded version",
+				              (long long)(ctx->heap_loaded - ctx->heap_start) / 1024);
+				if (ctx->commit) {
+					ssize_t heap_end = malloc_heap_used();
+
+					if (heap_end >= 0)
+						chunk_appendf(&trash, ", %+lld kB after purging the previous ones",
+						              (long long)(heap_end - ctx->heap_start) / 1024);
+				}
+				chunk_appendf(&trash, ".\n");
+			}
+		}
+
+		if (applet_putchk(appctx, &trash) == -1)
+			return 0;
+	}
+	return 1;
+}
+
+static void cli_release_load_map(struct appctx *appctx)
+{
+	struct load_map_ctx *ctx = appctx->svcctx;
+
+	/* an interrupted new version is purged by the next commit */
+	if (ctx->file)
+		fclose(ctx->file);
+	ha_free(&ctx->batch);
+	ha_free(&ctx->err);
+}
+
 /* register cli keywords */
 
 static struct cli_kw_list cli_kws = {{ },{
@@ -1162,6 +1467,7 @@ static struct cli_kw_list cli_kws = {{ },{
 	{ { "commit","acl", NULL }, "commit acl @<ver> <acl>                 : commit the ACL at this version",                         cli_parse_commit_map, cli_io_handler_clear_map, NULL },
 	{ { "del",   "acl", NULL }, "del acl <acl> [<key>|#<ref>]            : delete acl entries matching <key>",                      cli_parse_del_map, NULL },
 	{ { "get",   "acl", NULL }, "get acl <acl> <value>                   : report the patterns matching a sample for an ACL",       cli_parse_get_map, cli_io_handler_map_lookup, cli_release_mlook },
+	{ { "load",  "acl", NULL }, "load acl [@<ver>] <acl> <file>          : load an ACL from a file, committing it without version", cli_parse_load_map, cli_io_handler_load_map, cli_release_load_map },
 	{ { "prepare","acl",NULL }, "prepare acl <acl>                       : prepare a new version for atomic ACL replacement",       cli_parse_prepare_map, NULL },
 	{ { "show",  "acl", NULL }, "show acl [@<ver>] <acl>]                : report available acls or dump an acl's contents",        cli_parse_show_map, NULL },
 	{ { "add",   "map", NULL }, "add map [@<ver>] <map> <key> <val>      : add a map entry (payload supported instead of key/val)", cli_parse_add_map, NULL },
@@ -1169,6 +1475,7 @@ static struct cli_kw_list cli_kws = {{ },{
 	{ { "commit","map", NULL }, "commit map @<ver> <map>                 : commit the map at this version",                         cli_parse_commit_map, cli_io_handler_clear_map, NULL },
 	{ { "del",   "map", NULL }, "del map <map> [<key>|#<ref>]            : delete map entries matching <key>",                      cli_parse_del_map, NULL },
 	{ { "get",   "map", NULL }, "get map <acl> <value>                   : report the keys and values matching a sample for a map", cli_parse_get_map, cli_io_handler_map_lookup, cli_release_mlook },
+	{ { "load",  "map", NULL }, "load map [@<ver>] <map> <file>          : load a map from a file, committing it without version",  cli_parse_load_map, cli_io_handler_load_map, cli_release_load_map },
 	{ { "prepare","map",NULL }, "prepare map <acl>                       : prepare a new version for atomic map replacement",       cli_parse_prepare_map, NULL },
 	{ { "set",   "map", NULL }, "set map <map> [<key>|#<ref>] <value>    : modify a map entry",                                     cli_parse_set_map, NULL },
 	{ { "show",  "map", NULL }, "show map [@ver] [map]                   : report available maps or dump a map's contents",         cli_parse_show_map, NULL },
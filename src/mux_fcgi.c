@@ -32,6 +32,7 @@
 #include <haproxy/proxy.h>
 #include <haproxy/regex.h>
 #include <haproxy/sc_strm.h>
+#include <haproxy/server.h>
 #include <haproxy/session-t.h>
 #include <haproxy/stconn.h>
 #include <haproxy/stream.h>
@@ -2986,10 +2987,7 @@ struct task *fcgi_io_cb(struct task *t, void *ctx, unsigned int state)
 		struct server *srv = objt_server(conn->target);
 
 		HA_SPIN_LOCK(IDLE_CONNS_LOCK, &idle_conns[tid].idle_conns_lock);
-		if (conn_in_list == CO_FL_SAFE_LIST)
-			eb64_insert(&srv->per_thr[tid].safe_conns, &conn->hash_node->node);
-		else
-			eb64_insert(&srv->per_thr[tid].idle_conns, &conn->hash_node->node);
+		_srv_idle_tree_insert(srv, conn, conn_in_list == CO_FL_SAFE_LIST);
 		HA_SPIN_UNLOCK(IDLE_CONNS_LOCK, &idle_conns[tid].idle_conns_lock);
 	}
 	return t;
@@ -3091,7 +3089,9 @@ static int fcgi_wake(struct connection *conn)
 
 static int fcgi_ctl(struct connection *conn, enum mux_ctl_type mux_ctl, void *output)
 {
+	struct fcgi_conn *fconn = conn->ctx;
 	int ret = 0;
+
 	switch (mux_ctl) {
 	case MUX_STATUS:
 		if (!(conn->flags & CO_FL_WAIT_XPRT))
@@ -3099,6 +3099,18 @@ static int fcgi_ctl(struct connection *conn, enum mux_ctl_type mux_ctl, void *ou
 		return ret;
 	case MUX_EXIT_STATUS:
 		return MUX_ES_UNKNOWN;
+	case MUX_SET_IDLE:
+		/* the connection was migrated by fcgi_takeover() but will stay
+		 * idle, it may be stolen again. Its task was replaced and must
+		 * be armed again.
+		 */
+		HA_ATOMIC_OR(&fconn->wait_event.tasklet->state, TASK_F_USR1);
+		xprt_set_idle(conn, conn->xprt, conn->xprt_ctx);
+		if (fconn->task) {
+			fconn->task->expire = tick_add(now_ms, (fconn->state == FCGI_CS_CLOSED ? fconn->shut_timeout : fconn->timeout));
+			task_queue(fconn->task);
+		}
+		return 0;
 	default:
 		return -1;
 	}
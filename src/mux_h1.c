@@ -26,6 +26,7 @@
 #include <haproxy/mux_h1-t.h>
 #include <haproxy/pipe-t.h>
 #include <haproxy/proxy.h>
+#include <haproxy/server.h>
 #include <haproxy/session-t.h>
 #include <haproxy/stats.h>
 #include <haproxy/stconn.h>
@@ -3238,10 +3239,7 @@ struct task *h1_io_cb(struct task *t, void *ctx, unsigned int state)
 		struct server *srv = objt_server(conn->target);
 
 		HA_SPIN_LOCK(IDLE_CONNS_LOCK, &idle_conns[tid].idle_conns_lock);
-		if (conn_in_list == CO_FL_SAFE_LIST)
-			eb64_insert(&srv->per_thr[tid].safe_conns, &conn->hash_node->node);
-		else
-			eb64_insert(&srv->per_thr[tid].idle_conns, &conn->hash_node->node);
+		_srv_idle_tree_insert(srv, conn, conn_in_list == CO_FL_SAFE_LIST);
 		HA_SPIN_UNLOCK(IDLE_CONNS_LOCK, &idle_conns[tid].idle_conns_lock);
 	}
 	return t;
@@ -3962,6 +3960,15 @@ static int h1_ctl(struct connection *conn, enum mux_ctl_type mux_ctl, void *outp
 		if (!(h1c->wait_event.events & SUB_RETRY_RECV))
 			h1c->conn->xprt->subscribe(h1c->conn, h1c->conn->xprt_ctx, SUB_RETRY_RECV, &h1c->wait_event);
 		return 0;
+	case MUX_SET_IDLE:
+		/* the connection was migrated by h1_takeover() but will stay
+		 * idle, it may be stolen again. Its task was replaced and must
+		 * be armed again.
+		 */
+		HA_ATOMIC_OR(&h1c->wait_event.tasklet->state, TASK_F_USR1);
+		xprt_set_idle(conn, conn->xprt, conn->xprt_ctx);
+		h1_refresh_timeout(h1c);
+		return 0;
 	default:
 		return -1;
 	}
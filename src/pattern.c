@@ -24,6 +24,7 @@
 #include <haproxy/pattern.h>
 #include <haproxy/regex.h>
 #include <haproxy/sample.h>
+#include <haproxy/task.h>
 #include <haproxy/tools.h>
 #include <haproxy/xxhash.h>
 
@@ -171,6 +172,125 @@ static inline unsigned int make_4delim(unsigned char d1, unsigned char d2, unsig
 }
 
 
+/* Allocates the per-thread cache statistics of <expr> if no other thread did
+ * it first, and returns them, or NULL if they cannot be allocated.
+ */
+static struct pat_cache_ctr *pat_cache_ctr_alloc(struct pattern_expr *expr)
+{
+	struct pat_cache_ctr *ctr, *old = NULL;
+
+	ctr = calloc(global.nbthread, sizeof(*ctr));
+	if (!ctr)
+		return NULL;
+
+	if (!HA_ATOMIC_CAS(&expr->cache_ctr, &old, ctr)) {
+		free(ctr);
+		ctr = old;
+	}
+	return ctr;
+}
+
+/* Returns the calling thread's cache statistics of <expr>, or NULL if they
+ * cannot be allocated.
+ */
+static inline struct pat_cache_ctr *pat_cache_ctr(struct pattern_expr *expr)
+{
+	struct pat_cache_ctr *ctr = HA_ATOMIC_LOAD(&expr->cache_ctr);
+
+	if (unlikely(!ctr)) {
+		ctr = pat_cache_ctr_alloc(expr);
+		if (!ctr)
+			return NULL;
+	}
+	return &ctr[tid];
+}
+
+/* Looks up the result of the match of the <len> bytes at <key> against <expr>
+ * in the thread's pattern cache. If the returned entry has a domain, its data
+ * is the cached result. Otherwise the entry is new and the caller must commit
+ * its result with the revision stored in the entry, which is the one the
+ * lookup started with, so that a result computed while the reference changes
+ * is never considered valid. NULL is returned if nothing can be cached.
+ */
+static inline struct lru64 *pat_lru_get(struct pattern_expr *expr, const char *key, size_t len)
+{
+	struct pat_cache_ctr *ctr = pat_cache_ctr(expr);
+	unsigned long long revision;
+	struct lru64 *lru;
+
+	revision = HA_ATOMIC_LOAD(&expr->ref->revision);
+	__ha_barrier_load();
+
+	lru = lru64_get(XXH3(key, len, pat_lru_seed ^ (long)expr), pat_lru_tree, expr, revision);
+	if (lru && lru->domain) {
+		if (ctr)
+			ctr->hits++;
+	}
+	else {
+		if (ctr)
+			ctr->misses++;
+		if (lru)
+			lru->revision = revision;
+	}
+	return lru;
+}
+
+/* Returns the PAT_TRIE_STRIDE bits of the <len> bytes key <key> starting at bit
+ * <ofs>, counted from the most significant one. Bits past the key are zero.
+ */
+static inline unsigned int pat_trie_slot(const unsigned char *key, unsigned int len, unsigned int ofs)
+{
+	unsigned int i = ofs >> 3;
+	unsigned int w;
+
+	w  = (i < len) ? key[i] << 8 : 0;
+	w |= (i + 1 < len) ? key[i + 1] : 0;
+	return (w >> (16 - PAT_TRIE_STRIDE - (ofs & 7))) & ((1U << PAT_TRIE_STRIDE) - 1);
+}
+
+/* Returns the entry holding the longest prefix of trie <trie> which matches
+ * <key>, or NULL if none matches.
+ */
+static inline struct pattern_tree *pat_trie_lookup(const struct pat_trie *trie, const void *key)
+{
+	const struct pat_trie_node *node = trie->nodes;
+	unsigned int ofs = 0, slot;
+
+	while (1) {
+		slot = pat_trie_slot(key, trie->key_len, ofs);
+		if (!(node->child_map & (1ULL << slot)))
+			break;
+		node = &trie->nodes[node->child_base +
+		                    my_popcountll(node->child_map & ((1ULL << slot) - 1))];
+		ofs += PAT_TRIE_STRIDE;
+	}
+	return trie->leaves[node->leaf_base + my_popcountll(node->leaf_map << (63 - slot)) - 1];
+}
+
+/* Looks up <key> by longest match in the IP tree <idx> of <expr>, which is
+ * pattern_tree for 0 or pattern_tree_2 for 1. The compiled trie is used when
+ * it is still valid for the reference's revision. Returns the matching entry
+ * of the current generation, or NULL if none matches.
+ */
+static inline struct pattern_tree *pat_lookup_ip_tree(struct pattern_expr *expr, int idx, const void *key)
+{
+	struct pat_trie *trie = expr->trie[idx];
+	struct ebmb_node *node;
+	struct pattern_tree *elt;
+
+	if (trie && trie->revision == HA_ATOMIC_LOAD(&expr->ref->revision))
+		return pat_trie_lookup(trie, key);
+
+	node = ebmb_lookup_longest(idx ? &expr->pattern_tree_2 : &expr->pattern_tree, key);
+	while (node) {
+		elt = ebmb_entry(node, struct pattern_tree, node);
+		if (elt->ref->gen_id == expr->ref->curr_gen)
+			return elt;
+		node = ebmb_lookup_shorter(node);
+	}
+	return NULL;
+}
+
 /*
  *
  * These functions are exported and may be used by any other component.
@@ -492,10 +612,7 @@ struct pattern *pat_match_str(struct sample *smp, struct pattern_expr *expr, int
 
 	/* look in the list */
 	if (pat_lru_tree) {
-		unsigned long long seed = pat_lru_seed ^ (long)expr;
-
-		lru = lru64_get(XXH3(smp->data.u.str.area, smp->data.u.str.data, seed),
-				pat_lru_tree, expr, expr->ref->revision);
+		lru = pat_lru_get(expr, smp->data.u.str.area, smp->data.u.str.data);
 		if (lru && lru->domain) {
 			ret = lru->data;
 			return ret;
@@ -521,7 +638,7 @@ struct pattern *pat_match_str(struct sample *smp, struct pattern_expr *expr, int
 	}
 
 	if (lru)
-		lru64_commit(lru, ret, expr, expr->ref->revision, NULL);
+		lru64_commit(lru, ret, expr, lru->revision, NULL);
 
 	return ret;
 }
@@ -535,10 +652,7 @@ struct pattern *pat_match_bin(struct sample *smp, struct pattern_expr *expr, int
 	struct lru64 *lru = NULL;
 
 	if (pat_lru_tree) {
-		unsigned long long seed = pat_lru_seed ^ (long)expr;
-
-		lru = lru64_get(XXH3(smp->data.u.str.area, smp->data.u.str.data, seed),
-				pat_lru_tree, expr, expr->ref->revision);
+		lru = pat_lru_get(expr, smp->data.u.str.area, smp->data.u.str.data);
 		if (lru && lru->domain) {
 			ret = lru->data;
 			return ret;
@@ -561,7 +675,7 @@ struct pattern *pat_match_bin(struct sample *smp, struct pattern_expr *expr, int
 	}
 
 	if (lru)
-		lru64_commit(lru, ret, expr, expr->ref->revision, NULL);
+		lru64_commit(lru, ret, expr, lru->revision, NULL);
 
 	return ret;
 }
@@ -604,10 +718,7 @@ struct pattern *pat_match_reg(struct sample *smp, struct pattern_expr *expr, int
 	struct lru64 *lru = NULL;
 
 	if (pat_lru_tree) {
-		unsigned long long seed = pat_lru_seed ^ (long)expr;
-
-		lru = lru64_get(XXH3(smp->data.u.str.area, smp->data.u.str.data, seed),
-				pat_lru_tree, expr, expr->ref->revision);
+		lru = pat_lru_get(expr, smp->data.u.str.area, smp->data.u.str.data);
 		if (lru && lru->domain) {
 			ret = lru->data;
 			return ret;
@@ -627,7 +738,7 @@ struct pattern *pat_match_reg(struct sample *smp, struct pattern_expr *expr, int
 	}
 
 	if (lru)
-		lru64_commit(lru, ret, expr, expr->ref->revision, NULL);
+		lru64_commit(lru, ret, expr, lru->revision, NULL);
 
 	return ret;
 }
@@ -687,10 +798,7 @@ struct pattern *pat_match_beg(struct sample *smp, struct pattern_expr *expr, int
 
 	/* look in the list */
 	if (pat_lru_tree) {
-		unsigned long long seed = pat_lru_seed ^ (long)expr;
-
-		lru = lru64_get(XXH3(smp->data.u.str.area, smp->data.u.str.data, seed),
-				pat_lru_tree, expr, expr->ref->revision);
+		lru = pat_lru_get(expr, smp->data.u.str.area, smp->data.u.str.data);
 		if (lru && lru->domain) {
 			ret = lru->data;
 			return ret;
@@ -716,7 +824,7 @@ struct pattern *pat_match_beg(struct sample *smp, struct pattern_expr *expr, int
 	}
 
 	if (lru)
-		lru64_commit(lru, ret, expr, expr->ref->revision, NULL);
+		lru64_commit(lru, ret, expr, lru->revision, NULL);
 
 	return ret;
 }
@@ -731,10 +839,7 @@ struct pattern *pat_match_end(struct sample *smp, struct pattern_expr *expr, int
 	struct lru64 *lru = NULL;
 
 	if (pat_lru_tree) {
-		unsigned long long seed = pat_lru_seed ^ (long)expr;
-
-		lru = lru64_get(XXH3(smp->data.u.str.area, smp->data.u.str.data, seed),
-				pat_lru_tree, expr, expr->ref->revision);
+		lru = pat_lru_get(expr, smp->data.u.str.area, smp->data.u.str.data);
 		if (lru && lru->domain) {
 			ret = lru->data;
 			return ret;
@@ -760,7 +865,7 @@ struct pattern *pat_match_end(struct sample *smp, struct pattern_expr *expr, int
 	}
 
 	if (lru)
-		lru64_commit(lru, ret, expr, expr->ref->revision, NULL);
+		lru64_commit(lru, ret, expr, lru->revision, NULL);
 
 	return ret;
 }
@@ -779,10 +884,7 @@ struct pattern *pat_match_sub(struct sample *smp, struct pattern_expr *expr, int
 	struct lru64 *lru = NULL;
 
 	if (pat_lru_tree) {
-		unsigned long long seed = pat_lru_seed ^ (long)expr;
-
-		lru = lru64_get(XXH3(smp->data.u.str.area, smp->data.u.str.data, seed),
-				pat_lru_tree, expr, expr->ref->revision);
+		lru = pat_lru_get(expr, smp->data.u.str.area, smp->data.u.str.data);
 		if (lru && lru->domain) {
 			ret = lru->data;
 			return ret;
@@ -822,7 +924,7 @@ struct pattern *pat_match_sub(struct sample *smp, struct pattern_expr *expr, int
 	}
  leave:
 	if (lru)
-		lru64_commit(lru, ret, expr, expr->ref->revision, NULL);
+		lru64_commit(lru, ret, expr, lru->revision, NULL);
 
 	return ret;
 }
@@ -967,7 +1069,6 @@ struct pattern *pat_match_ip(struct sample *smp, struct pattern_expr *expr, int
 	unsigned int v4; /* in network byte order */
 	struct in6_addr tmp6;
 	struct in_addr *s;
-	struct ebmb_node *node;
 	struct pattern_tree *elt;
 	struct pattern_list *lst;
 	struct pattern *pattern;
@@ -978,13 +1079,8 @@ struct pattern *pat_match_ip(struct sample *smp, struct pattern_expr *expr, int
 		 * the longest match method.
 		 */
 		s = &smp->data.u.ipv4;
-		node = ebmb_lookup_longest(&expr->pattern_tree, &s->s_addr);
-		while (node) {
-			elt = ebmb_entry(node, struct pattern_tree, node);
-			if (elt->ref->gen_id != expr->ref->curr_gen) {
-				node = ebmb_lookup_shorter(node);
-				continue;
-			}
+		elt = pat_lookup_ip_tree(expr, 0, &s->s_addr);
+		if (elt) {
 			if (fill) {
 				static_pattern.data = elt->data;
 				static_pattern.ref = elt->ref;
@@ -1004,13 +1100,8 @@ struct pattern *pat_match_ip(struct sample *smp, struct pattern_expr *expr, int
 		memset(&tmp6, 0, 10);
 		write_u16(&tmp6.s6_addr[10], htons(0xffff));
 		write_u32(&tmp6.s6_addr[12], smp->data.u.ipv4.s_addr);
-		node = ebmb_lookup_longest(&expr->pattern_tree_2, &tmp6);
-		while (node) {
-			elt = ebmb_entry(node, struct pattern_tree, node);
-			if (elt->ref->gen_id != expr->ref->curr_gen) {
-				node = ebmb_lookup_shorter(node);
-				continue;
-			}
+		elt = pat_lookup_ip_tree(expr, 1, &tmp6);
+		if (elt) {
 			if (fill) {
 				static_pattern.data = elt->data;
 				static_pattern.ref = elt->ref;
@@ -1028,13 +1119,8 @@ struct pattern *pat_match_ip(struct sample *smp, struct pattern_expr *expr, int
 		/* Lookup an IPv6 address in the expression's pattern tree using
 		 * the longest match method.
 		 */
-		node = ebmb_lookup_longest(&expr->pattern_tree_2, &smp->data.u.ipv6);
-		while (node) {
-			elt = ebmb_entry(node, struct pattern_tree, node);
-			if (elt->ref->gen_id != expr->ref->curr_gen) {
-				node = ebmb_lookup_shorter(node);
-				continue;
-			}
+		elt = pat_lookup_ip_tree(expr, 1, &smp->data.u.ipv6);
+		if (elt) {
 			if (fill) {
 				static_pattern.data = elt->data;
 				static_pattern.ref = elt->ref;
@@ -1065,13 +1151,8 @@ struct pattern *pat_match_ip(struct sample *smp, struct pattern_expr *expr, int
 			/* Lookup an IPv4 address in the expression's pattern tree using the longest
 			 * match method.
 			 */
-			node = ebmb_lookup_longest(&expr->pattern_tree, &v4);
-			while (node) {
-				elt = ebmb_entry(node, struct pattern_tree, node);
-				if (elt->ref->gen_id != expr->ref->curr_gen) {
-					node = ebmb_lookup_shorter(node);
-					continue;
-				}
+			elt = pat_lookup_ip_tree(expr, 0, &v4);
+			if (elt) {
 				if (fill) {
 					static_pattern.data = elt->data;
 					static_pattern.ref = elt->ref;
@@ -1203,9 +1284,10 @@ int pat_idx_list_val(struct pattern_expr *expr, struct pattern *pat, char **err)
 	/* chain pattern in the expression */
 	LIST_APPEND(&expr->patterns, &patl->list);
 	/* and from the reference */
+	patl->expr = expr;
 	patl->from_ref = pat->ref->list_head;
 	pat->ref->list_head = &patl->from_ref;
-	expr->ref->revision = rdtsc();
+	pat_ref_changed(expr->ref, pat->ref->gen_id);
 	expr->ref->entry_cnt++;
 
 	/* that's ok */
@@ -1236,9 +1318,10 @@ int pat_idx_list_ptr(struct pattern_expr *expr, struct pattern *pat, char **err)
 	/* chain pattern in the expression */
 	LIST_APPEND(&expr->patterns, &patl->list);
 	/* and from the reference */
+	patl->expr = expr;
 	patl->from_ref = pat->ref->list_head;
 	pat->ref->list_head = &patl->from_ref;
-	expr->ref->revision = rdtsc();
+	pat_ref_changed(expr->ref, pat->ref->gen_id);
 	expr->ref->entry_cnt++;
 
 	/* that's ok */
@@ -1270,9 +1353,10 @@ int pat_idx_list_str(struct pattern_expr *expr, struct pattern *pat, char **err)
 	/* chain pattern in the expression */
 	LIST_APPEND(&expr->patterns, &patl->list);
 	/* and from the reference */
+	patl->expr = expr;
 	patl->from_ref = pat->ref->list_head;
 	pat->ref->list_head = &patl->from_ref;
-	expr->ref->revision = rdtsc();
+	pat_ref_changed(expr->ref, pat->ref->gen_id);
 	expr->ref->entry_cnt++;
 
 	/* that's ok */
@@ -1304,9 +1388,10 @@ int pat_idx_list_reg_cap(struct pattern_expr *expr, struct pattern *pat, int cap
 	/* chain pattern in the expression */
 	LIST_APPEND(&expr->patterns, &patl->list);
 	/* and from the reference */
+	patl->expr = expr;
 	patl->from_ref = pat->ref->list_head;
 	pat->ref->list_head = &patl->from_ref;
-	expr->ref->revision = rdtsc();
+	pat_ref_changed(expr->ref, pat->ref->gen_id);
 	expr->ref->entry_cnt++;
 
 	/* that's ok */
@@ -1356,9 +1441,10 @@ int pat_idx_tree_ip(struct pattern_expr *expr, struct pattern *pat, char **err)
 
 			/* Insert the entry. */
 			ebmb_insert_prefix(&expr->pattern_tree, &node->node, 4);
+			node->expr = expr;
 			node->from_ref = pat->ref->tree_head;
 			pat->ref->tree_head = &node->from_ref;
-			expr->ref->revision = rdtsc();
+			pat_ref_changed(expr->ref, pat->ref->gen_id);
 			expr->ref->entry_cnt++;
 
 			/* that's ok */
@@ -1387,9 +1473,10 @@ int pat_idx_tree_ip(struct pattern_expr *expr, struct pattern *pat, char **err)
 
 		/* Insert the entry. */
 		ebmb_insert_prefix(&expr->pattern_tree_2, &node->node, 16);
+		node->expr = expr;
 		node->from_ref = pat->ref->tree_head;
 		pat->ref->tree_head = &node->from_ref;
-		expr->ref->revision = rdtsc();
+		pat_ref_changed(expr->ref, pat->ref->gen_id);
 		expr->ref->entry_cnt++;
 
 		/* that's ok */
@@ -1434,9 +1521,10 @@ int pat_idx_tree_str(struct pattern_expr *expr, struct pattern *pat, char **err)
 
 	/* index the new node */
 	ebst_insert(&expr->pattern_tree, &node->node);
+	node->expr = expr;
 	node->from_ref = pat->ref->tree_head;
 	pat->ref->tree_head = &node->from_ref;
-	expr->ref->revision = rdtsc();
+	pat_ref_changed(expr->ref, pat->ref->gen_id);
 	expr->ref->entry_cnt++;
 
 	/* that's ok */
@@ -1479,15 +1567,30 @@ int pat_idx_tree_pfx(struct pattern_expr *expr, struct pattern *pat, char **err)
 
 	/* index the new node */
 	ebmb_insert_prefix(&expr->pattern_tree, &node->node, len);
+	node->expr = expr;
 	node->from_ref = pat->ref->tree_head;
 	pat->ref->tree_head = &node->from_ref;
-	expr->ref->revision = rdtsc();
+	pat_ref_changed(expr->ref, pat->ref->gen_id);
 	expr->ref->entry_cnt++;
 
 	/* that's ok */
 	return 1;
 }
 
+/* Called by pat_delete_gen() with the PATREF lock held before tree node <node>
+ * of reference <ref> is deleted, so that a job collecting the tree resumes
+ * from the next node. Deleting an entry of the current generation changes the
+ * revision, which restarts the job anyway, but entries of other generations
+ * may be purged at any time.
+ */
+static inline void pat_trie_job_skip(struct pat_ref *ref, struct ebmb_node *node)
+{
+	struct pat_trie_job *job = ref->trie_job;
+
+	if (job && job->next == node)
+		job->next = ebmb_next(node);
+}
+
 /* Deletes all patterns from reference <elt>. Note that all of their
  * expressions must be locked, and the pattern lock must be held as well.
  */
@@ -1503,6 +1606,7 @@ void pat_delete_gen(struct pat_ref *ref, struct pat_ref_elt *elt)
 		node = *node;
 		BUG_ON(tree->ref != elt);
 
+		pat_trie_job_skip(ref, &tree->node);
 		ebmb_delete(&tree->node);
 		free(tree->data);
 		free(tree);
@@ -1525,7 +1629,7 @@ void pat_delete_gen(struct pat_ref *ref, struct pat_ref_elt *elt)
 	}
 
 	/* update revision number to refresh the cache */
-	ref->revision = rdtsc();
+	pat_ref_changed(ref, elt->gen_id);
 	ref->entry_cnt--;
 	elt->tree_head = NULL;
 	elt->list_head = NULL;
@@ -1686,15 +1790,19 @@ struct pat_ref_elt *pat_ref_find_elt(struct pat_ref *ref, const char *key)
 
 /* This function modifies the sample of pat_ref_elt <elt> in all expressions
  * found under <ref> to become <value>. It is assumed that the caller has
- * already verified that <elt> belongs to <ref>.
+ * already verified that <elt> belongs to <ref>. The new samples are allocated
+ * and parsed before locking the expressions, which are then only locked for
+ * the time needed to replace the pointer, so that lookups are not blocked.
  */
 static inline int pat_ref_set_elt(struct pat_ref *ref, struct pat_ref_elt *elt,
                                   const char *value, char **err)
 {
 	struct pattern_expr *expr;
-	struct sample_data **data;
-	char *sample;
+	struct sample_data **data, **smps = NULL;
+	struct sample_data *smp, *old;
+	char *sample = NULL;
 	struct sample_data test;
+	int nb = 0, i;
 
 	/* Try all needed converters. */
 	list_for_each_entry(expr, &ref->pat, list) {
@@ -1705,27 +1813,56 @@ static inline int pat_ref_set_elt(struct pat_ref *ref, struct pat_ref_elt *elt,
 			memprintf(err, "unable to parse '%s'", value);
 			return 0;
 		}
+		nb++;
 	}
 
-	/* Modify pattern from reference. */
+	/* Modify pattern from reference, and allocate all samples first so
+	 * that nothing is changed on failure.
+	 */
 	sample = strdup(value);
-	if (!sample) {
-		memprintf(err, "out of memory error");
-		return 0;
+	if (!sample)
+		goto oom;
+
+	if (nb) {
+		smps = calloc(nb, sizeof(*smps));
+		if (!smps)
+			goto oom;
+		for (i = 0; i < nb; i++) {
+			smps[i] = malloc(sizeof(*smps[i]));
+			if (!smps[i])
+				goto oom;
+		}
 	}
+
 	/* Load sample in each reference. All the conversions are tested
-	 * below, normally these calls don't fail.
+	 * above, normally these calls don't fail.
 	 */
+	i = 0;
 	list_for_each_entry(expr, &ref->pat, list) {
 		if (!expr->pat_head->parse_smp)
 			continue;
 
-		HA_RWLOCK_WRLOCK(PATEXP_LOCK, &expr->lock);
+		smp = smps[i++];
 		data = pattern_find_smp(expr, elt);
-		if (data && *data && !expr->pat_head->parse_smp(sample, *data))
-			*data = NULL;
+		if (!data || !*data) {
+			free(smp);
+			continue;
+		}
+
+		if (!expr->pat_head->parse_smp(sample, smp)) {
+			free(smp);
+			smp = NULL;
+		}
+
+		HA_RWLOCK_WRLOCK(PATEXP_LOCK, &expr->lock);
+		old = *data;
+		*data = smp;
 		HA_RWLOCK_WRUNLOCK(PATEXP_LOCK, &expr->lock);
+
+		/* readers copy the sample under the lock, it's unused now */
+		free(old);
 	}
+	free(smps);
 
 	/* free old sample only when all exprs are updated */
 	free(elt->sample);
@@ -1733,6 +1870,16 @@ static inline int pat_ref_set_elt(struct pat_ref *ref, struct pat_ref_elt *elt,
 
 
 	return 1;
+
+ oom:
+	if (smps) {
+		for (i = 0; i < nb; i++)
+			free(smps[i]);
+		free(smps);
+	}
+	free(sample);
+	memprintf(err, "out of memory error");
+	return 0;
 }
 
 /* This function modifies the sample of pat_ref_elt <refelt> in all expressions
@@ -2097,6 +2244,530 @@ int pat_ref_prune(struct pat_ref *ref)
 	return pat_ref_purge_range(ref, 0, ~0, 100);
 }
 
+/* A prefix collected from an IP tree to build a trie. The key is masked to
+ * <plen> bits.
+ */
+struct pat_trie_pfx {
+	unsigned char key[16];
+	struct pattern_tree *elt;
+	unsigned int plen;
+};
+
+/* A node of the trie left to build from the <nb> prefixes starting at <first>,
+ * which share their first <ofs> bits. <def> is the longest prefix shorter than
+ * this which covers the node, if any.
+ */
+struct pat_trie_todo {
+	size_t first;
+	size_t nb;
+	unsigned int nidx;
+	unsigned int ofs;
+	struct pattern_tree *def;
+};
+
+/* Nodes are built depth first, so that at most all but one of the children of
+ * each level are waiting to be built.
+ */
+#define PAT_TRIE_MAX_TODO (((128 + PAT_TRIE_STRIDE - 1) / PAT_TRIE_STRIDE) << PAT_TRIE_STRIDE)
+
+/* Amount of work a trie build job performs per polling loop, in number of
+ * prefixes sorted or dispatched, in order to remain responsive. Collecting a
+ * prefix costs PAT_TRIE_COLLECT_COST since it is where the tree is walked,
+ * and it is the only step performed under the PATREF lock.
+ */
+#define PAT_TRIE_BUDGET       10000
+#define PAT_TRIE_COLLECT_COST 10
+
+/* Nodes with more prefixes than this locate their children using a binary
+ * search instead of visiting all prefixes.
+ */
+#define PAT_TRIE_SCAN_MAX     1024
+
+/* Releases trie <trie>, which may be NULL */
+static void pat_trie_free(struct pat_trie *trie)
+{
+	if (!trie)
+		return;
+	free(trie->nodes);
+	free(trie->leaves);
+	free(trie);
+}
+
+/* Returns the position past the prefixes of slot <slot> of a node at offset
+ * <ofs>, among the <nb> sorted prefixes at <pfx>, starting from <i>, which
+ * must be the first one of this slot or of a later one. Large ranges are
+ * searched by dichotomy.
+ */
+static inline size_t pat_trie_slot_end(const struct pat_trie_pfx *pfx, size_t i, size_t nb,
+                                       unsigned int ofs, unsigned int slot)
+{
+	size_t mid;
+
+	if (nb - i <= PAT_TRIE_SCAN_MAX) {
+		while (i < nb && pat_trie_slot(pfx[i].key, sizeof(pfx[i].key), ofs) <= slot)
+			i++;
+		return i;
+	}
+
+	while (i < nb) {
+		mid = i + (nb - i) / 2;
+		if (pat_trie_slot(pfx[mid].key, sizeof(pfx[mid].key), ofs) <= slot)
+			i = mid + 1;
+		else
+			nb = mid;
+	}
+	return i;
+}
+
+/* Builds the node of the trie described by <todo> from the sorted prefixes
+ * collected by job <job>. Each slot is first assigned the longest prefix
+ * covering it which ends within this node, then slots holding longer prefixes
+ * lead to children, which are queued. In a given slot, the shorter prefixes
+ * sort before the longer ones since their keys are masked, so that only them
+ * need to be visited, and the prefixes of each child are contiguous. Returns
+ * 0 on memory allocation failure, otherwise non-zero.
+ */
+static int pat_trie_build_node(struct pat_trie_job *job, const struct pat_trie_todo *todo)
+{
+	const struct pat_trie_pfx *pfx = job->pfx + todo->first;
+	struct pattern_tree *slots[1 << PAT_TRIE_STRIDE];
+	int plens[1 << PAT_TRIE_STRIDE];
+	size_t first[1 << PAT_TRIE_STRIDE], count[1 << PAT_TRIE_STRIDE];
+	uint64_t child_map = 0, leaf_map = 0;
+	unsigned int child_base, leaf_base, nb_children, nb_leaves;
+	unsigned int ofs = todo->ofs;
+	unsigned int slot, cover, lo, hi;
+	struct pattern_tree *last = NULL;
+	struct pat_trie *trie = job->trie;
+	struct pat_trie_todo *child;
+	size_t i, end;
+	void *ptr;
+
+	for (slot = 0; slot < (1 << PAT_TRIE_STRIDE); slot++) {
+		slots[slot] = todo->def;
+		plens[slot] = -1;
+		count[slot] = 0;
+	}
+
+	for (slot = 0, i = 0; i < todo->nb; slot++) {
+		end = pat_trie_slot_end(pfx, i, todo->nb, ofs, slot);
+
+		/* each prefix ending here covers all slots sharing its first bits */
+		for (; i < end && pfx[i].plen <= ofs + PAT_TRIE_STRIDE; i++) {
+			lo = slot & ~((1U << (ofs + PAT_TRIE_STRIDE - pfx[i].plen)) - 1);
+			hi = lo + (1U << (ofs + PAT_TRIE_STRIDE - pfx[i].plen));
+			for (cover = lo; cover < hi; cover++) {
+				if ((int)pfx[i].plen > plens[cover]) {
+					slots[cover] = pfx[i].elt;
+					plens[cover] = pfx[i].plen;
+				}
+			}
+		}
+
+		if (i < end) {
+			first[slot] = todo->first + i;
+			count[slot] = end - i;
+			child_map |= 1ULL << slot;
+			i = end;
+		}
+	}
+
+	/* count the leaves, slots leading to a child continue the run */
+	nb_leaves = 0;
+	for (slot = 0; slot < (1 << PAT_TRIE_STRIDE); slot++) {
+		if (child_map & (1ULL << slot))
+			continue;
+		if (!leaf_map || slots[slot] != last) {
+			leaf_map |= 1ULL << slot;
+			last = slots[slot];
+			nb_leaves++;
+		}
+	}
+
+	nb_children = my_popcountll(child_map);
+	if (trie->nb_nodes + nb_children > job->nodes_size) {
+		job->nodes_size = (trie->nb_nodes + nb_children) * 2;
+		ptr = realloc(trie->nodes, job->nodes_size * sizeof(*trie->nodes));
+		if (!ptr)
+			return 0;
+		trie->nodes = ptr;
+	}
+
+	if (trie->nb_leaves + nb_leaves > job->leaves_size) {
+		job->leaves_size = (trie->nb_leaves + nb_leaves) * 2;
+		ptr = realloc(trie->leaves, job->leaves_size * sizeof(*trie->leaves));
+		if (!ptr)
+			return 0;
+		trie->leaves = ptr;
+	}
+
+	child_base = trie->nb_nodes;
+	trie->nb_nodes += nb_children;
+	leaf_base = trie->nb_leaves;
+	for (slot = 0; slot < (1 << PAT_TRIE_STRIDE); slot++)
+		if (leaf_map & (1ULL << slot))
+			trie->leaves[trie->nb_leaves++] = slots[slot];
+
+	trie->nodes[todo->nidx].child_map  = child_map;
+	trie->nodes[todo->nidx].leaf_map   = leaf_map;
+	trie->nodes[todo->nidx].child_base = child_base;
+	trie->nodes[todo->nidx].leaf_base  = leaf_base;
+
+	/* queue the children backwards so that the first one is built next */
+	for (slot = 1 << PAT_TRIE_STRIDE; slot-- > 0; ) {
+		if (!(child_map & (1ULL << slot)))
+			continue;
+		child = &job->todo[job->nb_todo++];
+		child->first = first[slot];
+		child->nb    = count[slot];
+		child->nidx  = child_base + --nb_children;
+		child->ofs   = ofs + PAT_TRIE_STRIDE;
+		child->def   = slots[slot];
+	}
+	return 1;
+}
+
+/* Releases everything job <job> allocated for the tree being compiled */
+static void pat_trie_job_reset(struct pat_trie_job *job)
+{
+	ha_free(&job->pfx);
+	ha_free(&job->tmp);
+	ha_free(&job->todo);
+	pat_trie_free(job->trie);
+	job->trie = NULL;
+	job->nb = job->size = 0;
+}
+
+/* Collects up to <budget> entries of the tree being compiled by job <job>.
+ * Returns the budget left, or -1 if the reference's revision changed and the
+ * job must restart.
+ */
+static int pat_trie_job_collect(struct pat_trie_job *job, int budget)
+{
+	struct pat_trie_pfx *pfx;
+	struct pattern_tree *elt;
+	struct ebmb_node *node;
+	void *ptr;
+
+	HA_SPIN_LOCK(PATREF_LOCK, &job->ref->lock);
+	if (job->ref->revision != job->revision) {
+		HA_SPIN_UNLOCK(PATREF_LOCK, &job->ref->lock);
+		return -1;
+	}
+
+	for (node = job->next; node && budget > 0; node = ebmb_next(node)) {
+		budget -= PAT_TRIE_COLLECT_COST;
+		elt = ebmb_entry(node, struct pattern_tree, node);
+		if (elt->ref->gen_id != job->ref->curr_gen)
+			continue;
+
+		if (job->nb == job->size) {
+			/* all entries of the reference usually fit at once */
+			job->size = job->size ? job->size * 2 : MAX(job->ref->entry_cnt, 1024ULL);
+			ptr = realloc(job->pfx, job->size * sizeof(*job->pfx));
+			if (!ptr) {
+				node = NULL;
+				job->nb = 0;
+				break;
+			}
+			job->pfx = ptr;
+		}
+
+		pfx = &job->pfx[job->nb++];
+		pfx->plen = node->node.pfx;
+		memset(pfx->key, 0, sizeof(pfx->key));
+		memcpy(pfx->key, node->key, (pfx->plen + 7) / 8);
+		if (pfx->plen & 7)
+			pfx->key[pfx->plen / 8] &= 0xff << (8 - (pfx->plen & 7));
+		pfx->elt = elt;
+	}
+	job->next = node;
+	HA_SPIN_UNLOCK(PATREF_LOCK, &job->ref->lock);
+	return budget;
+}
+
+/* Sorts the prefixes collected by job <job> by key then by length, keeping
+ * the tree's order for duplicates, using a least significant byte first radix
+ * sort which performs up to <budget> steps at once. Returns the budget left,
+ * which is positive once sorted.
+ */
+static int pat_trie_job_sort(struct pat_trie_job *job, int budget)
+{
+	unsigned int key_len = job->idx ? 16 : 4;
+	struct pat_trie_pfx *pfx;
+	unsigned char byte;
+	size_t i, sum, cnt;
+
+	while (job->pass <= key_len) {
+		while (job->pos < 2 * job->nb) {
+			if (budget-- <= 0)
+				return 0;
+
+			/* the length first, then the key's bytes backwards */
+			i = job->pos % job->nb;
+			pfx = &job->pfx[i];
+			byte = job->pass ? pfx->key[key_len - job->pass] : pfx->plen;
+			if (job->pos++ < job->nb)
+				job->cnt[byte]++;
+			else
+				job->tmp[job->cnt[byte]++] = *pfx;
+
+			if (job->pos == job->nb) {
+				/* nothing to move if all prefixes share this byte */
+				if (job->cnt[byte] == job->nb)
+					break;
+
+				/* turn the counts into positions */
+				for (sum = i = 0; i < 256; i++) {
+					cnt = job->cnt[i];
+					job->cnt[i] = sum;
+					sum += cnt;
+				}
+			}
+		}
+
+		if (job->pos > job->nb) {
+			pfx = job->pfx;
+			job->pfx = job->tmp;
+			job->tmp = pfx;
+		}
+		memset(job->cnt, 0, sizeof(job->cnt));
+		job->pos = 0;
+		job->pass++;
+	}
+	return budget > 0 ? budget : 1;
+}
+
+/* Builds up to <budget> prefixes' worth of nodes of the trie of job <job>.
+ * Returns the budget left, which is positive once built, or -1 on memory
+ * allocation failure.
+ */
+static int pat_trie_job_build(struct pat_trie_job *job, int budget)
+{
+	struct pat_trie_todo todo;
+
+	while (job->nb_todo) {
+		if (budget <= 0)
+			return 0;
+		todo = job->todo[--job->nb_todo];
+		if (!pat_trie_build_node(job, &todo))
+			return -1;
+		budget -= (int)MIN(todo.nb, (size_t)PAT_TRIE_SCAN_MAX) + (1 << PAT_TRIE_STRIDE);
+	}
+	return budget > 0 ? budget : 1;
+}
+
+/* Publishes the trie built by job <job> for the tree it compiled, or removes
+ * the previous one if none was built, provided that the reference was not
+ * changed meanwhile. The unused room of the trie is released first.
+ */
+static void pat_trie_job_publish(struct pat_trie_job *job)
+{
+	struct pattern_expr *expr = job->expr;
+	struct pat_trie *trie = job->trie;
+	struct pat_trie *old;
+	void *ptr;
+
+	job->trie = NULL;
+	if (trie) {
+		ptr = realloc(trie->nodes, trie->nb_nodes * sizeof(*trie->nodes));
+		if (ptr)
+			trie->nodes = ptr;
+		if (trie->nb_leaves) {
+			ptr = realloc(trie->leaves, trie->nb_leaves * sizeof(*trie->leaves));
+			if (ptr)
+				trie->leaves = ptr;
+		}
+	}
+	else if (!HA_ATOMIC_LOAD(&expr->trie[job->idx]))
+		return;
+
+	/* a more recent commit or change makes this one useless */
+	HA_RWLOCK_WRLOCK(PATEXP_LOCK, &expr->lock);
+	old = trie;
+	if (HA_ATOMIC_LOAD(&job->ref->revision) == job->revision) {
+		old = expr->trie[job->idx];
+		expr->trie[job->idx] = trie;
+	}
+	HA_RWLOCK_WRUNLOCK(PATEXP_LOCK, &expr->lock);
+	pat_trie_free(old);
+}
+
+/* Moves job <job> to the next IP tree to compile after <expr>'s tree <idx>,
+ * or marks it as done if there is none.
+ */
+static void pat_trie_job_next(struct pat_trie_job *job, struct pattern_expr *expr, int idx)
+{
+	pat_trie_job_reset(job);
+	job->step = PAT_TRIE_ST_COLLECT;
+	job->expr = NULL;
+
+	if (expr && idx == 0)
+		job->idx = 1;
+	else {
+		expr = LIST_ELEM(expr ? expr->list.n : job->ref->pat.n, struct pattern_expr *, list);
+		while (&expr->list != &job->ref->pat && expr->pat_head->match != pat_match_ip)
+			expr = LIST_NEXT(&expr->list, struct pattern_expr *, list);
+		if (&expr->list == &job->ref->pat)
+			expr = NULL;
+		job->idx = 0;
+	}
+
+	/* <next> is also updated by pat_delete_gen() under the lock */
+	job->expr = expr;
+	HA_SPIN_LOCK(PATREF_LOCK, &job->ref->lock);
+	job->next = !expr ? NULL : ebmb_first(job->idx ? &expr->pattern_tree_2 : &expr->pattern_tree);
+	HA_SPIN_UNLOCK(PATREF_LOCK, &job->ref->lock);
+}
+
+/* Tasklet compiling the IP trees of a reference into tries. It collects the
+ * entries of the current generation of each tree under the PATREF lock, then
+ * sorts them and builds the trie without any lock, and finally replaces the
+ * previous trie, provided that the reference's revision did not change
+ * meanwhile. It is heavy so that it only runs once per polling loop, where it
+ * processes a few thousands of entries. It restarts from the first tree when
+ * the revision changes, and stops once all trees are compiled.
+ */
+static struct task *pat_trie_job_task(struct task *t, void *context, unsigned int state)
+{
+	struct pat_trie_job *job = context;
+	unsigned long long revision = HA_ATOMIC_LOAD(&job->ref->revision);
+	int budget = PAT_TRIE_BUDGET;
+
+	if (revision != job->revision) {
+		/* (re)start for the new revision */
+		job->revision = revision;
+		pat_trie_job_next(job, NULL, 0);
+	}
+
+	while (job->expr && budget > 0) {
+		switch (job->step) {
+		case PAT_TRIE_ST_COLLECT:
+			budget = pat_trie_job_collect(job, budget);
+			if (budget < 0) {
+				/* changed meanwhile, restart */
+				tasklet_wakeup((struct tasklet *)t);
+				return t;
+			}
+			if (job->next)
+				break;
+
+			if (!job->nb || job->nb < global.tune.pattern_ip_trie || !global.tune.pattern_ip_trie) {
+				pat_trie_job_publish(job);
+				pat_trie_job_next(job, job->expr, job->idx);
+				break;
+			}
+
+			job->tmp = malloc(job->nb * sizeof(*job->tmp));
+			if (!job->tmp)
+				goto fail;
+			job->pos = job->pass = 0;
+			memset(job->cnt, 0, sizeof(job->cnt));
+			job->step = PAT_TRIE_ST_SORT;
+			break;
+
+		case PAT_TRIE_ST_SORT:
+			budget = pat_trie_job_sort(job, budget);
+			if (budget <= 0)
+				break;
+
+			ha_free(&job->tmp);
+			job->trie = calloc(1, sizeof(*job->trie));
+			job->todo = malloc(PAT_TRIE_MAX_TODO * sizeof(*job->todo));
+			if (!job->trie || !job->todo)
+				goto fail;
+
+			job->trie->key_len = job->idx ? 16 : 4;
+			job->trie->revision = job->revision;
+			/* random prefixes need about 1.6 nodes and 2.8 leaves
+			 * each, the unused room is released once built.
+			 */
+			job->nodes_size = 1 + job->nb * 2;
+			job->leaves_size = 64 + job->nb * 3;
+			job->trie->nodes = malloc(job->nodes_size * sizeof(*job->trie->nodes));
+			job->trie->leaves = malloc(job->leaves_size * sizeof(*job->trie->leaves));
+			if (!job->trie->nodes || !job->trie->leaves)
+				goto fail;
+			job->trie->nb_nodes = 1;
+			job->todo[0] = (struct pat_trie_todo){ .first = 0, .nb = job->nb, .nidx = 0, .ofs = 0, .def = NULL };
+			job->nb_todo = 1;
+			job->step = PAT_TRIE_ST_BUILD;
+			break;
+
+		case PAT_TRIE_ST_BUILD:
+			budget = pat_trie_job_build(job, budget);
+			if (budget < 0)
+				goto fail;
+			if (budget == 0)
+				break;
+
+			pat_trie_job_publish(job);
+			pat_trie_job_next(job, job->expr, job->idx);
+			break;
+		}
+	}
+
+	if (job->expr)
+		tasklet_wakeup((struct tasklet *)t);
+	return t;
+
+ fail:
+	/* lookups will use the tree */
+	pat_trie_job_reset(job);
+	pat_trie_job_publish(job);
+	pat_trie_job_next(job, job->expr, job->idx);
+	if (job->expr)
+		tasklet_wakeup((struct tasklet *)t);
+	return t;
+}
+
+/* Schedules the compilation of the IP trees of <ref> into tries for its
+ * current generation. This is called at boot and after each commit. The trees
+ * are compiled in the background by a tasklet, during which lookups keep using
+ * the trees, and each trie replaces the previous one once built, provided
+ * that the reference was not changed meanwhile. Changes made to the current
+ * generation after this invalidate the tries until the next call. The tasklet
+ * is allocated on first use and runs on the thread which allocated it.
+ */
+void pat_ref_build_tries(struct pat_ref *ref)
+{
+	struct pat_trie_job *job = HA_ATOMIC_LOAD(&ref->trie_job);
+	struct pattern_expr *expr;
+
+	if (!job) {
+		if (!global.tune.pattern_ip_trie)
+			return;
+
+		list_for_each_entry(expr, &ref->pat, list)
+			if (expr->pat_head->match == pat_match_ip)
+				break;
+		if (&expr->list == &ref->pat)
+			return;
+
+		job = calloc(1, sizeof(*job));
+		if (!job)
+			return;
+		job->tasklet = tasklet_new();
+		if (!job->tasklet) {
+			free(job);
+			return;
+		}
+		job->ref = ref;
+		job->tasklet->process = pat_trie_job_task;
+		job->tasklet->context = job;
+		job->tasklet->tid = tid;
+		job->tasklet->state |= TASK_HEAVY;
+
+		/* another thread may have allocated it meanwhile */
+		if (!HA_ATOMIC_CAS(&ref->trie_job, &(struct pat_trie_job *){ NULL }, job)) {
+			tasklet_free(job->tasklet);
+			free(job);
+			job = HA_ATOMIC_LOAD(&ref->trie_job);
+		}
+	}
+	tasklet_wakeup(job->tasklet);
+}
+
 /* This function looks up any existing reference <ref> in pattern_head <head>, and
  * returns the associated pattern_expr pointer if found, otherwise NULL.
  */
@@ -2200,6 +2871,66 @@ struct pattern_expr *pattern_new_expr(struct pattern_head *head, struct pat_ref
 	return expr;
 }
 
+/* Parses in place line <line> read from a pattern file. Lines beginning with a
+ * '#' and empty lines are ignored, in which case zero is returned. Otherwise
+ * <key> points to the pattern, and non-zero is returned. If <value> is NULL,
+ * the pattern is the whole line without its leading spaces and tabs, which is
+ * the format of ACL files. Otherwise it ends at the first space or tab, and
+ * <value> is set to the rest of the line without surrounding spaces and tabs,
+ * which is the format of map files.
+ */
+int pat_ref_parse_line(char *line, char **key, char **value)
+{
+	char *c = line;
+	char *key_end;
+	char *value_end;
+
+	/* ignore lines beginning with a dash */
+	if (*c == '#')
+		return 0;
+
+	/* strip leading spaces and tabs */
+	while (*c == ' ' || *c == '\t')
+		c++;
+
+	/* empty lines are ignored too */
+	if (*c == '\0' || *c == '\r' || *c == '\n')
+		return 0;
+
+	*key = c;
+	if (!value) {
+		while (*c && *c != '\n' && *c != '\r')
+			c++;
+		*c = 0;
+		return 1;
+	}
+
+	/* look for the end of the key */
+	while (*c && *c != ' ' && *c != '\t' && *c != '\n' && *c != '\r')
+		c++;
+
+	key_end = c;
+
+	/* strip middle spaces and tabs */
+	while (*c == ' ' || *c == '\t')
+		c++;
+
+	/* look for the end of the value, it is the end of the line */
+	*value = c;
+	while (*c && *c != '\n' && *c != '\r')
+		c++;
+	value_end = c;
+
+	/* trim possibly trailing spaces and tabs */
+	while (value_end > *value && (value_end[-1] == ' ' || value_end[-1] == '\t'))
+		value_end--;
+
+	/* set final \0 */
+	*key_end = '\0';
+	*value_end = '\0';
+	return 1;
+}
+
 /* Reads patterns from a file. If <err_msg> is non-NULL, an error message will
  * be returned there on errors and the caller will have to free it.
  *
@@ -2225,13 +2956,10 @@ struct pattern_expr *pattern_new_expr(struct pattern_head *head, struct pat_ref
 int pat_ref_read_from_file_smp(struct pat_ref *ref, const char *filename, char **err)
 {
 	FILE *file;
-	char *c;
 	int ret = 0;
 	int line = 0;
-	char *key_beg;
-	char *key_end;
-	char *value_beg;
-	char *value_end;
+	char *key;
+	char *value;
 
 	file = fopen(filename, "r");
 	if (!file) {
@@ -2245,47 +2973,11 @@ int pat_ref_read_from_file_smp(struct pat_ref *ref, const char *filename, char *
 	 */
 	while (fgets(trash.area, trash.size, file) != NULL) {
 		line++;
-		c = trash.area;
-
-		/* ignore lines beginning with a dash */
-		if (*c == '#')
+		if (!pat_ref_parse_line(trash.area, &key, &value))
 			continue;
 
-		/* strip leading spaces and tabs */
-		while (*c == ' ' || *c == '\t')
-			c++;
-
-		/* empty lines are ignored too */
-		if (*c == '\0' || *c == '\r' || *c == '\n')
-			continue;
-
-		/* look for the end of the key */
-		key_beg = c;
-		while (*c && *c != ' ' && *c != '\t' && *c != '\n' && *c != '\r')
-			c++;
-
-		key_end = c;
-
-		/* strip middle spaces and tabs */
-		while (*c == ' ' || *c == '\t')
-			c++;
-
-		/* look for the end of the value, it is the end of the line */
-		value_beg = c;
-		while (*c && *c != '\n' && *c != '\r')
-			c++;
-		value_end = c;
-
-		/* trim possibly trailing spaces and tabs */
-		while (value_end > value_beg && (value_end[-1] == ' ' || value_end[-1] == '\t'))
-			value_end--;
-
-		/* set final \0 and check entries */
-		*key_end = '\0';
-		*value_end = '\0';
-
 		/* insert values */
-		if (!pat_ref_append(ref, key_beg, value_beg, line)) {
+		if (!pat_ref_append(ref, key, value, line)) {
 			memprintf(err, "out of memory");
 			goto out_close;
 		}
@@ -2310,7 +3002,6 @@ int pat_ref_read_from_file_smp(struct pat_ref *ref, const char *filename, char *
 int pat_ref_read_from_file(struct pat_ref *ref, const char *filename, char **err)
 {
 	FILE *file;
-	char *c;
 	char *arg;
 	int ret = 0;
 	int line = 0;
@@ -2327,24 +3018,7 @@ int pat_ref_read_from_file(struct pat_ref *ref, const char *filename, char **err
 	 */
 	while (fgets(trash.area, trash.size, file) != NULL) {
 		line++;
-		c = trash.area;
-
-		/* ignore lines beginning with a dash */
-		if (*c == '#')
-			continue;
-
-		/* strip leading spaces and tabs */
-		while (*c == ' ' || *c == '\t')
-			c++;
-
-
-		arg = c;
-		while (*c && *c != '\n' && *c != '\r')
-			c++;
-		*c = 0;
-
-		/* empty lines are ignored too */
-		if (c == arg)
+		if (!pat_ref_parse_line(trash.area, &arg, NULL))
 			continue;
 
 		if (!pat_ref_append(ref, arg, NULL, line)) {
@@ -2558,6 +3232,9 @@ void pattern_prune(struct pattern_head *head)
 			HA_RWLOCK_WRLOCK(PATEXP_LOCK, &list->expr->lock);
 			head->prune(list->expr);
 			HA_RWLOCK_WRUNLOCK(PATEXP_LOCK, &list->expr->lock);
+			pat_trie_free(list->expr->trie[0]);
+			pat_trie_free(list->expr->trie[1]);
+			free(list->expr->cache_ctr);
 			free(list->expr);
 		}
 		free(list);
@@ -2566,33 +3243,27 @@ void pattern_prune(struct pattern_head *head)
 
 /* This function searches occurrences of pattern reference element <ref> in
  * expression <expr> and returns a pointer to a pointer of the sample storage.
- * If <ref> is not found, NULL is returned.
+ * If <ref> is not found, NULL is returned. Only the nodes derived from <ref>
+ * are visited, which requires the PATREF lock to be held.
  */
 struct sample_data **pattern_find_smp(struct pattern_expr *expr, struct pat_ref_elt *ref)
 {
-	struct ebmb_node *node;
-	struct pattern_tree *elt;
+	struct pattern_tree *tree;
 	struct pattern_list *pat;
+	void **node;
 
-	for (node = ebmb_first(&expr->pattern_tree);
-	     node;
-	     node = ebmb_next(node)) {
-		elt = container_of(node, struct pattern_tree, node);
-		if (elt->ref == ref)
-			return &elt->data;
-	}
-
-	for (node = ebmb_first(&expr->pattern_tree_2);
-	     node;
-	     node = ebmb_next(node)) {
-		elt = container_of(node, struct pattern_tree, node);
-		if (elt->ref == ref)
-			return &elt->data;
+	/* only visit the nodes derived from <ref>, not the whole expression */
+	for (node = ref->tree_head; node; node = *node) {
+		tree = container_of(node, struct pattern_tree, from_ref);
+		if (tree->expr == expr)
+			return &tree->data;
 	}
 
-	list_for_each_entry(pat, &expr->patterns, list)
-		if (pat->pat.ref == ref)
+	for (node = ref->list_head; node; node = *node) {
+		pat = container_of(node, struct pattern_list, from_ref);
+		if (pat->expr == expr)
 			return &pat->pat.data;
+	}
 
 	return NULL;
 }
@@ -2676,6 +3347,11 @@ int pattern_finalize_config(void)
 	LIST_DELETE(&pr);
 
 	free(arr);
+
+	/* compile the large IP trees now that they are loaded */
+	list_for_each_entry(ref, &pattern_reference, list)
+		pat_ref_build_tries(ref);
+
 	return 0;
 }
 
@@ -2683,7 +3359,11 @@ static int pattern_per_thread_lru_alloc()
 {
 	if (!global.tune.pattern_cache)
 		return 1;
-	pat_lru_tree = lru64_new(global.tune.pattern_cache);
+	/* keep 80% of the entries for those which were hit at least twice so
+	 * that a burst of unique keys cannot flush the frequent ones.
+	 */
+	pat_lru_tree = lru64_new_segmented(global.tune.pattern_cache,
+	                                   global.tune.pattern_cache / 5 * 4);
 	return !!pat_lru_tree;
 }
 
@@ -11,9 +11,11 @@
  */
 
 #include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include <sys/socket.h>
 #include <sys/stat.h>
@@ -27,11 +29,14 @@
 #include <haproxy/applet.h>
 #include <haproxy/cfgparse.h>
 #include <haproxy/channel.h>
+#include <haproxy/clock.h>
 #include <haproxy/cli.h>
 #include <haproxy/dict.h>
 #include <haproxy/errors.h>
 #include <haproxy/fd.h>
 #include <haproxy/frontend.h>
+#include <haproxy/global.h>
+#include <haproxy/log.h>
 #include <haproxy/net_helper.h>
 #include <haproxy/obj_type-t.h>
 #include <haproxy/peers.h>
@@ -48,6 +53,7 @@
 #include <haproxy/time.h>
 #include <haproxy/tools.h>
 #include <haproxy/trace.h>
+#include <haproxy/xxhash.h>
 
 
 /*******************************/
@@ -72,6 +78,7 @@
 #define PEERS_F_RESYNC_LOCALASSIGN    0x00001000 /* A local node was assigned for a full resync */
 #define PEERS_F_RESYNC_REMOTEASSIGN   0x00002000 /* A remote node was assigned for a full resync */
 #define PEERS_F_RESYNC_REQUESTED      0x00004000 /* A resync was explicitly requested */
+#define PEERS_F_RESYNC_WAIT           0x00008000 /* The first session of the assigned peer finished teaching, waiting for the other ones */
 #define PEERS_F_DONOTSTOP             0x00010000 /* Main table sync task block process during soft stop
                                                     to push data to new process */
 
@@ -94,6 +101,8 @@
 #define PEER_F_TEACH_COMPLETE       0x00000010 /* All that we know already taught to current peer, used only for a local peer */
 #define PEER_F_LEARN_ASSIGN         0x00000100 /* Current peer was assigned for a lesson */
 #define PEER_F_LEARN_NOTUP2DATE     0x00000200 /* Learn from peer finished but peer is not up to date */
+#define PEER_F_SESSIONS             0x08000000 /* Several sessions were negotiated with this peer */
+#define PEER_F_BATCH                0x10000000 /* Update batches were negotiated with this peer */
 #define PEER_F_ALIVE                0x20000000 /* Used to flag a peer a alive. */
 #define PEER_F_HEARTBEAT            0x40000000 /* Heartbeat message to send. */
 #define PEER_F_DWNGRD               0x80000000 /* When this flag is enabled, we must downgrade the supported version announced during peer sessions. */
@@ -226,6 +235,7 @@ struct peer_prep_params {
 #define PEER_MSG_STKT_ACK              0x84
 #define PEER_MSG_STKT_UPDATE_TIMED     0x85
 #define PEER_MSG_STKT_INCUPDATE_TIMED  0x86
+#define PEER_MSG_STKT_UPDATE_BATCH     0x87
 /* All the stick-table message identifiers abova have the #7 bit set */
 #define PEER_MSG_STKT_BIT                 7
 #define PEER_MSG_STKT_BIT_MASK         (1 << PEER_MSG_STKT_BIT)
@@ -263,6 +273,24 @@ struct peer_prep_params {
 
 #define PEER_STKT_CACHE_MAX_ENTRIES       128
 
+/* A PEER_MSG_STKT_UPDATE_BATCH message starts with a flags varint and the
+ * update ID of its first entry, followed by the entries up to the end of the
+ * message. Each entry is made of the varint difference between its update ID
+ * and the previous one (0 for the first one), its zig-zag encoded expiration
+ * difference with the previous entry when PEER_BATCH_F_TIMED is set, its key
+ * encoded against the previous entry's key, and its values encoded as in
+ * update messages. Keys are sent as the zig-zag encoded difference with the
+ * previous key for integers, otherwise as the length of the prefix shared with
+ * the previous key followed by the remaining bytes, prefixed with their length
+ * for strings.
+ */
+#define PEER_BATCH_F_TIMED                0x01 /* entries carry their expiration */
+
+/* room reserved in front of the batch entries for the message header */
+#define PEER_BATCH_HDR_ROOM  (PEER_MSG_HEADER_LEN + PEER_MSG_ENC_LENGTH_MAXLEN + 1 + 5)
+/* maximum length of the encoded entry fields preceding the key bytes */
+#define PEER_BATCH_ENTRY_HDR_MAXLEN      20
+
 /**********************************/
 /* Peer Session IO handler states */
 /**********************************/
@@ -304,9 +332,20 @@ enum {
 #define PEER_MINOR_VER        1
 #define PEER_DWNGRD_MINOR_VER 0
 
+/* Capabilities optionally announced as a decimal bit field after the relative
+ * pid in the last line of the "hello" message, and after the status code in
+ * the success reply. Older peers ignore them, so that any extension they
+ * enable is only used when both ends announced it. PEER_CAP_SESSIONS is
+ * followed in the "hello" message by the session index and the number of
+ * sessions per peer of the sender.
+ */
+#define PEER_CAP_BATCH        0x00000001 /* PEER_MSG_STKT_UPDATE_BATCH messages */
+#define PEER_CAP_SESSIONS     0x00000002 /* several sessions per peer */
+
 static size_t proto_len = sizeof(PEER_SESSION_PROTO_NAME) - 1;
 struct peers *cfg_peers = NULL;
 static int peers_max_updates_at_once = PEER_DEF_MAX_UPDATES_AT_ONCE;
+static int peers_batch = 1; /* tune.peers.batch */
 static void peer_session_forceshutdown(struct peer *peer);
 
 static struct ebpt_node *dcache_tx_insert(struct dcache *dc,
@@ -568,6 +607,23 @@ uint64_t intdecode(char **str, char *end)
 	return 0;
 }
 
+/* Returns the capabilities announced to <peer>. None is announced when the
+ * protocol version had to be downgraded.
+ */
+static inline unsigned int peer_local_caps(const struct peer *peer)
+{
+	unsigned int caps = 0;
+
+	if (peer->flags & PEER_F_DWNGRD)
+		return 0;
+
+	if (peers_batch)
+		caps |= PEER_CAP_BATCH;
+	if (peer->peers->nb_sessions > 1)
+		caps |= PEER_CAP_SESSIONS;
+	return caps;
+}
+
 /*
  * Build a "hello" peer protocol message.
  * Return the number of written bytes written to build this messages if succeeded,
@@ -576,13 +632,24 @@ uint64_t intdecode(char **str, char *end)
 static int peer_prepare_hellomsg(char *msg, size_t size, struct peer_prep_params *p)
 {
 	int min_ver, ret;
+	unsigned int caps;
 	struct peer *peer;
 
 	peer = p->hello.peer;
 	min_ver = (peer->flags & PEER_F_DWNGRD) ? PEER_DWNGRD_MINOR_VER : PEER_MINOR_VER;
+	caps = peer_local_caps(peer);
 	/* Prepare headers */
-	ret = snprintf(msg, size, PEER_SESSION_PROTO_NAME " %d.%d\n%s\n%s %d %d\n",
-		       (int)PEER_MAJOR_VER, min_ver, peer->id, localpeer, (int)getpid(), (int)1);
+	if (caps & PEER_CAP_SESSIONS)
+		ret = snprintf(msg, size, PEER_SESSION_PROTO_NAME " %d.%d\n%s\n%s %d %d %u %u %d\n",
+			       (int)PEER_MAJOR_VER, min_ver, peer->id, localpeer, (int)getpid(), (int)1,
+			       caps, peer->sess_idx, peer->peers->nb_sessions);
+	else if (caps)
+		ret = snprintf(msg, size, PEER_SESSION_PROTO_NAME " %d.%d\n%s\n%s %d %d %u\n",
+			       (int)PEER_MAJOR_VER, min_ver, peer->id, localpeer, (int)getpid(), (int)1,
+			       caps);
+	else
+		ret = snprintf(msg, size, PEER_SESSION_PROTO_NAME " %d.%d\n%s\n%s %d %d\n",
+			       (int)PEER_MAJOR_VER, min_ver, peer->id, localpeer, (int)getpid(), (int)1);
 	if (ret >= size)
 		return 0;
 
@@ -590,15 +657,25 @@ static int peer_prepare_hellomsg(char *msg, size_t size, struct peer_prep_params
 }
 
 /*
- * Build a "handshake succeeded" status message.
+ * Build a "handshake succeeded" status message, followed by the capabilities
+ * accepted for the peer.
  * Return the number of written bytes written to build this messages if succeeded,
  * 0 if not.
  */
 static int peer_prepare_status_successmsg(char *msg, size_t size, struct peer_prep_params *p)
 {
 	int ret;
+	unsigned int caps = 0;
+
+	if (p->hello.peer->flags & PEER_F_BATCH)
+		caps |= PEER_CAP_BATCH;
+	if (p->hello.peer->flags & PEER_F_SESSIONS)
+		caps |= PEER_CAP_SESSIONS;
 
-	ret = snprintf(msg, size, "%d\n", (int)PEER_SESS_SC_SUCCESSCODE);
+	if (caps)
+		ret = snprintf(msg, size, "%d %u\n", (int)PEER_SESS_SC_SUCCESSCODE, caps);
+	else
+		ret = snprintf(msg, size, "%d\n", (int)PEER_SESS_SC_SUCCESSCODE);
 	if (ret >= size)
 		return 0;
 
@@ -643,72 +720,15 @@ static inline void peer_set_update_msg_type(char *msg_type, int use_identifier,
 	}
 }
 /*
- * This prepare the data update message on the stick session <ts>, <st> is the considered
- * stick table.
- *  <msg> is a buffer of <size> to receive data message content
- * If function returns 0, the caller should consider we were unable to encode this message (TODO:
- * check size)
+ * Encode the values of the stick session <ts> of <st> stick-table at <cursor>
+ * as expected by peer <peer> in update messages. The caller must ensure there
+ * is enough room. Returns the position following the encoded values.
  */
-static int peer_prepare_updatemsg(char *msg, size_t size, struct peer_prep_params *p)
+static char *peer_encode_update_values(char *cursor, struct stksess *ts,
+                                       struct shared_table *st, struct peer *peer)
 {
-	uint32_t netinteger;
-	unsigned short datalen;
-	char *cursor, *datamsg;
 	unsigned int data_type;
 	void *data_ptr;
-	struct stksess *ts;
-	struct shared_table *st;
-	unsigned int updateid;
-	int use_identifier;
-	int use_timed;
-	struct peer *peer;
-
-	ts = p->updt.stksess;
-	st = p->updt.shared_table;
-	updateid = p->updt.updateid;
-	use_identifier = p->updt.use_identifier;
-	use_timed = p->updt.use_timed;
-	peer = p->updt.peer;
-
-	cursor = datamsg = msg + PEER_MSG_HEADER_LEN + PEER_MSG_ENC_LENGTH_MAXLEN;
-
-	/* construct message */
-
-	/* check if we need to send the update identifier */
-	if (!st->last_pushed || updateid < st->last_pushed || ((updateid - st->last_pushed) != 1)) {
-		use_identifier = 1;
-	}
-
-	/* encode update identifier if needed */
-	if (use_identifier)  {
-		netinteger = htonl(updateid);
-		memcpy(cursor, &netinteger, sizeof(netinteger));
-		cursor += sizeof(netinteger);
-	}
-
-	if (use_timed) {
-		netinteger = htonl(tick_remain(now_ms, ts->expire));
-		memcpy(cursor, &netinteger, sizeof(netinteger));
-		cursor += sizeof(netinteger);
-	}
-
-	/* encode the key */
-	if (st->table->type == SMP_T_STR) {
-		int stlen = strlen((char *)ts->key.key);
-
-		intencode(stlen, &cursor);
-		memcpy(cursor, ts->key.key, stlen);
-		cursor += stlen;
-	}
-	else if (st->table->type == SMP_T_SINT) {
-		netinteger = htonl(read_u32(ts->key.key));
-		memcpy(cursor, &netinteger, sizeof(netinteger));
-		cursor += sizeof(netinteger);
-	}
-	else {
-		memcpy(cursor, ts->key.key, st->table->key_size);
-		cursor += st->table->key_size;
-	}
 
 	HA_RWLOCK_RDLOCK(STK_SESS_LOCK, &ts->lock);
 	/* encode values */
@@ -808,6 +828,18 @@ static int peer_prepare_updatemsg(char *msg, size_t size, struct peer_prep_param
 					intencode(frqp->prev_ctr, &cursor);
 					break;
 				}
+				case STD_T_HLL: {
+					struct hll *hll;
+
+					/* the registers are sent as a raw block
+					 * prefixed with its length.
+					 */
+					hll = &stktable_data_cast(data_ptr, std_t_hll);
+					intencode(sizeof(hll->reg), &cursor);
+					memcpy(cursor, hll->reg, sizeof(hll->reg));
+					cursor += sizeof(hll->reg);
+					break;
+				}
 				case STD_T_DICT: {
 					struct dict_entry *de;
 					struct ebpt_node *cached_de;
@@ -858,6 +890,77 @@ static int peer_prepare_updatemsg(char *msg, size_t size, struct peer_prep_param
 	}
 	HA_RWLOCK_RDUNLOCK(STK_SESS_LOCK, &ts->lock);
 
+	return cursor;
+}
+
+/*
+ * This prepare the data update message on the stick session <ts>, <st> is the considered
+ * stick table.
+ *  <msg> is a buffer of <size> to receive data message content
+ * If function returns 0, the caller should consider we were unable to encode this message (TODO:
+ * check size)
+ */
+static int peer_prepare_updatemsg(char *msg, size_t size, struct peer_prep_params *p)
+{
+	uint32_t netinteger;
+	unsigned short datalen;
+	char *cursor, *datamsg;
+	struct stksess *ts;
+	struct shared_table *st;
+	unsigned int updateid;
+	int use_identifier;
+	int use_timed;
+	struct peer *peer;
+
+	ts = p->updt.stksess;
+	st = p->updt.shared_table;
+	updateid = p->updt.updateid;
+	use_identifier = p->updt.use_identifier;
+	use_timed = p->updt.use_timed;
+	peer = p->updt.peer;
+
+	cursor = datamsg = msg + PEER_MSG_HEADER_LEN + PEER_MSG_ENC_LENGTH_MAXLEN;
+
+	/* construct message */
+
+	/* check if we need to send the update identifier */
+	if (!st->last_pushed || updateid < st->last_pushed || ((updateid - st->last_pushed) != 1)) {
+		use_identifier = 1;
+	}
+
+	/* encode update identifier if needed */
+	if (use_identifier)  {
+		netinteger = htonl(updateid);
+		memcpy(cursor, &netinteger, sizeof(netinteger));
+		cursor += sizeof(netinteger);
+	}
+
+	if (use_timed) {
+		netinteger = htonl(tick_remain(now_ms, ts->expire));
+		memcpy(cursor, &netinteger, sizeof(netinteger));
+		cursor += sizeof(netinteger);
+	}
+
+	/* encode the key */
+	if (st->table->type == SMP_T_STR) {
+		int stlen = strlen((char *)ts->key.key);
+
+		intencode(stlen, &cursor);
+		memcpy(cursor, ts->key.key, stlen);
+		cursor += stlen;
+	}
+	else if (st->table->type == SMP_T_SINT) {
+		netinteger = htonl(read_u32(ts->key.key));
+		memcpy(cursor, &netinteger, sizeof(netinteger));
+		cursor += sizeof(netinteger);
+	}
+	else {
+		memcpy(cursor, ts->key.key, st->table->key_size);
+		cursor += st->table->key_size;
+	}
+
+	cursor = peer_encode_update_values(cursor, ts, st, peer);
+
 	/* Compute datalen */
 	datalen = (cursor - datamsg);
 
@@ -1246,9 +1349,13 @@ static inline int peer_send_hellomsg(struct appctx *appctx, struct peer *peer)
  * any other negative returned value must  be considered as an error with an appcxt st0
  * returned value equal to PEER_SESS_ST_END.
  */
-static inline int peer_send_status_successmsg(struct appctx *appctx)
+static inline int peer_send_status_successmsg(struct appctx *appctx, struct peer *peer)
 {
-	return peer_send_msg(appctx, peer_prepare_status_successmsg, NULL);
+	struct peer_prep_params p = {
+		.hello.peer = peer,
+	};
+
+	return peer_send_msg(appctx, peer_prepare_status_successmsg, &p);
 }
 
 /*
@@ -1470,6 +1577,52 @@ static inline int peer_send_error_protomsg(struct appctx *appctx)
 	return peer_send_msg(appctx, peer_prepare_error_msg, &p);
 }
 
+/* Returns non-zero if session <p> is in charge of pushing entry <ts> of <st>
+ * table. When several sessions were negotiated with a peer, the entries of
+ * each table are spread over them depending on a hash of their key, so that
+ * the updates and the resyncs of a single table are shared between threads,
+ * and all the updates of a given entry are sent in order on the same session.
+ */
+static inline int peer_pushes_entry(const struct peer *p, const struct shared_table *st,
+                                    struct stksess *ts)
+{
+	size_t len;
+
+	if (!(p->flags & PEER_F_SESSIONS))
+		return 1;
+
+	len = (st->table->type == SMP_T_STR) ? strlen((char *)ts->key.key) : st->table->key_size;
+	return XXH3(ts->key.key, len, st->table->hash_seed) % p->peers->nb_sessions == p->sess_idx;
+}
+
+/* Returns the mask of the indexes of the sessions to a peer of <peers> other
+ * than the first one.
+ */
+static inline unsigned long long peers_other_sessions(const struct peers *peers)
+{
+	return (~0ULL >> (64 - peers->nb_sessions)) & ~1ULL;
+}
+
+/* Prepares the tables of session <p> to teach the whole of them from the next
+ * call to peer_send_msgs(), as requested by a resync request.
+ */
+static inline void peer_start_teaching(struct peer *p)
+{
+	struct shared_table *st;
+
+	/* prepare tables for a global push */
+	for (st = p->tables; st; st = st->next) {
+		st->teaching_origin = st->last_pushed = st->update;
+		st->flags = 0;
+	}
+
+	/* reset teaching flags to 0 */
+	p->flags &= PEER_TEACH_RESET;
+
+	/* flag to start to teach lesson */
+	p->flags |= PEER_F_TEACH_PROCESS;
+}
+
 /*
  * Function used to lookup for recent stick-table updates associated with
  * <st> shared stick-table when a lesson must be taught a peer (PEER_F_LEARN_ASSIGN flag set).
@@ -1536,53 +1689,176 @@ static inline struct stksess *peer_teach_stage2_stksess_lookup(struct shared_tab
 	return eb32_entry(eb, struct stksess, upd);
 }
 
+/* Returns the zig-zag encoding of <v> so that small negative differences are
+ * encoded as small unsigned integers.
+ */
+static inline unsigned int peer_zz_enc(int v)
+{
+	return ((unsigned int)v << 1) ^ (unsigned int)(v >> 31);
+}
+
+/* Returns the signed integer zig-zag encoded as <v> */
+static inline int peer_zz_dec(unsigned int v)
+{
+	return (int)(v >> 1) ^ -(int)(v & 1);
+}
+
+/* Context of a PEER_MSG_STKT_UPDATE_BATCH message being built. The entries are
+ * encoded in <buf> after PEER_BATCH_HDR_ROOM bytes reserved for the header.
+ * <key> holds the key of the last entry.
+ */
+struct peer_batch {
+	struct buffer *buf;
+	struct buffer *key;
+	unsigned int flags;         /* PEER_BATCH_F_* */
+	unsigned int count;         /* number of entries */
+	unsigned int first_id;      /* update ID of the first entry */
+	unsigned int last_id;       /* update ID of the last entry */
+	unsigned int last_exp;      /* remaining time of the last entry */
+};
+
+/* Resets batch <b> so that it holds no entry */
+static inline void peer_batch_reset(struct peer_batch *b)
+{
+	b->buf->data = PEER_BATCH_HDR_ROOM;
+	b->key->data = 0;
+	b->count = 0;
+	b->last_exp = 0;
+}
+
 /*
- * Generic function to emit update messages for <st> stick-table when a lesson must
- * be taught to the peer <p>.
- * <locked> must be set to 1 if the shared table <st> is already locked when entering
- * this function, 0 if not.
- *
- * This function temporary unlock/lock <st> when it sends stick-table updates or
- * when decrementing its refcount in case of any error when it sends this updates.
- *
- * Return 0 if any message could not be built modifying the appcxt st0 to PEER_SESS_ST_END value.
+ * Append to batch <b> the entry for the stick session <ts> of <st> with
+ * <updateid> as update ID, whose <vlen> bytes of encoded values are at <vals>.
+ * The caller must ensure there is enough room for PEER_BATCH_ENTRY_HDR_MAXLEN
+ * bytes in addition to the key and the values.
+ */
+static void peer_batch_add(struct peer_batch *b, struct shared_table *st, struct stksess *ts,
+                           unsigned int updateid, const char *vals, size_t vlen)
+{
+	char *cursor = b_tail(b->buf);
+	unsigned int exp;
+	size_t len, pfx;
+
+	if (!b->count)
+		b->first_id = b->last_id = updateid;
+	intencode(updateid - b->last_id, &cursor);
+	b->last_id = updateid;
+
+	if (b->flags & PEER_BATCH_F_TIMED) {
+		exp = tick_remain(now_ms, ts->expire);
+		intencode(peer_zz_enc(exp - b->last_exp), &cursor);
+		b->last_exp = exp;
+	}
+
+	if (st->table->type == SMP_T_SINT) {
+		unsigned int key = read_u32(ts->key.key);
+
+		intencode(peer_zz_enc(key - (b->key->data ? read_u32(b->key->area) : 0)), &cursor);
+		write_u32(b->key->area, key);
+		b->key->data = sizeof(key);
+	}
+	else {
+		len = (st->table->type == SMP_T_STR) ? strlen((char *)ts->key.key) : st->table->key_size;
+		for (pfx = 0; pfx < len && pfx < b->key->data; pfx++)
+			if (ts->key.key[pfx] != (unsigned char)b->key->area[pfx])
+				break;
+
+		intencode(pfx, &cursor);
+		if (st->table->type == SMP_T_STR)
+			intencode(len - pfx, &cursor);
+		memcpy(cursor, ts->key.key + pfx, len - pfx);
+		cursor += len - pfx;
+		memcpy(b->key->area + pfx, ts->key.key + pfx, len - pfx);
+		b->key->data = len;
+	}
+
+	memcpy(cursor, vals, vlen);
+	cursor += vlen;
+	b->buf->data = cursor - b->buf->area;
+	b->count++;
+}
+
+/*
+ * Send batch <b> to the peer attached to <appctx>, then reset it.
+ * Return 0 if the message could not be built modifying the appcxt st0 to PEER_SESS_ST_END value.
  * Returns -1 if there was not enough room left to send the message,
  * any other negative returned value must  be considered as an error with an appcxt st0
  * returned value equal to PEER_SESS_ST_END.
- * If it returns 0 or -1, this function leave <st> locked if already locked when entering this function
- * unlocked if not already locked when entering this function.
  */
-static inline int peer_send_teachmsgs(struct appctx *appctx, struct peer *p,
-                                      struct stksess *(*peer_stksess_lookup)(struct shared_table *),
-                                      struct shared_table *st, int locked)
+static int peer_send_batch(struct appctx *appctx, struct peer_batch *b)
 {
-	int ret, new_pushed, use_timed;
-	int updates_sent = 0;
+	char hdr[PEER_BATCH_HDR_ROOM], body[PEER_BATCH_HDR_ROOM];
+	char *cursor, *bcursor, *msg;
+	size_t len;
+	int ret;
 
-	ret = 1;
-	use_timed = 0;
-	if (st != p->last_local_table) {
-		ret = peer_send_switchmsg(st, appctx);
-		if (ret <= 0)
-			return ret;
+	/* the entries are preceded by the flags and the first update ID */
+	bcursor = body;
+	intencode(b->flags, &bcursor);
+	intencode(b->first_id, &bcursor);
 
-		p->last_local_table = st;
-	}
+	cursor = hdr;
+	*cursor++ = PEER_MSG_CLASS_STICKTABLE;
+	*cursor++ = PEER_MSG_STKT_UPDATE_BATCH;
+	intencode((bcursor - body) + b_data(b->buf) - PEER_BATCH_HDR_ROOM, &cursor);
+	memcpy(cursor, body, bcursor - body);
+	cursor += bcursor - body;
 
-	if (peer_stksess_lookup != peer_teach_process_stksess_lookup)
-		use_timed = !(p->flags & PEER_F_DWNGRD);
+	/* place all this just before the entries */
+	len = cursor - hdr;
+	msg = b->buf->area + PEER_BATCH_HDR_ROOM - len;
+	memcpy(msg, hdr, len);
 
-	/* We force new pushed to 1 to force identifier in update message */
-	new_pushed = 1;
+	ret = applet_putblk(appctx, msg, b_tail(b->buf) - msg);
+	if (ret <= 0) {
+		if (ret != -1)
+			appctx->st0 = PEER_SESS_ST_END;
+	}
+	peer_batch_reset(b);
+	return ret;
+}
 
-	if (!locked)
-		HA_RWLOCK_WRLOCK(STK_TABLE_LOCK, &st->table->lock);
+/*
+ * Emit the updates returned by <peer_stksess_lookup> for <st> stick-table to
+ * the peer <p> in PEER_MSG_STKT_UPDATE_BATCH messages. <st> must be locked and
+ * is temporarily unlocked while encoding each entry. Batches are limited to
+ * the room available in the output channel so that they may always be sent.
+ * <use_timed> must be set if the entries must carry their expiration.
+ *
+ * Return 0 if any message could not be built modifying the appcxt st0 to PEER_SESS_ST_END value.
+ * Returns -1 if there was not enough room left to send the message,
+ * any other negative returned value must  be considered as an error with an appcxt st0
+ * returned value equal to PEER_SESS_ST_END.
+ * Returns -2 without any side effect if no buffer could be allocated.
+ */
+static int peer_send_teachbatch(struct appctx *appctx, struct peer *p,
+                                struct stksess *(*peer_stksess_lookup)(struct shared_table *),
+                                struct shared_table *st, int use_timed)
+{
+	struct stconn *sc = appctx_sc(appctx);
+	struct peer_batch b = { };
+	unsigned int pushed = st->last_pushed;
+	int ret, updates_sent = 0;
+	size_t room;
+
+	b.buf = alloc_trash_chunk();
+	b.key = alloc_trash_chunk();
+	if (!b.buf || !b.key) {
+		free_trash_chunk(b.buf);
+		free_trash_chunk(b.key);
+		return -2;
+	}
+
+	b.flags = use_timed ? PEER_BATCH_F_TIMED : 0;
+	peer_batch_reset(&b);
+	ret = channel_recv_limit(sc_ic(sc)) - c_data(sc_ic(sc));
+	room = MIN(MAX(ret, 0), b.buf->size);
 
 	while (1) {
 		struct stksess *ts;
-		unsigned updateid;
+		unsigned int updateid;
+		size_t vlen, need;
 
-		/* push local updates */
 		ts = peer_stksess_lookup(st);
 		if (!ts) {
 			ret = 1; // done
@@ -1590,7 +1866,138 @@ static inline int peer_send_teachmsgs(struct appctx *appctx, struct peer *p,
 		}
 
 		updateid = ts->upd.key;
-		if (p->srv->shard && ts->shard != p->srv->shard) {
+		if ((p->srv->shard && ts->shard != p->srv->shard) ||
+		    !peer_pushes_entry(p, st, ts)) {
+			/* Skip this entry */
+			st->last_pushed = updateid;
+			continue;
+		}
+
+		ts->ref_cnt++;
+		HA_RWLOCK_WRUNLOCK(STK_TABLE_LOCK, &st->table->lock);
+
+		/* values do not depend on the batch, they are encoded first */
+		vlen = peer_encode_update_values(trash.area, ts, st, p) - trash.area;
+		need = PEER_BATCH_ENTRY_HDR_MAXLEN + st->table->key_size + vlen;
+		if (b.buf->data + need > room && b.count) {
+			room -= b.buf->data;
+			ret = peer_send_batch(appctx, &b);
+			if (ret <= 0) {
+				HA_RWLOCK_WRLOCK(STK_TABLE_LOCK, &st->table->lock);
+				ts->ref_cnt--;
+				st->last_pushed = pushed;
+				break;
+			}
+			pushed = st->last_pushed;
+		}
+
+		if (b.buf->data + need > room) {
+			/* wait for the entry to fit alone */
+			HA_RWLOCK_WRLOCK(STK_TABLE_LOCK, &st->table->lock);
+			ts->ref_cnt--;
+			sc_need_room(sc, PEER_BATCH_HDR_ROOM + need);
+			ret = -1;
+			break;
+		}
+
+		peer_batch_add(&b, st, ts, updateid, trash.area, vlen);
+
+		HA_RWLOCK_WRLOCK(STK_TABLE_LOCK, &st->table->lock);
+		ts->ref_cnt--;
+		st->last_pushed = updateid;
+
+		if (peer_stksess_lookup == peer_teach_process_stksess_lookup &&
+		    (int)(st->last_pushed - st->table->commitupdate) > 0)
+			st->table->commitupdate = st->last_pushed;
+
+		updates_sent++;
+		if (updates_sent >= peers_max_updates_at_once) {
+			/* pretend we're full so that we get back ASAP */
+			sc_need_room(sc, 0);
+			ret = -1;
+			break;
+		}
+	}
+
+	if (b.count && (ret > 0 || ret == -1)) {
+		int ret2;
+
+		ret2 = peer_send_batch(appctx, &b);
+		if (ret2 <= 0) {
+			st->last_pushed = pushed;
+			ret = ret2;
+		}
+	}
+
+	free_trash_chunk(b.buf);
+	free_trash_chunk(b.key);
+	return ret;
+}
+
+/*
+ * Generic function to emit update messages for <st> stick-table when a lesson must
+ * be taught to the peer <p>.
+ * <locked> must be set to 1 if the shared table <st> is already locked when entering
+ * this function, 0 if not.
+ *
+ * This function temporary unlock/lock <st> when it sends stick-table updates or
+ * when decrementing its refcount in case of any error when it sends this updates.
+ *
+ * Return 0 if any message could not be built modifying the appcxt st0 to PEER_SESS_ST_END value.
+ * Returns -1 if there was not enough room left to send the message,
+ * any other negative returned value must  be considered as an error with an appcxt st0
+ * returned value equal to PEER_SESS_ST_END.
+ * If it returns 0 or -1, this function leave <st> locked if already locked when entering this function
+ * unlocked if not already locked when entering this function.
+ */
+static inline int peer_send_teachmsgs(struct appctx *appctx, struct peer *p,
+                                      struct stksess *(*peer_stksess_lookup)(struct shared_table *),
+                                      struct shared_table *st, int locked)
+{
+	int ret, new_pushed, use_timed;
+	int updates_sent = 0;
+
+	ret = 1;
+	use_timed = 0;
+	if (st != p->last_local_table) {
+		ret = peer_send_switchmsg(st, appctx);
+		if (ret <= 0)
+			return ret;
+
+		p->last_local_table = st;
+	}
+
+	if (peer_stksess_lookup != peer_teach_process_stksess_lookup)
+		use_timed = !(p->flags & PEER_F_DWNGRD);
+
+	/* We force new pushed to 1 to force identifier in update message */
+	new_pushed = 1;
+
+	if (!locked)
+		HA_RWLOCK_WRLOCK(STK_TABLE_LOCK, &st->table->lock);
+
+	if (p->flags & PEER_F_BATCH) {
+		ret = peer_send_teachbatch(appctx, p, peer_stksess_lookup, st, use_timed);
+		/* fall back to update messages if no buffer is available */
+		if (ret != -2)
+			goto out;
+		ret = 1;
+	}
+
+	while (1) {
+		struct stksess *ts;
+		unsigned updateid;
+
+		/* push local updates */
+		ts = peer_stksess_lookup(st);
+		if (!ts) {
+			ret = 1; // done
+			break;
+		}
+
+		updateid = ts->upd.key;
+		if ((p->srv->shard && ts->shard != p->srv->shard) ||
+		    !peer_pushes_entry(p, st, ts)) {
 			/* Skip this entry */
 			st->last_pushed = updateid;
 			new_pushed = 1;
@@ -1684,125 +2091,19 @@ static inline int peer_send_teach_stage2_msgs(struct appctx *appctx, struct peer
 
 
 /*
- * Function used to parse a stick-table update message after it has been received
- * by <p> peer with <msg_cur> as address of the pointer to the position in the
- * receipt buffer with <msg_end> being position of the end of the stick-table message.
- * Update <msg_curr> accordingly to the peer protocol specs if no peer protocol error
- * was encountered.
- * <exp> must be set if the stick-table entry expires.
- * <updt> must be set for  PEER_MSG_STKT_UPDATE or PEER_MSG_STKT_UPDATE_TIMED stick-table
- * messages, in this case the stick-table update message is received with a stick-table
- * update ID.
- * <totl> is the length of the stick-table update message computed upon receipt.
+ * Store the stick-table entry <newts> received by <p> peer for <st> shared
+ * table, or update the existing one with the same key, in which case <newts>
+ * is released. Its values are decoded from <msg_cur> up to <msg_end> and its
+ * expiration is set to <expire> ticks from now.
+ * Return 1 if succeeded, 0 if the values are malformed.
  */
-static int peer_treat_updatemsg(struct appctx *appctx, struct peer *p, int updt, int exp,
-                                char **msg_cur, char *msg_end, int msg_len, int totl)
+static int peer_treat_update_values(struct peer *p, struct shared_table *st, struct stksess *newts,
+                                    int expire, char **msg_cur, char *msg_end)
 {
-	struct shared_table *st = p->remote_table;
-	struct stksess *ts, *newts;
-	uint32_t update;
-	int expire;
+	struct stksess *ts;
 	unsigned int data_type;
-	size_t keylen;
 	void *data_ptr;
 
-	TRACE_ENTER(PEERS_EV_UPDTMSG, NULL, p);
-	/* Here we have data message */
-	if (!st)
-		goto ignore_msg;
-
-	expire = MS_TO_TICKS(st->table->expire);
-
-	if (updt) {
-		if (msg_len < sizeof(update)) {
-			TRACE_PROTO("malformed message", PEERS_EV_UPDTMSG, NULL, p);
-			goto malformed_exit;
-		}
-
-		memcpy(&update, *msg_cur, sizeof(update));
-		*msg_cur += sizeof(update);
-		st->last_get = htonl(update);
-	}
-	else {
-		st->last_get++;
-	}
-
-	if (exp) {
-		size_t expire_sz = sizeof expire;
-
-		if (*msg_cur + expire_sz > msg_end) {
-			TRACE_PROTO("malformed message", PEERS_EV_UPDTMSG,
-			            NULL, p, *msg_cur);
-			TRACE_PROTO("malformed message", PEERS_EV_UPDTMSG,
-			            NULL, p, msg_end, &expire_sz);
-			goto malformed_exit;
-		}
-
-		memcpy(&expire, *msg_cur, expire_sz);
-		*msg_cur += expire_sz;
-		expire = ntohl(expire);
-	}
-
-	newts = stksess_new(st->table, NULL);
-	if (!newts)
-		goto ignore_msg;
-
-	if (st->table->type == SMP_T_STR) {
-		unsigned int to_read, to_store;
-
-		to_read = intdecode(msg_cur, msg_end);
-		if (!*msg_cur) {
-			TRACE_PROTO("malformed message", PEERS_EV_UPDTMSG, NULL, p);
-			goto malformed_free_newts;
-		}
-
-		to_store = MIN(to_read, st->table->key_size - 1);
-		if (*msg_cur + to_store > msg_end) {
-			TRACE_PROTO("malformed message", PEERS_EV_UPDTMSG,
-			            NULL, p, *msg_cur);
-			TRACE_PROTO("malformed message", PEERS_EV_UPDTMSG,
-			            NULL, p, msg_end, &to_store);
-			goto malformed_free_newts;
-		}
-
-		keylen = to_store;
-		memcpy(newts->key.key, *msg_cur, keylen);
-		newts->key.key[keylen] = 0;
-		*msg_cur += to_read;
-	}
-	else if (st->table->type == SMP_T_SINT) {
-		unsigned int netinteger;
-
-		if (*msg_cur + sizeof(netinteger) > msg_end) {
-			TRACE_PROTO("malformed message", PEERS_EV_UPDTMSG,
-			            NULL, p, *msg_cur);
-			TRACE_PROTO("malformed message", PEERS_EV_UPDTMSG,
-			            NULL, p, msg_end);
-			goto malformed_free_newts;
-		}
-
-		keylen = sizeof(netinteger);
-		memcpy(&netinteger, *msg_cur, keylen);
-		netinteger = ntohl(netinteger);
-		memcpy(newts->key.key, &netinteger, keylen);
-		*msg_cur += keylen;
-	}
-	else {
-		if (*msg_cur + st->table->key_size > msg_end) {
-			TRACE_PROTO("malformed message", PEERS_EV_UPDTMSG,
-			            NULL, p, *msg_cur);
-			TRACE_PROTO("malformed message", PEERS_EV_UPDTMSG,
-			            NULL, p, msg_end, &st->table->key_size);
-			goto malformed_free_newts;
-		}
-
-		keylen = st->table->key_size;
-		memcpy(newts->key.key, *msg_cur, keylen);
-		*msg_cur += keylen;
-	}
-
-	newts->shard = stktable_get_key_shard(st->table, newts->key.key, keylen);
-
 	/* lookup for existing entry */
 	ts = stktable_set_entry(st->table, newts);
 	if (ts != newts) {
@@ -1962,6 +2263,24 @@ static int peer_treat_updatemsg(struct appctx *appctx, struct peer *p, int updt,
 				stktable_data_cast(data_ptr, std_t_frqp) = data;
 			break;
 		}
+		case STD_T_HLL:
+			/* <decoded_int> is the length of the registers block */
+			if (*msg_cur + decoded_int > msg_end) {
+				TRACE_PROTO("malformed message", PEERS_EV_UPDTMSG,
+				            NULL, p, *msg_cur);
+				goto malformed_unlock;
+			}
+
+			/* The received sketch is merged with the local one so
+			 * that values accounted for on both sides are kept.
+			 * Sketches of a different size cannot be merged.
+			 */
+			data_ptr = stktable_data_ptr(st->table, ts, data_type);
+			if (data_ptr && !ignore && decoded_int == HLL_REGS)
+				hll_merge(&stktable_data_cast(data_ptr, std_t_hll), (const uint8_t *)*msg_cur);
+			*msg_cur += decoded_int;
+			break;
+
 		case STD_T_DICT: {
 			struct buffer *chunk;
 			size_t data_len, value_len;
@@ -2041,24 +2360,271 @@ static int peer_treat_updatemsg(struct appctx *appctx, struct peer *p, int updt,
 
 	HA_RWLOCK_WRUNLOCK(STK_SESS_LOCK, &ts->lock);
 	stktable_touch_remote(st->table, ts, 1);
-
- ignore_msg:
-	TRACE_LEAVE(PEERS_EV_UPDTMSG, NULL, p);
 	return 1;
 
  malformed_unlock:
 	/* malformed message */
 	HA_RWLOCK_WRUNLOCK(STK_SESS_LOCK, &ts->lock);
 	stktable_touch_remote(st->table, ts, 1);
-	appctx->st0 = PEER_SESS_ST_ERRPROTO;
-	TRACE_DEVEL("leaving in error", PEERS_EV_UPDTMSG);
 	return 0;
+}
+
+/*
+ * Function used to parse a stick-table update message after it has been received
+ * by <p> peer with <msg_cur> as address of the pointer to the position in the
+ * receipt buffer with <msg_end> being position of the end of the stick-table message.
+ * Update <msg_curr> accordingly to the peer protocol specs if no peer protocol error
+ * was encountered.
+ * <exp> must be set if the stick-table entry expires.
+ * <updt> must be set for  PEER_MSG_STKT_UPDATE or PEER_MSG_STKT_UPDATE_TIMED stick-table
+ * messages, in this case the stick-table update message is received with a stick-table
+ * update ID.
+ * <totl> is the length of the stick-table update message computed upon receipt.
+ * Return 1 if succeeded, 0 if the message is malformed, in which case it is up
+ * to the caller to report the protocol error.
+ */
+static int peer_treat_updatemsg(struct peer *p, int updt, int exp,
+                                char **msg_cur, char *msg_end, int msg_len, int totl)
+{
+	struct shared_table *st = p->remote_table;
+	struct stksess *newts;
+	uint32_t update;
+	int expire;
+	size_t keylen;
+
+	TRACE_ENTER(PEERS_EV_UPDTMSG, NULL, p);
+	/* Here we have data message */
+	if (!st)
+		goto ignore_msg;
+
+	expire = MS_TO_TICKS(st->table->expire);
+
+	if (updt) {
+		if (msg_len < sizeof(update)) {
+			TRACE_PROTO("malformed message", PEERS_EV_UPDTMSG, NULL, p);
+			goto malformed_exit;
+		}
+
+		memcpy(&update, *msg_cur, sizeof(update));
+		*msg_cur += sizeof(update);
+		st->last_get = htonl(update);
+	}
+	else {
+		st->last_get++;
+	}
+
+	if (exp) {
+		size_t expire_sz = sizeof expire;
+
+		if (*msg_cur + expire_sz > msg_end) {
+			TRACE_PROTO("malformed message", PEERS_EV_UPDTMSG,
+			            NULL, p, *msg_cur);
+			TRACE_PROTO("malformed message", PEERS_EV_UPDTMSG,
+			            NULL, p, msg_end, &expire_sz);
+			goto malformed_exit;
+		}
+
+		memcpy(&expire, *msg_cur, expire_sz);
+		*msg_cur += expire_sz;
+		expire = ntohl(expire);
+	}
+
+	newts = stksess_new(st->table, NULL);
+	if (!newts)
+		goto ignore_msg;
+
+	if (st->table->type == SMP_T_STR) {
+		unsigned int to_read, to_store;
+
+		to_read = intdecode(msg_cur, msg_end);
+		if (!*msg_cur) {
+			TRACE_PROTO("malformed message", PEERS_EV_UPDTMSG, NULL, p);
+			goto malformed_free_newts;
+		}
+
+		to_store = MIN(to_read, st->table->key_size - 1);
+		if (*msg_cur + to_store > msg_end) {
+			TRACE_PROTO("malformed message", PEERS_EV_UPDTMSG,
+			            NULL, p, *msg_cur);
+			TRACE_PROTO("malformed message", PEERS_EV_UPDTMSG,
+			            NULL, p, msg_end, &to_store);
+			goto malformed_free_newts;
+		}
+
+		keylen = to_store;
+		memcpy(newts->key.key, *msg_cur, keylen);
+		newts->key.key[keylen] = 0;
+		*msg_cur += to_read;
+	}
+	else if (st->table->type == SMP_T_SINT) {
+		unsigned int netinteger;
+
+		if (*msg_cur + sizeof(netinteger) > msg_end) {
+			TRACE_PROTO("malformed message", PEERS_EV_UPDTMSG,
+			            NULL, p, *msg_cur);
+			TRACE_PROTO("malformed message", PEERS_EV_UPDTMSG,
+			            NULL, p, msg_end);
+			goto malformed_free_newts;
+		}
+
+		keylen = sizeof(netinteger);
+		memcpy(&netinteger, *msg_cur, keylen);
+		netinteger = ntohl(netinteger);
+		memcpy(newts->key.key, &netinteger, keylen);
+		*msg_cur += keylen;
+	}
+	else {
+		if (*msg_cur + st->table->key_size > msg_end) {
+			TRACE_PROTO("malformed message", PEERS_EV_UPDTMSG,
+			            NULL, p, *msg_cur);
+			TRACE_PROTO("malformed message", PEERS_EV_UPDTMSG,
+			            NULL, p, msg_end, &st->table->key_size);
+			goto malformed_free_newts;
+		}
+
+		keylen = st->table->key_size;
+		memcpy(newts->key.key, *msg_cur, keylen);
+		*msg_cur += keylen;
+	}
+
+	newts->shard = stktable_get_key_shard(st->table, newts->key.key, keylen);
+
+	if (!peer_treat_update_values(p, st, newts, expire, msg_cur, msg_end))
+		goto malformed_exit;
+
+ ignore_msg:
+	TRACE_LEAVE(PEERS_EV_UPDTMSG, NULL, p);
+	return 1;
 
  malformed_free_newts:
 	/* malformed message */
 	stksess_free(st->table, newts);
  malformed_exit:
-	appctx->st0 = PEER_SESS_ST_ERRPROTO;
+	TRACE_DEVEL("leaving in error", PEERS_EV_UPDTMSG);
+	return 0;
+}
+
+/*
+ * Function used to parse a stick-table update batch message after it has been
+ * received by <p> peer with <msg_cur> as address of the pointer to the position
+ * in the receipt buffer with <msg_end> being position of the end of the
+ * stick-table message. Its format is described above PEER_BATCH_F_TIMED.
+ * Return 1 if succeeded, 0 if the message is malformed, in which case it is up
+ * to the caller to report the protocol error.
+ */
+static int peer_treat_batchmsg(struct peer *p, char **msg_cur, char *msg_end)
+{
+	struct shared_table *st = p->remote_table;
+	struct buffer *key = NULL;
+	struct stksess *newts;
+	unsigned int flags, update, exp;
+	size_t keylen;
+	int expire;
+
+	TRACE_ENTER(PEERS_EV_UPDTMSG, NULL, p);
+	if (!st)
+		goto ignore_msg;
+
+	flags = intdecode(msg_cur, msg_end);
+	if (!*msg_cur) {
+		TRACE_PROTO("malformed message", PEERS_EV_UPDTMSG, NULL, p);
+		goto malformed_exit;
+	}
+
+	update = intdecode(msg_cur, msg_end);
+	if (!*msg_cur) {
+		TRACE_PROTO("malformed message", PEERS_EV_UPDTMSG, NULL, p);
+		goto malformed_exit;
+	}
+
+	/* holds the key of the previous entry */
+	key = alloc_trash_chunk();
+	if (!key)
+		goto ignore_msg;
+
+	expire = MS_TO_TICKS(st->table->expire);
+	exp = 0;
+	while (*msg_cur < msg_end) {
+		update += intdecode(msg_cur, msg_end);
+		if (!*msg_cur) {
+			TRACE_PROTO("malformed message", PEERS_EV_UPDTMSG, NULL, p);
+			goto malformed_exit;
+		}
+		st->last_get = update;
+
+		if (flags & PEER_BATCH_F_TIMED) {
+			exp += peer_zz_dec(intdecode(msg_cur, msg_end));
+			if (!*msg_cur) {
+				TRACE_PROTO("malformed message", PEERS_EV_UPDTMSG, NULL, p);
+				goto malformed_exit;
+			}
+			expire = exp;
+		}
+
+		if (st->table->type == SMP_T_SINT) {
+			unsigned int delta;
+
+			delta = intdecode(msg_cur, msg_end);
+			if (!*msg_cur) {
+				TRACE_PROTO("malformed message", PEERS_EV_UPDTMSG, NULL, p);
+				goto malformed_exit;
+			}
+			write_u32(key->area, (key->data ? read_u32(key->area) : 0) + peer_zz_dec(delta));
+			key->data = keylen = sizeof(uint32_t);
+		}
+		else {
+			size_t pfx, to_read, to_store;
+
+			pfx = intdecode(msg_cur, msg_end);
+			if (!*msg_cur || pfx > key->data) {
+				TRACE_PROTO("malformed message", PEERS_EV_UPDTMSG, NULL, p, *msg_cur);
+				goto malformed_exit;
+			}
+
+			if (st->table->type == SMP_T_STR) {
+				to_read = intdecode(msg_cur, msg_end);
+				if (!*msg_cur) {
+					TRACE_PROTO("malformed message", PEERS_EV_UPDTMSG, NULL, p);
+					goto malformed_exit;
+				}
+				to_store = MIN(to_read, st->table->key_size - 1 - pfx);
+			}
+			else
+				to_read = to_store = st->table->key_size - pfx;
+
+			if (*msg_cur + to_read > msg_end) {
+				TRACE_PROTO("malformed message", PEERS_EV_UPDTMSG,
+				            NULL, p, *msg_cur);
+				TRACE_PROTO("malformed message", PEERS_EV_UPDTMSG,
+				            NULL, p, msg_end, &to_read);
+				goto malformed_exit;
+			}
+
+			memcpy(key->area + pfx, *msg_cur, to_store);
+			key->data = keylen = pfx + to_store;
+			*msg_cur += to_read;
+		}
+
+		newts = stksess_new(st->table, NULL);
+		if (!newts)
+			goto ignore_msg;
+
+		memcpy(newts->key.key, key->area, keylen);
+		if (st->table->type == SMP_T_STR)
+			newts->key.key[keylen] = 0;
+		newts->shard = stktable_get_key_shard(st->table, newts->key.key, keylen);
+
+		if (!peer_treat_update_values(p, st, newts, expire, msg_cur, msg_end))
+			goto malformed_exit;
+	}
+
+ ignore_msg:
+	free_trash_chunk(key);
+	TRACE_LEAVE(PEERS_EV_UPDTMSG, NULL, p);
+	return 1;
+
+ malformed_exit:
+	free_trash_chunk(key);
 	TRACE_DEVEL("leaving in error", PEERS_EV_UPDTMSG);
 	return 0;
 }
@@ -2146,9 +2712,10 @@ static inline int peer_treat_switchmsg(struct appctx *appctx, struct peer *p,
  * Update <msg_curr> accordingly to the peer protocol specs if no peer protocol error
  * was encountered.
  * <totl> is the length of the stick-table update message computed upon receipt.
- * Return 1 if succeeded, 0 if not with the appctx state st0 set to PEER_SESS_ST_ERRPROTO.
+ * Return 1 if succeeded, 0 if the message is malformed, in which case it is up
+ * to the caller to report the protocol error.
  */
-static inline int peer_treat_definemsg(struct appctx *appctx, struct peer *p,
+static inline int peer_treat_definemsg(struct peer *p,
                                       char **msg_cur, char *msg_end, int totl)
 {
 	int table_id_len;
@@ -2327,7 +2894,6 @@ static inline int peer_treat_definemsg(struct appctx *appctx, struct peer *p,
 
  malformed_exit:
 	/* malformed message */
-	appctx->st0 = PEER_SESS_ST_ERRPROTO;
 	return 0;
 }
 
@@ -2423,23 +2989,20 @@ static inline int peer_treat_awaited_msg(struct appctx *appctx, struct peer *pee
 
 	if (msg_head[0] == PEER_MSG_CLASS_CONTROL) {
 		if (msg_head[1] == PEER_MSG_CTRL_RESYNCREQ) {
-			struct shared_table *st;
 			/* Reset message: remote need resync */
 
 			TRACE_PROTO("received control message", PEERS_EV_CTRLMSG,
 			            NULL, &msg_head[1], peers->local->id, peer->id);
-			/* prepare tables for a global push */
-			for (st = peer->tables; st; st = st->next) {
-				st->teaching_origin = st->last_pushed = st->update;
-				st->flags = 0;
-			}
-
-			/* reset teaching flags to 0 */
-			peer->flags &= PEER_TEACH_RESET;
-
-			/* flag to start to teach lesson */
-			peer->flags |= PEER_F_TEACH_PROCESS;
+			peer_start_teaching(peer);
 			peers->flags |= PEERS_F_RESYNC_REQUESTED;
+
+			if ((peer->flags & PEER_F_SESSIONS) && !peer->sess_idx) {
+				/* the other sessions teach their share of the
+				 * entries, the sync task starts them.
+				 */
+				HA_ATOMIC_STORE(&peer->teach_sessions, peers_other_sessions(peers));
+				task_wakeup(peers->sync_task, TASK_WOKEN_MSG);
+			}
 		}
 		else if (msg_head[1] == PEER_MSG_CTRL_RESYNCFINISHED) {
 			TRACE_PROTO("received control message", PEERS_EV_CTRLMSG,
@@ -2479,7 +3042,21 @@ static inline int peer_treat_awaited_msg(struct appctx *appctx, struct peer *pee
 					}
 				}
 
-				if (commit_a_finish) {
+				if (commit_a_finish && HA_ATOMIC_LOAD(&peers->lessons)) {
+					/* the other sessions to this peer have not
+					 * finished teaching their share of the entries
+					 * yet, the sync task will conclude once they
+					 * are done, or try another peer if they are
+					 * not done in time. A remote peer is not asked
+					 * again in this case.
+					 */
+					peers->flags |= (PEERS_F_RESYNC_ASSIGN|PEERS_F_RESYNC_PROCESS|PEERS_F_RESYNC_WAIT);
+					if (!peer->local)
+						peer->flags |= PEER_F_LEARN_NOTUP2DATE;
+					peers->resync_timeout = tick_add(now_ms, MS_TO_TICKS(PEER_RESYNC_TIMEOUT));
+					task_wakeup(peers->sync_task, TASK_WOKEN_MSG);
+				}
+				else if (commit_a_finish) {
 					peers->flags |= (PEERS_F_RESYNC_LOCAL|PEERS_F_RESYNC_REMOTE);
 					if (peer->local)
 						peers->flags |= PEERS_F_RESYNC_LOCALFINISHED;
@@ -2487,6 +3064,13 @@ static inline int peer_treat_awaited_msg(struct appctx *appctx, struct peer *pee
 						peers->flags |= PEERS_F_RESYNC_REMOTEFINISHED;
 				}
 			}
+			else if (peer->sess_idx && (peer->flags & PEER_F_SESSIONS)) {
+				/* one of the other sessions to the peer assigned
+				 * for the lesson finished teaching its share.
+				 */
+				if (!HA_ATOMIC_AND_FETCH(&peers->lessons, ~(1ULL << peer->sess_idx)))
+					task_wakeup(peers->sync_task, TASK_WOKEN_MSG);
+			}
 			peer->confirm++;
 		}
 		else if (msg_head[1] == PEER_MSG_CTRL_RESYNCPARTIAL) {
@@ -2504,6 +3088,13 @@ static inline int peer_treat_awaited_msg(struct appctx *appctx, struct peer *pee
 				peers->resync_timeout = tick_add(now_ms, MS_TO_TICKS(PEER_RESYNC_TIMEOUT));
 				task_wakeup(peers->sync_task, TASK_WOKEN_MSG);
 			}
+			else if (peer->sess_idx && (peer->flags & PEER_F_SESSIONS)) {
+				/* one of the other sessions to the peer assigned
+				 * for the lesson finished teaching its share.
+				 */
+				if (!HA_ATOMIC_AND_FETCH(&peers->lessons, ~(1ULL << peer->sess_idx)))
+					task_wakeup(peers->sync_task, TASK_WOKEN_MSG);
+			}
 			peer->confirm++;
 		}
 		else if (msg_head[1] == PEER_MSG_CTRL_RESYNCCONFIRM)  {
@@ -2535,8 +3126,10 @@ static inline int peer_treat_awaited_msg(struct appctx *appctx, struct peer *pee
 	}
 	else if (msg_head[0] == PEER_MSG_CLASS_STICKTABLE) {
 		if (msg_head[1] == PEER_MSG_STKT_DEFINE) {
-			if (!peer_treat_definemsg(appctx, peer, msg_cur, msg_end, totl))
+			if (!peer_treat_definemsg(peer, msg_cur, msg_end, totl)) {
+				appctx->st0 = PEER_SESS_ST_ERRPROTO;
 				return 0;
+			}
 		}
 		else if (msg_head[1] == PEER_MSG_STKT_SWITCH) {
 			if (!peer_treat_switchmsg(appctx, peer, msg_cur, msg_end))
@@ -2550,11 +3143,19 @@ static inline int peer_treat_awaited_msg(struct appctx *appctx, struct peer *pee
 
 			update = msg_head[1] == PEER_MSG_STKT_UPDATE || msg_head[1] == PEER_MSG_STKT_UPDATE_TIMED;
 			expire = msg_head[1] == PEER_MSG_STKT_UPDATE_TIMED || msg_head[1] == PEER_MSG_STKT_INCUPDATE_TIMED;
-			if (!peer_treat_updatemsg(appctx, peer, update, expire,
-			                          msg_cur, msg_end, msg_len, totl))
+			if (!peer_treat_updatemsg(peer, update, expire,
+			                          msg_cur, msg_end, msg_len, totl)) {
+				appctx->st0 = PEER_SESS_ST_ERRPROTO;
 				return 0;
+			}
 
 		}
+		else if (msg_head[1] == PEER_MSG_STKT_UPDATE_BATCH) {
+			if (!peer_treat_batchmsg(peer, msg_cur, msg_end)) {
+				appctx->st0 = PEER_SESS_ST_ERRPROTO;
+				return 0;
+			}
+		}
 		else if (msg_head[1] == PEER_MSG_STKT_ACK) {
 			if (!peer_treat_ackmsg(appctx, peer, msg_cur, msg_end))
 				return 0;
@@ -2568,6 +3169,21 @@ static inline int peer_treat_awaited_msg(struct appctx *appctx, struct peer *pee
 	return 1;
 }
 
+/* Returns non-zero if a connection may be established for session <p>. The
+ * other sessions to a peer than the first one wait for it to have negotiated
+ * them, and to be established or to have completed a local resync.
+ */
+static inline int peer_may_connect(const struct peer *p)
+{
+	const struct peer *primary = p->primary;
+
+	if (primary == p)
+		return 1;
+
+	return (primary->flags & PEER_F_SESSIONS) &&
+	       ((primary->appctx && primary->statuscode == PEER_SESS_SC_SUCCESSCODE) ||
+	        (primary->flags & PEER_F_TEACH_COMPLETE));
+}
 
 /*
  * Send any message to <peer> peer.
@@ -2776,12 +3392,18 @@ static inline int peer_getline_host(struct appctx *appctx)
  * Read and parse a last line of a "hello" peer protocol message.
  * Returns 0 if could not read a character, -1 if there was a read error or
  * the line is malformed, 1 if succeeded.
- * Set <curpeer> accordingly (the remote peer sending the "hello" message).
+ * Set <curpeer> accordingly (the remote peer sending the "hello" message), and
+ * <caps> to the capabilities it announced, if any. When several sessions per
+ * peer are announced with the same number of sessions as ours, <curpeer> is
+ * the session designated by the announced index. PEER_CAP_SESSIONS is removed
+ * from <caps> otherwise.
  */
-static inline int peer_getline_last(struct appctx *appctx, struct peer **curpeer)
+static inline int peer_getline_last(struct appctx *appctx, struct peer **curpeer,
+                                    unsigned int *caps)
 {
 	char *p;
 	int reql;
+	unsigned int idx = 0, nb = 0;
 	struct peer *peer;
 	struct stream *s = appctx_strm(appctx);
 	struct peers *peers = strm_fe(s)->parent;
@@ -2793,7 +3415,7 @@ static inline int peer_getline_last(struct appctx *appctx, struct peer **curpeer
 	if (reql < 0)
 		return -1;
 
-	/* parse line "<peer name> <pid> <relative_pid>" */
+	/* parse line "<peer name> <pid> <relative_pid> [<capabilities> [<index> <sessions>]]" */
 	p = strchr(trash.area, ' ');
 	if (!p) {
 		appctx->st0 = PEER_SESS_ST_EXIT;
@@ -2802,9 +3424,33 @@ static inline int peer_getline_last(struct appctx *appctx, struct peer **curpeer
 	}
 	*p = 0;
 
+	*caps = 0;
+	p = strchr(p + 1, ' ');
+	if (p)
+		p = strchr(p + 1, ' ');
+	if (p) {
+		*caps = strtoul(p + 1, &p, 10);
+		if (*caps & PEER_CAP_SESSIONS) {
+			idx = strtoul(p, &p, 10);
+			nb = strtoul(p, NULL, 10);
+		}
+	}
+
+	if (nb != (unsigned int)peers->nb_sessions) {
+		/* only the first session is known to a peer which does not
+		 * use the same number of sessions.
+		 */
+		if (idx) {
+			appctx->st0 = PEER_SESS_ST_EXIT;
+			appctx->st1 = PEER_SESS_SC_ERRPEER;
+			return -1;
+		}
+		*caps &= ~PEER_CAP_SESSIONS;
+	}
+
 	/* lookup known peer */
 	for (peer = peers->remote; peer; peer = peer->next) {
-		if (strcmp(peer->id, trash.area) == 0)
+		if (peer->sess_idx == idx && strcmp(peer->id, trash.area) == 0)
 			break;
 	}
 
@@ -2863,6 +3509,10 @@ static inline void init_accepted_peer(struct peer *peer, struct peers *peers)
 	peer->flags &= PEER_TEACH_RESET;
 	peer->flags &= PEER_LEARN_RESET;
 
+	/* only the first session to a peer may be assigned for a lesson */
+	if (peer->sess_idx)
+		return;
+
 	/* if current peer is local */
 	if (peer->local) {
 		/* if current host need resyncfrom local and no process assigned  */
@@ -2872,6 +3522,13 @@ static inline void init_accepted_peer(struct peer *peer, struct peers *peers)
 			peer->flags |= PEER_F_LEARN_ASSIGN;
 			peers->flags |= (PEERS_F_RESYNC_ASSIGN|PEERS_F_RESYNC_PROCESS);
 			peers->flags |= PEERS_F_RESYNC_LOCALASSIGN;
+
+			/* the other sessions teach the tables they are in
+			 * charge of, and the lesson is only complete once
+			 * all of them have finished.
+			 */
+			HA_ATOMIC_STORE(&peers->lessons, (peer->flags & PEER_F_SESSIONS) ?
+			                peers_other_sessions(peers) : 0);
 		}
 
 	}
@@ -2927,7 +3584,7 @@ static inline void init_connected_peer(struct peer *peer, struct peers *peers)
 		peer->flags |= PEER_F_TEACH_PROCESS;
 	}
 	else if ((peers->flags & PEERS_RESYNC_STATEMASK) == PEERS_RESYNC_FROMREMOTE &&
-	         !(peers->flags & PEERS_F_RESYNC_ASSIGN)) {
+	         !(peers->flags & PEERS_F_RESYNC_ASSIGN) && !peer->sess_idx) {
 		/* If peer is remote and resync from remote is needed,
 		and no peer currently assigned */
 
@@ -2935,6 +3592,10 @@ static inline void init_connected_peer(struct peer *peer, struct peers *peers)
 		peer->flags |= PEER_F_LEARN_ASSIGN;
 		peers->flags |= PEERS_F_RESYNC_ASSIGN;
 		peers->flags |= PEERS_F_RESYNC_REMOTEASSIGN;
+
+		/* the other sessions teach their share of the entries */
+		HA_ATOMIC_STORE(&peers->lessons, (peer->flags & PEER_F_SESSIONS) ?
+		                peers_other_sessions(peers) : 0);
 	}
 }
 
@@ -2996,8 +3657,10 @@ static void peer_io_handler(struct appctx *appctx)
 				appctx->st0 = PEER_SESS_ST_GETPEER;
 				__fallthrough;
 			case PEER_SESS_ST_GETPEER: {
+				unsigned int caps;
+
 				prev_state = appctx->st0;
-				reql = peer_getline_last(appctx, &curpeer);
+				reql = peer_getline_last(appctx, &curpeer, &caps);
 				if (reql <= 0) {
 					if (!reql)
 						goto out;
@@ -3030,6 +3693,15 @@ static void peer_io_handler(struct appctx *appctx)
 						curpeer->flags &= ~PEER_F_DWNGRD;
 					}
 				}
+				caps &= peer_local_caps(curpeer);
+				if (caps & PEER_CAP_BATCH)
+					curpeer->flags |= PEER_F_BATCH;
+				else
+					curpeer->flags &= ~PEER_F_BATCH;
+				if (caps & PEER_CAP_SESSIONS)
+					curpeer->flags |= PEER_F_SESSIONS;
+				else
+					curpeer->flags &= ~PEER_F_SESSIONS;
 				curpeer->appctx = appctx;
 				curpeer->flags |= PEER_F_ALIVE;
 				appctx->svcctx = curpeer;
@@ -3048,7 +3720,7 @@ static void peer_io_handler(struct appctx *appctx)
 					}
 				}
 
-				repl = peer_send_status_successmsg(appctx);
+				repl = peer_send_status_successmsg(appctx, curpeer);
 				if (repl <= 0) {
 					if (repl == -1)
 						goto out;
@@ -3114,6 +3786,26 @@ static void peer_io_handler(struct appctx *appctx)
 
 				/* If status code is success */
 				if (curpeer->statuscode == PEER_SESS_SC_SUCCESSCODE) {
+					char *p = strchr(trash.area, ' ');
+					unsigned int caps = p ? strtoul(p + 1, NULL, 10) : 0;
+
+					/* only capabilities we announced may be accepted */
+					caps &= peer_local_caps(curpeer);
+					if (caps & PEER_CAP_BATCH)
+						curpeer->flags |= PEER_F_BATCH;
+					else
+						curpeer->flags &= ~PEER_F_BATCH;
+					if (caps & PEER_CAP_SESSIONS)
+						curpeer->flags |= PEER_F_SESSIONS;
+					else if (curpeer->sess_idx) {
+						/* the remote peer took us for its first session */
+						curpeer->flags &= ~PEER_F_SESSIONS;
+						curpeer->statuscode = PEER_SESS_SC_ERRPEER;
+						appctx->st0 = PEER_SESS_ST_END;
+						goto switchstate;
+					}
+					else
+						curpeer->flags &= ~PEER_F_SESSIONS;
 					init_connected_peer(curpeer, curpeers);
 				}
 				else {
@@ -3332,6 +4024,7 @@ struct task *process_peer_sync(struct task * task, void *context, unsigned int s
 	struct peers *peers = context;
 	struct peer *ps;
 	struct shared_table *st;
+	int local_pending = 0;
 
 	task->expire = TICK_ETERNITY;
 
@@ -3367,13 +4060,39 @@ struct task *process_peer_sync(struct task * task, void *context, unsigned int s
 			peers->resync_timeout = tick_add(now_ms, MS_TO_TICKS(PEER_RESYNC_TIMEOUT));
 		}
 
+		if (peers->flags & PEERS_F_RESYNC_WAIT) {
+			/* The first session to the peer assigned for the lesson
+			 * finished teaching, the other ones must be done too to
+			 * consider the lesson complete, otherwise we try resync
+			 * from (other) remotes.
+			 */
+			int from_local = (peers->flags & PEERS_RESYNC_STATEMASK) == PEERS_RESYNC_FROMLOCAL;
+
+			if (!HA_ATOMIC_LOAD(&peers->lessons)) {
+				peers->flags &= ~(PEERS_F_RESYNC_ASSIGN|PEERS_F_RESYNC_PROCESS|PEERS_F_RESYNC_WAIT);
+				peers->flags |= (PEERS_F_RESYNC_LOCAL|PEERS_F_RESYNC_REMOTE);
+				peers->flags |= from_local ? PEERS_F_RESYNC_LOCALFINISHED : PEERS_F_RESYNC_REMOTEFINISHED;
+			}
+			else if (tick_is_expired(peers->resync_timeout, now_ms)) {
+				peers->flags &= ~(PEERS_F_RESYNC_ASSIGN|PEERS_F_RESYNC_PROCESS|PEERS_F_RESYNC_WAIT);
+				if (from_local)
+					peers->flags |= (PEERS_F_RESYNC_LOCAL|PEERS_F_RESYNC_LOCALTIMEOUT);
+				else
+					peers->flags |= PEERS_F_RESYNC_REMOTEPARTIAL;
+				peers->resync_timeout = tick_add(now_ms, MS_TO_TICKS(PEER_RESYNC_TIMEOUT));
+			}
+		}
+
 		/* For each session */
 		for (ps = peers->remote; ps; ps = ps->next) {
 			/* For each remote peers */
 			if (!ps->local) {
 				if (!ps->appctx) {
 					/* no active peer connection */
-					if (ps->statuscode == 0 ||
+					if (!peer_may_connect(ps)) {
+						/* wait for the first session to this peer */
+					}
+					else if (ps->statuscode == 0 ||
 					    ((ps->statuscode == PEER_SESS_SC_CONNECTCODE ||
 					      ps->statuscode == PEER_SESS_SC_SUCCESSCODE ||
 					      ps->statuscode == PEER_SESS_SC_CONNECTEDCODE) &&
@@ -3399,15 +4118,18 @@ struct task *process_peer_sync(struct task * task, void *context, unsigned int s
 					/* current peer connection is active and established */
 					if (((peers->flags & PEERS_RESYNC_STATEMASK) == PEERS_RESYNC_FROMREMOTE) &&
 					    !(peers->flags & PEERS_F_RESYNC_ASSIGN) &&
-					    !(ps->flags & PEER_F_LEARN_NOTUP2DATE)) {
+					    !(ps->flags & PEER_F_LEARN_NOTUP2DATE) && !ps->sess_idx) {
 						/* Resync from a remote is needed
 						 * and no peer was assigned for lesson
-						 * and current peer may be up2date */
+						 * and current peer may be up2date
+						 * and this is the first session to this peer */
 
 						/* assign peer for the lesson */
 						ps->flags |= PEER_F_LEARN_ASSIGN;
 						peers->flags |= PEERS_F_RESYNC_ASSIGN;
 						peers->flags |= PEERS_F_RESYNC_REMOTEASSIGN;
+						HA_ATOMIC_STORE(&peers->lessons, (ps->flags & PEER_F_SESSIONS) ?
+						                peers_other_sessions(peers) : 0);
 
 						/* wake up peer handler to handle a request of resync */
 						appctx_wakeup(ps->appctx);
@@ -3415,6 +4137,16 @@ struct task *process_peer_sync(struct task * task, void *context, unsigned int s
 					else {
 						int update_to_push = 0;
 
+						if (ps->sess_idx && (ps->flags & PEER_F_SESSIONS) &&
+						    (HA_ATOMIC_LOAD(&ps->primary->teach_sessions) & (1ULL << ps->sess_idx))) {
+							/* a resync was requested on the first session
+							 * to this peer, teach our share of the entries.
+							 */
+							HA_ATOMIC_AND(&ps->primary->teach_sessions, ~(1ULL << ps->sess_idx));
+							peer_start_teaching(ps);
+							appctx_wakeup(ps->appctx);
+						}
+
 						/* Awake session if there is data to push */
 						for (st = ps->tables; st ; st = st->next) {
 							if (st->last_pushed != st->table->localupdate) {
@@ -3517,13 +4249,54 @@ struct task *process_peer_sync(struct task * task, void *context, unsigned int s
 
 				/* Set resync timeout for the local peer and request a immediate reconnect */
 				peers->resync_timeout = tick_add(now_ms, MS_TO_TICKS(PEER_RESYNC_TIMEOUT));
-				peers->local->reconnect = now_ms;
+				for (ps = peers->local; ps && ps->primary == peers->local; ps = ps->next)
+					ps->reconnect = now_ms;
+			}
+		}
+
+		/* The other sessions to the local peer push their share of the
+		 * entries once the first one negotiated them.
+		 */
+		for (ps = peers->local->next; ps && ps->primary == peers->local; ps = ps->next) {
+			if (ps->flags & PEER_F_TEACH_COMPLETE)
+				continue;
+
+			if (ps->appctx) {
+				local_pending = 1;
+				if (ps->statuscode != PEER_SESS_SC_SUCCESSCODE)
+					continue;
+
+				for (st = ps->tables; st ; st = st->next) {
+					if (st->last_pushed != st->table->localupdate) {
+						appctx_wakeup(ps->appctx);
+						break;
+					}
+				}
+			}
+			else if ((peers->flags & PEERS_F_DONOTSTOP) && peer_may_connect(ps) &&
+			         !tick_is_expired(peers->resync_timeout, now_ms) &&
+			         (ps->statuscode == 0 ||
+			          ps->statuscode == PEER_SESS_SC_SUCCESSCODE ||
+			          ps->statuscode == PEER_SESS_SC_CONNECTEDCODE ||
+			          ps->statuscode == PEER_SESS_SC_TRYAGAIN)) {
+				local_pending = 1;
+				if (!tick_is_expired(ps->reconnect, now_ms))
+					task->expire = tick_first(task->expire, ps->reconnect);
+				else
+					peer_session_create(peers, ps);
 			}
 		}
 
 		ps = peers->local;
 		if (ps->flags & PEER_F_TEACH_COMPLETE) {
-			if (peers->flags & PEERS_F_DONOTSTOP) {
+			/* the other sessions are given up to a resync timeout */
+			if (local_pending && !tick_isset(peers->resync_timeout))
+				peers->resync_timeout = tick_add(now_ms, MS_TO_TICKS(PEER_RESYNC_TIMEOUT));
+
+			if (local_pending && !tick_is_expired(peers->resync_timeout, now_ms)) {
+				task->expire = tick_first(task->expire, peers->resync_timeout);
+			}
+			else if (peers->flags & PEERS_F_DONOTSTOP) {
 				/* resync of new process was complete, current process can die now */
 				_HA_ATOMIC_DEC(&jobs);
 				peers->flags &= ~PEERS_F_DONOTSTOP;
@@ -3596,6 +4369,53 @@ struct task *process_peer_sync(struct task * task, void *context, unsigned int s
 }
 
 
+/*
+ * Creates the additional sessions to each peer of <peers> section when several
+ * sessions per peer were configured. They are inserted in the list just after
+ * the first session to the same peer, with which they share the configuration.
+ * Returns 0 in case of error.
+ */
+static int peers_create_sessions(struct peers *peers)
+{
+	struct peer *curpeer, *p;
+	int idx;
+
+	for (curpeer = peers->remote; curpeer; curpeer = p->next) {
+		curpeer->primary = curpeer;
+		p = curpeer;
+		for (idx = 1; idx < peers->nb_sessions; idx++) {
+			struct peer *sess;
+
+			sess = calloc(1, sizeof(*sess));
+			if (!sess)
+				return 0;
+
+			sess->id = strdup(curpeer->id);
+			if (!sess->id) {
+				free(sess);
+				return 0;
+			}
+			sess->local = curpeer->local;
+			sess->conf = curpeer->conf;
+			sess->last_change = curpeer->last_change;
+			sess->addr = curpeer->addr;
+			sess->proto = curpeer->proto;
+			sess->xprt = curpeer->xprt;
+			sess->sock_init_arg = curpeer->sock_init_arg;
+			sess->srv = curpeer->srv;
+			sess->peers = peers;
+			sess->primary = curpeer;
+			sess->sess_idx = idx;
+			HA_SPIN_INIT(&sess->lock);
+			sess->next = p->next;
+			p->next = sess;
+			p = sess;
+		}
+	}
+
+	return 1;
+}
+
 /*
  * returns 0 in case of error.
  */
@@ -3603,6 +4423,9 @@ int peers_init_sync(struct peers *peers)
 {
 	struct peer * curpeer;
 
+	if (!peers_create_sessions(peers))
+		return 0;
+
 	for (curpeer = peers->remote; curpeer; curpeer = curpeer->next) {
 		peers->peers_fe->maxconn += 3;
 	}
@@ -3708,6 +4531,24 @@ static inline void flush_dcache(struct peer *peer)
 	memset(dc->rx, 0, dc->max_entries * sizeof *dc->rx);
 }
 
+/*
+ * Flush and release the dictionary cache of <peer>, if any.
+ */
+static void free_dcache(struct peer *peer)
+{
+	struct dcache *dc = peer->dcache;
+
+	if (!dc)
+		return;
+
+	flush_dcache(peer);
+	free(dc->tx->entries);
+	free(dc->tx);
+	free(dc->rx);
+	free(dc);
+	peer->dcache = NULL;
+}
+
 /*
  * Insert a dictionary entry in <dc> cache part used upon transmission (->tx)
  * with information provided by <i> dictionary cache entry (especially the value
@@ -3794,9 +4635,11 @@ int peers_register_table(struct peers *peers, struct stktable *table)
 		/* If peer is local we inc table
 		 * refcnt to protect against flush
 		 * until this process pushed all
-		 * table content to the new one
+		 * table content to the new one.
+		 * This is only done for the first
+		 * session to the local peer.
 		 */
-		if (curpeer->local)
+		if (curpeer == peers->local)
 			HA_ATOMIC_INC(&st->table->refcnt);
 		curpeer->tables = st;
 	}
@@ -3895,10 +4738,15 @@ static int peers_dump_peer(struct buffer *msg, struct appctx *appctx, struct pee
 	struct shared_table *st;
 
 	addr_to_str(&peer->addr, pn, sizeof pn);
-	chunk_appendf(msg, "  %p: id=%s(%s,%s) addr=%s:%d last_status=%s",
+	chunk_appendf(msg, "  %p: id=%s(%s,%s)",
 	              peer, peer->id,
 	              peer->local ? "local" : "remote",
-	              peer->appctx ? "active" : "inactive",
+	              peer->appctx ? "active" : "inactive");
+
+	if (peer->peers->nb_sessions > 1)
+		chunk_appendf(msg, " session=%u/%d", peer->sess_idx, peer->peers->nb_sessions);
+
+	chunk_appendf(msg, " addr=%s:%d last_status=%s",
 	              pn, get_host_port(&peer->addr),
 	              statuscode_str(peer->statuscode));
 
@@ -4107,6 +4955,517 @@ static int cli_io_handler_show_peers(struct appctx *appctx)
 	return ret;
 }
 
+/*
+ * Stick-table snapshots. A table declaring a "snapshot" file is periodically
+ * saved to this file by a dedicated task, once more when the process starts to
+ * stop, and restored from it on startup. The file starts with a header made of a
+ * magic string, the version of the peers protocol and the date of the
+ * snapshot, followed by the same messages as the ones sent to remote peers :
+ * a table definition message then one update message per entry. A pseudo-peer
+ * is used to build and parse them, so that the dictionary cache is handled
+ * exactly as on the wire.
+ */
+#define PEERS_SNAPSHOT_MAGIC     "HAPSTKT"  /* 8 bytes including the trailing zero */
+#define PEERS_SNAPSHOT_HDR_LEN   18         /* magic(8) + version(2) + date(8) */
+#define PEERS_SNAPSHOT_BATCH     1000       /* entries dumped per task call */
+
+/* Context of the snapshot of a stick-table */
+struct peers_snapshot {
+	struct stktable *table;
+	struct peer peer;           /* pseudo-peer holding the dictionary cache */
+	struct shared_table st;     /* <table> as shared with <peer> */
+	struct stksess *entry;      /* next entry to dump (refcount held), or NULL */
+	struct buffer *out;         /* output buffer, NULL if no dump in progress */
+	struct sig_handler *sighandler; /* wakes the task up when stopping */
+	unsigned int updateid;      /* update ID of the last dumped entry */
+	int fd;                     /* temporary file being written, or -1 */
+	int stopped;                /* the final snapshot was taken */
+};
+
+/* Returns the current wall-clock date in milliseconds */
+static inline unsigned long long peers_snapshot_date(void)
+{
+	return (unsigned long long)date.tv_sec * 1000 + date.tv_usec / 1000;
+}
+
+/* Returns the name of the temporary file the snapshot of <ctx> is written to.
+ * It is stored in a trash chunk, and depends on the PID so that an old process
+ * does not collide with the new one during a reload.
+ */
+static inline const char *peers_snapshot_tmpname(const struct peers_snapshot *ctx)
+{
+	struct buffer *tmp = get_trash_chunk();
+
+	chunk_printf(tmp, "%s.%d.tmp", ctx->table->snapshot.file, (int)getpid());
+	return tmp->area;
+}
+
+/* Writes the pending output of snapshot <ctx> to its file.
+ * Returns 1 on success, 0 on error with errno set.
+ */
+static int peers_snapshot_flush(struct peers_snapshot *ctx)
+{
+	const char *area = b_orig(ctx->out);
+	size_t len = b_data(ctx->out);
+	ssize_t ret;
+
+	while (len) {
+		ret = write(ctx->fd, area, len);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			return 0;
+		}
+		area += ret;
+		len -= ret;
+	}
+	ctx->out->data = 0;
+	return 1;
+}
+
+/* Appends message <msg> of <len> bytes to the output of snapshot <ctx>,
+ * flushing it first if there is not enough room left.
+ * Returns 1 on success, 0 on error.
+ */
+static int peers_snapshot_put(struct peers_snapshot *ctx, const char *msg, int len)
+{
+	if (chunk_memcat(ctx->out, msg, len))
+		return 1;
+	if (!peers_snapshot_flush(ctx))
+		return 0;
+	return chunk_memcat(ctx->out, msg, len);
+}
+
+/* Aborts any dump in progress for snapshot <ctx>, removing its temporary file.
+ * The snapshot file itself is left untouched.
+ */
+static void peers_snapshot_abort(struct peers_snapshot *ctx)
+{
+	if (ctx->entry) {
+		stksess_kill_if_expired(ctx->table, ctx->entry, 1);
+		ctx->entry = NULL;
+	}
+	if (ctx->fd >= 0) {
+		close(ctx->fd);
+		unlink(peers_snapshot_tmpname(ctx));
+		ctx->fd = -1;
+	}
+	free_trash_chunk(ctx->out);
+	ctx->out = NULL;
+}
+
+/* Starts a dump of snapshot <ctx>: opens the temporary file, writes the header
+ * and the table definition, and holds the first entry of the table.
+ * Returns 1 on success, 0 on error, in which case the caller must abort it.
+ */
+static int peers_snapshot_start(struct peers_snapshot *ctx)
+{
+	struct peer_prep_params p = {
+		.swtch.shared_table = &ctx->st,
+	};
+	struct stktable *t = ctx->table;
+	char hdr[PEERS_SNAPSHOT_HDR_LEN];
+	struct ebmb_node *eb;
+	int len;
+
+	ctx->out = alloc_trash_chunk();
+	if (!ctx->out)
+		return 0;
+
+	ctx->fd = open(peers_snapshot_tmpname(ctx), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (ctx->fd < 0)
+		return 0;
+
+	/* each file is a new stream of messages */
+	flush_dcache(&ctx->peer);
+	ctx->st.last_pushed = ctx->updateid = 0;
+
+	memcpy(hdr, PEERS_SNAPSHOT_MAGIC, 8);
+	hdr[8] = PEER_MAJOR_VER;
+	hdr[9] = PEER_MINOR_VER;
+	write_n64(hdr + 10, peers_snapshot_date());
+	if (!peers_snapshot_put(ctx, hdr, sizeof(hdr)))
+		return 0;
+
+	len = peer_prepare_switchmsg(trash.area, trash.size, &p);
+	if (!len || !peers_snapshot_put(ctx, trash.area, len))
+		return 0;
+
+	HA_RWLOCK_WRLOCK(STK_TABLE_LOCK, &t->lock);
+	eb = ebmb_first(&t->keys);
+	if (eb) {
+		ctx->entry = ebmb_entry(eb, struct stksess, key);
+		ctx->entry->ref_cnt++;
+	}
+	HA_RWLOCK_WRUNLOCK(STK_TABLE_LOCK, &t->lock);
+	return 1;
+}
+
+/* Dumps at most <budget> entries of snapshot <ctx>. Once all entries were
+ * dumped, the temporary file is renamed to the snapshot file. Returns 1 when
+ * done, 0 if entries remain to be dumped, or -1 on error, in which case the
+ * caller must abort the dump.
+ */
+static int peers_snapshot_dump(struct peers_snapshot *ctx, int budget)
+{
+	struct peer_prep_params p = {
+		.updt = {
+			.shared_table = &ctx->st,
+			.use_timed = 1,
+			.peer = &ctx->peer,
+		},
+	};
+	struct stktable *t = ctx->table;
+	struct ebmb_node *eb;
+	struct stksess *ts;
+	const char *tmpname;
+	int len;
+
+	while ((ts = ctx->entry)) {
+		if (budget-- <= 0)
+			return 0;
+
+		if (!tick_is_expired(ts->expire, now_ms)) {
+			/* consecutive update IDs are not encoded */
+			p.updt.stksess = ts;
+			p.updt.updateid = ctx->updateid + 1;
+			len = peer_prepare_updatemsg(trash.area, trash.size, &p);
+			if (!len || !peers_snapshot_put(ctx, trash.area, len))
+				return -1;
+			ctx->st.last_pushed = ++ctx->updateid;
+		}
+
+		HA_RWLOCK_WRLOCK(STK_TABLE_LOCK, &t->lock);
+		ts->ref_cnt--;
+		eb = ebmb_next(&ts->key);
+		ctx->entry = eb ? ebmb_entry(eb, struct stksess, key) : NULL;
+		if (ctx->entry)
+			ctx->entry->ref_cnt++;
+		__stksess_kill_if_expired(t, ts);
+		HA_RWLOCK_WRUNLOCK(STK_TABLE_LOCK, &t->lock);
+	}
+
+	if (!peers_snapshot_flush(ctx))
+		return -1;
+
+	len = close(ctx->fd);
+	ctx->fd = -1;
+	tmpname = peers_snapshot_tmpname(ctx);
+	if (len < 0 || rename(tmpname, t->snapshot.file) < 0) {
+		unlink(tmpname);
+		return -1;
+	}
+
+	free_trash_chunk(ctx->out);
+	ctx->out = NULL;
+	return 1;
+}
+
+/* Task periodically saving the stick-table of snapshot <context>. The entries
+ * are dumped by batches so that the traffic is not stalled on large tables.
+ * When the process starts to stop, a last snapshot is taken, after which the
+ * table is released so that it may be flushed.
+ */
+static struct task *peers_snapshot_task(struct task *task, void *context, unsigned int state)
+{
+	struct peers_snapshot *ctx = context;
+	struct stktable *t = ctx->table;
+	int ret;
+
+	if (ctx->stopped)
+		return task;
+
+	if (!ctx->out) {
+		if (!stopping && !tick_is_expired(task->expire, now_ms))
+			return task;
+		if (!peers_snapshot_start(ctx))
+			goto fail;
+	}
+
+	ret = peers_snapshot_dump(ctx, PEERS_SNAPSHOT_BATCH);
+	if (ret < 0)
+		goto fail;
+
+	if (!ret) {
+		/* let other tasks run before dumping the next batch */
+		task_wakeup(task, TASK_WOKEN_OTHER);
+		return task;
+	}
+
+	if (stopping)
+		goto release;
+
+	task->expire = tick_add(now_ms, MS_TO_TICKS(t->snapshot.period));
+	return task;
+
+ fail:
+	send_log(NULL, LOG_WARNING, "Failed to save stick-table '%s' to snapshot file '%s' : %s.\n",
+	         t->id, t->snapshot.file, strerror(errno));
+	peers_snapshot_abort(ctx);
+	if (!stopping) {
+		task->expire = tick_add(now_ms, MS_TO_TICKS(t->snapshot.period));
+		return task;
+	}
+ release:
+	ctx->stopped = 1;
+	HA_ATOMIC_DEC(&t->refcnt);
+	task->expire = TICK_ETERNITY;
+	return task;
+}
+
+/* Removes the expired entries of table <t> which were just restored from a
+ * snapshot taken <elapsed> milliseconds ago, and ages its frequency counters
+ * accordingly. Must only be called during startup.
+ */
+static void peers_snapshot_age(struct stktable *t, unsigned long long elapsed)
+{
+	struct ebmb_node *eb;
+	struct stksess *ts;
+	struct freq_ctr *ctr;
+	unsigned int data_type, idx;
+	void *ptr;
+
+	HA_RWLOCK_WRLOCK(STK_TABLE_LOCK, &t->lock);
+	eb = ebmb_first(&t->keys);
+	while (eb) {
+		ts = ebmb_entry(eb, struct stksess, key);
+		eb = ebmb_next(eb);
+
+		if (__stksess_kill_if_expired(t, ts) || !elapsed)
+			continue;
+
+		for (data_type = 0; data_type < STKTABLE_DATA_TYPES; data_type++) {
+			if (stktable_data_types[data_type].std_type != STD_T_FRQP)
+				continue;
+
+			for (idx = 0; (ptr = stktable_data_ptr_idx(t, ts, data_type, idx)); idx++) {
+				ctr = &stktable_data_cast(ptr, std_t_frqp);
+				if (elapsed >= 2ULL * t->data_arg[data_type].u)
+					ctr->curr_ctr = ctr->prev_ctr = 0;
+				else
+					ctr->curr_tick = tick_add(ctr->curr_tick, -(int)elapsed) & ~0x1;
+			}
+		}
+	}
+	HA_RWLOCK_WRUNLOCK(STK_TABLE_LOCK, &t->lock);
+}
+
+/* Restores the stick-table of snapshot <ctx> from its file, if it exists. The
+ * remaining time of the entries is reduced by the time elapsed since the
+ * snapshot was taken. Entries decoded before an error are kept.
+ * Returns 1 on success, 0 on error with <err> filled.
+ */
+static int peers_snapshot_restore(struct peers_snapshot *ctx, char **err)
+{
+	struct stktable *t = ctx->table;
+	struct peer *p = &ctx->peer;
+	unsigned long long saved, elapsed = 0;
+	char *area = NULL, *cur, *end, *msg_end;
+	uint32_t msg_len, remain;
+	struct stat st;
+	size_t len = 0;
+	ssize_t ret;
+	int fd, updt, exp, ret_code = 0;
+	unsigned char type;
+
+	fd = open(t->snapshot.file, O_RDONLY);
+	if (fd < 0) {
+		if (errno == ENOENT)
+			return 1; /* nothing saved yet */
+		memprintf(err, "cannot open file (%s)", strerror(errno));
+		return 0;
+	}
+
+	if (fstat(fd, &st) < 0 || !(area = malloc(st.st_size + 1))) {
+		memprintf(err, "cannot load file (%s)", strerror(errno));
+		close(fd);
+		return 0;
+	}
+
+	while (len < (size_t)st.st_size) {
+		ret = read(fd, area + len, st.st_size - len);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret <= 0)
+			break;
+		len += ret;
+	}
+	close(fd);
+
+	if (len < PEERS_SNAPSHOT_HDR_LEN || memcmp(area, PEERS_SNAPSHOT_MAGIC, 8) != 0) {
+		memprintf(err, "not a stick-table snapshot");
+		goto out;
+	}
+
+	if (area[8] != PEER_MAJOR_VER || area[9] > PEER_MINOR_VER) {
+		memprintf(err, "unsupported snapshot version %d.%d", area[8], area[9]);
+		goto out;
+	}
+
+	saved = read_n64(area + 10);
+	if (peers_snapshot_date() > saved)
+		elapsed = peers_snapshot_date() - saved;
+
+	p->remote_table = NULL;
+	cur = area + PEERS_SNAPSHOT_HDR_LEN;
+	end = area + len;
+	while (cur < end) {
+		if (end - cur < PEER_MSG_HEADER_LEN || cur[0] != PEER_MSG_CLASS_STICKTABLE)
+			goto malformed;
+
+		type = cur[1];
+		cur += PEER_MSG_HEADER_LEN;
+		msg_len = intdecode(&cur, end);
+		if (!cur || msg_len > (size_t)(end - cur))
+			goto malformed;
+		msg_end = cur + msg_len;
+
+		if (type == PEER_MSG_STKT_DEFINE) {
+			if (!peer_treat_definemsg(p, &cur, msg_end, 0))
+				goto malformed;
+			if (!p->remote_table) {
+				memprintf(err, "the table definition does not match the saved one");
+				goto age;
+			}
+		}
+		else if (type == PEER_MSG_STKT_UPDATE || type == PEER_MSG_STKT_INCUPDATE ||
+		         type == PEER_MSG_STKT_UPDATE_TIMED || type == PEER_MSG_STKT_INCUPDATE_TIMED) {
+			updt = type == PEER_MSG_STKT_UPDATE || type == PEER_MSG_STKT_UPDATE_TIMED;
+			exp = type == PEER_MSG_STKT_UPDATE_TIMED || type == PEER_MSG_STKT_INCUPDATE_TIMED;
+
+			if (!p->remote_table)
+				goto malformed;
+
+			/* the expiration follows the optional update ID */
+			if (exp && elapsed && msg_len >= (updt ? 8 : 4)) {
+				char *pos = cur + (updt ? 4 : 0);
+
+				remain = read_n32(pos);
+				remain = remain > elapsed ? remain - elapsed : 0;
+				write_n32(pos, remain);
+			}
+
+			if (!peer_treat_updatemsg(p, updt, exp, &cur, msg_end, msg_len, 0))
+				goto malformed;
+		}
+		else
+			goto malformed;
+
+		cur = msg_end;
+	}
+	ret_code = 1;
+	goto age;
+
+ malformed:
+	memprintf(err, "truncated or malformed snapshot at offset %ld", (long)(cur ? cur - area : len));
+ age:
+	peers_snapshot_age(t, elapsed);
+	flush_dcache(p);
+ out:
+	free(area);
+	return ret_code;
+}
+
+/* Sets up the snapshot of stick-table <t> which has a snapshot file : the table
+ * is restored from the file, and a task is created to periodically save it.
+ * The table's refcount is held until the last snapshot is taken, in order to
+ * prevent it from being flushed when stopping. A failure to restore the table
+ * only emits a warning. Nothing is done when only checking the configuration.
+ * Returns 1 on success, 0 on allocation failure.
+ */
+int peers_snapshot_init(struct stktable *t)
+{
+	struct peers_snapshot *ctx;
+	struct task *task;
+	char *errmsg = NULL;
+
+	if (global.mode & MODE_CHECK)
+		return 1;
+
+	ctx = calloc(1, sizeof(*ctx));
+	task = task_new_anywhere();
+	if (!ctx || !task)
+		goto fail;
+
+	ctx->peer.dcache = new_dcache(PEER_STKT_CACHE_MAX_ENTRIES);
+	if (!ctx->peer.dcache)
+		goto fail;
+
+	ctx->table = t;
+	ctx->fd = -1;
+	ctx->peer.id = t->snapshot.file;
+	ctx->peer.tables = &ctx->st;
+	ctx->st.table = t;
+	ctx->st.local_id = 1;
+
+	if (!peers_snapshot_restore(ctx, &errmsg)) {
+		ha_warning("Failed to restore stick-table '%s' from snapshot file '%s' : %s.\n",
+		           t->id, t->snapshot.file, errmsg);
+		ha_free(&errmsg);
+	}
+
+	task->process = peers_snapshot_task;
+	task->context = ctx;
+	task->expire = tick_add(now_ms, MS_TO_TICKS(t->snapshot.period));
+	ctx->sighandler = signal_register_task(0, task, 0);
+	if (!ctx->sighandler)
+		goto fail;
+	task_queue(task);
+	t->snapshot.task = task;
+	HA_ATOMIC_INC(&t->refcnt);
+	return 1;
+
+ fail:
+	task_destroy(task);
+	if (ctx)
+		free_dcache(&ctx->peer);
+	free(ctx);
+	return 0;
+}
+
+/* Synchronously saves all stick-tables which have a snapshot file and were not
+ * saved when starting to stop, which happens on hard stop. This is meant to be
+ * called once the threads are stopped, before the tables are released. A dump
+ * in progress is restarted from scratch.
+ */
+void peers_snapshot_save_all(void)
+{
+	struct peers_snapshot *ctx;
+	struct stktable *t;
+
+	for (t = stktables_list; t; t = t->next) {
+		if (!t->snapshot.task)
+			continue;
+
+		ctx = t->snapshot.task->context;
+		if (ctx->stopped)
+			continue;
+
+		peers_snapshot_abort(ctx);
+		if (!peers_snapshot_start(ctx) || peers_snapshot_dump(ctx, INT_MAX) < 0) {
+			ha_warning("Failed to save stick-table '%s' to snapshot file '%s' : %s.\n",
+			           t->id, t->snapshot.file, strerror(errno));
+			peers_snapshot_abort(ctx);
+		}
+	}
+}
+
+/* Releases the snapshot context of stick-table <t> */
+void peers_snapshot_deinit(struct stktable *t)
+{
+	struct peers_snapshot *ctx;
+
+	if (!t->snapshot.task)
+		return;
+
+	ctx = t->snapshot.task->context;
+	peers_snapshot_abort(ctx);
+	free_dcache(&ctx->peer);
+	task_destroy(t->snapshot.task);
+	t->snapshot.task = NULL;
+	free(ctx);
+}
+
 /* config parser for global "tune.peers.max-updates-at-once" */
 static int cfg_parse_max_updt_at_once(char **args, int section_type, struct proxy *curpx,
                                       const struct proxy *defpx, const char *file, int line,
@@ -4129,8 +5488,28 @@ static int cfg_parse_max_updt_at_once(char **args, int section_type, struct prox
 	return 0;
 }
 
+/* config parser for global "tune.peers.batch" */
+static int cfg_parse_peers_batch(char **args, int section_type, struct proxy *curpx,
+                                 const struct proxy *defpx, const char *file, int line,
+                                 char **err)
+{
+	if (too_many_args(1, args, err, NULL))
+		return -1;
+
+	if (strcmp(args[1], "on") == 0)
+		peers_batch = 1;
+	else if (strcmp(args[1], "off") == 0)
+		peers_batch = 0;
+	else {
+		memprintf(err, "'%s' expects 'on' or 'off' but got '%s'.", args[0], args[1]);
+		return -1;
+	}
+	return 0;
+}
+
 /* config keyword parsers */
 static struct cfg_kw_list cfg_kws = {ILH, {
+	{ CFG_GLOBAL, "tune.peers.batch",                cfg_parse_peers_batch },
 	{ CFG_GLOBAL, "tune.peers.max-updates-at-once",  cfg_parse_max_updt_at_once },
 	{ 0, NULL, NULL }
 }};
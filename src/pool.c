@@ -247,6 +247,44 @@ int malloc_trim(size_t pad)
 	return ret;
 }
 
+/* Returns the number of bytes currently allocated by malloc(), or -1 if the
+ * allocator does not permit to retrieve it. This may be expensive, so it is
+ * only meant to be used for reporting.
+ */
+ssize_t malloc_heap_used(void)
+{
+	if (my_mallctl) {
+		uint64_t epoch = 1;
+		size_t allocated, len = sizeof(epoch);
+
+		/* jemalloc's statistics are only refreshed with the epoch */
+		(void)my_mallctl("epoch", &epoch, &len, &epoch, len);
+		len = sizeof(allocated);
+		if (my_mallctl("stats.allocated", &allocated, &len, NULL, 0) == 0)
+			return allocated;
+		return -1;
+	}
+
+	if (!using_default_allocator)
+		return -1;
+
+#if defined(HA_HAVE_MALLOC_TRIM)
+	{
+		/* in-use chunks and mmapped areas */
+#ifdef HA_HAVE_MALLINFO2
+		struct mallinfo2 mi = mallinfo2();
+
+		return mi.uordblks + mi.hblkhd;
+#else
+		struct mallinfo mi = mallinfo();
+
+		return (size_t)(uint)mi.uordblks + (uint)mi.hblkhd;
+#endif
+	}
+#endif
+	return -1;
+}
+
 static int mem_should_fail(const struct pool_head *pool)
 {
 	int ret = 0;
@@ -27,6 +27,7 @@
 #include <haproxy/api.h>
 #include <haproxy/arg.h>
 #include <haproxy/connection.h>
+#include <haproxy/cpuset.h>
 #include <haproxy/errors.h>
 #include <haproxy/fd.h>
 #include <haproxy/global.h>
@@ -570,6 +571,28 @@ int tcp_connect_server(struct connection *conn, int flags)
 	return SF_ERR_NONE;  /* connection is OK */
 }
 
+#if defined(SO_INCOMING_CPU) && defined(USE_CPU_AFFINITY)
+/* Returns the CPU the shard served by listener <listener> should receive its
+ * connections from, which is the first CPU its first thread is bound to by
+ * "cpu-map", or -1 if this thread is not bound. The kernel then prefers this
+ * socket among those of the same SO_REUSEPORT group when a connection is
+ * received on this CPU.
+ */
+static int tcp_listener_incoming_cpu(const struct listener *listener)
+{
+	const struct hap_cpuset *set;
+	int grp = listener->rx.bind_tgroup;
+	int ltid;
+
+	if (!grp || !listener->rx.bind_thread)
+		return -1;
+
+	ltid = my_ffsl(listener->rx.bind_thread) - 1;
+	set = &cpu_map[grp - 1].thread[ltid];
+	return ha_cpuset_ffs(set) - 1;
+}
+#endif
+
 /* This function tries to bind a TCPv4/v6 listener. It may return a warning or
  * an error message in <errmsg> if the message is at most <errlen> bytes long
  * (including '\0'). Note that <errmsg> may be NULL if <errlen> is also zero.
@@ -666,6 +689,33 @@ int tcp_bind_listener(struct listener *listener, char *errmsg, int errlen)
 		setsockopt(fd, IPPROTO_TCP, TCP_USER_TIMEOUT, &zero,
 		    sizeof(zero));
 #endif
+#if defined(SO_INCOMING_CPU) && defined(USE_CPU_AFFINITY)
+	if (listener->bind_conf->options & BC_O_INCOMING_CPU) {
+		int cpu = tcp_listener_incoming_cpu(listener);
+
+		if (cpu < 0) {
+			chunk_appendf(msg, "%sincoming-cpu ignored since the shard's thread is not bound by cpu-map", msg->data ? ", " : "");
+			err |= ERR_WARN;
+		}
+		else if (setsockopt(fd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, sizeof(cpu)) == -1) {
+			chunk_appendf(msg, "%scannot set SO_INCOMING_CPU", msg->data ? ", " : "");
+			err |= ERR_WARN;
+		}
+	}
+#endif
+#if defined(SO_BUSY_POLL)
+	if (listener->bind_conf->busy_poll) {
+		if (setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL,
+			       &listener->bind_conf->busy_poll, sizeof(listener->bind_conf->busy_poll)) == -1) {
+			chunk_appendf(msg, "%scannot enable SO_BUSY_POLL", msg->data ? ", " : "");
+			err |= ERR_WARN;
+		}
+#if defined(SO_PREFER_BUSY_POLL)
+		/* not supported before Linux 5.11, that's not an error */
+		setsockopt(fd, SOL_SOCKET, SO_PREFER_BUSY_POLL, &one, sizeof(one));
+#endif
+	}
+#endif
 #if defined(TCP_DEFER_ACCEPT)
 	if (listener->bind_conf->options & BC_O_DEF_ACCEPT) {
 		/* defer accept by up to one second */
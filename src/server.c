@@ -31,6 +31,7 @@
 #include <haproxy/log.h>
 #include <haproxy/mailers.h>
 #include <haproxy/namespace.h>
+#include <haproxy/pool.h>
 #include <haproxy/port_range.h>
 #include <haproxy/protocol.h>
 #include <haproxy/proxy.h>
@@ -73,6 +74,8 @@ struct eb_root idle_conn_srv = EB_ROOT;
 struct task *idle_conn_task __read_mostly = NULL;
 struct list servers_list = LIST_HEAD_INIT(servers_list);
 
+DECLARE_STATIC_POOL(pool_head_srv_warm_conn, "srv_warm_conn", sizeof(struct srv_warm_conn));
+
 /* SERVER DELETE(n)->ADD global tracker:
  * This is meant to provide srv->rid (revision id) value.
  * Revision id allows to differentiate between a previously existing
@@ -880,6 +883,25 @@ static int srv_parse_pool_max_conn(char **args, int *cur_arg, struct proxy *curp
 	return 0;
 }
 
+static int srv_parse_pool_warm(char **args, int *cur_arg, struct proxy *curproxy, struct server *newsrv, char **err)
+{
+	char *arg;
+
+	arg = args[*cur_arg + 1];
+	if (!*arg) {
+		memprintf(err, "'%s' expects <value> as argument.\n", args[*cur_arg]);
+		return ERR_ALERT | ERR_FATAL;
+	}
+
+	if ((int)atoi(arg) < 0) {
+		memprintf(err, "'%s' must be >= 0", args[*cur_arg]);
+		return ERR_ALERT | ERR_FATAL;
+	}
+
+	newsrv->pool_warm = atoi(arg);
+	return 0;
+}
+
 /* parse the "id" server keyword */
 static int srv_parse_id(char **args, int *cur_arg, struct proxy *curproxy, struct server *newsrv, char **err)
 {
@@ -1919,6 +1941,7 @@ static struct srv_kw_list srv_kws = { "ALL", { }, {
 	{ "pool-low-conn",       srv_parse_pool_low_conn,       1,  1,  1 }, /* Set the min number of orphan idle connecbefore being allowed to pick from other threads */
 	{ "pool-max-conn",       srv_parse_pool_max_conn,       1,  1,  1 }, /* Set the max number of orphan idle connections, -1 means unlimited */
 	{ "pool-purge-delay",    srv_parse_pool_purge_delay,    1,  1,  1 }, /* Set the time before we destroy orphan idle connections, defaults to 1s */
+	{ "pool-warm",           srv_parse_pool_warm,           1,  1,  0 }, /* Set the number of pre-established connections to keep per thread */
 	{ "proto",               srv_parse_proto,               1,  1,  1 }, /* Set the proto to use for all outgoing connections */
 	{ "proxy-v2-options",    srv_parse_proxy_v2_options,    1,  1,  1 }, /* options for send-proxy-v2 */
 	{ "redir",               srv_parse_redir,               1,  1,  0 }, /* Enable redirection mode */
@@ -2413,6 +2436,7 @@ void srv_settings_cpy(struct server *srv, const struct server *src, int srv_tmpl
 	srv->pool_purge_delay = src->pool_purge_delay;
 	srv->low_idle_conns = src->low_idle_conns;
 	srv->max_idle_conns = src->max_idle_conns;
+	srv->pool_warm = src->pool_warm;
 	srv->max_reuse = src->max_reuse;
 
 	if (srv_tmpl)
@@ -2531,6 +2555,12 @@ struct server *srv_drop(struct server *srv)
 
 	task_destroy(srv->warmup);
 	task_destroy(srv->srvrq_check);
+	if (srv->per_thr) {
+		int i;
+
+		for (i = 0; i < global.nbthread; i++)
+			task_destroy(srv->per_thr[i].warm_task);
+	}
 
 	free(srv->id);
 	srv_free_params(srv);
@@ -4806,6 +4836,7 @@ int srv_init_per_thr(struct server *srv)
 		srv->per_thr[i].idle_conns = EB_ROOT;
 		srv->per_thr[i].safe_conns = EB_ROOT;
 		srv->per_thr[i].avail_conns = EB_ROOT;
+		LIST_INIT(&srv->per_thr[i].warm_conns);
 		MT_LIST_INIT(&srv->per_thr[i].streams);
 	}
 
@@ -5956,9 +5987,11 @@ void srv_release_conn(struct server *srv, struct connection *conn)
 	}
 	else {
 		/* The connection is not private and not in any server's idle
-		 * list, so decrement the current number of used connections
+		 * list, so decrement the current number of used connections,
+		 * unless it was never used (pool-warm).
 		 */
-		_HA_ATOMIC_DEC(&srv->curr_used_conns);
+		if (!(conn->flags & CO_FL_WARM))
+			_HA_ATOMIC_DEC(&srv->curr_used_conns);
 	}
 
 	/* Remove the connection from any tree (safe, idle or available) */
@@ -6040,13 +6073,12 @@ int srv_add_to_idle_list(struct server *srv, struct connection *conn, int is_saf
 
 		if (is_safe) {
 			conn->flags = (conn->flags & ~CO_FL_LIST_MASK) | CO_FL_SAFE_LIST;
-			eb64_insert(&srv->per_thr[tid].safe_conns, &conn->hash_node->node);
 			_HA_ATOMIC_INC(&srv->curr_safe_nb);
 		} else {
 			conn->flags = (conn->flags & ~CO_FL_LIST_MASK) | CO_FL_IDLE_LIST;
-			eb64_insert(&srv->per_thr[tid].idle_conns, &conn->hash_node->node);
 			_HA_ATOMIC_INC(&srv->curr_idle_nb);
 		}
+		_srv_idle_tree_insert(srv, conn, is_safe);
 		HA_SPIN_UNLOCK(IDLE_CONNS_LOCK, &idle_conns[tid].idle_conns_lock);
 		_HA_ATOMIC_INC(&srv->curr_idle_thr[tid]);
 
@@ -6165,6 +6197,294 @@ struct task *srv_cleanup_idle_conns(struct task *task, void *context, unsigned i
 	return task;
 }
 
+/* Returns non-zero if the pre-established connection <conn> does not point to
+ * the current address of server <srv> anymore (e.g. after a DNS update).
+ */
+static int srv_warm_conn_moved(struct server *srv, struct connection *conn)
+{
+	struct sockaddr_storage addr = srv->addr;
+
+	set_host_port(&addr, srv->svc_port);
+	return ipcmp(conn->dst, &addr, 1) == 1;
+}
+
+/* Closes and releases the pre-established connection attached to <wc> as well
+ * as its context. Must be called from the thread owning it.
+ */
+static void srv_warm_conn_release(struct server *srv, struct srv_warm_conn *wc)
+{
+	struct connection *conn = wc->conn;
+
+	if (wc->wait_event.events)
+		conn->xprt->unsubscribe(conn, conn->xprt_ctx, wc->wait_event.events, &wc->wait_event);
+	LIST_DELETE(&wc->list);
+	srv->per_thr[tid].warm_nb--;
+	_HA_ATOMIC_DEC(&srv->curr_warm_conns);
+	tasklet_free(wc->wait_event.tasklet);
+	pool_free(pool_head_srv_warm_conn, wc);
+
+	conn->ctx = NULL;
+	conn_full_close(conn);
+	conn_free(conn);
+}
+
+/* I/O callback of a pre-established connection. It is first woken up once the
+ * connection is established (including the SSL handshake) or failed, then it
+ * watches for read events. On an unused connection these may only report a
+ * close or unsolicited data, both of which make it unusable.
+ */
+static struct task *srv_warm_conn_io_cb(struct task *t, void *context, unsigned int state)
+{
+	struct srv_warm_conn *wc = context;
+	struct connection *conn = wc->conn;
+	struct server *srv = __objt_server(conn->target);
+	int event_type;
+
+	if (conn->flags & (CO_FL_ERROR | CO_FL_SOCK_RD_SH | CO_FL_SOCK_WR_SH))
+		goto release;
+
+	if (conn->flags & CO_FL_WAIT_XPRT) {
+		/* not established yet */
+		event_type = SUB_RETRY_SEND;
+	}
+	else {
+		b_reset(&trash);
+		if (conn->xprt->rcv_buf(conn, conn->xprt_ctx, &trash, trash.size, 0) > 0 ||
+		    conn->flags & (CO_FL_ERROR | CO_FL_SOCK_RD_SH))
+			goto release;
+		event_type = SUB_RETRY_RECV;
+	}
+
+	conn->xprt->subscribe(conn, conn->xprt_ctx, event_type, &wc->wait_event);
+	return t;
+
+ release:
+	srv_warm_conn_release(srv, wc);
+	return NULL;
+}
+
+/* Starts a new connection to server <srv> for the current thread's pool of
+ * pre-established connections. Returns non-zero on success, zero on failure.
+ */
+static int srv_warm_conn_new(struct server *srv)
+{
+	struct srv_warm_conn *wc;
+	struct connection *conn;
+	struct conn_hash_params hash_params;
+
+	wc = pool_alloc(pool_head_srv_warm_conn);
+	if (!wc)
+		goto fail;
+
+	wc->wait_event.tasklet = tasklet_new();
+	if (!wc->wait_event.tasklet)
+		goto fail_wc;
+	wc->wait_event.tasklet->process = srv_warm_conn_io_cb;
+	wc->wait_event.tasklet->context = wc;
+	wc->wait_event.events = 0;
+
+	conn = conn_new(&srv->obj_type);
+	if (!conn)
+		goto fail_tasklet;
+
+	/* the connection is not used yet, see srv_release_conn() */
+	conn->flags |= CO_FL_WARM;
+	_HA_ATOMIC_DEC(&srv->curr_used_conns);
+
+	/* same hash as the one connect_server() calculates for the
+	 * configurations compatible with pool-warm.
+	 */
+	memset(&hash_params, 0, sizeof(hash_params));
+	hash_params.target = &srv->obj_type;
+	conn->hash_node->node.key = conn_calculate_hash(&hash_params);
+
+	if (!sockaddr_alloc(&conn->dst, &srv->addr, sizeof(srv->addr)))
+		goto fail_conn;
+	set_host_port(conn->dst, srv->svc_port);
+
+	if (conn_prepare(conn, protocol_lookup(conn->dst->ss_family, PROTO_TYPE_STREAM, 0), srv->xprt) < 0 ||
+	    !conn->ctrl || !conn->ctrl->connect)
+		goto fail_conn;
+
+	conn->ctx = wc;
+	wc->conn = conn;
+	wc->expire = tick_add_ifset(now_ms, srv->proxy->timeout.server);
+	LIST_APPEND(&srv->per_thr[tid].warm_conns, &wc->list);
+	srv->per_thr[tid].warm_nb++;
+	_HA_ATOMIC_INC(&srv->curr_warm_conns);
+
+	if (conn->ctrl->connect(conn, 0) != SF_ERR_NONE ||
+	    conn_xprt_start(conn) < 0) {
+		srv_warm_conn_release(srv, wc);
+		return 0;
+	}
+
+	conn->xprt->subscribe(conn, conn->xprt_ctx, SUB_RETRY_SEND, &wc->wait_event);
+	return 1;
+
+ fail_conn:
+	conn_free(conn);
+ fail_tasklet:
+	tasklet_free(wc->wait_event.tasklet);
+ fail_wc:
+	pool_free(pool_head_srv_warm_conn, wc);
+ fail:
+	return 0;
+}
+
+/* Returns the number of connections to server <srv> which are in use, idle or
+ * pre-established, which is what "maxconn" limits for pre-established ones.
+ */
+static inline unsigned int srv_warm_conns_total(const struct server *srv)
+{
+	return srv->curr_used_conns + srv->curr_idle_conns + srv->curr_warm_conns;
+}
+
+/* Per-thread task maintaining the pool of pre-established connections of the
+ * server passed in <context>. It closes the expired ones and opens new ones
+ * until "pool-warm" is reached, without exceeding "pool-max-conn" when counted
+ * with idle connections, nor the server's "maxconn" when counted with the
+ * connections in use and idle ones, in which case the excess ones are closed.
+ * Connections are only refilled when the server may be used, and failed
+ * attempts are only retried on the next periodic wakeup.
+ */
+static struct task *srv_warm_conns_task(struct task *t, void *context, unsigned int state)
+{
+	struct server *srv = context;
+	struct srv_per_thread *thr = &srv->per_thr[tid];
+	struct srv_warm_conn *wc, *back;
+	unsigned int maxconn;
+	int usable;
+
+	usable = !stopping && srv_currently_usable(srv) && is_addr(&srv->addr);
+	t->expire = TICK_ETERNITY;
+
+	list_for_each_entry_safe(wc, back, &thr->warm_conns, list) {
+		if (!usable || tick_is_expired(wc->expire, now_ms) ||
+		    srv_warm_conn_moved(srv, wc->conn))
+			srv_warm_conn_release(srv, wc);
+	}
+
+	if (stopping)
+		return t;
+
+	/* connections serving streams have precedence over ours */
+	maxconn = srv->maxconn ? srv_dynamic_maxconn(srv) : 0;
+	while (maxconn && !LIST_ISEMPTY(&thr->warm_conns) &&
+	       srv_warm_conns_total(srv) > maxconn)
+		srv_warm_conn_release(srv, LIST_NEXT(&thr->warm_conns, struct srv_warm_conn *, list));
+
+	while (usable && thr->warm_nb < srv->pool_warm &&
+	       (srv->max_idle_conns == -1 ||
+	        srv->curr_idle_conns + srv->curr_warm_conns < srv->max_idle_conns) &&
+	       (!maxconn || srv_warm_conns_total(srv) < maxconn) &&
+	       ha_used_fds < global.tune.pool_high_count) {
+		if (!srv_warm_conn_new(srv))
+			break;
+	}
+
+	/* connections are queued in creation order so the oldest one expires
+	 * first. Come back earlier to complete the pool or to watch the
+	 * server's state if needed.
+	 */
+	if (!LIST_ISEMPTY(&thr->warm_conns))
+		t->expire = LIST_NEXT(&thr->warm_conns, struct srv_warm_conn *, list)->expire;
+	if (thr->warm_nb < srv->pool_warm)
+		t->expire = tick_first(t->expire, tick_add(now_ms, MS_TO_TICKS(1000)));
+	return t;
+}
+
+/* Picks a ready pre-established connection to server <srv> from the current
+ * thread's pool. Its warming context is released and it is returned without
+ * mux nor owner, just like a newly established connection, or NULL if none is
+ * available. The warming task is woken up to replace it.
+ */
+struct connection *srv_take_warm_conn(struct server *srv)
+{
+	struct srv_per_thread *thr = &srv->per_thr[tid];
+	struct srv_warm_conn *wc;
+	struct connection *conn;
+
+	list_for_each_entry(wc, &thr->warm_conns, list) {
+		conn = wc->conn;
+		if (conn->flags & (CO_FL_WAIT_XPRT | CO_FL_ERROR | CO_FL_SOCK_RD_SH | CO_FL_SOCK_WR_SH))
+			continue;
+
+		if (wc->wait_event.events)
+			conn->xprt->unsubscribe(conn, conn->xprt_ctx, wc->wait_event.events, &wc->wait_event);
+		LIST_DELETE(&wc->list);
+		thr->warm_nb--;
+		_HA_ATOMIC_DEC(&srv->curr_warm_conns);
+		tasklet_free(wc->wait_event.tasklet);
+		pool_free(pool_head_srv_warm_conn, wc);
+
+		conn->ctx = NULL;
+		conn->flags &= ~CO_FL_WARM;
+		srv_use_conn(srv, conn);
+
+		task_wakeup(thr->warm_task, TASK_WOKEN_OTHER);
+		return conn;
+	}
+	return NULL;
+}
+
+/* Validates the "pool-warm" setting of server <srv> and starts its per-thread
+ * warming tasks. Pre-established connections must be interchangeable, so
+ * settings making connections depend on the stream disable the feature.
+ *
+ * Returns 0 on success else non-zero.
+ */
+static int init_srv_pool_warm(struct server *srv)
+{
+	const char *reason = NULL;
+	int err_code = ERR_NONE;
+	int i;
+
+	if (!srv->pool_warm)
+		return ERR_NONE;
+
+	if (srv->max_idle_conns == 0)
+		reason = "'pool-max-conn' is 0";
+	else if (srv->pp_opts)
+		reason = "it sends the PROXY protocol";
+	else if (srv->flags & (SRV_F_SOCKS4_PROXY | SRV_F_MAPPORTS))
+		reason = "it uses a SOCKS4 proxy or maps ports";
+#ifdef USE_OPENSSL
+	else if (srv->ssl_ctx.sni)
+		reason = "its SNI depends on the stream";
+#endif
+#if defined(CONFIG_HAP_TRANSPARENT)
+	else if ((srv->conn_src.opts & CO_SRC_TPROXY_MASK) ||
+	         (!(srv->conn_src.opts & CO_SRC_BIND) && (srv->proxy->conn_src.opts & CO_SRC_TPROXY_MASK)))
+		reason = "it uses a transparent source address";
+#endif
+
+	if (reason) {
+		ha_warning("'pool-warm' is ignored for server '%s/%s' because %s.\n",
+		           srv->proxy->id, srv->id, reason);
+		srv->pool_warm = 0;
+		return ERR_WARN;
+	}
+
+	for (i = 0; i < global.nbthread; i++) {
+		struct task *t;
+
+		if ((t = task_new_on(i)) == NULL) {
+			ha_alert("Cannot activate pool-warm for server %s/%s: out of memory.\n", srv->proxy->id, srv->id);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			break;
+		}
+
+		t->process = srv_warm_conns_task;
+		t->context = srv;
+		srv->per_thr[i].warm_task = t;
+		task_wakeup(t, TASK_WOKEN_INIT);
+	}
+
+	return err_code;
+}
+REGISTER_POST_SERVER_CHECK(init_srv_pool_warm);
+
 /* Close remaining idle connections. This functions is designed to be run on
  * process shutdown. This guarantees a proper socket shutdown to avoid
  * TIME_WAIT state. For a quick operation, only ctrl is closed, xprt stack is
@@ -6197,6 +6517,16 @@ static void srv_close_idle_conns(struct server *srv)
 				ebmb_delete(node);
 			}
 		}
+
+		while (!LIST_ISEMPTY(&srv->per_thr[i].warm_conns)) {
+			struct srv_warm_conn *wc = LIST_NEXT(&srv->per_thr[i].warm_conns, struct srv_warm_conn *, list);
+
+			if (wc->conn->ctrl->ctrl_close)
+				wc->conn->ctrl->ctrl_close(wc->conn);
+			LIST_DELETE(&wc->list);
+			tasklet_free(wc->wait_event.tasklet);
+			pool_free(pool_head_srv_warm_conn, wc);
+		}
 	}
 }
 
@@ -6221,6 +6551,28 @@ static int cfg_parse_idle_pool_shared(char **args, int section_type, struct prox
 	return 0;
 }
 
+/* config parser for global "tune.idle-pool.steal-batch" */
+static int cfg_parse_idle_pool_steal_batch(char **args, int section_type, struct proxy *curpx,
+                                           const struct proxy *defpx, const char *file, int line,
+                                           char **err)
+{
+	int arg = -1;
+
+	if (too_many_args(1, args, err, NULL))
+		return -1;
+
+	if (*(args[1]) != 0)
+		arg = atoi(args[1]);
+
+	if (arg < 1 || arg > MAX_IDLE_STEAL_BATCH) {
+		memprintf(err, "'%s' expects an integer argument between 1 and %d.", args[0], MAX_IDLE_STEAL_BATCH);
+		return -1;
+	}
+
+	global.tune.idle_steal_batch = arg;
+	return 0;
+}
+
 /* config parser for global "tune.pool-{low,high}-fd-ratio" */
 static int cfg_parse_pool_fd_ratio(char **args, int section_type, struct proxy *curpx,
                                    const struct proxy *defpx, const char *file, int line,
@@ -6249,6 +6601,7 @@ static int cfg_parse_pool_fd_ratio(char **args, int section_type, struct proxy *
 /* config keyword parsers */
 static struct cfg_kw_list cfg_kws = {ILH, {
 	{ CFG_GLOBAL, "tune.idle-pool.shared",       cfg_parse_idle_pool_shared },
+	{ CFG_GLOBAL, "tune.idle-pool.steal-batch",  cfg_parse_idle_pool_steal_batch },
 	{ CFG_GLOBAL, "tune.pool-high-fd-ratio",     cfg_parse_pool_fd_ratio },
 	{ CFG_GLOBAL, "tune.pool-low-fd-ratio",      cfg_parse_pool_fd_ratio },
 	{ 0, NULL, NULL }
@@ -89,7 +89,7 @@ struct shared_block *shctx_row_reserve_hot(struct shared_context *shctx,
 
 			/* release callback */
 			if (first_len && shctx->free_block)
-				shctx->free_block(next, block);
+				shctx->free_block(shctx, next, block);
 
 			block->block_count = 1;
 			block->len = 0;
@@ -190,6 +190,35 @@ void shctx_row_dec_hot(struct shared_context *shctx, struct shared_block *first)
 
 }
 
+/*
+ * Same as shctx_row_dec_hot() but the row is moved back at the beginning of the
+ * avail list, so that it keeps its place among the oldest rows.
+ */
+void shctx_row_dec_hot_oldest(struct shared_context *shctx, struct shared_block *first)
+{
+	struct shared_block *block, *sblock;
+	struct list *prev = &shctx->avail;
+	int count = 0;
+
+	first->refcount--;
+
+	if (first->refcount <= 0) {
+
+		block = first;
+
+		list_for_each_entry_safe_from(block, sblock, &shctx->hot, list) {
+
+			shctx->nbav++;
+			LIST_DELETE(&block->list);
+			LIST_INSERT(prev, &block->list);
+			prev = &block->list;
+
+			count++;
+			if (count >= first->block_count)
+				break;
+		}
+	}
+}
 
 /*
  * Append data in the row if there is enough space.
@@ -0,0 +1,163 @@
+/*
+ * Approximate counting sketches: HyperLogLog and count-min.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ *
+ */
+
+#include <haproxy/api.h>
+#include <haproxy/clock.h>
+#include <haproxy/sketch.h>
+#include <haproxy/ticks.h>
+#include <haproxy/tools.h>
+
+/* Returns the natural logarithm of <x>, which must be at least 1. libm is not
+ * always linked, and the precision needed here is modest: <x> is reduced to
+ * [1,2) using powers of two, then ln(y) = 2*atanh((y-1)/(y+1)) is expanded
+ * up to a precision of about 1e-9.
+ */
+static double sketch_ln(double x)
+{
+	double t, t2, term, sum;
+	int k = 0, n;
+
+	while (x >= 2.0) {
+		x /= 2.0;
+		k++;
+	}
+
+	t = (x - 1.0) / (x + 1.0);
+	t2 = t * t;
+	term = t;
+	sum = 0.0;
+	for (n = 1; n < 20; n += 2) {
+		sum += term / n;
+		term *= t2;
+	}
+	return k * 0.69314718055994530942 + 2.0 * sum;
+}
+
+/* Returns the estimated number of distinct values accounted for in sketch
+ * <hll>. Small cardinalities, which leave some registers empty, are estimated
+ * using linear counting, which is more accurate there. The caller is
+ * responsible for the locking.
+ */
+uint hll_estimate(const struct hll *hll)
+{
+	const double m = HLL_REGS;
+	double sum = 0.0, est;
+	uint zeros = 0;
+	uint i;
+
+	for (i = 0; i < HLL_REGS; i++) {
+		sum += 1.0 / (double)(1ULL << hll->reg[i]);
+		zeros += !hll->reg[i];
+	}
+
+	/* alpha(m) = 0.7213 / (1 + 1.079 / m) */
+	est = 0.7213 / (1.0 + 1.079 / m) * m * m / sum;
+	if (est <= 2.5 * m && zeros)
+		est = m * sketch_ln(m / zeros);
+
+	return (uint)(est + 0.5);
+}
+
+/* Allocates the counters of count-min sketch <cms> made of <depth> rows of
+ * <width> counters, halved every <period> milliseconds if not zero. Returns
+ * non-zero on success, or zero on allocation failure.
+ */
+int cms_init(struct cms *cms, uint width, uint depth, uint period)
+{
+	cms->width = width;
+	cms->depth = depth;
+	cms->period = period;
+	cms->last_decay = now_ms;
+	cms->decay_pos = cms->decay_shift = 0;
+	cms->ctr = calloc((size_t)width * depth, sizeof(*cms->ctr));
+	return cms->ctr != NULL;
+}
+
+/* Releases the counters of count-min sketch <cms> */
+void cms_free(struct cms *cms)
+{
+	ha_free(&cms->ctr);
+}
+
+/* Halves the counters of count-min sketch <cms> once per period elapsed since
+ * the last halving, by batches of at most CMS_DECAY_BATCH counters so that
+ * large sketches do not stall the thread. Returns non-zero if a halving is in
+ * progress and the function must be called again as soon as possible. It must
+ * not be called concurrently for the same sketch, it is meant to be called
+ * from a task. The halving is not atomic with concurrent increments, which may
+ * only cause a few of them to be partially lost.
+ */
+int cms_decay(struct cms *cms)
+{
+	uint nb = cms->width * cms->depth;
+	uint periods, end;
+
+	if (!cms->decay_shift) {
+		if (!cms->period || (int)(now_ms - cms->last_decay) < (int)cms->period)
+			return 0;
+
+		periods = (now_ms - cms->last_decay) / cms->period;
+		cms->last_decay += periods * cms->period;
+		cms->decay_shift = MIN(periods, 31);
+		cms->decay_pos = 0;
+	}
+
+	end = MIN(nb, cms->decay_pos + CMS_DECAY_BATCH);
+	for (; cms->decay_pos < end; cms->decay_pos++)
+		HA_ATOMIC_STORE(&cms->ctr[cms->decay_pos], HA_ATOMIC_LOAD(&cms->ctr[cms->decay_pos]) >> cms->decay_shift);
+
+	if (cms->decay_pos < nb)
+		return 1;
+
+	cms->decay_shift = 0;
+	return 0;
+}
+
+/* Returns the index of the counter of row <row> designated by hash <hash> in
+ * sketch <cms>. Rows use distinct combinations of both halves of the hash
+ * (Kirsch-Mitzenmacher), which is as good as independent hashes.
+ */
+static inline uint cms_index(const struct cms *cms, uint64_t hash, uint row)
+{
+	uint32_t h1 = hash;
+	uint32_t h2 = (hash >> 32) | 1;
+
+	return row * cms->width + (uint32_t)(h1 + row * h2) % cms->width;
+}
+
+/* Adds <inc> to the frequency of the value whose 64-bit hash is <hash> in
+ * count-min sketch <cms>, and returns its new estimated frequency. Thread-safe.
+ */
+uint cms_add(struct cms *cms, uint64_t hash, uint inc)
+{
+	uint row, val, min = ~0U;
+
+	for (row = 0; row < cms->depth; row++) {
+		val = HA_ATOMIC_ADD_FETCH(&cms->ctr[cms_index(cms, hash, row)], inc);
+		if (val < min)
+			min = val;
+	}
+	return min;
+}
+
+/* Returns the estimated frequency of the value whose 64-bit hash is <hash> in
+ * count-min sketch <cms>. Thread-safe.
+ */
+uint cms_get(struct cms *cms, uint64_t hash)
+{
+	uint row, val, min = ~0U;
+
+	for (row = 0; row < cms->depth; row++) {
+		val = HA_ATOMIC_LOAD(&cms->ctr[cms_index(cms, hash, row)]);
+		if (val < min)
+			min = val;
+	}
+	return min;
+}
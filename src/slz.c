@@ -28,6 +28,10 @@
 #include <import/slz.h>
 #include <import/slz-tables.h>
 
+#if defined(__SSE2__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
 /* First, RFC1951-specific declarations and extracts from the RFC.
  *
  * RFC1951 - deflate stream format
@@ -466,6 +470,100 @@ static inline long memmatch(const unsigned char *a, const unsigned char *b, long
 #endif
 }
 
+/* Same as memmatch() except that it compares 32 or 16 bytes at once when the
+ * build target supports AVX2 or SSE2. It is only worth it when long matches
+ * are expected, which is the case in the higher ratio mode since it keeps
+ * more candidates. The same constraints as memmatch() apply.
+ */
+static inline long memmatch_wide(const unsigned char *a, const unsigned char *b, long max)
+{
+#if defined(__AVX2__)
+	long len = 0;
+	uint32_t mask;
+
+	while (len + 32 <= max) {
+		mask = ~(uint32_t)_mm256_movemask_epi8(
+			_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(a + len)),
+					  _mm256_loadu_si256((const __m256i *)(b + len))));
+		if (mask)
+			return len + __builtin_ctz(mask);
+		len += 32;
+	}
+	return len + memmatch(a + len, b + len, max - len);
+#elif defined(__SSE2__)
+	long len = 0;
+	uint32_t mask;
+
+	while (len + 16 <= max) {
+		mask = ~(uint32_t)_mm_movemask_epi8(
+			_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(a + len)),
+				       _mm_loadu_si128((const __m128i *)(b + len)))) & 0xffff;
+		if (mask)
+			return len + __builtin_ctz(mask);
+		len += 16;
+	}
+	return len + memmatch(a + len, b + len, max - len);
+#else
+	return memmatch(a, b, max);
+#endif
+}
+
+/* reads the 4 bytes at <p> as a little endian word, like the encoder does */
+static inline uint32_t read_word(const unsigned char *p)
+{
+#ifdef UNALIGNED_LE_OK
+	return *(uint32_t *)p;
+#else
+	return p[0] + (p[1] << 8) + (p[2] << 16) + ((uint32_t)p[3] << 24);
+#endif
+}
+
+/* The higher ratio mode keeps two references per hash bucket in <refs>, the
+ * most recent one first. It uses the same table as the regular mode so that
+ * the stack usage remains the same, hence hash <h> designates the bucket made
+ * of entries (h & ~1) and (h | 1). This inserts <pos> for <word> in bucket
+ * <h>, pushing the previous one to the second slot.
+ */
+static inline void insert_ref2(union ref *refs, uint32_t h, unsigned long pos, uint32_t word)
+{
+	refs[h | 1] = refs[h & ~1];
+	refs[h & ~1].by32.pos = pos;
+	refs[h & ~1].by32.word = word;
+}
+
+/* Looks up the two references of bucket <h> in <refs> for <word> found at
+ * <pos> in <in>, and returns the length of the longest usable match, or zero
+ * if none is usable. <rem> is the number of bytes left after <pos>, which must
+ * be at least 4. The nearest reference wins on equal lengths. The position of
+ * the match is returned in <last>.
+ */
+static inline long find_ref2(const union ref *refs, uint32_t h, uint32_t word,
+                             const unsigned char *in, unsigned long pos, long rem,
+                             unsigned long *last)
+{
+	long max = (rem > 258 ? 258 : rem) - 4;
+	long best = 0, len;
+	unsigned long ref;
+	int i;
+
+	for (i = 0; i < 2; i++) {
+		if (refs[(h & ~1) + i].by32.word != word)
+			continue;
+
+		ref = refs[(h & ~1) + i].by32.pos;
+		/* We reject pos = ref and pos > ref+32768 */
+		if ((unsigned long)(pos - ref - 1) >= 32768)
+			continue;
+
+		len = memmatch_wide(in + pos + 4, in + ref + 4, max) + 4;
+		if (len > best) {
+			best = len;
+			*last = ref;
+		}
+	}
+	return best;
+}
+
 /* sets <count> BYTES to -32769 in <refs> so that any uninitialized entry will
  * verify (pos-last-1 >= 32768) and be ignored. <count> must be a multiple of
  * 128 bytes and <refs> must be at least one count in length. It's supposed to
@@ -544,6 +642,26 @@ long slz_rfc1951_encode(struct slz_stream *strm, unsigned char *out, const unsig
 		h = slz_hash(word);
 		asm volatile ("" ::); // prevent gcc from trying to be smart with the prefetch
 
+		if (strm->level > 1) {
+			/* higher ratio mode: take the longest of the two
+			 * references, and only if the next position does not
+			 * offer a longer one (lazy matching).
+			 */
+			mlen = find_ref2(refs, h, word, in, pos, rem, &last);
+			insert_ref2(refs, h, pos, word);
+			if (!mlen)
+				goto send_as_lit;
+
+			if (mlen < 32 && rem > 4 && mlen < rem - 1) {
+				uint32_t word1 = read_word(in + pos + 1);
+				unsigned long last1;
+
+				if (find_ref2(refs, slz_hash(word1), word1, in, pos + 1, rem - 1, &last1) > mlen)
+					goto send_as_lit;
+			}
+			goto match_found;
+		}
+
 		if (sizeof(long) >= 8) {
 			ent = refs[h].by64;
 			last = (uint32_t)ent;
@@ -621,6 +739,7 @@ long slz_rfc1951_encode(struct slz_stream *strm, unsigned char *out, const unsig
 		mlen = memmatch(in + pos + 4, in + last + 4, (rem > 258 ? 258 : rem) - 4) + 4;
 
 		/* found a matching entry */
+	match_found:
 
 		if (bit9 >= 52 && mlen < 6)
 			goto send_as_lit;
@@ -668,6 +787,22 @@ long slz_rfc1951_encode(struct slz_stream *strm, unsigned char *out, const unsig
 		/* in fixed huffman mode, dist is fixed 5 bits */
 		enqueue24(strm, dist >> 5, dist & 0x1f);
 		bit9 = 0;
+
+		if (strm->level > 1 && mlen <= 32) {
+			/* index the positions covered by short matches so
+			 * that they may be referenced later.
+			 */
+			unsigned long end = pos + mlen;
+			unsigned long cur;
+
+			if (end + 4 > pos + rem)
+				end = pos + rem - 4;
+			for (cur = pos + 1; cur < end; cur++) {
+				uint32_t w = read_word(in + cur);
+
+				insert_ref2(refs, slz_hash(w), cur, w);
+			}
+		}
 		rem -= mlen;
 		pos += mlen;
 
@@ -705,8 +840,9 @@ long slz_rfc1951_encode(struct slz_stream *strm, unsigned char *out, const unsig
 
 /* Initializes stream <strm> for use with raw deflate (rfc1951). The CRC is
  * unused but set to zero. The compression level passed in <level> is set. This
- * value can only be 0 (no compression) or 1 (compression) and other values
- * will lead to unpredictable behaviour. The function always returns 0.
+ * value can only be 0 (no compression), 1 (compression) or 2 (higher ratio)
+ * and other values will lead to unpredictable behaviour. The function always
+ * returns 0.
  */
 int slz_rfc1951_init(struct slz_stream *strm, int level)
 {
@@ -1074,8 +1210,8 @@ long slz_rfc1952_encode(struct slz_stream *strm, unsigned char *out, const unsig
 
 /* Initializes stream <strm> for use with the gzip format (rfc1952). The
  * compression level passed in <level> is set. This value can only be 0 (no
- * compression) or 1 (compression) and other values will lead to unpredictable
- * behaviour. The function always returns 0.
+ * compression), 1 (compression) or 2 (higher ratio) and other values will lead
+ * to unpredictable behaviour. The function always returns 0.
  */
 int slz_rfc1952_init(struct slz_stream *strm, int level)
 {
@@ -1350,8 +1486,8 @@ long slz_rfc1950_encode(struct slz_stream *strm, unsigned char *out, const unsig
 
 /* Initializes stream <strm> for use with the zlib format (rfc1952). The
  * compression level passed in <level> is set. This value can only be 0 (no
- * compression) or 1 (compression) and other values will lead to unpredictable
- * behaviour. The function always returns 0.
+ * compression), 1 (compression) or 2 (higher ratio) and other values will lead
+ * to unpredictable behaviour. The function always returns 0.
  */
 int slz_rfc1950_init(struct slz_stream *strm, int level)
 {
@@ -1790,7 +1790,7 @@ int stats_fill_fe_stats(struct proxy *px, struct field *stats, int len,
 				metric = mkf_u32(FO_CONFIG|FS_SERVICE, STATS_TYPE_FE);
 				break;
 			case ST_F_RATE:
-				metric = mkf_u32(FN_RATE, read_freq_ctr(&px->fe_sess_per_sec));
+				metric = mkf_u32(FN_RATE, read_freq_ctr_shd(&px->fe_sess_per_sec));
 				break;
 			case ST_F_RATE_LIM:
 				metric = mkf_u32(FO_CONFIG|FN_LIMIT, px->fe_sps_lim);
@@ -1841,7 +1841,7 @@ int stats_fill_fe_stats(struct proxy *px, struct field *stats, int len,
 					metric = mkf_u64(FN_COUNTER, px->fe_counters.p.http.cache_hits);
 				break;
 			case ST_F_REQ_RATE:
-				metric = mkf_u32(FN_RATE, read_freq_ctr(&px->fe_req_per_sec));
+				metric = mkf_u32(FN_RATE, read_freq_ctr_shd(&px->fe_req_per_sec));
 				break;
 			case ST_F_REQ_RATE_MAX:
 				metric = mkf_u32(FN_MAX, px->fe_counters.p.http.rps_max);
@@ -1871,7 +1871,7 @@ int stats_fill_fe_stats(struct proxy *px, struct field *stats, int len,
 				metric = mkf_u64(FN_COUNTER, px->fe_counters.p.http.comp_rsp);
 				break;
 			case ST_F_CONN_RATE:
-				metric = mkf_u32(FN_RATE, read_freq_ctr(&px->fe_conn_per_sec));
+				metric = mkf_u32(FN_RATE, read_freq_ctr_shd(&px->fe_conn_per_sec));
 				break;
 			case ST_F_CONN_RATE_MAX:
 				metric = mkf_u32(FN_MAX, px->fe_counters.cps_max);
@@ -2420,7 +2420,7 @@ int stats_fill_sv_stats(struct proxy *px, struct server *sv, int flags,
 				metric = mkf_u32(FO_CONFIG|FS_SERVICE, STATS_TYPE_SV);
 				break;
 			case ST_F_RATE:
-				metric = mkf_u32(FN_RATE, read_freq_ctr(&sv->sess_per_sec));
+				metric = mkf_u32(FN_RATE, read_freq_ctr_shd(&sv->sess_per_sec));
 				break;
 			case ST_F_RATE_MAX:
 				metric = mkf_u32(FN_MAX, sv->counters.sps_max);
@@ -2837,7 +2837,7 @@ int stats_fill_be_stats(struct proxy *px, int flags, struct field *stats, int le
 				metric = mkf_u32(FO_CONFIG|FS_SERVICE, STATS_TYPE_BE);
 				break;
 			case ST_F_RATE:
-				metric = mkf_u32(0, read_freq_ctr(&px->be_sess_per_sec));
+				metric = mkf_u32(0, read_freq_ctr_shd(&px->be_sess_per_sec));
 				break;
 			case ST_F_RATE_MAX:
 				metric = mkf_u32(0, px->be_counters.sps_max);
@@ -3650,7 +3650,7 @@ static void stats_dump_html_info(struct stconn *sc, struct uri_auth *uri)
 	              global.rlimit_memmax ? " MB" : "",
 	              global.rlimit_nofile,
 	              global.maxsock, global.maxconn, HA_ATOMIC_LOAD(&maxconn_reached), global.maxpipes,
-	              actconn, pipes_used, pipes_used+pipes_free, read_freq_ctr(&global.conn_per_sec),
+	              actconn, pipes_used, pipes_used+pipes_free, read_freq_ctr_shd(&global.conn_per_sec),
 		      bps >= 1000000000UL ? (bps / 1000000000.0) : bps >= 1000000UL ? (bps / 1000000.0) : (bps / 1000.0),
 		      bps >= 1000000000UL ? 'G' : bps >= 1000000UL ? 'M' : 'k',
 	              total_run_queues(), total_allocated_tasks(), clock_report_idle()
@@ -4636,7 +4636,7 @@ int stats_fill_info(struct field *info, int len, uint flags)
 	int thr;
 
 #ifdef USE_OPENSSL
-	double ssl_sess_rate = read_freq_ctr_flt(&global.ssl_per_sec);
+	double ssl_sess_rate = read_freq_ctr_shd_flt(&global.ssl_per_sec);
 	double ssl_key_rate  = read_freq_ctr_flt(&global.ssl_fe_keys_per_sec);
 	double ssl_reuse = 0;
 
@@ -4702,10 +4702,10 @@ int stats_fill_info(struct field *info, int len, uint flags)
 	info[INF_MAXPIPES]                       = mkf_u32(FO_CONFIG|FN_LIMIT, global.maxpipes);
 	info[INF_PIPES_USED]                     = mkf_u32(0, pipes_used);
 	info[INF_PIPES_FREE]                     = mkf_u32(0, pipes_free);
-	info[INF_CONN_RATE]                      = (flags & STAT_USE_FLOAT) ? mkf_flt(FN_RATE, read_freq_ctr_flt(&global.conn_per_sec)) : mkf_u32(FN_RATE, read_freq_ctr(&global.conn_per_sec));
+	info[INF_CONN_RATE]                      = (flags & STAT_USE_FLOAT) ? mkf_flt(FN_RATE, read_freq_ctr_shd_flt(&global.conn_per_sec)) : mkf_u32(FN_RATE, read_freq_ctr_shd(&global.conn_per_sec));
 	info[INF_CONN_RATE_LIMIT]                = mkf_u32(FO_CONFIG|FN_LIMIT, global.cps_lim);
 	info[INF_MAX_CONN_RATE]                  = mkf_u32(FN_MAX, global.cps_max);
-	info[INF_SESS_RATE]                      = (flags & STAT_USE_FLOAT) ? mkf_flt(FN_RATE, read_freq_ctr_flt(&global.sess_per_sec)) : mkf_u32(FN_RATE, read_freq_ctr(&global.sess_per_sec));
+	info[INF_SESS_RATE]                      = (flags & STAT_USE_FLOAT) ? mkf_flt(FN_RATE, read_freq_ctr_shd_flt(&global.sess_per_sec)) : mkf_u32(FN_RATE, read_freq_ctr_shd(&global.sess_per_sec));
 	info[INF_SESS_RATE_LIMIT]                = mkf_u32(FO_CONFIG|FN_LIMIT, global.sps_lim);
 	info[INF_MAX_SESS_RATE]                  = mkf_u32(FN_RATE, global.sps_max);
 
@@ -81,12 +81,209 @@ struct stktable *stktable_find_by_name(const char *name)
 	return NULL;
 }
 
+/* Dumps key <key> of table <t> into <msg> in a human-readable form */
+static void stktable_dump_key(struct buffer *msg, struct stktable *t, const void *key)
+{
+	if (t->type == SMP_T_IPV4) {
+		char addr[INET_ADDRSTRLEN];
+		inet_ntop(AF_INET, key, addr, sizeof(addr));
+		chunk_appendf(msg, "%s", addr);
+	}
+	else if (t->type == SMP_T_IPV6) {
+		char addr[INET6_ADDRSTRLEN];
+		inet_ntop(AF_INET6, key, addr, sizeof(addr));
+		chunk_appendf(msg, "%s", addr);
+	}
+	else if (t->type == SMP_T_SINT)
+		chunk_appendf(msg, "%u", read_u32(key));
+	else if (t->type == SMP_T_STR)
+		dump_text(msg, key, t->key_size);
+	else
+		dump_binary(msg, key, t->key_size);
+}
+
+/* Returns the value of the data type <dt> of entry <ts> in table <t> as an
+ * unsigned integer, or 0 if it is not stored. Only integer and frequency
+ * counter types are supported. The entry's lock is not taken since the value
+ * is only used to rank the entry, so it may be slightly outdated.
+ */
+static unsigned long long stktable_data_ull(struct stktable *t, struct stksess *ts, int dt)
+{
+	void *ptr;
+
+	ptr = stktable_data_ptr(t, ts, dt);
+	if (!ptr)
+		return 0;
+
+	switch (stktable_data_types[dt].std_type) {
+	case STD_T_SINT:
+		return (unsigned int)HA_ATOMIC_LOAD(&stktable_data_cast(ptr, std_t_sint));
+	case STD_T_UINT:
+		return HA_ATOMIC_LOAD(&stktable_data_cast(ptr, std_t_uint));
+	case STD_T_ULL:
+		return HA_ATOMIC_LOAD(&stktable_data_cast(ptr, std_t_ull));
+	case STD_T_FRQP:
+		return read_freq_ctr_period(&stktable_data_cast(ptr, std_t_frqp),
+		                            t->data_arg[dt].u);
+	}
+	return 0;
+}
+
+/* Sets the admission threshold of the top-K list <tk> and the position of its
+ * lowest entry from the values last read. The top-K lock must be held.
+ */
+static void __stktable_topk_set_min(struct stktable_topk *tk)
+{
+	unsigned long long min = 0;
+	uint i;
+
+	if (tk->count == tk->size) {
+		tk->min_idx = 0;
+		for (i = 1; i < tk->count; i++)
+			if (tk->elems[i].value < tk->elems[tk->min_idx].value)
+				tk->min_idx = i;
+		min = tk->elems[tk->min_idx].value;
+	}
+	HA_ATOMIC_STORE(&tk->min, min);
+}
+
+/* Re-reads the values of all entries of the top-K list of table <t> and sorts
+ * the list by decreasing values. The top-K lock must be held.
+ */
+static void __stktable_topk_refresh(struct stktable *t)
+{
+	struct stktable_topk *tk = &t->topk;
+	struct stktable_topk_elem e;
+	uint i, j;
+
+	for (i = 0; i < tk->count; i++) {
+		e = tk->elems[i];
+		e.value = stktable_data_ull(t, e.ts, tk->data_type);
+		for (j = i; j > 0 && tk->elems[j - 1].value < e.value; j--)
+			tk->elems[j] = tk->elems[j - 1];
+		tk->elems[j] = e;
+	}
+	__stktable_topk_set_min(tk);
+}
+
+/* Task refreshing the top-K list of the table passed in <context>, so that the
+ * admission threshold follows the values of the listed entries.
+ */
+static struct task *stktable_topk_task(struct task *task, void *context, unsigned int state)
+{
+	struct stktable *t = context;
+
+	HA_SPIN_LOCK(STK_TABLE_LOCK, &t->topk.lock);
+	__stktable_topk_refresh(t);
+	HA_SPIN_UNLOCK(STK_TABLE_LOCK, &t->topk.lock);
+
+	task->expire = tick_add(now_ms, MS_TO_TICKS(STKTABLE_TOPK_REFRESH));
+	return task;
+}
+
+/* Offers entry <ts> to the top-K list of table <t>, which must have one. The
+ * entry is appended if the list is not full, otherwise it replaces the lowest
+ * one if its value is higher. Entries already listed are ignored since their
+ * values are read when needed. Only entries above the admission threshold take
+ * the top-K lock, and only the value of the entry they may replace is read
+ * again, refreshing the whole list is left to the refresh task.
+ */
+static void stktable_topk_offer(struct stktable *t, struct stksess *ts)
+{
+	struct stktable_topk *tk = &t->topk;
+	unsigned long long value;
+
+	if (HA_ATOMIC_LOAD(&ts->topk))
+		return;
+
+	value = stktable_data_ull(t, ts, tk->data_type);
+	if (HA_ATOMIC_LOAD(&tk->count) == tk->size && value <= HA_ATOMIC_LOAD(&tk->min))
+		return;
+
+	HA_SPIN_LOCK(STK_TABLE_LOCK, &tk->lock);
+	if (ts->topk)
+		goto out;
+
+	if (tk->count == tk->size) {
+		if (value <= tk->min)
+			goto out;
+
+		/* the lowest value may be outdated, so check it first. If it
+		 * grew, the entry will simply be offered again on its next
+		 * update, against the new lowest one.
+		 */
+		tk->elems[tk->min_idx].value = stktable_data_ull(t, tk->elems[tk->min_idx].ts, tk->data_type);
+		if (tk->elems[tk->min_idx].value >= value) {
+			__stktable_topk_set_min(tk);
+			goto out;
+		}
+
+		/* replace the lowest entry by moving the last one there */
+		HA_ATOMIC_STORE(&tk->elems[tk->min_idx].ts->topk, 0);
+		tk->elems[tk->min_idx] = tk->elems[--tk->count];
+	}
+
+	tk->elems[tk->count].ts = ts;
+	tk->elems[tk->count].value = value;
+	tk->count++;
+	HA_ATOMIC_STORE(&ts->topk, 1);
+	__stktable_topk_set_min(tk);
+ out:
+	HA_SPIN_UNLOCK(STK_TABLE_LOCK, &tk->lock);
+}
+
+/* Removes entry <ts> from the top-K list of table <t>. It must be listed. */
+static void stktable_topk_remove(struct stktable *t, struct stksess *ts)
+{
+	struct stktable_topk *tk = &t->topk;
+	uint i;
+
+	HA_SPIN_LOCK(STK_TABLE_LOCK, &tk->lock);
+	for (i = 0; i < tk->count; i++) {
+		if (tk->elems[i].ts == ts) {
+			tk->elems[i] = tk->elems[--tk->count];
+			break;
+		}
+	}
+	ts->topk = 0;
+	__stktable_topk_set_min(tk);
+	HA_SPIN_UNLOCK(STK_TABLE_LOCK, &tk->lock);
+}
+
+/* Looks up the entry ranked <rank> (starting at 0) in the top-K list of table
+ * <t>. The list is refreshed first when <rank> is zero so that it reflects the
+ * current values. On success, the entry's key is dumped into <key> the same
+ * way as "show table" does, its value is stored into <value>, and non-zero is
+ * returned. Zero is returned if there is no such entry.
+ */
+int stktable_topk_get(struct stktable *t, uint rank, struct buffer *key, unsigned long long *value)
+{
+	struct stktable_topk *tk = &t->topk;
+	int ret = 0;
+
+	if (!tk->size)
+		return 0;
+
+	HA_SPIN_LOCK(STK_TABLE_LOCK, &tk->lock);
+	if (!rank)
+		__stktable_topk_refresh(t);
+	if (rank < tk->count) {
+		stktable_dump_key(key, t, tk->elems[rank].ts->key.key);
+		*value = tk->elems[rank].value;
+		ret = 1;
+	}
+	HA_SPIN_UNLOCK(STK_TABLE_LOCK, &tk->lock);
+	return ret;
+}
+
 /*
  * Free an allocated sticky session <ts>, and decrease sticky sessions counter
  * in table <t>. It's safe to call it under or out of a lock.
  */
 void __stksess_free(struct stktable *t, struct stksess *ts)
 {
+	if (HA_ATOMIC_LOAD(&ts->topk))
+		stktable_topk_remove(t, ts);
 	HA_ATOMIC_DEC(&t->current);
 	pool_free(t->pool, (void *)ts - round_ptr_size(t->data_size));
 }
@@ -197,6 +394,7 @@ static struct stksess *__stksess_init(struct stktable *t, struct stksess * ts)
 	memset((void *)ts - t->data_size, 0, t->data_size);
 	ts->ref_cnt = 0;
 	ts->shard = 0;
+	ts->topk = 0;
 	ts->key.node.leaf_p = NULL;
 	ts->exp.node.leaf_p = NULL;
 	ts->upd.node.leaf_p = NULL;
@@ -505,6 +703,8 @@ void stktable_touch_local(struct stktable *t, struct stksess *ts, int decrefcnt)
 {
 	int expire = tick_add(now_ms, MS_TO_TICKS(t->expire));
 
+	if (t->topk.size)
+		stktable_topk_offer(t, ts);
 	stktable_touch_with_exp(t, ts, 1, expire, decrefcnt);
 }
 /* Just decrease the ref_cnt of the current session. Does nothing if <ts> is NULL.
@@ -741,6 +941,20 @@ struct task *process_table_expire(struct task *task, void *context, unsigned int
 	return task;
 }
 
+/* Task halving the counters of the count-min sketch of the table once per
+ * period. Large sketches are processed by batches, one per millisecond.
+ */
+static struct task *stktable_cms_task(struct task *task, void *context, unsigned int state)
+{
+	struct stktable *t = context;
+
+	if (cms_decay(&t->cms))
+		task->expire = tick_add(now_ms, MS_TO_TICKS(1));
+	else
+		task->expire = tick_add(t->cms.last_decay, MS_TO_TICKS(t->cms.period));
+	return task;
+}
+
 /* Perform minimal stick table intializations, report 0 in case of error, 1 if OK. */
 int stktable_init(struct stktable *t)
 {
@@ -763,9 +977,35 @@ int stktable_init(struct stktable *t)
 			t->exp_task->process = process_table_expire;
 			t->exp_task->context = (void *)t;
 		}
+		if (t->cms.width && !cms_init(&t->cms, t->cms.width, t->cms.depth, t->cms.period))
+			return 0;
+		if (t->cms.width && t->cms.period) {
+			t->cms_task = task_new_anywhere();
+			if (!t->cms_task)
+				return 0;
+			t->cms_task->process = stktable_cms_task;
+			t->cms_task->context = (void *)t;
+			t->cms_task->expire = tick_add(now_ms, MS_TO_TICKS(t->cms.period));
+			task_queue(t->cms_task);
+		}
+		if (t->topk.size) {
+			t->topk.elems = calloc(t->topk.size, sizeof(*t->topk.elems));
+			if (!t->topk.elems)
+				return 0;
+			HA_SPIN_INIT(&t->topk.lock);
+			t->topk.task = task_new_anywhere();
+			if (!t->topk.task)
+				return 0;
+			t->topk.task->process = stktable_topk_task;
+			t->topk.task->context = (void *)t;
+			t->topk.task->expire = tick_add(now_ms, MS_TO_TICKS(STKTABLE_TOPK_REFRESH));
+			task_queue(t->topk.task);
+		}
 		if (t->peers.p && t->peers.p->peers_fe && !(t->peers.p->peers_fe->flags & (PR_FL_DISABLED|PR_FL_STOPPED))) {
 			peers_retval = peers_register_table(t->peers.p, t);
 		}
+		if (t->snapshot.file && !peers_snapshot_init(t))
+			return 0;
 
 		return (t->pool != NULL) && !peers_retval;
 	}
@@ -783,7 +1023,13 @@ void stktable_deinit(struct stktable *t)
 	if (!t)
 		return;
 	task_destroy(t->exp_task);
+	task_destroy(t->topk.task);
+	task_destroy(t->cms_task);
+	peers_snapshot_deinit(t);
 	pool_destroy(t->pool);
+	cms_free(&t->cms);
+	ha_free(&t->topk.elems);
+	ha_free(&t->snapshot.file);
 }
 
 /*
@@ -1115,6 +1361,94 @@ int parse_stick_table(const char *file, int linenum, char **args,
 			}
 			idx++;
 		}
+		else if (strcmp(args[idx], "count-min") == 0) {
+			/* count-min <width>,<depth>[,<period>] */
+			char *end;
+
+			idx++;
+			t->cms.width = strtoul(args[idx], &end, 10);
+			if (*end == ',')
+				t->cms.depth = strtoul(end + 1, &end, 10);
+			if (*end == ',' && !parse_time_err(end + 1, &t->cms.period, TIME_UNIT_MS))
+				end += strlen(end);
+			if (*end || !t->cms.width || t->cms.width > (1U << 24) ||
+			    !t->cms.depth || t->cms.depth > 16) {
+				ha_alert("parsing [%s:%d] : %s: '%s' expects <width>,<depth>[,<period>] with a width between 1 and %u and a depth between 1 and 16 (got '%s').\n",
+					 file, linenum, args[0], args[idx-1], 1U << 24, args[idx]);
+				err_code |= ERR_ALERT | ERR_FATAL;
+				goto out;
+			}
+			idx++;
+		}
+		else if (strcmp(args[idx], "topk") == 0) {
+			/* topk <count> <data_type> */
+			char *end;
+			int type;
+
+			idx++;
+			t->topk.size = strtoul(args[idx], &end, 10);
+			if (!*args[idx] || *end || !t->topk.size || t->topk.size > STKTABLE_MAX_TOPK_SIZE) {
+				ha_alert("parsing [%s:%d] : %s: '%s' expects a count between 1 and %d (got '%s').\n",
+					 file, linenum, args[0], args[idx-1], STKTABLE_MAX_TOPK_SIZE, args[idx]);
+				err_code |= ERR_ALERT | ERR_FATAL;
+				goto out;
+			}
+			idx++;
+			type = stktable_get_data_type(args[idx]);
+			if (type < 0 || stktable_data_types[type].is_array ||
+			    (stktable_data_types[type].std_type != STD_T_SINT &&
+			     stktable_data_types[type].std_type != STD_T_UINT &&
+			     stktable_data_types[type].std_type != STD_T_ULL &&
+			     stktable_data_types[type].std_type != STD_T_FRQP)) {
+				ha_alert("parsing [%s:%d] : %s: '%s' expects a counter or rate data type (got '%s').\n",
+					 file, linenum, args[0], args[idx-2], args[idx]);
+				err_code |= ERR_ALERT | ERR_FATAL;
+				goto out;
+			}
+			t->topk.data_type = type;
+			idx++;
+		}
+		else if (strcmp(args[idx], "snapshot") == 0) {
+			idx++;
+			if (!*(args[idx])) {
+				ha_alert("parsing [%s:%d] : %s: missing file name after '%s'.\n",
+					 file, linenum, args[0], args[idx-1]);
+				err_code |= ERR_ALERT | ERR_FATAL;
+				goto out;
+			}
+			ha_free(&t->snapshot.file);
+			t->snapshot.file = strdup(args[idx++]);
+		}
+		else if (strcmp(args[idx], "snapshot-period") == 0) {
+			idx++;
+			if (!*(args[idx])) {
+				ha_alert("parsing [%s:%d] : %s: missing argument after '%s'.\n",
+					 file, linenum, args[0], args[idx-1]);
+				err_code |= ERR_ALERT | ERR_FATAL;
+				goto out;
+			}
+			err = parse_time_err(args[idx], &val, TIME_UNIT_MS);
+			if (err == PARSE_TIME_OVER) {
+				ha_alert("parsing [%s:%d]: %s: timer overflow in argument <%s> to <%s>, maximum value is 2147483647 ms (~24.8 days).\n",
+					 file, linenum, args[0], args[idx], args[idx-1]);
+				err_code |= ERR_ALERT | ERR_FATAL;
+				goto out;
+			}
+			else if (err == PARSE_TIME_UNDER || (!err && !val)) {
+				ha_alert("parsing [%s:%d]: %s: timer underflow in argument <%s> to <%s>, minimum non-null value is 1 ms.\n",
+					 file, linenum, args[0], args[idx], args[idx-1]);
+				err_code |= ERR_ALERT | ERR_FATAL;
+				goto out;
+			}
+			else if (err) {
+				ha_alert("parsing [%s:%d] : %s: unexpected character '%c' in argument of '%s'.\n",
+					 file, linenum, args[0], *err, args[idx-1]);
+				err_code |= ERR_ALERT | ERR_FATAL;
+				goto out;
+			}
+			t->snapshot.period = val;
+			idx++;
+		}
 		else {
 			ha_alert("parsing [%s:%d] : %s: unknown argument '%s'.\n",
 				 file, linenum, args[0], args[idx]);
@@ -1137,6 +1471,16 @@ int parse_stick_table(const char *file, int linenum, char **args,
 		goto out;
 	}
 
+	if (t->topk.size && !t->data_ofs[t->topk.data_type]) {
+		ha_alert("parsing [%s:%d] : %s: 'topk' requires data type '%s' to be stored.\n",
+			 file, linenum, args[0], stktable_data_types[t->topk.data_type].name);
+		err_code |= ERR_ALERT | ERR_FATAL;
+		goto out;
+	}
+
+	if (t->snapshot.file && !t->snapshot.period)
+		t->snapshot.period = STKTABLE_SNAPSHOT_PERIOD;
+
  out:
 	return err_code;
 }
@@ -1292,6 +1636,7 @@ struct stktable_data_type stktable_data_types[STKTABLE_DATA_TYPES] = {
 	[STKTABLE_DT_GPT]           = { .name = "gpt",            .std_type = STD_T_UINT, .is_array = 1 },
 	[STKTABLE_DT_GPC]           = { .name = "gpc",            .std_type = STD_T_UINT, .is_array = 1 },
 	[STKTABLE_DT_GPC_RATE]      = { .name = "gpc_rate",       .std_type = STD_T_FRQP, .is_array = 1, .arg_type = ARG_T_DELAY },
+	[STKTABLE_DT_DISTINCT]      = { .name = "distinct",       .std_type = STD_T_HLL   },
 };
 
 /* Registers stick-table extra data type with index <idx>, name <name>, type
@@ -1709,6 +2054,126 @@ static int sample_conv_table_gpt0(const struct arg *arg_p, struct sample *smp, v
 	return !!ptr;
 }
 
+/* Returns a 64-bit hash of the contents of sample <smp>, to be fed to a
+ * sketch. It does not depend on the process nor on the table, so that the
+ * sketches filled by different peers may be merged. Strings and binary blocks
+ * holding the same bytes get the same hash.
+ */
+static uint64_t stktable_smp_hash(const struct sample *smp)
+{
+	uint64_t val;
+
+	switch (smp->data.type) {
+	case SMP_T_IPV4:
+		return XXH64(&smp->data.u.ipv4, sizeof(smp->data.u.ipv4), 0);
+	case SMP_T_IPV6:
+		return XXH64(&smp->data.u.ipv6, sizeof(smp->data.u.ipv6), 0);
+	case SMP_T_STR:
+	case SMP_T_BIN:
+		return XXH64(smp->data.u.str.area, smp->data.u.str.data, 0);
+	case SMP_T_METH:
+		if (smp->data.u.meth.meth == HTTP_METH_OTHER)
+			return XXH64(smp->data.u.meth.str.area, smp->data.u.meth.str.data, 0);
+		val = my_htonll(smp->data.u.meth.meth);
+		break;
+	default:
+		val = my_htonll(smp->data.u.sint);
+		break;
+	}
+	return XXH64(&val, sizeof(val), 0);
+}
+
+/* Casts sample <smp> to the type of the table specified in arg(0), and looks
+ * it up into this table. Returns the estimated number of distinct values
+ * accounted for the key if it is present in the table, otherwise zero, so that
+ * comparisons can be easily performed. If the inspected parameter is not
+ * stored in the table, <not found> is returned.
+ */
+static int sample_conv_table_distinct_cnt(const struct arg *arg_p, struct sample *smp, void *private)
+{
+	struct stktable *t;
+	struct stktable_key *key;
+	struct stksess *ts;
+	void *ptr;
+
+	t = arg_p[0].data.t;
+
+	key = smp_to_stkey(smp, t);
+	if (!key)
+		return 0;
+
+	ts = stktable_lookup_key(t, key);
+
+	smp->flags = SMP_F_VOL_TEST;
+	smp->data.type = SMP_T_SINT;
+	smp->data.u.sint = 0;
+
+	if (!ts) /* key not present */
+		return 1;
+
+	ptr = stktable_data_ptr(t, ts, STKTABLE_DT_DISTINCT);
+	if (ptr) {
+		HA_RWLOCK_RDLOCK(STK_SESS_LOCK, &ts->lock);
+		smp->data.u.sint = hll_estimate(&stktable_data_cast(ptr, std_t_hll));
+		HA_RWLOCK_RDUNLOCK(STK_SESS_LOCK, &ts->lock);
+	}
+
+	stktable_release(t, ts);
+	return !!ptr;
+}
+
+/* Checks that the increment passed to table_cms_inc, if any, is neither
+ * negative nor larger than a counter. Returns 0 with <err> filled on error.
+ */
+static int sample_conv_table_cms_inc_check(struct arg *args, struct sample_conv *conv,
+                                           const char *file, int line, char **err)
+{
+	if (args[1].type == ARGT_SINT &&
+	    (args[1].data.sint < 0 || args[1].data.sint > UINT_MAX)) {
+		memprintf(err, "increment must be between 0 and %u", UINT_MAX);
+		return 0;
+	}
+	return 1;
+}
+
+/* Adds arg_p(1) (or 1 if absent) to the frequency of the value of sample
+ * <smp> in the count-min sketch of the table specified in arg_p(0), and
+ * returns its new estimated frequency. The sample is not converted to the
+ * table's key type. If the table has no count-min sketch, <not found> is
+ * returned.
+ */
+static int sample_conv_table_cms_inc(const struct arg *arg_p, struct sample *smp, void *private)
+{
+	struct stktable *t = arg_p[0].data.t;
+	uint inc = (arg_p[1].type == ARGT_SINT) ? arg_p[1].data.sint : 1;
+
+	if (!t->cms.ctr)
+		return 0;
+
+	smp->data.u.sint = cms_add(&t->cms, stktable_smp_hash(smp), inc);
+	smp->data.type = SMP_T_SINT;
+	smp->flags = SMP_F_VOL_TEST;
+	return 1;
+}
+
+/* Returns the estimated frequency of the value of sample <smp> in the
+ * count-min sketch of the table specified in arg_p(0). The sample is not
+ * converted to the table's key type. If the table has no count-min sketch,
+ * <not found> is returned.
+ */
+static int sample_conv_table_cms_cnt(const struct arg *arg_p, struct sample *smp, void *private)
+{
+	struct stktable *t = arg_p[0].data.t;
+
+	if (!t->cms.ctr)
+		return 0;
+
+	smp->data.u.sint = cms_get(&t->cms, stktable_smp_hash(smp));
+	smp->data.type = SMP_T_SINT;
+	smp->flags = SMP_F_VOL_TEST;
+	return 1;
+}
+
 /* Casts sample <smp> to the type of the table specified in arg_p(1), and looks
  * it up into this table. Returns the value of the GPC[arg_p(0)] counter for the key
  * if the key is present in the table, otherwise zero, so that comparisons can
@@ -2891,6 +3356,139 @@ static enum act_parse_ret parse_set_gpt(const char **args, int *arg, struct prox
 	return ACT_RET_PRS_OK;
 }
 
+/* This function accounts for the value of the expression 'rule->arg.gpt.expr'
+ * in the "distinct" sketch of the tracksc counter of index 'rule->arg.gpt.sc'
+ * stored into the <stream> or directly in the session <sess> if <stream> is
+ * set to NULL.
+ *
+ * This function always returns ACT_RET_CONT and parameter flags is unused.
+ */
+static enum act_return action_add_distinct(struct act_rule *rule, struct proxy *px,
+                                           struct session *sess, struct stream *s, int flags)
+{
+	void *ptr;
+	struct stksess *ts;
+	struct stkctr *stkctr = NULL;
+	struct sample *smp;
+	uint64_t hash;
+	int smp_opt_dir;
+
+	/* Extract the stksess, return OK if no stksess available. */
+	if (s && s->stkctr)
+		stkctr = &s->stkctr[rule->arg.gpt.sc];
+	else if (sess->stkctr)
+		stkctr = &sess->stkctr[rule->arg.gpt.sc];
+	else
+		return ACT_RET_CONT;
+
+	ts = stkctr_entry(stkctr);
+	if (!ts)
+		return ACT_RET_CONT;
+
+	ptr = stktable_data_ptr(stkctr->table, ts, STKTABLE_DT_DISTINCT);
+	if (!ptr)
+		return ACT_RET_CONT;
+
+	switch (rule->from) {
+	case ACT_F_TCP_REQ_CON: smp_opt_dir = SMP_OPT_DIR_REQ; break;
+	case ACT_F_TCP_REQ_SES: smp_opt_dir = SMP_OPT_DIR_REQ; break;
+	case ACT_F_TCP_REQ_CNT: smp_opt_dir = SMP_OPT_DIR_REQ; break;
+	case ACT_F_TCP_RES_CNT: smp_opt_dir = SMP_OPT_DIR_RES; break;
+	case ACT_F_HTTP_REQ:    smp_opt_dir = SMP_OPT_DIR_REQ; break;
+	case ACT_F_HTTP_RES:    smp_opt_dir = SMP_OPT_DIR_RES; break;
+	default:
+		send_log(px, LOG_ERR, "stick table: internal error while adding a distinct value.");
+		if (!(global.mode & MODE_QUIET) || (global.mode & MODE_VERBOSE))
+			ha_alert("stick table: internal error while adding a distinct value.\n");
+		return ACT_RET_CONT;
+	}
+
+	/* Fetch the expression, a missing sample is simply not accounted for */
+	smp = sample_process(px, sess, s, smp_opt_dir|SMP_OPT_FINAL, rule->arg.gpt.expr, NULL);
+	if (!smp || (smp->flags & SMP_F_MAY_CHANGE))
+		return ACT_RET_CONT;
+
+	hash = stktable_smp_hash(smp);
+
+	HA_RWLOCK_WRLOCK(STK_SESS_LOCK, &ts->lock);
+
+	hll_add(&stktable_data_cast(ptr, std_t_hll), hash);
+
+	HA_RWLOCK_WRUNLOCK(STK_SESS_LOCK, &ts->lock);
+
+	stktable_touch_local(stkctr->table, ts, 0);
+
+	return ACT_RET_CONT;
+}
+
+/* This function is a parser for the "sc-add-distinct" action. It understands
+ * the format:
+ *
+ *   sc-add-distinct(<track ID>) <expression>
+ *
+ * It returns ACT_RET_PRS_ERR if fails and <err> is filled with an error message.
+ * Otherwise, it returns ACT_RET_PRS_OK and the variable 'rule->arg.gpt.expr'
+ * is filled with the pointer to the expression to execute.
+ */
+static enum act_parse_ret parse_add_distinct(const char **args, int *arg, struct proxy *px,
+                                             struct act_rule *rule, char **err)
+{
+	const char *cmd_name = args[*arg-1];
+	char *error;
+	int smp_val;
+
+	if (!global.tune.nb_stk_ctr) {
+		memprintf(err, "Cannot use '%s', stick-counters are disabled via tune.stick-counters", args[*arg-1]);
+		return ACT_RET_PRS_ERR;
+	}
+
+	cmd_name += strlen("sc-add-distinct");
+	if (*cmd_name != '(') {
+		memprintf(err, "invalid stick table track ID '%s'. Expects sc-add-distinct(<Track ID>)", args[*arg-1]);
+		return ACT_RET_PRS_ERR;
+	}
+	cmd_name++; /* jump the '(' */
+	rule->arg.gpt.sc = strtol(cmd_name, &error, 10); /* Convert stick table id. */
+	if (*error != ')') {
+		memprintf(err, "invalid stick table track ID '%s'. Expects sc-add-distinct(<Track ID>)", args[*arg-1]);
+		return ACT_RET_PRS_ERR;
+	}
+
+	if (rule->arg.gpt.sc >= global.tune.nb_stk_ctr) {
+		memprintf(err, "invalid stick table track ID '%s'. The max allowed ID is %d",
+		          args[*arg-1], global.tune.nb_stk_ctr-1);
+		return ACT_RET_PRS_ERR;
+	}
+
+	rule->arg.gpt.expr = sample_parse_expr((char **)args, arg, px->conf.args.file,
+	                                       px->conf.args.line, err, &px->conf.args, NULL);
+	if (!rule->arg.gpt.expr)
+		return ACT_RET_PRS_ERR;
+
+	switch (rule->from) {
+	case ACT_F_TCP_REQ_CON: smp_val = SMP_VAL_FE_CON_ACC; break;
+	case ACT_F_TCP_REQ_SES: smp_val = SMP_VAL_FE_SES_ACC; break;
+	case ACT_F_TCP_REQ_CNT: smp_val = SMP_VAL_FE_REQ_CNT; break;
+	case ACT_F_TCP_RES_CNT: smp_val = SMP_VAL_BE_RES_CNT; break;
+	case ACT_F_HTTP_REQ:    smp_val = SMP_VAL_FE_HRQ_HDR; break;
+	case ACT_F_HTTP_RES:    smp_val = SMP_VAL_BE_HRS_HDR; break;
+	default:
+		memprintf(err, "internal error, unexpected rule->from=%d, please report this bug!", rule->from);
+		return ACT_RET_PRS_ERR;
+	}
+	if (!(rule->arg.gpt.expr->fetch->val & smp_val)) {
+		memprintf(err, "fetch method '%s' extracts information from '%s', none of which is available here", args[*arg-1],
+		          sample_src_names(rule->arg.gpt.expr->fetch->use));
+		free(rule->arg.gpt.expr);
+		return ACT_RET_PRS_ERR;
+	}
+
+	rule->action_ptr = action_add_distinct;
+	rule->action = ACT_CUSTOM;
+
+	return ACT_RET_PRS_OK;
+}
+
 /* This function updates the gpc at index 'rule->arg.gpc.idx' of the array on
  * the tracksc counter of index 'rule->arg.gpc.sc' stored into the <stream> or
  * directly in the session <sess> if <stream> is set to NULL. This gpc is
@@ -3267,6 +3865,48 @@ smp_fetch_sc_get_gpt(const struct arg *args, struct sample *smp, const char *kw,
 	return 1;
 }
 
+/* set <smp> to the estimated number of distinct values accounted for by
+ * "sc-add-distinct" in the stream's tracked frontend counters or in the src.
+ * Supports being called as "sc_distinct_cnt(<sc-idx>[,<table>])" or
+ * "src_distinct_cnt([<table>])" only. Value zero is returned if the key is
+ * new.
+ */
+static int
+smp_fetch_sc_distinct_cnt(const struct arg *args, struct sample *smp, const char *kw, void *private)
+{
+	struct stkctr tmpstkctr;
+	struct stkctr *stkctr;
+
+	stkctr = smp_fetch_sc_stkctr(smp->sess, smp->strm, args, kw, &tmpstkctr);
+	if (!stkctr)
+		return 0;
+
+	smp->flags = SMP_F_VOL_TEST;
+	smp->data.type = SMP_T_SINT;
+	smp->data.u.sint = 0;
+
+	if (stkctr_entry(stkctr)) {
+		void *ptr;
+
+		ptr = stktable_data_ptr(stkctr->table, stkctr_entry(stkctr), STKTABLE_DT_DISTINCT);
+		if (!ptr) {
+			if (stkctr == &tmpstkctr)
+				stktable_release(stkctr->table, stkctr_entry(stkctr));
+			return 0; /* parameter not stored */
+		}
+
+		HA_RWLOCK_RDLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
+
+		smp->data.u.sint = hll_estimate(&stktable_data_cast(ptr, std_t_hll));
+
+		HA_RWLOCK_RDUNLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
+
+		if (stkctr == &tmpstkctr)
+			stktable_release(stkctr->table, stkctr_entry(stkctr));
+	}
+	return 1;
+}
+
 /* set <smp> to the General Purpose Flag 0 value from the stream's tracked
  * frontend counters or from the src.
  * Supports being called as "sc[0-9]_get_gpc0" or "src_get_gpt0" only. Value
@@ -4635,6 +5275,12 @@ static int table_dump_head_to_buffer(struct buffer *msg,
 		     t->id, stktable_types[t->type].kw, t->size, t->current);
 
 	/* any other information should be dumped here */
+	if (t->cms.ctr)
+		chunk_appendf(msg, "# count-min: width:%u, depth:%u, period:%u\n",
+			      t->cms.width, t->cms.depth, t->cms.period);
+	if (t->topk.size)
+		chunk_appendf(msg, "# topk: count:%u, data:%s\n",
+			      t->topk.size, stktable_data_types[t->topk.data_type].name);
 
 	if (target && (strm_li(s)->bind_conf->level & ACCESS_LVL_MASK) < ACCESS_LVL_OPER)
 		chunk_appendf(msg, "# contents not dumped due to insufficient privileges\n");
@@ -4655,29 +5301,8 @@ static int table_dump_entry_to_buffer(struct buffer *msg,
 {
 	int dt;
 
-	chunk_appendf(msg, "%p:", entry);
-
-	if (t->type == SMP_T_IPV4) {
-		char addr[INET_ADDRSTRLEN];
-		inet_ntop(AF_INET, (const void *)&entry->key.key, addr, sizeof(addr));
-		chunk_appendf(msg, " key=%s", addr);
-	}
-	else if (t->type == SMP_T_IPV6) {
-		char addr[INET6_ADDRSTRLEN];
-		inet_ntop(AF_INET6, (const void *)&entry->key.key, addr, sizeof(addr));
-		chunk_appendf(msg, " key=%s", addr);
-	}
-	else if (t->type == SMP_T_SINT) {
-		chunk_appendf(msg, " key=%u", read_u32(entry->key.key));
-	}
-	else if (t->type == SMP_T_STR) {
-		chunk_appendf(msg, " key=");
-		dump_text(msg, (const char *)entry->key.key, t->key_size);
-	}
-	else {
-		chunk_appendf(msg, " key=");
-		dump_binary(msg, (const char *)entry->key.key, t->key_size);
-	}
+	chunk_appendf(msg, "%p: key=", entry);
+	stktable_dump_key(msg, t, entry->key.key);
 
 	chunk_appendf(msg, " use=%d exp=%d shard=%d", entry->ref_cnt - 1, tick_remain(now_ms, entry->expire), entry->shard);
 
@@ -4760,6 +5385,9 @@ static int table_dump_entry_to_buffer(struct buffer *msg,
 			chunk_appendf(msg, "%s", de ? (char *)de->value.key : "-");
 			break;
 		}
+		case STD_T_HLL:
+			chunk_appendf(msg, "%u", hll_estimate(&stktable_data_cast(ptr, std_t_hll)));
+			break;
 		}
 	}
 	chunk_appendf(msg, "\n");
@@ -4786,6 +5414,52 @@ struct show_table_ctx {
 	char action;                                /* action on the table : one of STK_CLI_ACT_* */
 };
 
+/* Dumps the top-K list of the table designated by the context, from the highest
+ * value to the lowest one. Returns 1 since the whole output is emitted at once.
+ */
+static int table_dump_topk(struct appctx *appctx)
+{
+	struct show_table_ctx *ctx = appctx->svcctx;
+	struct stktable *t = ctx->target;
+	struct buffer *out, *key;
+	unsigned long long value;
+	int dt = t->topk.data_type;
+	uint rank;
+
+	if (!t->topk.size)
+		return cli_err(appctx, "No top-K list configured for this table\n");
+
+	if (!cli_has_level(appctx, ACCESS_LVL_OPER))
+		return 1;
+
+	out = alloc_trash_chunk();
+	key = alloc_trash_chunk();
+	if (!out || !key) {
+		free_trash_chunk(out);
+		free_trash_chunk(key);
+		return cli_err(appctx, "Out of memory\n");
+	}
+
+	chunk_appendf(out, "# table: %s, type: %s, top: %u, data: %s",
+		      t->id, stktable_types[t->type].kw, t->topk.size, stktable_data_types[dt].name);
+	if (stktable_data_types[dt].std_type == STD_T_FRQP)
+		chunk_appendf(out, "(%u)", t->data_arg[dt].u);
+	chunk_appendf(out, "\n");
+
+	for (rank = 0; stktable_topk_get(t, rank, key, &value); rank++) {
+		chunk_appendf(out, "%u: key=%.*s %s", rank + 1, (int)key->data, key->area, stktable_data_types[dt].name);
+		if (stktable_data_types[dt].std_type == STD_T_FRQP)
+			chunk_appendf(out, "(%u)", t->data_arg[dt].u);
+		chunk_appendf(out, "=%llu\n", value);
+		chunk_reset(key);
+	}
+
+	free_trash_chunk(key);
+	cli_dynmsg(appctx, LOG_INFO, my_strndup(out->area, out->data));
+	free_trash_chunk(out);
+	return 1;
+}
+
 /* Processes a single table entry matching a specific key passed in argument.
  * returns 0 if wants to be called again, 1 if has ended processing.
  */
@@ -4947,6 +5621,16 @@ static int table_process_entry_per_key(struct appctx *appctx, char **args)
 				frqp->prev_ctr = 0;
 				frqp->curr_ctr = value;
 				break;
+			case STD_T_HLL:
+				/* a sketch may only be reset */
+				if (value) {
+					cli_err(appctx, "Only 0 may be set to reset a sketch\n");
+					HA_RWLOCK_WRUNLOCK(STK_SESS_LOCK, &ts->lock);
+					stktable_touch_local(t, ts, 1);
+					return 1;
+				}
+				hll_reset(&stktable_data_cast(ptr, std_t_hll));
+				break;
 			}
 		}
 		HA_RWLOCK_WRUNLOCK(STK_SESS_LOCK, &ts->lock);
@@ -5026,6 +5710,8 @@ static int cli_parse_table_req(char **args, char *payload, struct appctx *appctx
 		return table_process_entry_per_key(appctx, args);
 	else if (strncmp(args[3], "data.", 5) == 0)
 		return table_prepare_data_request(appctx, args);
+	else if (strcmp(args[3], "top") == 0 && ctx->action == STK_CLI_ACT_SHOW && !*args[4])
+		return table_dump_topk(appctx);
 	else if (*args[3])
 		goto err_args;
 
@@ -5034,7 +5720,7 @@ static int cli_parse_table_req(char **args, char *payload, struct appctx *appctx
 err_args:
 	switch (ctx->action) {
 	case STK_CLI_ACT_SHOW:
-		return cli_err(appctx, "Optional argument only supports \"data.<store_data_type>\" <operator> <value> and key <key>\n");
+		return cli_err(appctx, "Optional argument only supports \"data.<store_data_type>\" <operator> <value>, key <key> and top\n");
 	case STK_CLI_ACT_CLR:
 		return cli_err(appctx, "Required arguments: <table> \"data.<store_data_type>\" <operator> <value> or <table> key <key>\n");
 	case STK_CLI_ACT_SET:
@@ -5146,6 +5832,9 @@ static int cli_io_handler_table(struct appctx *appctx)
 						data = read_freq_ctr_period(&stktable_data_cast(ptr, std_t_frqp),
 									    ctx->t->data_arg[dt].u);
 						break;
+					case STD_T_HLL:
+						data = hll_estimate(&stktable_data_cast(ptr, std_t_hll));
+						break;
 					}
 
 					op = ctx->data_op[i];
@@ -5271,13 +5960,14 @@ INITCALL0(STG_INIT, stkt_late_init);
 static struct cli_kw_list cli_kws = {{ },{
 	{ { "clear", "table", NULL }, "clear table <table> [<filter>]*         : remove an entry from a table (filter: data/key)",                           cli_parse_table_req, cli_io_handler_table, cli_release_show_table, (void *)STK_CLI_ACT_CLR },
 	{ { "set",   "table", NULL }, "set table <table> key <k> [data.* <v>]* : update or create a table entry's data",                                     cli_parse_table_req, cli_io_handler_table, NULL, (void *)STK_CLI_ACT_SET },
-	{ { "show",  "table", NULL }, "show table <table> [<filter>]*          : report table usage stats or dump this table's contents (filter: data/key)", cli_parse_table_req, cli_io_handler_table, cli_release_show_table, (void *)STK_CLI_ACT_SHOW },
+	{ { "show",  "table", NULL }, "show table <table> [<filter>]*          : report table usage stats or dump this table's contents (filter: data/key/top)", cli_parse_table_req, cli_io_handler_table, cli_release_show_table, (void *)STK_CLI_ACT_SHOW },
 	{{},}
 }};
 
 INITCALL1(STG_REGISTER, cli_register_kw, &cli_kws);
 
 static struct action_kw_list tcp_conn_kws = { { }, {
+	{ "sc-add-distinct", parse_add_distinct, KWF_MATCH_PREFIX },
 	{ "sc-add-gpc",  parse_add_gpc,  KWF_MATCH_PREFIX },
 	{ "sc-inc-gpc",  parse_inc_gpc,  KWF_MATCH_PREFIX },
 	{ "sc-inc-gpc0", parse_inc_gpc,  KWF_MATCH_PREFIX },
@@ -5290,6 +5980,7 @@ static struct action_kw_list tcp_conn_kws = { { }, {
 INITCALL1(STG_REGISTER, tcp_req_conn_keywords_register, &tcp_conn_kws);
 
 static struct action_kw_list tcp_sess_kws = { { }, {
+	{ "sc-add-distinct", parse_add_distinct, KWF_MATCH_PREFIX },
 	{ "sc-add-gpc",  parse_add_gpc,  KWF_MATCH_PREFIX },
 	{ "sc-inc-gpc",  parse_inc_gpc,  KWF_MATCH_PREFIX },
 	{ "sc-inc-gpc0", parse_inc_gpc,  KWF_MATCH_PREFIX },
@@ -5302,6 +5993,7 @@ static struct action_kw_list tcp_sess_kws = { { }, {
 INITCALL1(STG_REGISTER, tcp_req_sess_keywords_register, &tcp_sess_kws);
 
 static struct action_kw_list tcp_req_kws = { { }, {
+	{ "sc-add-distinct", parse_add_distinct, KWF_MATCH_PREFIX },
 	{ "sc-add-gpc",  parse_add_gpc,  KWF_MATCH_PREFIX },
 	{ "sc-inc-gpc",  parse_inc_gpc,  KWF_MATCH_PREFIX },
 	{ "sc-inc-gpc0", parse_inc_gpc,  KWF_MATCH_PREFIX },
@@ -5314,6 +6006,7 @@ static struct action_kw_list tcp_req_kws = { { }, {
 INITCALL1(STG_REGISTER, tcp_req_cont_keywords_register, &tcp_req_kws);
 
 static struct action_kw_list tcp_res_kws = { { }, {
+	{ "sc-add-distinct", parse_add_distinct, KWF_MATCH_PREFIX },
 	{ "sc-add-gpc",  parse_add_gpc,  KWF_MATCH_PREFIX },
 	{ "sc-inc-gpc",  parse_inc_gpc,  KWF_MATCH_PREFIX },
 	{ "sc-inc-gpc0", parse_inc_gpc,  KWF_MATCH_PREFIX },
@@ -5326,6 +6019,7 @@ static struct action_kw_list tcp_res_kws = { { }, {
 INITCALL1(STG_REGISTER, tcp_res_cont_keywords_register, &tcp_res_kws);
 
 static struct action_kw_list http_req_kws = { { }, {
+	{ "sc-add-distinct", parse_add_distinct, KWF_MATCH_PREFIX },
 	{ "sc-add-gpc",  parse_add_gpc,  KWF_MATCH_PREFIX },
 	{ "sc-inc-gpc",  parse_inc_gpc,  KWF_MATCH_PREFIX },
 	{ "sc-inc-gpc0", parse_inc_gpc,  KWF_MATCH_PREFIX },
@@ -5338,6 +6032,7 @@ static struct action_kw_list http_req_kws = { { }, {
 INITCALL1(STG_REGISTER, http_req_keywords_register, &http_req_kws);
 
 static struct action_kw_list http_res_kws = { { }, {
+	{ "sc-add-distinct", parse_add_distinct, KWF_MATCH_PREFIX },
 	{ "sc-add-gpc",  parse_add_gpc,  KWF_MATCH_PREFIX },
 	{ "sc-inc-gpc",  parse_inc_gpc,  KWF_MATCH_PREFIX },
 	{ "sc-inc-gpc0", parse_inc_gpc,  KWF_MATCH_PREFIX },
@@ -5350,6 +6045,7 @@ static struct action_kw_list http_res_kws = { { }, {
 INITCALL1(STG_REGISTER, http_res_keywords_register, &http_res_kws);
 
 static struct action_kw_list http_after_res_kws = { { }, {
+	{ "sc-add-distinct", parse_add_distinct, KWF_MATCH_PREFIX },
 	{ "sc-add-gpc",  parse_add_gpc,  KWF_MATCH_PREFIX },
 	{ "sc-inc-gpc",  parse_inc_gpc,  KWF_MATCH_PREFIX },
 	{ "sc-inc-gpc0", parse_inc_gpc,  KWF_MATCH_PREFIX },
@@ -5373,6 +6069,7 @@ static struct sample_fetch_kw_list smp_fetch_keywords = {ILH, {
 	{ "sc_conn_cnt",        smp_fetch_sc_conn_cnt,       ARG2(1,SINT,TAB), NULL, SMP_T_SINT, SMP_USE_INTRN, },
 	{ "sc_conn_cur",        smp_fetch_sc_conn_cur,       ARG2(1,SINT,TAB), NULL, SMP_T_SINT, SMP_USE_INTRN, },
 	{ "sc_conn_rate",       smp_fetch_sc_conn_rate,      ARG2(1,SINT,TAB), NULL, SMP_T_SINT, SMP_USE_INTRN, },
+	{ "sc_distinct_cnt",    smp_fetch_sc_distinct_cnt,   ARG2(1,SINT,TAB), NULL, SMP_T_SINT, SMP_USE_INTRN, },
 	{ "sc_get_gpt",         smp_fetch_sc_get_gpt,        ARG3(2,SINT,SINT,TAB), NULL, SMP_T_SINT, SMP_USE_INTRN, },
 	{ "sc_get_gpt0",        smp_fetch_sc_get_gpt0,       ARG2(1,SINT,TAB), NULL, SMP_T_SINT, SMP_USE_INTRN, },
 	{ "sc_get_gpc",         smp_fetch_sc_get_gpc,        ARG3(2,SINT,SINT,TAB), NULL, SMP_T_SINT, SMP_USE_INTRN, },
@@ -5483,6 +6180,7 @@ static struct sample_fetch_kw_list smp_fetch_keywords = {ILH, {
 	{ "src_conn_cnt",       smp_fetch_sc_conn_cnt,       ARG1(1,TAB),      NULL, SMP_T_SINT, SMP_USE_L4CLI, },
 	{ "src_conn_cur",       smp_fetch_sc_conn_cur,       ARG1(1,TAB),      NULL, SMP_T_SINT, SMP_USE_L4CLI, },
 	{ "src_conn_rate",      smp_fetch_sc_conn_rate,      ARG1(1,TAB),      NULL, SMP_T_SINT, SMP_USE_L4CLI, },
+	{ "src_distinct_cnt",   smp_fetch_sc_distinct_cnt,   ARG1(1,TAB),      NULL, SMP_T_SINT, SMP_USE_L4CLI, },
 	{ "src_get_gpt" ,       smp_fetch_sc_get_gpt,        ARG2(2,SINT,TAB), NULL, SMP_T_SINT, SMP_USE_L4CLI, },
 	{ "src_get_gpt0",       smp_fetch_sc_get_gpt0,       ARG1(1,TAB),      NULL, SMP_T_SINT, SMP_USE_L4CLI, },
 	{ "src_get_gpc",        smp_fetch_sc_get_gpc,        ARG2(2,SINT,TAB), NULL, SMP_T_SINT, SMP_USE_L4CLI, },
@@ -5517,9 +6215,12 @@ static struct sample_conv_kw_list sample_conv_kws = {ILH, {
 	{ "in_table",             sample_conv_in_table,             ARG1(1,TAB),  NULL, SMP_T_ANY,  SMP_T_BOOL  },
 	{ "table_bytes_in_rate",  sample_conv_table_bytes_in_rate,  ARG1(1,TAB),  NULL, SMP_T_ANY,  SMP_T_SINT  },
 	{ "table_bytes_out_rate", sample_conv_table_bytes_out_rate, ARG1(1,TAB),  NULL, SMP_T_ANY,  SMP_T_SINT  },
+	{ "table_cms_cnt",        sample_conv_table_cms_cnt,        ARG1(1,TAB),  NULL, SMP_T_ANY,  SMP_T_SINT  },
+	{ "table_cms_inc",        sample_conv_table_cms_inc,        ARG2(1,TAB,SINT),  sample_conv_table_cms_inc_check, SMP_T_ANY,  SMP_T_SINT  },
 	{ "table_conn_cnt",       sample_conv_table_conn_cnt,       ARG1(1,TAB),  NULL, SMP_T_ANY,  SMP_T_SINT  },
 	{ "table_conn_cur",       sample_conv_table_conn_cur,       ARG1(1,TAB),  NULL, SMP_T_ANY,  SMP_T_SINT  },
 	{ "table_conn_rate",      sample_conv_table_conn_rate,      ARG1(1,TAB),  NULL, SMP_T_ANY,  SMP_T_SINT  },
+	{ "table_distinct_cnt",   sample_conv_table_distinct_cnt,   ARG1(1,TAB),  NULL, SMP_T_ANY,  SMP_T_SINT  },
 	{ "table_expire",         sample_conv_table_expire,         ARG2(1,TAB,SINT),  NULL, SMP_T_ANY,  SMP_T_SINT  },
 	{ "table_gpt",            sample_conv_table_gpt,            ARG2(2,SINT,TAB),  NULL, SMP_T_ANY,  SMP_T_SINT  },
 	{ "table_gpt0",           sample_conv_table_gpt0,           ARG1(1,TAB),  NULL, SMP_T_ANY,  SMP_T_SINT  },
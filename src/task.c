@@ -42,6 +42,22 @@ DECLARE_POOL(pool_head_notification, "notification", sizeof(struct notification)
  */
 __decl_aligned_rwlock(wq_lock);
 
+/* Default share of the CPU bandwidth assigned to each tasklet class. These are
+ * the fixed weights, and the starting point of the adaptive scheduler.
+ */
+static const unsigned int sched_default_weights[TL_CLASSES] = {
+	[TL_URGENT] = 64, // ~50% of CPU bandwidth for I/O
+	[TL_NORMAL] = 48, // ~37% of CPU bandwidth for tasks
+	[TL_BULK]   = 16, // ~13% of CPU bandwidth for self-wakers
+	[TL_HEAVY]  = 1,  // never more than 1 heavy task at once
+};
+
+/* number of samples for the per-class delay averages and interval in ms
+ * between two weight adjustments.
+ */
+#define SCHED_LAT_SAMPLES   64
+#define SCHED_ADAPT_PERIOD  10
+
 /* Flags the task <t> for immediate destruction and puts it into its first
  * thread's shared tasklet list if not yet queued/running. This will bypass
  * the priority scheduling and make the task show up as fast as possible in
@@ -214,6 +230,7 @@ void __task_wakeup(struct task *t)
 {
 	struct eb_root *root = &th_ctx->rqueue;
 	int thr __maybe_unused = t->tid >= 0 ? t->tid : tid;
+	int exposed __maybe_unused = 0;
 
 #ifdef USE_THREAD
 	if (thr != tid) {
@@ -224,6 +241,21 @@ void __task_wakeup(struct task *t)
 
 		t->rq.key = _HA_ATOMIC_ADD_FETCH(&ha_thread_ctx[thr].rqueue_ticks, 1);
 		__ha_barrier_store();
+	}
+	else if (unlikely(global.tune.options & GTUNE_SCHED_WORK_STEALING) && t->tid < 0 &&
+		 th_ctx->rq_total >= global.tune.runqueue_depth && tg->count > 1) {
+		/* This thread is already overloaded and the task may run
+		 * anywhere: put it into our shared run queue instead of the
+		 * local one so that idle siblings may steal it. It remains
+		 * ordered with the local tasks since it uses the same ticks.
+		 */
+		root = &th_ctx->rqueue_shared;
+
+		_HA_ATOMIC_INC(&th_ctx->rq_total);
+		HA_SPIN_LOCK(TASK_RQ_LOCK, &th_ctx->rqsh_lock);
+
+		exposed = eb_is_empty(root) ? 2 : 1;
+		t->rq.key = _HA_ATOMIC_ADD_FETCH(&th_ctx->rqueue_ticks, 1);
 	} else
 #endif
 	{
@@ -239,7 +271,7 @@ void __task_wakeup(struct task *t)
 		t->rq.key += offset;
 	}
 
-	if (_HA_ATOMIC_LOAD(&th_ctx->flags) & TH_FL_TASK_PROFILING)
+	if (_HA_ATOMIC_LOAD(&th_ctx->flags) & (TH_FL_TASK_PROFILING | TH_FL_SCHED_TIMING))
 		t->wake_date = now_mono_time();
 
 	eb32_insert(root, &t->rq);
@@ -253,10 +285,256 @@ void __task_wakeup(struct task *t)
 		 */
 		wake_thread(thr);
 	}
+	else if (exposed) {
+		HA_SPIN_UNLOCK(TASK_RQ_LOCK, &th_ctx->rqsh_lock);
+
+		/* wake a sleeping sibling up when starting to expose tasks,
+		 * it will then keep stealing for as long as it finds some.
+		 */
+		if (exposed > 1) {
+			for (thr = tg->base; thr < tg->base + tg->count; thr++) {
+				if (thr != tid &&
+				    (_HA_ATOMIC_LOAD(&ha_thread_ctx[thr].flags) & TH_FL_SLEEPING)) {
+					wake_thread(thr);
+					break;
+				}
+			}
+		}
+	}
 #endif
 	return;
 }
 
+#ifdef USE_THREAD
+/* Takes a batch of tasks which are allowed to run on any thread from the
+ * shared run queue of the most loaded sibling thread of the same group, and
+ * appends them to the current thread's TL_NORMAL list, exactly as if they had
+ * been picked from its own run queue. Only siblings whose run queue is at least
+ * as large as tune.runqueue-depth are considered. This is meant to be called
+ * by an idle thread. Returns the number of tasks taken.
+ */
+static int sched_steal_tasks(void)
+{
+	struct thread_ctx *victim = NULL;
+	struct eb32_node *rq;
+	struct task *t;
+	uint load, best_load = global.tune.runqueue_depth;
+	int thr, budget, visits, picked = 0;
+
+	for (thr = tg->base; thr < tg->base + tg->count; thr++) {
+		if (thr == tid || eb_is_empty(&ha_thread_ctx[thr].rqueue_shared))
+			continue;
+
+		load = _HA_ATOMIC_LOAD(&ha_thread_ctx[thr].rq_total);
+		if (load >= best_load) {
+			victim = &ha_thread_ctx[thr];
+			best_load = load;
+		}
+	}
+
+	if (!victim)
+		return 0;
+
+	/* take up to half of the excess load, with a limit on the number of
+	 * entries visited since tasks bound to the victim are skipped.
+	 */
+	budget = MIN(best_load / 2, global.tune.runqueue_depth / 4 + 1);
+	visits = 4 * budget;
+
+	HA_SPIN_LOCK(TASK_RQ_LOCK, &victim->rqsh_lock);
+	rq = eb32_first(&victim->rqueue_shared);
+	while (rq && picked < budget && visits--) {
+		t = eb32_entry(rq, struct task, rq);
+		rq = eb32_next(rq);
+
+		if (t->tid >= 0)
+			continue;
+
+		eb32_delete(&t->rq);
+		if (t->nice)
+			_HA_ATOMIC_DEC(&tg_ctx->niced_tasks);
+		LIST_APPEND(&th_ctx->tasklets[TL_NORMAL], &((struct tasklet *)t)->list);
+		picked++;
+	}
+	HA_SPIN_UNLOCK(TASK_RQ_LOCK, &victim->rqsh_lock);
+
+	if (picked) {
+		_HA_ATOMIC_SUB(&victim->rq_total, picked);
+		_HA_ATOMIC_ADD(&th_ctx->rq_total, picked);
+		_HA_ATOMIC_ADD(&th_ctx->tasks_in_list, picked);
+		th_ctx->tl_class_mask |= 1 << TL_NORMAL;
+		activity[tid].tasksw += picked;
+		activity[tid].tasks_stolen += picked;
+	}
+	return picked;
+}
+#endif
+
+#ifdef USE_TIMER_WHEEL
+
+/* The wait queues are timer wheels, allocated apart from the thread and group
+ * contexts given their size.
+ */
+static struct twheel ha_thread_timers[MAX_THREADS];
+#ifdef USE_THREAD
+static struct twheel ha_tgroup_timers[MAX_TGROUPS];
+#endif
+
+/*
+ * __task_queue()
+ *
+ * Inserts a task into wait queue <wq> at the position given by its expiration
+ * date. It does not matter if the task was already in the wait queue or not,
+ * as it will be unlinked. The task MUST NOT have an infinite expiration timer.
+ * Last, tasks must not be queued further than <now_ms> + 2^31 ms.
+ *
+ * This function should not be used directly, it is meant to be called by the
+ * inline version of task_queue() which performs a few cheap preliminary tests
+ * before deciding to call __task_queue(). Moreover this function doesn't care
+ * at all about locking so the caller must be careful when deciding whether to
+ * lock or not around this call.
+ */
+void __task_queue(struct task *task, struct twheel *wq)
+{
+#ifdef USE_THREAD
+	BUG_ON((wq == tg_ctx->timers && task->tid >= 0) ||
+	       (wq == th_ctx->timers && task->tid < 0) ||
+	       (wq != tg_ctx->timers && wq != th_ctx->timers));
+#endif
+	/* if this happens the process is doomed anyway, so better catch it now
+	 * so that we have the caller in the stack.
+	 */
+	BUG_ON(task->expire == TICK_ETERNITY);
+
+	if (likely(task_in_wq(task)))
+		__task_unlink_wq(task);
+
+	/* the task is not in the queue now */
+	task->wq.key = task->expire;
+#ifdef DEBUG_CHECK_INVALID_EXPIRATION_DATES
+	if (tick_is_lt(task->wq.key, now_ms))
+		/* we're queuing too far away or in the past (most likely) */
+		return;
+#endif
+
+	twheel_insert(wq, &task->wq, now_ms);
+}
+
+/*
+ * Extract all expired timers from the timer queue, and wakes up all
+ * associated tasks.
+ */
+void wake_expired_tasks()
+{
+	struct thread_ctx * const tt = th_ctx; // thread's tasks
+	int max_processed = global.tune.runqueue_depth;
+	struct twheel_node *node;
+	struct task *task;
+	__decl_thread(int key);
+
+	/* Only the expired list needs to be visited once the wheel has been
+	 * advanced. As with the trees, a task's key may be earlier than its
+	 * real expiration date, in which case it's simply queued again.
+	 */
+	twheel_advance(tt->timers, now_ms);
+	while ((node = twheel_first_expired(tt->timers)) != NULL) {
+		if (max_processed-- <= 0)
+			goto leave;
+
+		task = LIST_ELEM(node, struct task *, wq);
+		__task_unlink_wq(task);
+		if (tick_is_expired(task->expire, now_ms))
+			task_wakeup(task, TASK_WOKEN_TIMER);
+		else if (tick_isset(task->expire))
+			__task_queue(task, tt->timers);
+	}
+
+#ifdef USE_THREAD
+	if (twheel_is_empty(tg_ctx->timers))
+		goto leave;
+
+	HA_RWLOCK_RDLOCK(TASK_WQ_LOCK, &wq_lock);
+	key = twheel_next_expiry(tg_ctx->timers, 0);
+	if (!tick_isset(key) || tick_is_lt(now_ms, key)) {
+		HA_RWLOCK_RDUNLOCK(TASK_WQ_LOCK, &wq_lock);
+		goto leave;
+	}
+
+	/* There's really something of interest here, let's visit the queue */
+
+	if (HA_RWLOCK_TRYRDTOSK(TASK_WQ_LOCK, &wq_lock)) {
+		/* if we failed to grab the lock it means another thread is
+		 * already doing the same here, so let it do the job.
+		 */
+		HA_RWLOCK_RDUNLOCK(TASK_WQ_LOCK, &wq_lock);
+		goto leave;
+	}
+
+	HA_RWLOCK_SKTOWR(TASK_WQ_LOCK, &wq_lock);
+	twheel_advance(tg_ctx->timers, now_ms);
+	HA_RWLOCK_WRTOSK(TASK_WQ_LOCK, &wq_lock);
+
+	while ((node = twheel_first_expired(tg_ctx->timers)) != NULL) {
+		if (max_processed-- <= 0)
+			break;
+
+		task = LIST_ELEM(node, struct task *, wq);
+
+		/* Check for any competing run of the task, exactly as is
+		 * done with the trees below.
+		 */
+		if (HA_ATOMIC_FETCH_OR(&task->state, TASK_RUNNING) & TASK_RUNNING)
+			break;
+
+		HA_RWLOCK_SKTOWR(TASK_WQ_LOCK, &wq_lock);
+		__task_unlink_wq(task);
+		if (tick_is_expired(task->expire, now_ms)) {
+			/* expired task, wake it up */
+			HA_RWLOCK_WRTOSK(TASK_WQ_LOCK, &wq_lock);
+			task_drop_running(task, TASK_WOKEN_TIMER);
+		}
+		else {
+			/* task is not expired, its key was only a minorant */
+			if (tick_isset(task->expire))
+				__task_queue(task, tg_ctx->timers);
+			HA_RWLOCK_WRTOSK(TASK_WQ_LOCK, &wq_lock);
+			task_drop_running(task, 0);
+		}
+	}
+
+	HA_RWLOCK_SKUNLOCK(TASK_WQ_LOCK, &wq_lock);
+#endif
+leave:
+	return;
+}
+
+/* Checks the next timer for the current thread by looking into its own timer
+ * wheel and the global one. It may return TICK_ETERNITY if no timer is present.
+ * Note that the next timer might very well be slightly in the past, or be the
+ * beginning of a wheel slot that needs to be reorganized.
+ */
+int next_timer_expiry()
+{
+	struct thread_ctx * const tt = th_ctx; // thread's tasks
+	int ret;
+	__decl_thread(int key);
+
+	/* first check in the thread-local timers */
+	ret = twheel_next_expiry(tt->timers, 1);
+
+#ifdef USE_THREAD
+	if (!twheel_is_empty(tg_ctx->timers)) {
+		HA_RWLOCK_RDLOCK(TASK_WQ_LOCK, &wq_lock);
+		key = twheel_next_expiry(tg_ctx->timers, 0);
+		HA_RWLOCK_RDUNLOCK(TASK_WQ_LOCK, &wq_lock);
+		ret = tick_first(ret, key);
+	}
+#endif
+	return ret;
+}
+
+#else /* !USE_TIMER_WHEEL */
+
 /*
  * __task_queue()
  *
@@ -500,6 +778,72 @@ int next_timer_expiry()
 	return ret;
 }
 
+#endif /* USE_TIMER_WHEEL */
+
+/* Accounts a wake-to-run delay of <lat> nanoseconds for a task or tasklet of
+ * class <queue> run by the current thread: it's counted in the class' delay
+ * histogram and average.
+ */
+static inline void sched_account_delay(unsigned int queue, uint32_t lat)
+{
+	unsigned int bucket;
+
+	/* buckets are <16us, <64us, <256us, <1ms, <4ms, <16ms, <65ms, >=65ms */
+	bucket = (my_flsl(lat >> 14) + 1) / 2;
+	if (bucket >= SCHED_LAT_BUCKETS)
+		bucket = SCHED_LAT_BUCKETS - 1;
+	activity[tid].rq_delay[queue][bucket]++;
+	swrate_add(&th_ctx->sched_lat_avg[queue], SCHED_LAT_SAMPLES, lat);
+}
+
+/* Adjusts the current thread's class weights so that the average wake-to-run
+ * delay of the latency-sensitive classes (TL_URGENT and TL_NORMAL) remains
+ * below tune.sched.latency-target. Late classes get more bandwidth, taken from
+ * the bulk class, and if this is not enough, the low-latency mode is enabled
+ * for the thread. Once all delays are back below half of the target, these
+ * adjustments are progressively reverted. This is called at most once every
+ * SCHED_ADAPT_PERIOD milliseconds.
+ */
+static void sched_adapt_weights(struct thread_ctx *tt)
+{
+	uint target = global.tune.sched_lat_target * 1000U;
+	uint *w = tt->sched_weights;
+	uint lat[TL_CLASSES];
+	int late = 0;
+	int q;
+
+	tt->sched_adapt_date = tick_add(now_ms, SCHED_ADAPT_PERIOD);
+
+	for (q = TL_URGENT; q <= TL_NORMAL; q++) {
+		lat[q] = swrate_avg(tt->sched_lat_avg[q], SCHED_LAT_SAMPLES);
+		if (lat[q] > target) {
+			/* up to 4 times the default weight */
+			w[q] = MIN(w[q] + (w[q] + 3) / 4, 4 * sched_default_weights[q]);
+			late = 1;
+		}
+	}
+
+	if (late) {
+		if (w[TL_BULK] > 1)
+			w[TL_BULK] /= 2;
+		else
+			tt->sched_low_lat = 1;
+		return;
+	}
+
+	if (lat[TL_URGENT] > target / 2 || lat[TL_NORMAL] > target / 2)
+		return;
+
+	/* all delays are well within the target, slowly get back to normal */
+	tt->sched_low_lat = 0;
+	for (q = 0; q < TL_CLASSES; q++) {
+		if (w[q] > sched_default_weights[q])
+			w[q] -= (w[q] - sched_default_weights[q] + 7) / 8;
+		else if (w[q] < sched_default_weights[q])
+			w[q] += (sched_default_weights[q] - w[q] + 1) / 2;
+	}
+}
+
 /* Walks over tasklet lists th_ctx->tasklets[0..TL_CLASSES-1] and run at most
  * budget[TL_*] of them. Returns the number of entries effectively processed
  * (tasks and tasklets merged). The count of tasks in the list for the current
@@ -520,8 +864,10 @@ unsigned int run_tasks_from_lists(unsigned int budgets[])
 	for (queue = 0; queue < TL_CLASSES;) {
 		th_ctx->current_queue = queue;
 
-		/* global.tune.sched.low-latency is set */
-		if (global.tune.options & GTUNE_SCHED_LOW_LATENCY) {
+		/* global.tune.sched.low-latency is set, or forced by the
+		 * adaptive scheduler.
+		 */
+		if ((global.tune.options & GTUNE_SCHED_LOW_LATENCY) || th_ctx->sched_low_lat) {
 			if (unlikely(th_ctx->tl_class_mask & budget_mask & ((1 << queue) - 1))) {
 				/* a lower queue index has tasks again and still has a
 				 * budget to run them. Let's switch to it now.
@@ -577,6 +923,7 @@ unsigned int run_tasks_from_lists(unsigned int budgets[])
 			th_ctx->sched_profile_entry = profile_entry;
 			HA_ATOMIC_ADD(&profile_entry->lat_time, lat);
 			HA_ATOMIC_INC(&profile_entry->calls);
+			sched_account_delay(queue, lat);
 		}
 		__ha_barrier_store();
 
@@ -664,8 +1011,12 @@ unsigned int run_tasks_from_lists(unsigned int budgets[])
 		__ha_barrier_store();
 
 		/* stats are only registered for non-zero wake dates */
-		if (unlikely(th_ctx->sched_wake_date))
-			HA_ATOMIC_ADD(&profile_entry->cpu_time, (uint32_t)(now_mono_time() - th_ctx->sched_call_date));
+		if (unlikely(th_ctx->sched_wake_date)) {
+			uint32_t cpu = (uint32_t)now_mono_time() - th_ctx->sched_call_date;
+
+			HA_ATOMIC_ADD(&profile_entry->cpu_time, cpu);
+			activity[tid].cls_cpu_ns[queue] += cpu;
+		}
 		done++;
 	}
 	th_ctx->current_queue = -1;
@@ -692,12 +1043,7 @@ void process_runnable_tasks()
 	struct eb32_node *lrq; // next local run queue entry
 	struct eb32_node *grq; // next global run queue entry
 	struct task *t;
-	const unsigned int default_weights[TL_CLASSES] = {
-		[TL_URGENT] = 64, // ~50% of CPU bandwidth for I/O
-		[TL_NORMAL] = 48, // ~37% of CPU bandwidth for tasks
-		[TL_BULK]   = 16, // ~13% of CPU bandwidth for self-wakers
-		[TL_HEAVY]  = 1,  // never more than 1 heavy task at once
-	};
+	const unsigned int *default_weights = sched_default_weights;
 	unsigned int max[TL_CLASSES]; // max to be run per class
 	unsigned int max_total;       // sum of max above
 	struct mt_list *tmp_list;
@@ -710,8 +1056,21 @@ void process_runnable_tasks()
 	_HA_ATOMIC_AND(&th_ctx->flags, ~TH_FL_STUCK); // this thread is still running
 
 	if (!thread_has_tasks()) {
-		activity[tid].empty_rq++;
-		return;
+#ifdef USE_THREAD
+		/* an idle thread may help its overloaded siblings */
+		if (!(global.tune.options & GTUNE_SCHED_WORK_STEALING) || !sched_steal_tasks())
+#endif
+		{
+			activity[tid].empty_rq++;
+			return;
+		}
+	}
+
+	if (unlikely(global.tune.sched_lat_target)) {
+		/* adaptive weights are in use */
+		if (tick_is_expired(tt->sched_adapt_date, now_ms))
+			sched_adapt_weights(tt);
+		default_weights = tt->sched_weights;
 	}
 
 	max_processed = global.tune.runqueue_depth;
@@ -780,7 +1139,7 @@ void process_runnable_tasks()
 	 * efficiently if the queue becomes congested.
 	 */
 	if (max[TL_HEAVY] > 1) {
-		if (global.tune.options & GTUNE_SCHED_LOW_LATENCY)
+		if ((global.tune.options & GTUNE_SCHED_LOW_LATENCY) || tt->sched_low_lat)
 			budget = 1;
 		else if (tt->tl_class_mask & ~(1 << TL_HEAVY))
 			budget = 1 + tt->rq_total / 1024;
@@ -891,8 +1250,12 @@ void mworker_cleantasks()
 {
 	struct task *t;
 	int i;
-	struct eb32_node *tmp_wq = NULL;
 	struct eb32_node *tmp_rq = NULL;
+#ifdef USE_TIMER_WHEEL
+	struct twheel_node *node;
+#else
+	struct eb32_node *tmp_wq = NULL;
+#endif
 
 #ifdef USE_THREAD
 	/* cleanup the global run queue */
@@ -903,12 +1266,17 @@ void mworker_cleantasks()
 		task_destroy(t);
 	}
 	/* cleanup the timers queue */
+#ifdef USE_TIMER_WHEEL
+	while ((node = twheel_first(tg_ctx->timers)) != NULL)
+		task_destroy(LIST_ELEM(node, struct task *, wq));
+#else
 	tmp_wq = eb32_first(&tg_ctx->timers);
 	while (tmp_wq) {
 		t = eb32_entry(tmp_wq, struct task, wq);
 		tmp_wq = eb32_next(tmp_wq);
 		task_destroy(t);
 	}
+#endif
 #endif
 	/* clean the per thread run queue */
 	for (i = 0; i < global.nbthread; i++) {
@@ -919,12 +1287,17 @@ void mworker_cleantasks()
 			task_destroy(t);
 		}
 		/* cleanup the per thread timers queue */
+#ifdef USE_TIMER_WHEEL
+		while ((node = twheel_first(ha_thread_ctx[i].timers)) != NULL)
+			task_destroy(LIST_ELEM(node, struct task *, wq));
+#else
 		tmp_wq = eb32_first(&ha_thread_ctx[i].timers);
 		while (tmp_wq) {
 			t = eb32_entry(tmp_wq, struct task, wq);
 			tmp_wq = eb32_next(tmp_wq);
 			task_destroy(t);
 		}
+#endif
 	}
 }
 
@@ -933,10 +1306,26 @@ static void init_task()
 {
 	int i, q;
 
+#ifdef USE_TIMER_WHEEL
+	for (i = 0; i < MAX_TGROUPS; i++) {
+#ifdef USE_THREAD
+		ha_tgroup_ctx[i].timers = &ha_tgroup_timers[i];
+#else
+		/* no shared wq without threads */
+		ha_tgroup_ctx[i].timers = &ha_thread_timers[0];
+#endif
+		twheel_init(ha_tgroup_ctx[i].timers);
+	}
+#else
 	for (i = 0; i < MAX_TGROUPS; i++)
 		memset(&ha_tgroup_ctx[i].timers, 0, sizeof(ha_tgroup_ctx[i].timers));
+#endif
 
 	for (i = 0; i < MAX_THREADS; i++) {
+#ifdef USE_TIMER_WHEEL
+		ha_thread_ctx[i].timers = &ha_thread_timers[i];
+		twheel_init(ha_thread_ctx[i].timers);
+#endif
 		for (q = 0; q < TL_CLASSES; q++)
 			LIST_INIT(&ha_thread_ctx[i].tasklets[q]);
 		MT_LIST_INIT(&ha_thread_ctx[i].shared_tasklet_list);
@@ -963,13 +1352,82 @@ static int cfg_parse_tune_sched_low_latency(char **args, int section_type, struc
 }
 
 /* config keyword parsers */
+/* config parser for global "tune.sched.work-stealing", accepts "on" or "off" */
+static int cfg_parse_tune_sched_work_stealing(char **args, int section_type, struct proxy *curpx,
+                                              const struct proxy *defpx, const char *file, int line,
+                                              char **err)
+{
+	if (too_many_args(1, args, err, NULL))
+		return -1;
+
+	if (strcmp(args[1], "on") == 0)
+		global.tune.options |= GTUNE_SCHED_WORK_STEALING;
+	else if (strcmp(args[1], "off") == 0)
+		global.tune.options &= ~GTUNE_SCHED_WORK_STEALING;
+	else {
+		memprintf(err, "'%s' expects either 'on' or 'off' but got '%s'.", args[0], args[1]);
+		return -1;
+	}
+	return 0;
+}
+
+/* config parser for global "tune.sched.latency-target", accepts a time which
+ * defaults to microseconds, 0 disables the adaptive weights.
+ */
+static int cfg_parse_tune_sched_latency_target(char **args, int section_type, struct proxy *curpx,
+                                               const struct proxy *defpx, const char *file, int line,
+                                               char **err)
+{
+	const char *res;
+	uint value;
+
+	if (too_many_args(1, args, err, NULL))
+		return -1;
+
+	/* delays are measured in nanoseconds on 32 bits, so the target is
+	 * limited to one second.
+	 */
+	res = parse_time_err(args[1], &value, TIME_UNIT_US);
+	if (res == PARSE_TIME_OVER || (!res && value > 1000000)) {
+		memprintf(err, "timer overflow in argument '%s' to '%s' (maximum value is 1000000 us or 1s)",
+		          args[1], args[0]);
+		return -1;
+	}
+	else if (res == PARSE_TIME_UNDER) {
+		memprintf(err, "timer underflow in argument '%s' to '%s' (minimum non-null value is 1 us)",
+		          args[1], args[0]);
+		return -1;
+	}
+	else if (res) {
+		memprintf(err, "unexpected character '%c' in argument to <%s>.", *res, args[0]);
+		return -1;
+	}
+	global.tune.sched_lat_target = value;
+	return 0;
+}
+
 static struct cfg_kw_list cfg_kws = {ILH, {
+	{ CFG_GLOBAL, "tune.sched.latency-target", cfg_parse_tune_sched_latency_target },
 	{ CFG_GLOBAL, "tune.sched.low-latency", cfg_parse_tune_sched_low_latency },
+	{ CFG_GLOBAL, "tune.sched.work-stealing", cfg_parse_tune_sched_work_stealing },
 	{ 0, NULL, NULL }
 }};
 
+/* Initializes the current thread's scheduler weights, and enables the
+ * measurement of wake dates if the adaptive weights are in use.
+ */
+static int init_task_per_thread()
+{
+	memcpy(th_ctx->sched_weights, sched_default_weights, sizeof(th_ctx->sched_weights));
+	th_ctx->sched_adapt_date = tick_add(now_ms, SCHED_ADAPT_PERIOD);
+	if (global.tune.sched_lat_target)
+		_HA_ATOMIC_OR(&th_ctx->flags, TH_FL_SCHED_TIMING);
+	return 1;
+}
+
 INITCALL1(STG_REGISTER, cfg_register_keywords, &cfg_kws);
 INITCALL0(STG_PREPARE, init_task);
+REGISTER_PER_THREAD_INIT(init_task_per_thread);
 
 /*
  * Local variables:
@@ -435,6 +435,7 @@ static const char *lock_label(enum lock_label label)
 	case APPLETS_LOCK:         return "APPLETS";
 	case PEER_LOCK:            return "PEER";
 	case SHCTX_LOCK:           return "SHCTX";
+	case CACHE_LOCK:           return "CACHE";
 	case SSL_LOCK:             return "SSL";
 	case SSL_GEN_CERTS_LOCK:   return "SSL_GEN_CERTS";
 	case PATREF_LOCK:          return "PATREF";
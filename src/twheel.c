@@ -0,0 +1,176 @@
+/*
+ * Hierarchical timer wheel.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ *
+ * The wheel is an alternative to the timers trees, offering O(1) insertion
+ * and removal, which matters when many timers are constantly re-armed. Nodes
+ * are stored at the lowest level where their key shares all upper bits with
+ * the wheel's current date, so that a level 0 slot only holds nodes expiring
+ * at the exact same date. When the current date enters a slot of an upper
+ * level, the slot is cascaded, which means that its nodes are re-inserted
+ * into the lower levels. A node is thus moved at most TWHEEL_LEVELS-1 times
+ * during its life, and usually never since most timers are removed or pushed
+ * back before they expire. The per-level maps of non-empty slots allow to
+ * find the next slot to process in a few operations. They are only cleared
+ * lazily, so that removing a node never needs to know its wheel.
+ */
+
+#include <haproxy/api.h>
+#include <haproxy/twheel.h>
+
+/* Initializes wheel <w> as empty. Its date is set on the first insertion. */
+void twheel_init(struct twheel *w)
+{
+	int lvl, slot;
+
+	w->cur = 0;
+	w->started = 0;
+	LIST_INIT(&w->expired);
+	for (lvl = 0; lvl < TWHEEL_LEVELS; lvl++) {
+		w->map[lvl] = 0;
+		for (slot = 0; slot < TWHEEL_SLOTS; slot++)
+			LIST_INIT(&w->slots[lvl][slot]);
+	}
+}
+
+/* Looks for the earliest slot of wheel <w> which holds nodes. Slots found
+ * empty on the way are dropped from the maps if <clean> is set, which requires
+ * an exclusive access to the wheel. On success, returns 1 and sets <date> to
+ * the date at which the slot must be processed, which is its first date or the
+ * current one if it was already reached, and <lvl> and <slot> to its position.
+ * On equal dates, the upper level wins so that it is cascaded first. Returns 0
+ * if no slot holds any node.
+ */
+static int twheel_next_slot(struct twheel *w, int clean, unsigned int *date,
+                            unsigned int *lvl, unsigned int *slot)
+{
+	unsigned int l, s, cs, shift, d;
+	uint64_t m, after;
+	int found = 0;
+
+	for (l = 0; l < TWHEEL_LEVELS; l++) {
+		shift = l * TWHEEL_BITS;
+		cs = (w->cur >> shift) & (TWHEEL_SLOTS - 1);
+		m = w->map[l];
+		while (m) {
+			/* Slots before the current one are empty within the
+			 * current rotation, except at the upper level which
+			 * wraps.
+			 */
+			after = m & (~0ULL << cs);
+			if (after)
+				s = __builtin_ctzll(after);
+			else if (l == TWHEEL_LEVELS - 1)
+				s = __builtin_ctzll(m);
+			else
+				break;
+
+			if (LIST_ISEMPTY(&w->slots[l][s])) {
+				if (clean)
+					w->map[l] &= ~(1ULL << s);
+				m &= ~(1ULL << s);
+				continue;
+			}
+
+			if (shift + TWHEEL_BITS < 32)
+				d = (w->cur & ~((1U << (shift + TWHEEL_BITS)) - 1)) + (s << shift);
+			else
+				d = s << shift;
+
+			if (tick_is_lt(d, w->cur))
+				d = w->cur;
+
+			if (!found || !tick_is_lt(*date, d)) {
+				*date = d;
+				*lvl = l;
+				*slot = s;
+				found = 1;
+			}
+			break;
+		}
+	}
+	return found;
+}
+
+/* Moves all nodes of wheel <w> whose key is before or equal to <now> to its
+ * expired list, cascading the upper levels' slots as needed, then sets the
+ * wheel's date past <now>. Requires an exclusive access to the wheel.
+ */
+void twheel_advance(struct twheel *w, unsigned int now)
+{
+	struct twheel_node *n, *back;
+	unsigned int date, lvl, slot;
+	struct list cascade;
+
+	if (!w->started)
+		return;
+
+	while (twheel_next_slot(w, 1, &date, &lvl, &slot) && !tick_is_lt(now, date)) {
+		w->cur = date;
+		w->map[lvl] &= ~(1ULL << slot);
+
+		if (!lvl) {
+			/* all these nodes share the same key */
+			LIST_SPLICE(&w->expired, &w->slots[0][slot]);
+			LIST_INIT(&w->slots[0][slot]);
+			w->cur = date + 1;
+			continue;
+		}
+
+		/* redistribute the slot's nodes over the lower levels */
+		LIST_INIT(&cascade);
+		LIST_SPLICE(&cascade, &w->slots[lvl][slot]);
+		LIST_INIT(&w->slots[lvl][slot]);
+		list_for_each_entry_safe(n, back, &cascade, list) {
+			LIST_DELETE(&n->list);
+			__twheel_insert(w, n);
+		}
+	}
+
+	if (!tick_is_lt(now, w->cur))
+		w->cur = now + 1;
+}
+
+/* Returns the date at which wheel <w> needs to be visited again, which is the
+ * key of the first expired node if any, otherwise the date of its next non
+ * empty slot, or TICK_ETERNITY if it is empty. For upper levels' slots, this
+ * date is the beginning of the slot, which may be earlier than the first key
+ * it holds and will only cause the slot to be cascaded. <clean> may only be
+ * set with an exclusive access to the wheel, and permits to drop empty slots
+ * from the maps.
+ */
+int twheel_next_expiry(struct twheel *w, int clean)
+{
+	unsigned int date, lvl, slot;
+	struct twheel_node *n;
+
+	n = twheel_first_expired(w);
+	if (n)
+		return n->key;
+
+	if (!w->started || !twheel_next_slot(w, clean, &date, &lvl, &slot))
+		return TICK_ETERNITY;
+
+	return date ? date : 1;
+}
+
+/* Returns any node queued in wheel <w>, or NULL if it is empty. This is meant
+ * to be used to purge a wheel, not to walk over it in any order.
+ */
+struct twheel_node *twheel_first(struct twheel *w)
+{
+	int lvl, slot;
+
+	if (!LIST_ISEMPTY(&w->expired))
+		return LIST_ELEM(w->expired.n, struct twheel_node *, list);
+
+	for (lvl = 0; lvl < TWHEEL_LEVELS; lvl++)
+		for (slot = 0; slot < TWHEEL_SLOTS; slot++)
+			if (!LIST_ISEMPTY(&w->slots[lvl][slot]))
+				return LIST_ELEM(w->slots[lvl][slot].n, struct twheel_node *, list);
+	return NULL;
+}